@@ -20,6 +20,14 @@ u32 x86_ioapic_get_irq_override(u32 irq)
     return ioapic_irq_override[irq];
 }
 
+static u8 cpu_apic_ids[MOS_MAX_CPU_COUNT] = { 0 }; // the IDs need not be contiguous, nor start at 0
+
+u32 x86_cpu_get_apic_id(u32 cpu)
+{
+    MOS_ASSERT(cpu < x86_platform.num_cpus);
+    return cpu_apic_ids[cpu];
+}
+
 void madt_parse_table()
 {
     if (!x86_acpi_madt)
@@ -51,7 +59,7 @@ void madt_parse_table()
                 if (unlikely(x86_platform.num_cpus >= MOS_MAX_CPU_COUNT))
                     mos_panic("Too many CPUs");
 
-                x86_platform.num_cpus++;
+                cpu_apic_ids[x86_platform.num_cpus++] = lapic->apic_id;
                 break;
             }
             case 1:
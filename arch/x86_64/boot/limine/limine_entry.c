@@ -11,6 +11,7 @@
 #include "mos/printk.h"
 #include "mos/setup.h"
 #include "mos/x86/cpu/ap_entry.h"
+#include "mos/x86/cpu/percpu.h"
 #include "mos/x86/devices/serial_console.h"
 #include "mos/x86/x86_platform.h"
 
@@ -66,6 +67,7 @@ static void add_to_memmap(pfn_t start, size_t npages, bool reserved, u32 type, c
 #if MOS_CONFIG(MOS_SMP)
 static void ap_entry(struct limine_smp_info *info)
 {
+    x86_init_percpu_area();
     pr_info("AP started: #%u, LAPIC ID: %u", info->processor_id, info->lapic_id);
     x86_ap_begin_exec();
 }
@@ -73,6 +75,7 @@ static void ap_entry(struct limine_smp_info *info)
 
 asmlinkage void limine_entry(void)
 {
+    x86_init_percpu_area(); // printk needs this
     extern serial_console_t com1_console, com2_console;
     console_register(&com1_console.con);
     console_register(&com2_console.con);
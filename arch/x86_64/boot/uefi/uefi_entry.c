@@ -4,6 +4,7 @@
 
 #include <mos/printk.h>
 #include <mos/types.h>
+#include <mos/x86/cpu/percpu.h>
 
 static char cmdline[1024];
 
@@ -16,6 +17,7 @@ static void wide_to_ascii(const u16 *wide, char *ascii)
 
 asmlinkage void mos_uefi_entry(boot_info_t *boot_info)
 {
+    x86_init_percpu_area(); // printk needs this
     wide_to_ascii(boot_info->cmdline, cmdline);
     pr_info("cmdline: %s", cmdline);
 
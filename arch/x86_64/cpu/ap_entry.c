@@ -10,6 +10,7 @@
 #include "mos/x86/cpu/cpu.h"
 #include "mos/x86/descriptors/descriptors.h"
 #include "mos/x86/interrupt/apic.h"
+#include "mos/x86/x86_interrupt.h"
 
 static bool aps_blocked = true;
 
@@ -32,6 +33,7 @@ noreturn void x86_ap_begin_exec(void)
     x86_cpu_set_cr3(pgd_pfn(platform_info->kernel_mm->pgd) * MOS_PAGE_SIZE);
 
     x86_cpu_initialise_caps();
+    x86_init_percpu_syscall();
     x86_cpu_setup_xsave_area();
     lapic_enable();
 
@@ -4,6 +4,7 @@
 #include "mos/platform/platform_defs.h"
 #include "mos/printk.h"
 #include "mos/x86/cpu/cpuid.h"
+#include "mos/x86/tasks/fpu_context.h"
 
 #include <mos_string.h>
 
@@ -44,11 +45,6 @@ size_t x86_cpu_setup_xsave_area(void)
     x86_cpu_set_cr4(cr4);
 
     reg_t xcr0 = XCR0_X87 | XCR0_SSE; // bit 0, 1
-    size_t xsave_size = 512;          // X87 + SSE
-
-    // SSE
-    xcr0 |= XCR0_SSE; // bit 1
-    xsave_size += 64; // XSAVE header
 
     // AVX
     if (cpu_has_feature(CPU_FEATURE_AVX))
@@ -77,15 +73,16 @@ size_t x86_cpu_setup_xsave_area(void)
             pr_dinfo2(x86_startup, "XSAVE state component '%s': size=%d, offset=%d", name, size, offset);
 
             if (xcr0 & BIT(state_component))
-            {
                 pr_dcont(x86_startup, " (enabled)");
-                xsave_size += size;
-            }
         }
     }
 
-    pr_dinfo2(x86_startup, "XSAVE area size: %zu", xsave_size);
-
     __asm__ volatile("xsetbv" : : "c"(0), "a"(xcr0), "d"(xcr0 >> 32));
+
+    // now that XCR0 is set, the CPU reports the size of an area holding exactly the enabled components,
+    // the compacted form (XSAVEC/XSAVES) packs them without the gaps of the standard layout
+    const bool compacted = x86_xsave_is_compacted();
+    const size_t xsave_size = compacted ? x86_cpuid(b, 0xd, 1) : x86_cpuid(b, 0xd, 0);
+    pr_dinfo2(x86_startup, "XSAVE area size: %zu (%s form)", xsave_size, compacted ? "compacted" : "standard");
     return xsave_size;
 }
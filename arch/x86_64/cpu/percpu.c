@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/x86/cpu/percpu.h"
+
+#include "mos/x86/cpu/cpu.h"
+
+static x86_percpu_area_t x86_percpu_areas[MOS_MAX_CPU_COUNT];
+
+void x86_init_percpu_area(void)
+{
+    // this is the only place where CPUID is used to identify the CPU, everyone else reads the cached id
+    const u32 apic_id = x86_cpuid(b, 1, 0) >> 24;
+    if (unlikely(apic_id >= MOS_MAX_CPU_COUNT))
+        x86_cpu_halt(); // too early to print anything, printk needs the per-CPU area
+
+    x86_percpu_area_t *area = &x86_percpu_areas[apic_id];
+    area->self = area;
+    area->cpu_id = apic_id;
+
+    cpu_wrmsr(MSR_GS_BASE, (ptr_t) area);
+    cpu_wrmsr(MSR_KERNEL_GS_BASE, 0); // user GS base, swapped in when returning to userspace
+}
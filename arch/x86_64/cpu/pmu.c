@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// The first architectural performance counter, counting unhalted core cycles, drives the sampler through the LAPIC as an NMI,
+// so that it also lands in code that runs with interrupts disabled: system calls, interrupt handlers and most of the kernel.
+
+#include "mos/x86/cpu/pmu.h"
+
+#include "mos/x86/cpu/cpu.h"
+#include "mos/x86/devices/tsc.h"
+#include "mos/x86/interrupt/apic.h"
+
+#include <mos/platform/platform.h>
+#include <mos_stdlib.h>
+
+#define MSR_IA32_PMC0                  0xC1
+#define MSR_IA32_PERFEVTSEL0           0x186
+#define MSR_IA32_PERF_GLOBAL_STATUS    0x38E
+#define MSR_IA32_PERF_GLOBAL_CTRL      0x38F
+#define MSR_IA32_PERF_GLOBAL_OVF_CTRL  0x390
+
+#define PERFEVTSEL_CORE_CYCLES 0x3C // event 0x3C, umask 0: UnHalted Core Cycles
+#define PERFEVTSEL_USR         BIT(16)
+#define PERFEVTSEL_OS          BIT(17)
+#define PERFEVTSEL_INT         BIT(20)
+#define PERFEVTSEL_EN          BIT(22)
+
+#define PMU_MAX_PERIOD 0x7FFFFFFFu // without full-width writes, only the low 32 bits of a counter are written, sign-extended
+
+typedef struct
+{
+    bool probed;
+    u8 version; // 0 if there is no usable counter
+    u8 width;   // of the general-purpose counters, in bits
+} pmu_info_t;
+
+static pmu_info_t pmu_info;
+static u64 pmu_period; // cycles between two samples, the same on every CPU
+static PER_CPU_DECLARE(bool, pmu_sampling);
+
+static const pmu_info_t *pmu_probe(void)
+{
+    if (likely(__atomic_load_n(&pmu_info.probed, __ATOMIC_ACQUIRE)))
+        return &pmu_info;
+
+    const reg32_t eax = x86_cpuid(a, 0xA, 0); // 0 if the leaf isn't there
+    const reg32_t ebx = x86_cpuid(b, 0xA, 0);
+
+    const u8 version = eax & 0xFF;
+    const u8 ncounters = (eax >> 8) & 0xFF;
+    const u8 nevents = (eax >> 24) & 0xFF; // the number of valid bits in EBX, a set bit means that event is not available
+    if (version >= 1 && ncounters >= 1 && nevents >= 1 && !(ebx & BIT(0)))
+    {
+        pmu_info.version = version;
+        pmu_info.width = (eax >> 16) & 0xFF;
+    }
+
+    __atomic_store_n(&pmu_info.probed, true, __ATOMIC_RELEASE);
+    return &pmu_info;
+}
+
+bool x86_pmu_available(void)
+{
+    return pmu_probe()->version != 0;
+}
+
+static void pmu_arm(void)
+{
+    cpu_wrmsr(MSR_IA32_PMC0, -__atomic_load_n(&pmu_period, __ATOMIC_RELAXED));
+    lapic_perf_counter_nmi(true);
+}
+
+void x86_pmu_sample_start(u32 hz)
+{
+    const pmu_info_t *info = pmu_probe();
+    MOS_ASSERT(info->version);
+
+    // the cycles run at about the TSC frequency, halted cycles (the idle loop) aren't counted
+    __atomic_store_n(&pmu_period, MAX(MIN(x86_tsc_khz * 1000 / hz, (u64) PMU_MAX_PERIOD), (u64) 1), __ATOMIC_RELAXED);
+
+    cpu_wrmsr(MSR_IA32_PERFEVTSEL0, 0);
+    *per_cpu(pmu_sampling) = true;
+    pmu_arm();
+    cpu_wrmsr(MSR_IA32_PERFEVTSEL0, PERFEVTSEL_CORE_CYCLES | PERFEVTSEL_USR | PERFEVTSEL_OS | PERFEVTSEL_INT | PERFEVTSEL_EN);
+    if (info->version >= 2)
+        cpu_wrmsr(MSR_IA32_PERF_GLOBAL_CTRL, cpu_rdmsr(MSR_IA32_PERF_GLOBAL_CTRL) | BIT(0));
+}
+
+void x86_pmu_sample_stop(void)
+{
+    cpu_wrmsr(MSR_IA32_PERFEVTSEL0, 0);
+    lapic_perf_counter_nmi(false);
+    *per_cpu(pmu_sampling) = false;
+}
+
+bool x86_pmu_sample_ack(void)
+{
+    const bool sampling = *per_cpu(pmu_sampling);
+    if (pmu_info.version >= 2)
+    {
+        // also claims an overflow that raced with x86_pmu_sample_stop()
+        if (!(cpu_rdmsr(MSR_IA32_PERF_GLOBAL_STATUS) & BIT(0)))
+            return false;
+        cpu_wrmsr(MSR_IA32_PERF_GLOBAL_OVF_CTRL, BIT(0));
+    }
+    else if (!sampling || cpu_rdmsr(MSR_IA32_PMC0) & BIT(pmu_info.width - 1))
+    {
+        return false; // still negative, it hasn't wrapped around
+    }
+
+    if (sampling)
+        pmu_arm();
+    return true;
+}
@@ -4,11 +4,24 @@
 
 #include <mos/platform/platform.h>
 #include <mos/printk.h>
+#include <mos/x86/cpu/percpu.h>
 #include <mos/x86/x86_platform.h>
 #include <mos_string.h>
 
 typeof(x86_cpu_descriptor) x86_cpu_descriptor = { 0 };
 
+#define X86_NMI_STACK_SIZE (4 * MOS_PAGE_SIZE)
+
+// The NMI entry finds its per-CPU area at the top of this stack, as the GS base it interrupted may be the user's.
+typedef struct
+{
+    char stack[X86_NMI_STACK_SIZE - 16];
+    ptr_t percpu_area; // where TSS.IST points, see x86_nmi_entry_impl in interrupt64.asm
+    ptr_t padding;
+} __aligned(16) x86_nmi_stack_t;
+
+static PER_CPU_DECLARE(x86_nmi_stack_t, x86_nmi_stacks);
+
 typedef enum
 {
     GDT_ENTRY_CODE,
@@ -33,7 +46,6 @@ static gdt_entry_t *gdt_set_entry(gdt_entry_t *entry, ptr_t base, u32 limit, gdt
 {
     entry->base_low = MASK_BITS(base, 24);
     entry->base_high = MASK_BITS((base >> 24), 8);
-    entry->base_veryhigh = base >> 32;
     entry->long_mode_code = entry_type == GDT_ENTRY_CODE;
     entry->pm32_segment = !entry->long_mode_code; // it's one or the other
 
@@ -63,13 +75,18 @@ void x86_init_percpu_gdt()
 
     // {Kernel,User}{Code,Data} Segments
     // We are using a flat memory model, so the base is 0 and the limit is all the way up to the end of the address space.
+    // gdt[3] is the 32-bit user code segment, which is left as a null descriptor, see GDT_SEGMENT_USERCODE32
     gdt_set_entry(&this_cpu_desc->gdt[1], 0x00000000, 0xFFFFFFFF, GDT_ENTRY_CODE, GDT_RING_KERNEL, GDT_GRAN_PAGE);
     gdt_set_entry(&this_cpu_desc->gdt[2], 0x00000000, 0xFFFFFFFF, GDT_ENTRY_DATA, GDT_RING_KERNEL, GDT_GRAN_PAGE);
-    gdt_set_entry(&this_cpu_desc->gdt[3], 0x00000000, 0xFFFFFFFF, GDT_ENTRY_CODE, GDT_RING_USER, GDT_GRAN_PAGE);
     gdt_set_entry(&this_cpu_desc->gdt[4], 0x00000000, 0xFFFFFFFF, GDT_ENTRY_DATA, GDT_RING_USER, GDT_GRAN_PAGE);
+    gdt_set_entry(&this_cpu_desc->gdt[5], 0x00000000, 0xFFFFFFFF, GDT_ENTRY_CODE, GDT_RING_USER, GDT_GRAN_PAGE);
 
-    // TSS segment
-    gdt_entry_t *tss_seg = gdt_set_entry(&this_cpu_desc->gdt[5], (ptr_t) &this_cpu_desc->tss, sizeof(tss64_t), GDT_ENTRY_CODE, GDT_RING_KERNEL, GDT_GRAN_BYTE);
+    // TSS segment, its upper half (the upper 32 bits of the base) is in gdt[7]
+    const ptr_t tss_base = (ptr_t) &this_cpu_desc->tss;
+    gdt_entry_t *tss_seg = gdt_set_entry(&this_cpu_desc->gdt[6], tss_base, sizeof(tss64_t), GDT_ENTRY_CODE, GDT_RING_KERNEL, GDT_GRAN_BYTE);
+    gdt_entry_upper_t *tss_seg_upper = (gdt_entry_upper_t *) &this_cpu_desc->gdt[7];
+    tss_seg_upper->base_veryhigh = tss_base >> 32;
+    tss_seg_upper->reserved = 0;
 
     // ! Set special attributes for the TSS segment.
     tss_seg->code_data_segment = 0; // indicates TSS/LDT (see also `accessed`)
@@ -87,5 +104,10 @@ void x86_init_percpu_tss()
 {
     x86_cpu_descriptor_t *this_cpu_desc = per_cpu(x86_cpu_descriptor);
     memzero(&this_cpu_desc->tss, sizeof(tss64_t));
+
+    x86_nmi_stack_t *nmi_stack = per_cpu(x86_nmi_stacks);
+    nmi_stack->percpu_area = (ptr_t) x86_percpu_area();
+    this_cpu_desc->tss.ist1 = (ptr_t) &nmi_stack->percpu_area;
+
     tss_flush(GDT_SEGMENT_TSS);
 }
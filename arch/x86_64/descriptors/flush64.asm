@@ -9,14 +9,14 @@ global gdt_flush_only:function (gdt_flush_only.end - gdt_flush_only)
 gdt_flush:
     lgdt [rdi]
 
-    mov ax, 0x20
+    mov ax, 0x10                    ; GDT_SEGMENT_KDATA
     mov ss, ax
     mov ds, ax
     mov es, ax
     mov fs, ax
-    mov gs, ax
+    ; ! don't reload GS, that would clear the GS base, which points to the per-CPU area
 
-    push qword 0x10
+    push qword 0x08                 ; GDT_SEGMENT_KCODE
     lea rax, [rel .ret]
     push rax
     retfq
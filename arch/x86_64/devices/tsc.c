@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/x86/devices/tsc.h"
+
+#include "mos/device/timekeeping.h"
+#include "mos/printk.h"
+#include "mos/x86/cpu/cpuid.h"
+#include "mos/x86/delays.h"
+#include "mos/x86/devices/port.h"
+
+#include <mos_stdlib.h>
+
+#define PIT_FREQUENCY    1193182 // Hz
+#define PIT_CH2_DATA     0x42
+#define PIT_COMMAND      0x43
+#define PIT_CH2_GATE     0x61 // bit 0: gate, bit 1: speaker enable, bit 5: channel 2 output
+#define PIT_CH2_OUT_HIGH 0x20
+
+#define TSC_CALIBRATE_MS    10 // must be less than 65535 / PIT_FREQUENCY seconds, i.e. 54ms
+#define TSC_CALIBRATE_TRIES 5
+
+u64 x86_tsc_khz = 2000 * 1000;
+
+// count the TSC cycles for the PIT channel 2 to count down from 'ms' milliseconds
+static u64 tsc_calibrate_pit_once(u32 ms)
+{
+    const u32 latch = PIT_FREQUENCY * ms / 1000;
+
+    port_outb(PIT_CH2_GATE, (port_inb(PIT_CH2_GATE) & ~0x02) | 0x01); // gate high, speaker off
+    port_outb(PIT_COMMAND, 0xB0);                                     // channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    port_outb(PIT_CH2_DATA, latch & 0xFF);
+    port_outb(PIT_CH2_DATA, latch >> 8);
+
+    const u64 start = rdtsc();
+    while (!(port_inb(PIT_CH2_GATE) & PIT_CH2_OUT_HIGH))
+        ;
+    return rdtsc() - start;
+}
+
+static u64 tsc_frequency_from_cpuid(void)
+{
+    if (x86_cpuid(a, 0, 0) < 0x15)
+        return 0;
+
+    // leaf 0x15: TSC frequency = crystal frequency (ecx) * ebx / eax, any of them may be 0 (i.e. not enumerated)
+    const u32 denominator = x86_cpuid(a, 0x15, 0);
+    const u32 numerator = x86_cpuid(b, 0x15, 0);
+    const u32 crystal_hz = x86_cpuid(c, 0x15, 0);
+    if (!denominator || !numerator || !crystal_hz)
+        return 0;
+
+    return (u64) crystal_hz * numerator / denominator;
+}
+
+static u64 tsc_frequency_from_pit(void)
+{
+    // the shortest run is the one with the least interference (SMIs, VM exits, ...)
+    u64 cycles = (u64) -1;
+    for (int i = 0; i < TSC_CALIBRATE_TRIES; i++)
+        cycles = MIN(cycles, tsc_calibrate_pit_once(TSC_CALIBRATE_MS));
+
+    return cycles * (1000 / TSC_CALIBRATE_MS);
+}
+
+void tsc_init(void)
+{
+    const bool invariant = cpu_has_feature(CPU_FEATURE_INVTSC);
+    if (!invariant)
+        pr_warn("tsc: not invariant, timekeeping may drift");
+
+    const char *source = "cpuid";
+    u64 hz = tsc_frequency_from_cpuid();
+    if (!hz)
+        source = "pit", hz = tsc_frequency_from_pit();
+
+    x86_tsc_khz = hz / 1000;
+    pr_dinfo2(x86_startup, "tsc: %llu kHz (from %s)", x86_tsc_khz, source);
+
+    timekeeping_init(hz, invariant);
+}
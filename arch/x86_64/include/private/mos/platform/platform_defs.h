@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "mos/x86/cpu/cpuid.h"
+#include "mos/x86/cpu/percpu.h"
 
 #include <mos/types.h>
 
@@ -31,6 +32,15 @@
 
 #define MOS_ELF_PLATFORM EM_X86_64
 
+#define MOS_PLATFORM_CACHE_LINE_SIZE X86_CACHE_LINE_SIZE
+#define MOS_PLATFORM_DMA_COHERENT    1 // devices snoop the CPU caches, DMA memory doesn't need to be mapped uncached
+
+// read from the per-CPU area instead of executing CPUID, this is on the path of every per_cpu() access
+should_inline u32 platform_current_cpu_id(void)
+{
+    return x86_percpu_cpu_id();
+}
+
 typedef struct _platform_process_options
 {
     bool iopl;
@@ -40,6 +50,7 @@ typedef struct _platform_thread_options
 {
     ptr_t fs_base, gs_base;
     u8 *xsaveptr;
+    u32 fpu_cpu; ///< the CPU whose FPU registers were last loaded from xsaveptr, (u32) -1 if none
 } platform_thread_options_t;
 
 typedef struct _platform_cpuinfo
@@ -50,6 +61,7 @@ typedef struct _platform_cpuinfo
 typedef struct _platform_arch_info
 {
     size_t xsave_size;
+    u64 xsave_features; ///< the state components enabled in XCR0
 
     ptr_t rsdp_addr;
     u32 rsdp_revision;
@@ -8,4 +8,5 @@ extern const acpi_madt_t *x86_acpi_madt;
 extern ptr_t x86_ioapic_phyaddr;
 
 u32 x86_ioapic_get_irq_override(u32 irq);
+u32 x86_cpu_get_apic_id(u32 cpu); // 'cpu' is an index below the number of CPUs, in the order of the MADT
 void madt_parse_table(void);
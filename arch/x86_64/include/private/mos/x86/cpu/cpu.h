@@ -58,6 +58,13 @@ should_inline void x86_cpu_invlpg_all(void)
     __asm__ volatile("mov %%cr3, %%rax; mov %%rax, %%cr3" : : : "rax", "memory");
 }
 
+should_inline u64 x86_cpu_get_xcr0(void)
+{
+    u32 lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((u64) hi << 32) | lo;
+}
+
 void x86_cpu_initialise_caps(void);
 
 size_t x86_cpu_setup_xsave_area(void);
@@ -58,9 +58,12 @@
 #define CPU_FEATURE_AVX2         7, 0, b, 5           // Advanced Vector Extensions 2
 #define CPU_FEATURE_FSGSBASE     7, 0, b, 0           // RDFSBASE, RDGSBASE, WRFSBASE, WRGSBASE
 #define CPU_FEATURE_LA57         7, 0, c, 16          // 5-Level Paging
+#define CPU_FEATURE_XSAVEOPT     0xd, 1, a, 0         // XSAVEOPT
+#define CPU_FEATURE_XSAVEC       0xd, 1, a, 1         // XSAVEC, compacted XSAVE area
 #define CPU_FEATURE_XSAVES       0xd, 1, a, 3         // XSAVES, XSTORS, and IA32_XSS
 #define CPU_FEATURE_NX           0x80000001, 0, d, 20 // No-Execute Bit
 #define CPU_FEATURE_PDPE1GB      0x80000001, 0, d, 26 // GB pages
+#define CPU_FEATURE_INVTSC       0x80000007, 0, d, 8  // Invariant TSC, runs at a constant rate in all ACPI P-, C- and T-states
 
 // clang-format off
 #define FOR_ALL_CPU_FEATURES(M) \
@@ -69,7 +72,7 @@
     M(ACPI)     M(MMX)      M(FXSR)     M(SSE)  M(SSE2)     M(SS)       M(HTT)          M(TM1)      M(IA64)     M(PBE)          \
     M(SSE3)     M(SSSE3)    M(PCID)     M(DCA)  M(SSE4_1)   M(SSE4_2)   M(X2APIC)       M(MOVBE)    M(POPCNT)   M(TSC_DEADLINE) \
     M(AES_NI)   M(XSAVE)    M(OSXSAVE)  M(AVX)  M(F16C)     M(RDRAND)   M(HYPERVISOR)   M(AVX2)     M(FSGSBASE) M(LA57)         \
-    M(XSAVES)   M(NX)       M(PDPE1GB)
+    M(XSAVEOPT) M(XSAVEC)   M(XSAVES)   M(NX)   M(PDPE1GB)  M(INVTSC)
 // clang-format on
 
 #define _do_count(leaf) __COUNTER__,
@@ -86,7 +89,8 @@ MOS_STATIC_ASSERT(sizeof((int[]){ FOR_ALL_CPU_FEATURES(_do_count) }) / sizeof(in
     M(7, 0, b)                                                                                                                                                           \
     M(7, 0, c)                                                                                                                                                           \
     M(0xd, 1, a)                                                                                                                                                         \
-    M(0x80000001, 0, d)
+    M(0x80000001, 0, d)                                                                                                                                                  \
+    M(0x80000007, 0, d)
 
 #define X86_CPUID_LEAF_ENUM(leaf, subleaf, reg, ...) X86_CPUID_##leaf##_##subleaf##_##reg
 
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/mos_global.h>
+#include <mos/types.h>
+#include <stddef.h>
+
+#define MSR_FS_BASE        0xC0000100
+#define MSR_GS_BASE        0xC0000101
+#define MSR_KERNEL_GS_BASE 0xC0000102 // the value swapped into GS base by swapgs
+
+#define X86_CACHE_LINE_SIZE 64
+
+/**
+ * @brief The per-CPU area of the current CPU, pointed to by the GS base while running in kernel mode.
+ *
+ * @details On entry from userspace, the interrupt stubs execute swapgs so that GS base points to this
+ * area, and the user's GS base is parked in MSR_KERNEL_GS_BASE until the CPU returns to userspace.
+ */
+typedef struct _x86_percpu_area
+{
+    struct _x86_percpu_area *self; ///< points to itself, so that the area can be located with a single %gs load
+    u32 cpu_id;                    ///< the APIC id of this CPU, read from CPUID once at startup
+    ptr_t kernel_stack;            ///< top of the kernel stack of the running thread, loaded by the SYSCALL entry
+    ptr_t user_stack;              ///< scratch slot for the user stack pointer during SYSCALL entry
+} __aligned(X86_CACHE_LINE_SIZE) x86_percpu_area_t;
+
+// these offsets are also used in interrupt64.asm
+MOS_STATIC_ASSERT(offsetof(x86_percpu_area_t, kernel_stack) == 16, "update X86_PERCPU_KERNEL_STACK in interrupt64.asm");
+MOS_STATIC_ASSERT(offsetof(x86_percpu_area_t, user_stack) == 24, "update X86_PERCPU_USER_STACK in interrupt64.asm");
+
+/**
+ * @brief Point the GS base of the calling CPU to its per-CPU area.
+ *
+ * @note This must be called before anything on this CPU uses platform_current_cpu_id(), which includes printk.
+ */
+void x86_init_percpu_area(void);
+
+should_inline x86_percpu_area_t *x86_percpu_area(void)
+{
+    x86_percpu_area_t *area;
+    __asm__ volatile("movq %%gs:%c1, %0" : "=r"(area) : "i"(offsetof(x86_percpu_area_t, self)));
+    return area;
+}
+
+should_inline u32 x86_percpu_cpu_id(void)
+{
+    u32 id;
+    __asm__ volatile("movl %%gs:%c1, %0" : "=r"(id) : "i"(offsetof(x86_percpu_area_t, cpu_id)));
+    return id;
+}
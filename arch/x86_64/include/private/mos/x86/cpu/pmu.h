@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.h>
+
+/**
+ * @brief Whether the CPU has an architectural performance counter that can count core cycles (CPUID leaf 0xA)
+ */
+bool x86_pmu_available(void);
+
+/**
+ * @brief Make the calling CPU's first performance counter overflow 'hz' times a second of unhalted cycles, raising an NMI
+ */
+void x86_pmu_sample_start(u32 hz);
+void x86_pmu_sample_stop(void);
+
+/**
+ * @brief Acknowledge an NMI raised by the calling CPU's counter, and arm the counter for the next one if it's still sampling
+ *
+ * @return false if the counter didn't overflow, and the NMI came from somewhere else
+ */
+bool x86_pmu_sample_ack(void);
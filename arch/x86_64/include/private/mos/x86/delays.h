@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "mos/x86/devices/tsc.h"
+
 #include <mos/mos_global.h>
 #include <mos/types.h>
 
@@ -14,14 +16,14 @@ should_inline u64 rdtsc(void)
 
 should_inline void mdelay(u64 ms)
 {
-    u64 end = rdtsc() + ms * 2000 * 1000;
+    u64 end = rdtsc() + ms * x86_tsc_khz;
     while (rdtsc() < end)
         ;
 }
 
 should_inline void udelay(u64 us)
 {
-    u64 end = rdtsc() + us * 2000;
+    u64 end = rdtsc() + us * x86_tsc_khz / 1000;
     while (rdtsc() < end)
         ;
 }
@@ -14,13 +14,16 @@
 
 #define GDT_SEGMENT_NULL 0x00
 
-#define GDT_SEGMENT_KCODE    0x10
-#define GDT_SEGMENT_KDATA    0x20
-#define GDT_SEGMENT_USERCODE 0x30
-#define GDT_SEGMENT_USERDATA 0x40
-#define GDT_SEGMENT_TSS      0x50
+// ! The order of the user segments is dictated by SYSRET, which loads SS from STAR[63:48] + 8 and CS from STAR[63:48] + 16,
+// ! the (unused) 32-bit user code segment is only there to make the layout work.
+#define GDT_SEGMENT_KCODE      0x08
+#define GDT_SEGMENT_KDATA      0x10
+#define GDT_SEGMENT_USERCODE32 0x18
+#define GDT_SEGMENT_USERDATA   0x20
+#define GDT_SEGMENT_USERCODE   0x28
+#define GDT_SEGMENT_TSS        0x30 // a system descriptor, takes two entries
 
-#define GDT_ENTRY_COUNT 6
+#define GDT_ENTRY_COUNT 8
 
 typedef struct
 {
@@ -39,11 +42,18 @@ typedef struct
     u32 pm32_segment : 1;           // 32-bit opcodes for code, uint32_t stack for data
     u32 granularity : 1;            // 1 to use 4k page addressing, 0 for byte addressing
     u32 base_high : 8;
+} __packed gdt_entry_t;
+
+MOS_STATIC_ASSERT(sizeof(gdt_entry_t) == 8, "gdt_entry_t is not 8 bytes");
+
+// the second half of a 16-byte system descriptor (i.e. the TSS)
+typedef struct
+{
     u32 base_veryhigh; // upper 32 bits of base address
     u32 reserved;
-} __packed gdt_entry_t;
+} __packed gdt_entry_upper_t;
 
-MOS_STATIC_ASSERT(sizeof(gdt_entry_t) == 16, "gdt_entry_t is not 16 bytes");
+MOS_STATIC_ASSERT(sizeof(gdt_entry_upper_t) == sizeof(gdt_entry_t), "gdt_entry_upper_t is not 8 bytes");
 
 typedef struct
 {
@@ -83,11 +93,14 @@ typedef struct
 
 extern PER_CPU_DECLARE(x86_cpu_descriptor_t, x86_cpu_descriptor);
 
+#define X86_IST_NMI 1 // an NMI can arrive anywhere, even before the SYSCALL entry has switched stacks
+
 typedef struct
 {
     u16 isr_low; // The lower 16 bits of the ISR's address
     u16 segment; // The GDT segment selector that the CPU will load into CS before calling the ISR
-    u32 reserved : 8;
+    u32 ist : 3; // The TSS stack to switch to, 0 to stay on the current one (or the kernel stack, coming from userspace)
+    u32 reserved : 5;
     u32 type : 4; // The type of interrupt
     u32 zero : 1;
     u32 dpl : 2;
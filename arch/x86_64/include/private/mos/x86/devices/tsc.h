@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.h>
+
+extern u64 x86_tsc_khz; ///< TSC frequency, assumed to be 2 GHz until tsc_init() calibrates it
+
+/**
+ * @brief Find out the TSC frequency (from CPUID, or by calibrating against the PIT), and start timekeeping with it.
+ */
+void tsc_init(void);
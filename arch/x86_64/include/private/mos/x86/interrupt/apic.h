@@ -42,6 +42,21 @@ void lapic_write64(u32 offset, u64 value);
 
 void lapic_eoi(void);
 
+/**
+ * @brief Make the calling CPU's LAPIC timer fire 'vector' periodically, 'hz' times a second
+ *
+ * @note The timer frequency is measured against the TSC the first time, which takes a few milliseconds.
+ */
+void lapic_timer_start_periodic(u8 vector, u32 hz);
+void lapic_timer_stop(void);
+
+/**
+ * @brief Deliver the calling CPU's performance counter overflows as NMIs, or mask them
+ *
+ * @note The LAPIC masks the entry again each time it delivers one, so it is re-enabled after every overflow.
+ */
+void lapic_perf_counter_nmi(bool enabled);
+
 should_inline u8 lapic_get_id(void)
 {
     // https://stackoverflow.com/a/71756491
@@ -65,6 +80,8 @@ typedef enum
 void ioapic_init(void);
 void ioapic_enable_with_mode(u32 irq, u32 cpu, ioapic_trigger_mode_t trigger_mode, ioapic_polarity_t polarity);
 void ioapic_disable(u32 irq);
+void ioapic_set_masked(u32 irq, bool masked);
+bool ioapic_is_enabled(u32 irq); // whether the line is routed and not masked
 
 should_inline void ioapic_enable_interrupt(u32 irq, u32 cpu)
 {
@@ -5,3 +5,5 @@
 #include "mos/platform/platform.h"
 
 void x86_set_fsbase(thread_t *thread);
+void x86_set_gsbase(thread_t *thread);
+void x86_save_gsbase(thread_t *thread);
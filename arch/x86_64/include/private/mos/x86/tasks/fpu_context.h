@@ -7,5 +7,34 @@
 
 extern slab_t *xsave_area_slab;
 
+/**
+ * @brief Whether XSAVE areas are in the compacted form, i.e. saved with XSAVEC or XSAVES.
+ */
+bool x86_xsave_is_compacted(void);
+
+/**
+ * @brief Allocate the XSAVE area of a new user thread, holding the initial FPU state.
+ */
+void x86_fpu_init_thread(thread_t *thread);
+
+/**
+ * @brief Copy the FPU state of a thread into a forked one.
+ *
+ * @details If the state of 'from' is still in the registers, it is saved straight into the new area.
+ */
+void x86_fpu_clone(const thread_t *from, thread_t *to);
+
+/**
+ * @brief Save the FPU state of a thread which is being switched out.
+ *
+ * @details This does nothing unless the thread's state is loaded on this CPU. The registers are left
+ * intact, so if the thread comes back to this CPU before anyone else uses the FPU, there's nothing to restore.
+ */
 void x86_xsave_thread(thread_t *thread);
+
+/**
+ * @brief Load the FPU state of the current thread, called right before returning to userspace.
+ *
+ * @details This does nothing if the state is already in the registers of this CPU.
+ */
 void x86_xrstor_thread(thread_t *thread);
@@ -10,11 +10,19 @@
 
 #define IRQ_BASE 0x20
 #define IPI_BASE 0x50
+#define MSI_BASE 0x90 // vectors for message-signalled interrupts, handed out on demand
+
+#define LAPIC_TIMER_VECTOR 0x80 // the LAPIC timer, which drives the sampling profiler
 
 #define ISR_MAX_COUNT   32
 #define IRQ_MAX_COUNT   16
+#define MSI_MAX_COUNT   96
 #define IDT_ENTRY_COUNT 256
 
+// MSIs are numbered as IRQs after the legacy ones
+#define MSI_IRQ_BASE  IRQ_MAX_COUNT
+#define X86_IRQ_COUNT (IRQ_MAX_COUNT + MSI_MAX_COUNT)
+
 typedef enum
 {
     EXCEPTION_DIVIDE_ERROR = 0,
@@ -72,6 +80,8 @@ typedef enum
 } x86_irq_enum_t;
 
 MOS_STATIC_ASSERT(IRQ_MAX_COUNT == IRQ_MAX, "IRQ_MAX_COUNT is not equal to IRQ_MAX");
+MOS_STATIC_ASSERT(LAPIC_TIMER_VECTOR >= IPI_BASE + IPI_TYPE_MAX && LAPIC_TIMER_VECTOR < MOS_SYSCALL_INTR, "the LAPIC timer vector overlaps with the IPIs or the syscall vector");
+MOS_STATIC_ASSERT(MSI_BASE > MOS_SYSCALL_INTR && MSI_BASE + MSI_MAX_COUNT < 0xFF, "MSI vectors overlap with the syscall vector, or run out of stubs");
 
 void pic_remap_irq(void);
 
@@ -82,6 +92,31 @@ extern void *irq_stub_table[];
 void x86_init_irq_handlers(void);
 void x86_interrupt_entry(ptr_t esp);
 
+/**
+ * @brief The NMI handler, on its own stack, and with the kernel GS base whatever context it interrupted.
+ *
+ * @details Sampler NMIs are recorded and returned from, anything else is fatal. It returns through x86_nmi_entry_impl,
+ * which restores the interrupted context exactly, so it mustn't schedule, take locks or touch current_cpu->interrupt_regs.
+ */
+void x86_nmi_entry(platform_regs_t *regs);
+extern void x86_nmi_entry_impl(void);
+
+/**
+ * @brief Enable the SYSCALL instruction on the calling CPU, 'int 0x88' keeps working as a fallback.
+ */
+void x86_init_percpu_syscall(void);
+noreturn void x86_syscall_entry(platform_regs_t *regs);
+
 bool x86_install_interrupt_handler(u32 irq, void (*handler)(u32 irq));
+void x86_remove_interrupt_handler(u32 irq, void (*handler)(u32 irq));
+
+/**
+ * @brief Mask a level-triggered legacy line in the IOAPIC whenever it's delivered, before the EOI is sent.
+ *
+ * @details The line stays asserted until the interrupt is cleared on the device, by a driver that may not run for a
+ * while. Without this, the line would be delivered again as soon as the handler returns.
+ */
+void x86_irq_set_mask_on_delivery(u32 irq, bool mask);
 
 extern noreturn void x86_interrupt_return_impl(const platform_regs_t *regs);
+extern noreturn void x86_syscall_return_impl(const platform_regs_t *regs);
@@ -33,3 +33,10 @@ extern const char __MOS_KERNEL_END[];                                     // Ker
 
 extern mos_platform_info_t x86_platform;
 void x86_dump_stack_at(ptr_t this_frame, bool can_access_vmaps);
+
+/**
+ * @brief Collect the interrupted IP and the return addresses below it, from an interrupt handler
+ *
+ * @return The number of addresses stored in 'ips', at least 1
+ */
+size_t x86_sample_stack(const platform_regs_t *regs, ptr_t *ips, size_t max);
@@ -12,6 +12,13 @@ enum
     X86_SYSCALL_SET_GS_BASE = 3,  // set the GS base address
 };
 
+// The kernel accepts system calls from both 'syscall' and 'int 0x88', with different calling conventions:
+// - syscall:   number in rax, arguments in rdi, rsi, rdx, r10, r8, r9, rcx and r11 are clobbered
+// - int 0x88:  number in rax, arguments in rbx, rcx, rdx, rsi, rdi, r9
+// Define MOS_SYSCALL_USE_INT to fall back to 'int 0x88'.
+
+#if defined(MOS_SYSCALL_USE_INT)
+
 should_inline reg_t platform_syscall0(reg_t number)
 {
     reg_t result = 0;
@@ -57,6 +64,66 @@ should_inline reg_t platform_syscall5(reg_t number, reg_t arg1, reg_t arg2, reg_
 should_inline reg_t platform_syscall6(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5, reg_t arg6)
 {
     reg_t result = 0;
-    __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3), "S"(arg4), "D"(arg5), "r"(arg6) : "memory");
+    register reg_t r9 __asm__("r9") = arg6;
+    __asm__ volatile("int $0x88" : "=a"(result) : "a"(number), "b"(arg1), "c"(arg2), "d"(arg3), "S"(arg4), "D"(arg5), "r"(r9) : "memory");
+    return result;
+}
+
+#else
+
+should_inline reg_t platform_syscall0(reg_t number)
+{
+    reg_t result = 0;
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number) : "rcx", "r11", "memory");
+    return result;
+}
+
+should_inline reg_t platform_syscall1(reg_t number, reg_t arg1)
+{
+    reg_t result = 0;
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number), "D"(arg1) : "rcx", "r11", "memory");
+    return result;
+}
+
+should_inline reg_t platform_syscall2(reg_t number, reg_t arg1, reg_t arg2)
+{
+    reg_t result = 0;
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number), "D"(arg1), "S"(arg2) : "rcx", "r11", "memory");
+    return result;
+}
+
+should_inline reg_t platform_syscall3(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3)
+{
+    reg_t result = 0;
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number), "D"(arg1), "S"(arg2), "d"(arg3) : "rcx", "r11", "memory");
+    return result;
+}
+
+should_inline reg_t platform_syscall4(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4)
+{
+    reg_t result = 0;
+    register reg_t r10 __asm__("r10") = arg4;
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number), "D"(arg1), "S"(arg2), "d"(arg3), "r"(r10) : "rcx", "r11", "memory");
+    return result;
+}
+
+should_inline reg_t platform_syscall5(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5)
+{
+    reg_t result = 0;
+    register reg_t r10 __asm__("r10") = arg4;
+    register reg_t r8 __asm__("r8") = arg5;
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number), "D"(arg1), "S"(arg2), "d"(arg3), "r"(r10), "r"(r8) : "rcx", "r11", "memory");
+    return result;
+}
+
+should_inline reg_t platform_syscall6(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5, reg_t arg6)
+{
+    reg_t result = 0;
+    register reg_t r10 __asm__("r10") = arg4;
+    register reg_t r8 __asm__("r8") = arg5;
+    register reg_t r9 __asm__("r9") = arg6;
+    __asm__ volatile("syscall" : "=a"(result) : "a"(number), "D"(arg1), "S"(arg2), "d"(arg3), "r"(r10), "r"(r8), "r"(r9) : "rcx", "r11", "memory");
     return result;
 }
+
+#endif
@@ -30,6 +30,7 @@ static void idt_set_descriptor(u8 vector, void *isr, bool usermode, bool is_trap
     descriptor->dpl = usermode ? 3 : 0;
     descriptor->type = is_trap ? STS_TG32 : STS_IG32;
     descriptor->zero = 0;
+    descriptor->ist = 0;
     descriptor->reserved = 0;
 }
 
@@ -43,6 +44,10 @@ void x86_idt_init()
     for (u8 isr = 0; isr < ISR_MAX_COUNT; isr++)
         idt_set_descriptor(isr, isr_stub_table[isr], false, false);
 
+    // NMIs have their own entry and stack, see x86_nmi_entry_impl
+    idt_set_descriptor(EXCEPTION_NMI, x86_nmi_entry_impl, false, false);
+    idt[EXCEPTION_NMI].ist = X86_IST_NMI;
+
     for (u8 irq_n = 0; irq_n < IRQ_MAX_COUNT; irq_n++)
         idt_set_descriptor(irq_n + IRQ_BASE, irq_stub_table[irq_n], false, false);
 
@@ -52,6 +57,11 @@ void x86_idt_init()
     for (u8 ipi_n = 0; ipi_n < IPI_TYPE_MAX; ipi_n++)
         idt_set_descriptor(ipi_n + IPI_BASE, isr_stub_table[ipi_n + IPI_BASE], false, false);
 
+    idt_set_descriptor(LAPIC_TIMER_VECTOR, isr_stub_table[LAPIC_TIMER_VECTOR], false, false);
+
+    for (u8 msi_n = 0; msi_n < MSI_MAX_COUNT; msi_n++)
+        idt_set_descriptor(msi_n + MSI_BASE, isr_stub_table[msi_n + MSI_BASE], false, false);
+
     idtr.base = &idt[0];
     idtr.limit = (u16) sizeof(idt_entry_t) * IDT_ENTRY_COUNT - 1;
 }
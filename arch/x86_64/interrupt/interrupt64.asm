@@ -8,7 +8,15 @@
 
 %define REGSIZE           8
 
+%define MOS_SYSCALL_INTR        0x88    ; as in mos_global.h
+%define GDT_SEGMENT_USERCODE    0x28    ; as in descriptors.h
+%define GDT_SEGMENT_USERDATA    0x20    ; as in descriptors.h
+%define X86_PERCPU_KERNEL_STACK 16      ; offsetof(x86_percpu_area_t, kernel_stack)
+%define X86_PERCPU_USER_STACK   24      ; offsetof(x86_percpu_area_t, user_stack)
+
 extern x86_interrupt_entry
+extern x86_syscall_entry
+extern x86_nmi_entry
 
 global irq_stub_table
 global isr_stub_table
@@ -117,7 +125,7 @@ irq_stub_table:
     %assign i i+1
     %endrep
 
-do_handle_interrupt:
+%macro PUSH_GPRS 0
     push    rax
     push    rbx
     push    rcx
@@ -135,19 +143,9 @@ do_handle_interrupt:
     push    r13
     push    r14
     push    r15
+%endmacro
 
-    cld                             ; clears the DF flag in the RFLAGS register.
-                                    ; so that string operations increment the index registers (RSI and/or RDI).
-
-    mov     rdi, rsp
-    call    x86_interrupt_entry    ; x86_interrupt_entry(ptr_t sp)
-    ud2                             ; if x86_interrupt_entry returns, it's a bug
-.end:
-
-global x86_interrupt_return_impl:function (x86_interrupt_return_impl.end - x86_interrupt_return_impl)
-x86_interrupt_return_impl:
-    mov     rsp, rdi
-
+%macro POP_GPRS 0
     pop     r15
     pop     r14
     pop     r13
@@ -165,7 +163,99 @@ x86_interrupt_return_impl:
     pop     rcx
     pop     rbx
     pop     rax
+%endmacro
+
+do_handle_interrupt:
+    ; if we came from userspace, switch to the kernel GS base (the per-CPU area)
+    test    qword [rsp + 3 * REGSIZE], 3    ; CS of the interrupted context
+    jz      .from_kernel
+    swapgs
+.from_kernel:
+    PUSH_GPRS
+
+    cld                             ; clears the DF flag in the RFLAGS register.
+                                    ; so that string operations increment the index registers (RSI and/or RDI).
+
+    mov     rdi, rsp
+    call    x86_interrupt_entry    ; x86_interrupt_entry(ptr_t sp)
+    ud2                             ; if x86_interrupt_entry returns, it's a bug
+.end:
+
+global x86_interrupt_return_impl:function (x86_interrupt_return_impl.end - x86_interrupt_return_impl)
+x86_interrupt_return_impl:
+    mov     rsp, rdi
+    POP_GPRS
+    add     rsp, 2 * REGSIZE
+
+    ; if we are returning to userspace, restore its GS base
+    test    qword [rsp + REGSIZE], 3        ; CS of the context being returned to
+    jz      .to_kernel
+    swapgs
+.to_kernel:
+    iretq
+.end:
+
+; ! NMI entry point, through TSS.IST1 (X86_IST_NMI), with the per-CPU area stored right above the stack.
+; ! An NMI may land anywhere, e.g. between swapgs and the stack switch of the SYSCALL entry, so neither the stack
+; ! nor the GS base of the interrupted context can be trusted: load the kernel GS base, and put back whatever was there.
+; ! It returns straight to the interrupted context, without going through the scheduler.
+global x86_nmi_entry_impl:function (x86_nmi_entry_impl.end - x86_nmi_entry_impl)
+x86_nmi_entry_impl:
+    push    0                               ; error code (not used)
+    push    2                               ; interrupt number
+    PUSH_GPRS
+    cld
+
+    rdgsbase rbx                            ; callee-saved, for after the call
+    mov     rax, [rsp + 22 * REGSIZE]       ; above the 15 GPRs, the 2 words pushed above and the 5 the CPU pushed
+    wrgsbase rax
 
+    mov     rdi, rsp
+    call    x86_nmi_entry                   ; x86_nmi_entry(platform_regs_t *regs)
+
+    wrgsbase rbx
+    POP_GPRS
     add     rsp, 2 * REGSIZE
     iretq
 .end:
+
+; ! SYSCALL entry point (MSR_LSTAR), the CPU has:
+; ! RCX = user RIP, R11 = user RFLAGS, CS/SS = kernel segments, RFLAGS masked by MSR_SFMASK (so IF = 0)
+; ! RSP is still the user stack, so switch to the kernel stack before touching memory through it.
+global x86_syscall_entry_impl:function (x86_syscall_entry_impl.end - x86_syscall_entry_impl)
+x86_syscall_entry_impl:
+    swapgs
+    mov     [gs:X86_PERCPU_USER_STACK], rsp
+    mov     rsp, [gs:X86_PERCPU_KERNEL_STACK]
+
+    ; build the same frame as an 'int 0x88' would, so that the rest of the kernel can't tell the difference
+    push    GDT_SEGMENT_USERDATA | 3        ; ss
+    push    qword [gs:X86_PERCPU_USER_STACK] ; rsp
+    push    r11                             ; rflags
+    push    GDT_SEGMENT_USERCODE | 3        ; cs
+    push    rcx                             ; rip
+    push    0                               ; error code
+    push    MOS_SYSCALL_INTR                ; interrupt number
+
+    PUSH_GPRS
+    cld
+
+    mov     rdi, rsp
+    call    x86_syscall_entry               ; x86_syscall_entry(platform_regs_t *regs)
+    ud2                                     ; if x86_syscall_entry returns, it's a bug
+.end:
+
+; ! x86_syscall_return_impl(regs) returns to userspace with SYSRET, the caller must have checked that
+; ! regs->ip is canonical, and regs->cs and regs->ss are the flat user segments (see x86_can_sysret)
+global x86_syscall_return_impl:function (x86_syscall_return_impl.end - x86_syscall_return_impl)
+x86_syscall_return_impl:
+    mov     rsp, rdi
+    POP_GPRS
+    add     rsp, 2 * REGSIZE                ; interrupt number and error code
+
+    mov     rcx, [rsp]                      ; rip
+    mov     r11, [rsp + 2 * REGSIZE]        ; rflags
+    mov     rsp, [rsp + 3 * REGSIZE]        ; rsp
+    swapgs
+    o64 sysret
+.end:
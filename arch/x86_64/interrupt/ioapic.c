@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <mos/lib/sync/spinlock.h>
 #include <mos/mm/paging/paging.h>
 #include <mos/mm/physical/pmm.h>
 #include <mos/platform/platform.h>
@@ -51,6 +52,7 @@ typedef struct
 MOS_STATIC_ASSERT(sizeof(ioapic_redirection_entry_t) == sizeof(u64), "ioapic_register_1 is not 64 bits");
 
 static u32 volatile *ioapic = NULL;
+static spinlock_t ioapic_lock = SPINLOCK_INIT; // the register window is shared, lines are masked from interrupt handlers
 
 should_inline u32 ioapic_read(u32 reg)
 {
@@ -118,8 +120,9 @@ void ioapic_init(void)
 
     pr_dinfo2(x86_ioapic, "max IRQs: %d, id: %d, version: %d, arb: %d", version.max_entries + 1, ioapic_id, version.version, arb_id);
 
-    for (int i = 0; i < version.max_entries + 1; i++)
-        ioapic_disable(i);
+    // mask every pin, whichever IRQ it is overridden to
+    for (int pin = 0; pin < version.max_entries + 1; pin++)
+        ioapic_write_redirection_entry(pin, (ioapic_redirection_entry_t){ .interrupt_vec = pin + ISR_MAX_COUNT, .mask = true });
 }
 
 void ioapic_enable_with_mode(u32 irq, u32 cpu, ioapic_trigger_mode_t trigger_mode, ioapic_polarity_t polarity)
@@ -133,7 +136,11 @@ void ioapic_enable_with_mode(u32 irq, u32 cpu, ioapic_trigger_mode_t trigger_mod
     entry.destination.target_apic_id = cpu;
 
     u32 irq_overrided = x86_ioapic_get_irq_override(irq); // the irq number received by the ioapic "pin"
+
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&ioapic_lock, irq_enabled);
     ioapic_write_redirection_entry(irq_overrided, entry);
+    spinlock_release_irqrestore(&ioapic_lock, irq_enabled);
 }
 
 void ioapic_disable(u32 irq)
@@ -141,5 +148,30 @@ void ioapic_disable(u32 irq)
     ioapic_redirection_entry_t entry = { 0 };
     entry.interrupt_vec = irq + ISR_MAX_COUNT;
     entry.mask = true;
-    ioapic_write_redirection_entry(irq, entry);
+
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&ioapic_lock, irq_enabled);
+    ioapic_write_redirection_entry(x86_ioapic_get_irq_override(irq), entry);
+    spinlock_release_irqrestore(&ioapic_lock, irq_enabled);
+}
+
+void ioapic_set_masked(u32 irq, bool masked)
+{
+    const u32 pin = x86_ioapic_get_irq_override(irq);
+
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&ioapic_lock, irq_enabled);
+    ioapic_redirection_entry_t entry = ioapic_read_redirection_entry(pin);
+    entry.mask = masked;
+    ioapic_write_redirection_entry(pin, entry);
+    spinlock_release_irqrestore(&ioapic_lock, irq_enabled);
+}
+
+bool ioapic_is_enabled(u32 irq)
+{
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&ioapic_lock, irq_enabled);
+    const ioapic_redirection_entry_t entry = ioapic_read_redirection_entry(x86_ioapic_get_irq_override(irq));
+    spinlock_release_irqrestore(&ioapic_lock, irq_enabled);
+    return !entry.mask;
 }
@@ -8,9 +8,11 @@
 #include <mos/x86/acpi/madt.h>
 #include <mos/x86/cpu/cpu.h>
 #include <mos/x86/cpu/cpuid.h>
+#include <mos/x86/delays.h>
 #include <mos/x86/interrupt/apic.h>
 #include <mos/x86/mm/paging_impl.h>
 #include <mos/x86/x86_platform.h>
+#include <mos_stdlib.h>
 
 #define APIC_REG_LAPIC_VERSION       0x30
 #define APIC_REG_PRIO_TASK           0x80
@@ -51,6 +53,12 @@
 
 #define IA32_APIC_BASE_MSR 0x1B
 
+#define APIC_LVT_MASKED          BIT(16)
+#define APIC_LVT_TIMER_PERIODIC  BIT(17)
+#define APIC_TIMER_DIVIDE_BY_16  0x3
+#define APIC_TIMER_CALIBRATE_MS  10
+#define APIC_TIMER_COUNT_MAX     0xFFFFFFFFu
+
 static ptr_t lapic_regs = 0;
 
 u32 lapic_read32(u32 offset)
@@ -147,3 +155,45 @@ void lapic_eoi(void)
 {
     lapic_write32(APIC_REG_EOI, 0);
 }
+
+static u32 lapic_timer_khz = 0; // timer ticks per millisecond, after the divider, the same on every CPU
+
+// count the timer ticks while the TSC counts APIC_TIMER_CALIBRATE_MS milliseconds
+static u32 lapic_timer_calibrate(void)
+{
+    lapic_write32(APIC_REG_TIMER_DIVIDE_CONFIG, APIC_TIMER_DIVIDE_BY_16);
+    lapic_write32(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);
+    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, APIC_TIMER_COUNT_MAX);
+    mdelay(APIC_TIMER_CALIBRATE_MS);
+    const u32 elapsed = APIC_TIMER_COUNT_MAX - lapic_read32(APIC_REG_TIMER_CURRENT_COUNT);
+    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, 0);
+    return MAX(elapsed / APIC_TIMER_CALIBRATE_MS, 1u);
+}
+
+void lapic_timer_start_periodic(u8 vector, u32 hz)
+{
+    u32 khz = __atomic_load_n(&lapic_timer_khz, __ATOMIC_RELAXED);
+    if (unlikely(!khz))
+    {
+        khz = lapic_timer_calibrate();
+        __atomic_store_n(&lapic_timer_khz, khz, __ATOMIC_RELAXED);
+        pr_dinfo2(x86_lapic, "timer: %u kHz", khz);
+    }
+
+    u64 count = (u64) khz * 1000 / MAX(hz, 1u);
+    count = count ? MIN(count, (u64) APIC_TIMER_COUNT_MAX) : 1;
+    lapic_write32(APIC_REG_TIMER_DIVIDE_CONFIG, APIC_TIMER_DIVIDE_BY_16);
+    lapic_write32(APIC_REG_LVT_TIMER, APIC_LVT_TIMER_PERIODIC | vector);
+    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, (u32) count); // writing the count starts it
+}
+
+void lapic_timer_stop(void)
+{
+    lapic_write32(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);
+    lapic_write32(APIC_REG_TIMER_INITIAL_COUNT, 0);
+}
+
+void lapic_perf_counter_nmi(bool enabled)
+{
+    lapic_write32(APIC_REG_LVT_PERF_MON_CTR, enabled ? APIC_DELIVER_MODE_NMI << 8 : APIC_LVT_MASKED);
+}
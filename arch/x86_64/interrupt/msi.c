@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Message-signalled interrupts, the device writes 'data' to 'address', which the LAPICs decode into a vector and a CPU
+
+#define pr_fmt(fmt) "msi: " fmt
+
+#include <mos/lib/sync/spinlock.h>
+#include <mos/platform/platform.h>
+#include <mos/printk.h>
+#include <mos/x86/acpi/madt.h>
+#include <mos/x86/x86_interrupt.h>
+#include <mos/x86/x86_platform.h>
+
+#define MSI_ADDRESS_BASE        0xFEE00000
+#define MSI_ADDRESS_DEST_ID(id) ((u64) (id) << 12) // physical destination mode, no redirection hint
+#define MSI_DATA_VECTOR(vec)    ((u32) (vec))      // fixed delivery mode, edge-triggered
+
+// the vectors are the same on every CPU, so moving an MSI to another CPU only changes its address
+static spinlock_t msi_lock = SPINLOCK_INIT;
+static bool msi_allocated[MSI_MAX_COUNT];
+
+static void msi_compose_message(u32 irq, u32 cpu, msi_message_t *message)
+{
+    message->address = MSI_ADDRESS_BASE | MSI_ADDRESS_DEST_ID(x86_cpu_get_apic_id(cpu));
+    message->data = MSI_DATA_VECTOR(irq - MSI_IRQ_BASE + MSI_BASE);
+}
+
+bool platform_msi_allocate(u32 cpu, u32 *irq, msi_message_t *message)
+{
+    spinlock_acquire(&msi_lock);
+    for (u32 i = 0; i < MSI_MAX_COUNT; i++)
+    {
+        if (msi_allocated[i])
+            continue;
+
+        msi_allocated[i] = true;
+        spinlock_release(&msi_lock);
+
+        *irq = MSI_IRQ_BASE + i;
+        msi_compose_message(*irq, cpu, message);
+        pr_dinfo2(x86_ioapic, "allocated vector %u for cpu %u", MSI_BASE + i, cpu);
+        return true;
+    }
+    spinlock_release(&msi_lock);
+
+    pr_warn("out of vectors");
+    return false;
+}
+
+bool platform_msi_set_affinity(u32 irq, u32 cpu, msi_message_t *message)
+{
+    MOS_ASSERT(irq >= MSI_IRQ_BASE && irq < MSI_IRQ_BASE + MSI_MAX_COUNT);
+    msi_compose_message(irq, cpu, message);
+    return true;
+}
+
+void platform_msi_free(u32 irq)
+{
+    MOS_ASSERT(irq >= MSI_IRQ_BASE && irq < MSI_IRQ_BASE + MSI_MAX_COUNT);
+    spinlock_acquire(&msi_lock);
+    MOS_ASSERT_X(msi_allocated[irq - MSI_IRQ_BASE], "freeing an MSI that was not allocated");
+    msi_allocated[irq - MSI_IRQ_BASE] = false;
+    spinlock_release(&msi_lock);
+}
@@ -2,7 +2,9 @@
 
 #include "mos/kallsyms.h"
 #include "mos/ksyscall_entry.h"
+#include "mos/locks/rcu.h"
 #include "mos/misc/profiling.h"
+#include "mos/misc/sampler.h"
 #include "mos/tasks/signal.h"
 #include "mos/tasks/task_types.h"
 
@@ -13,9 +15,13 @@
 #include <mos/printk.h>
 #include <mos/syscall/dispatcher.h>
 #include <mos/x86/cpu/cpu.h>
+#include <mos/x86/cpu/percpu.h>
+#include <mos/x86/cpu/pmu.h>
+#include <mos/x86/descriptors/descriptors.h>
 #include <mos/x86/devices/port.h>
 #include <mos/x86/interrupt/apic.h>
 #include <mos/x86/tasks/context.h>
+#include <mos/x86/tasks/fpu_context.h>
 #include <mos/x86/x86_interrupt.h>
 #include <mos/x86/x86_platform.h>
 #include <mos_stdio.h>
@@ -62,24 +68,62 @@ typedef struct
     void (*handler)(u32 irq);
 } x86_irq_handler_t;
 
-static list_head irq_handlers[IRQ_MAX_COUNT];
+// handlers are never freed, a removed one leaves an empty slot behind, so the IRQ path walks the lists without a lock
+static list_head irq_handlers[X86_IRQ_COUNT];
+static spinlock_t irq_handlers_lock = SPINLOCK_INIT; // serialises changes to the lists
+static bool irq_mask_on_delivery[IRQ_MAX_COUNT];
 
 void x86_init_irq_handlers(void)
 {
-    for (int i = 0; i < IRQ_MAX_COUNT; i++)
+    for (int i = 0; i < X86_IRQ_COUNT; i++)
         linked_list_init(&irq_handlers[i]);
 }
 
 bool x86_install_interrupt_handler(u32 irq, void (*handler)(u32 irq))
 {
-    MOS_ASSERT(irq < IRQ_MAX_COUNT);
+    if (irq >= X86_IRQ_COUNT)
+        return false;
+
+    spinlock_acquire(&irq_handlers_lock);
+    list_foreach(x86_irq_handler_t, desc, irq_handlers[irq])
+    {
+        if (!desc->handler)
+        {
+            __atomic_store_n(&desc->handler, handler, __ATOMIC_RELEASE);
+            spinlock_release(&irq_handlers_lock);
+            return true;
+        }
+    }
+
     x86_irq_handler_t *desc = kmalloc(sizeof(x86_irq_handler_t));
     linked_list_init(list_node(desc));
     desc->handler = handler;
-    list_node_append(&irq_handlers[irq], list_node(desc));
+    list_node_append_rcu(&irq_handlers[irq], list_node(desc)); // fully initialised before the IRQ path can reach it
+    spinlock_release(&irq_handlers_lock);
     return true;
 }
 
+void x86_remove_interrupt_handler(u32 irq, void (*handler)(u32 irq))
+{
+    MOS_ASSERT(irq < X86_IRQ_COUNT);
+    spinlock_acquire(&irq_handlers_lock);
+    list_foreach(x86_irq_handler_t, desc, irq_handlers[irq])
+    {
+        if (desc->handler == handler)
+        {
+            __atomic_store_n(&desc->handler, NULL, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    spinlock_release(&irq_handlers_lock);
+}
+
+void x86_irq_set_mask_on_delivery(u32 irq, bool mask)
+{
+    MOS_ASSERT(irq < IRQ_MAX_COUNT);
+    __atomic_store_n(&irq_mask_on_delivery[irq], mask, __ATOMIC_RELEASE);
+}
+
 static void x86_handle_nmi(platform_regs_t *regs)
 {
     pr_emph("cpu %d: NMI received", lapic_get_id());
@@ -215,22 +259,61 @@ done:
     return;
 }
 
-static void x86_handle_irq(platform_regs_t *frame)
+static void x86_handle_irq(u32 irq)
 {
+    if (irq < IRQ_MAX_COUNT && __atomic_load_n(&irq_mask_on_delivery[irq], __ATOMIC_ACQUIRE))
+        ioapic_set_masked(irq, true);
+
     lapic_eoi();
-    int irq = frame->interrupt_number - IRQ_BASE;
 
     bool irq_handled = false;
-    list_foreach(x86_irq_handler_t, handler, irq_handlers[irq])
+    list_foreach_rcu(x86_irq_handler_t, desc, irq_handlers[irq])
     {
+        void (*handler)(u32 irq) = __atomic_load_n(&desc->handler, __ATOMIC_ACQUIRE);
+        if (!handler)
+            continue;
+
         irq_handled = true;
         const pf_point_t ev = profile_enter();
-        handler->handler(irq);
-        profile_leave(ev, "x86.irq.handler.%d", irq);
+        handler(irq);
+        profile_leave(ev, "x86.irq.handler", irq);
     }
 
     if (unlikely(!irq_handled))
-        pr_warn("IRQ %d not handled!", irq);
+        pr_warn("IRQ %u not handled!", irq);
+}
+
+#if MOS_CONFIG(MOS_SAMPLER)
+static void x86_record_sample(const platform_regs_t *regs)
+{
+    ptr_t ips[SAMPLER_MAX_DEPTH];
+    const size_t depth = x86_sample_stack(regs, ips, SAMPLER_MAX_DEPTH);
+    sampler_record(regs->cs & 0x3, ips, depth);
+}
+#endif
+
+// the sampler's fallback when there is no performance counter, it can't interrupt code that runs with interrupts disabled
+static void x86_handle_lapic_timer(const platform_regs_t *regs)
+{
+    lapic_eoi();
+#if MOS_CONFIG(MOS_SAMPLER)
+    x86_record_sample(regs);
+#else
+    MOS_UNUSED(regs);
+#endif
+}
+
+void x86_nmi_entry(platform_regs_t *regs)
+{
+#if MOS_CONFIG(MOS_SAMPLER)
+    if (x86_pmu_sample_ack())
+    {
+        x86_record_sample(regs);
+        return;
+    }
+#endif
+
+    x86_handle_nmi(regs);
 }
 
 void x86_interrupt_entry(ptr_t rsp)
@@ -245,15 +328,19 @@ void x86_interrupt_entry(ptr_t rsp)
     if (frame->interrupt_number < IRQ_BASE)
         x86_handle_exception(frame);
     else if (frame->interrupt_number >= IRQ_BASE && frame->interrupt_number < IRQ_BASE + IRQ_MAX)
-        x86_handle_irq(frame);
+        x86_handle_irq(frame->interrupt_number - IRQ_BASE);
+    else if (frame->interrupt_number >= MSI_BASE && frame->interrupt_number < MSI_BASE + MSI_MAX_COUNT)
+        x86_handle_irq(frame->interrupt_number - MSI_BASE + MSI_IRQ_BASE);
     else if (frame->interrupt_number >= IPI_BASE && frame->interrupt_number < IPI_BASE + IPI_TYPE_MAX)
         ipi_do_handle((ipi_type_t) (frame->interrupt_number - IPI_BASE));
+    else if (frame->interrupt_number == LAPIC_TIMER_VECTOR)
+        x86_handle_lapic_timer(frame);
     else if (frame->interrupt_number == MOS_SYSCALL_INTR)
         syscall_nr = frame->ax, syscall_ret = ksyscall_enter(frame->ax, frame->bx, frame->cx, frame->dx, frame->si, frame->di, frame->r9);
     else
         pr_warn("Unknown interrupt number: %lu", frame->interrupt_number);
 
-    profile_leave(ev, "x86.int.%lu", frame->interrupt_number);
+    profile_leave(ev, "x86.int", frame->interrupt_number);
 
     if (unlikely(!current_thread))
         x86_interrupt_return_impl(frame), MOS_UNREACHABLE();
@@ -265,8 +352,76 @@ void x86_interrupt_entry(ptr_t rsp)
             signal_exit_to_user_prepare_syscall(frame, syscall_nr, syscall_ret);
         else
             signal_exit_to_user_prepare(frame);
+
+        x86_xrstor_thread(current_thread);
     }
 
     x86_interrupt_return_impl(frame);
     MOS_UNREACHABLE();
 }
+
+#define MSR_EFER   0xC0000080
+#define MSR_STAR   0xC0000081
+#define MSR_LSTAR  0xC0000082
+#define MSR_SFMASK 0xC0000084
+
+#define EFER_SCE BIT(0) // SYSCALL/SYSRET enable
+
+#define RFLAGS_TF BIT(8)
+#define RFLAGS_IF BIT(9)
+#define RFLAGS_DF BIT(10)
+#define RFLAGS_NT BIT(14)
+#define RFLAGS_RF BIT(16)
+#define RFLAGS_AC BIT(18)
+
+extern void x86_syscall_entry_impl(void);
+
+void x86_init_percpu_syscall(void)
+{
+    // SYSCALL loads CS from STAR[47:32] and SS from STAR[47:32] + 8,
+    // SYSRET loads SS from STAR[63:48] + 8 and CS from STAR[63:48] + 16 (both with RPL 3)
+    const u64 star = ((u64) GDT_SEGMENT_USERCODE32 << 48) | ((u64) GDT_SEGMENT_KCODE << 32);
+    cpu_wrmsr(MSR_STAR, star);
+    cpu_wrmsr(MSR_LSTAR, (ptr_t) x86_syscall_entry_impl);
+    // syscalls run with interrupts disabled, just like the 'int 0x88' path does
+    cpu_wrmsr(MSR_SFMASK, RFLAGS_TF | RFLAGS_IF | RFLAGS_DF | RFLAGS_NT | RFLAGS_AC);
+    cpu_wrmsr(MSR_EFER, cpu_rdmsr(MSR_EFER) | EFER_SCE);
+}
+
+static bool x86_can_sysret(const platform_regs_t *regs)
+{
+    // SYSRET can only return to the flat 64-bit user segments
+    if (regs->cs != (GDT_SEGMENT_USERCODE | 3) || regs->ss != (GDT_SEGMENT_USERDATA | 3))
+        return false;
+
+    // ! a non-canonical RIP makes SYSRET fault in ring 0, but with the user's RSP and GS (on Intel CPUs),
+    // ! also stay away from the last user page, so that a SYSCALL there can't return to a non-canonical address
+    if (regs->ip >= MOS_USER_END_VADDR + 1 - MOS_PAGE_SIZE)
+        return false;
+
+    // SYSRET can't restore RF, and TF would trap right after it, in the kernel
+    if (regs->eflags & (RFLAGS_RF | RFLAGS_TF))
+        return false;
+
+    return true;
+}
+
+void x86_syscall_entry(platform_regs_t *regs)
+{
+    current_cpu->interrupt_regs = regs;
+
+    // the 'syscall' instruction clobbers rcx and r11, so the arguments are passed in rdi, rsi, rdx, r10, r8, r9
+    const reg_t syscall_nr = regs->ax;
+    const pf_point_t ev = profile_enter();
+    const reg_t syscall_ret = ksyscall_enter(regs->ax, regs->di, regs->si, regs->dx, regs->r10, regs->r8, regs->r9);
+    profile_leave(ev, "x86.syscall", syscall_nr);
+
+    // this may rewind regs->ip to replay the 'syscall' instruction, which is 2 bytes long, just like 'int 0x88'
+    signal_exit_to_user_prepare_syscall(regs, syscall_nr, syscall_ret);
+    x86_xrstor_thread(current_thread);
+
+    if (likely(x86_can_sysret(regs)))
+        x86_syscall_return_impl(regs);
+    else
+        x86_interrupt_return_impl(regs);
+}
@@ -149,6 +149,28 @@ vm_flags platform_pml1e_get_flags(const pml1e_t *pml1e)
     return flags;
 }
 
+// the CPU sets the accessed and dirty bits on its own, so entries that may be in use are updated atomically
+#define X86_PTE_PRESENT  BIT(0)
+#define X86_PTE_WRITABLE BIT(1)
+#define X86_PTE_DIRTY    BIT(6)
+
+void platform_pml1e_clear_dirty(pml1e_t *pml1e)
+{
+    __atomic_fetch_and(&pml1e->content, ~(pte_content_t) X86_PTE_DIRTY, __ATOMIC_SEQ_CST);
+}
+
+bool platform_pml1e_discard_if_clean(pml1e_t *pml1e)
+{
+    pte_content_t content = __atomic_load_n(&pml1e->content, __ATOMIC_RELAXED);
+    do
+    {
+        if ((content & (X86_PTE_PRESENT | X86_PTE_WRITABLE | X86_PTE_DIRTY)) != (X86_PTE_PRESENT | X86_PTE_WRITABLE))
+            return false;
+    } while (!__atomic_compare_exchange_n(&pml1e->content, &content, 0, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    return true;
+}
+
 // PML2
 
 pml1_t platform_pml2e_get_pml1(const pml2e_t *pml2e)
@@ -7,6 +7,7 @@
 #include "mos/platform/platform_defs.h"
 #include "mos/tasks/signal.h"
 #include "mos/x86/cpu/cpuid.h"
+#include "mos/x86/cpu/percpu.h"
 #include "mos/x86/descriptors/descriptors.h"
 #include "mos/x86/tasks/fpu_context.h"
 
@@ -42,12 +43,13 @@ static void x86_start_user_thread()
 {
     platform_regs_t *regs = platform_thread_regs(current_thread);
     signal_exit_to_user_prepare(regs);
+    x86_xrstor_thread(current_thread);
     x86_interrupt_return_impl(regs);
 }
 
 static platform_regs_t *x86_setup_thread_common(thread_t *thread)
 {
-    thread->platform_options.xsaveptr = kmalloc(xsave_area_slab);
+    x86_fpu_init_thread(thread);
     thread->k_stack.head -= sizeof(platform_regs_t);
     platform_regs_t *regs = platform_thread_regs(thread);
     *regs = (platform_regs_t){ 0 };
@@ -104,10 +106,12 @@ static void x86_clone_forked_context(const thread_t *from, thread_t *to)
     if (to->mode == THREAD_MODE_USER)
     {
         to->u_stack.head = to_regs->sp;
-        to->platform_options.xsaveptr = kmalloc(xsave_area_slab);
-        memcpy(to->platform_options.xsaveptr, from->platform_options.xsaveptr, platform_info->arch_info.xsave_size);
+        x86_fpu_clone(from, to);
     }
 
+    if (from == current_thread)
+        x86_save_gsbase(current_thread); // userspace may have changed it with wrgsbase
+
     to->platform_options.fs_base = from->platform_options.fs_base;
     to->platform_options.gs_base = from->platform_options.gs_base;
     to->k_stack.head -= sizeof(platform_regs_t);
@@ -121,12 +125,14 @@ static void x86_switch_to_thread(ptr_t *scheduler_stack, thread_t *new_thread, s
                                       switch_flags & SWITCH_TO_NEW_KERNEL_THREAD ? x86_start_kernel_thread :
                                                                                    x86_normal_switch_impl;
 
-    x86_xsave_thread(old_thread);
-    x86_xrstor_thread(new_thread);
+    x86_xsave_thread(old_thread); // the new thread's state is loaded on its way back to userspace
+    x86_save_gsbase(old_thread);
     x86_set_fsbase(new_thread);
+    x86_set_gsbase(new_thread);
 
     __atomic_store_n(&current_cpu->thread, new_thread, __ATOMIC_SEQ_CST);
     __atomic_store_n(&per_cpu(x86_cpu_descriptor)->tss.rsp0, new_thread->k_stack.top, __ATOMIC_SEQ_CST);
+    x86_percpu_area()->kernel_stack = new_thread->k_stack.top; // for SYSCALL, which doesn't use the TSS
 
     x86_context_switch_impl(scheduler_stack, new_thread->k_stack.head, switch_func);
 }
@@ -142,3 +148,17 @@ void x86_set_fsbase(thread_t *thread)
 {
     __asm__ volatile("wrfsbase %0" ::"r"(thread->platform_options.fs_base) : "memory");
 }
+
+// while in the kernel, the user's GS base is kept in MSR_KERNEL_GS_BASE, see x86_init_percpu_area
+void x86_set_gsbase(thread_t *thread)
+{
+    cpu_wrmsr(MSR_KERNEL_GS_BASE, thread->platform_options.gs_base);
+}
+
+void x86_save_gsbase(thread_t *thread)
+{
+    if (!thread || thread->mode == THREAD_MODE_KERNEL)
+        return;
+
+    thread->platform_options.gs_base = cpu_rdmsr(MSR_KERNEL_GS_BASE);
+}
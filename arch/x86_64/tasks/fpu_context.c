@@ -10,28 +10,124 @@
 #include "mos/x86/cpu/cpuid.h"
 
 #include <mos_stdlib.h>
+#include <mos_string.h>
+
+#define XSAVE_MXCSR_OFFSET    24
+#define XSAVE_XCOMP_BV_OFFSET 520
+#define XCOMP_BV_COMPACTED    BIT(63)
+
+#define FPU_CPU_NONE ((u32) -1)
+
+typedef enum
+{
+    XSAVE_INSN_XSAVE,    // plain XSAVE
+    XSAVE_INSN_XSAVEOPT, // skips components that are in their initial state, or unmodified since the last XRSTOR
+    XSAVE_INSN_XSAVEC,   // skips initial components, and writes the compacted form
+    XSAVE_INSN_XSAVES,   // all of the above, restored with XRSTORS
+} xsave_insn_t;
 
 slab_t *xsave_area_slab = NULL;
+static xsave_insn_t xsave_insn = XSAVE_INSN_XSAVE;
+static PER_CPU_DECLARE(thread_t *, fpu_owner); // the thread whose FPU state is in the registers of this CPU
+
+static const u64 RFBM = ~0ULL;
+const reg32_t low = RFBM & 0xFFFFFFFF;
+const reg32_t high = RFBM >> 32;
+
+bool x86_xsave_is_compacted(void)
+{
+    return cpu_has_feature(CPU_FEATURE_XSAVES) || cpu_has_feature(CPU_FEATURE_XSAVEC);
+}
 
 static void setup_xsave_slab(void)
 {
-    xsave_area_slab = kmemcache_create("x86.xsave", platform_info->arch_info.xsave_size);
+    if (cpu_has_feature(CPU_FEATURE_XSAVES))
+        xsave_insn = XSAVE_INSN_XSAVES;
+    else if (cpu_has_feature(CPU_FEATURE_XSAVEC))
+        xsave_insn = XSAVE_INSN_XSAVEC;
+    else if (cpu_has_feature(CPU_FEATURE_XSAVEOPT))
+        xsave_insn = XSAVE_INSN_XSAVEOPT;
+
+    static const char *const insn_names[] = { "xsave", "xsaveopt", "xsavec", "xsaves" };
+    pr_dinfo2(x86_startup, "saving FPU state with %s, %zu bytes per thread", insn_names[xsave_insn], platform_info->arch_info.xsave_size);
+    // XSAVE areas must be 64-byte aligned, slab objects are laid out at multiples of their size from a page boundary
+    xsave_area_slab = kmemcache_create("x86.xsave", ALIGN_UP(platform_info->arch_info.xsave_size, 64));
 }
 
 MOS_INIT(SLAB_AUTOINIT, setup_xsave_slab);
 
-static const u64 RFBM = ~0ULL;
-const reg32_t low = RFBM & 0xFFFFFFFF;
-const reg32_t high = RFBM >> 32;
+static void xsave_to(u8 *area)
+{
+    switch (xsave_insn)
+    {
+        case XSAVE_INSN_XSAVE: __asm__ volatile("xsave64 %0" : "+m"(*area) : "a"(low), "d"(high) : "memory"); break;
+        case XSAVE_INSN_XSAVEOPT: __asm__ volatile("xsaveopt64 %0" : "+m"(*area) : "a"(low), "d"(high) : "memory"); break;
+        case XSAVE_INSN_XSAVEC: __asm__ volatile("xsavec64 %0" : "+m"(*area) : "a"(low), "d"(high) : "memory"); break;
+        case XSAVE_INSN_XSAVES: __asm__ volatile("xsaves64 %0" : "+m"(*area) : "a"(low), "d"(high) : "memory"); break;
+    }
+}
+
+static void xrstor_from(const u8 *area)
+{
+    if (xsave_insn == XSAVE_INSN_XSAVES)
+        __asm__ volatile("xrstors64 %0" ::"m"(*area), "a"(low), "d"(high) : "memory");
+    else
+        __asm__ volatile("xrstor64 %0" ::"m"(*area), "a"(low), "d"(high) : "memory");
+}
+
+static bool fpu_is_loaded_here(const thread_t *thread)
+{
+    return *per_cpu(fpu_owner) == thread && thread->platform_options.fpu_cpu == platform_current_cpu_id();
+}
+
+static u8 *xsave_alloc_area(void)
+{
+    u8 *area = kmalloc(xsave_area_slab); // zeroed, i.e. XSTATE_BV = 0: every component is in its initial state
+
+    // ... except MXCSR, which standard-form XRSTOR loads from the legacy area regardless of XSTATE_BV
+    const u32 mxcsr = 0x1F80;
+    memcpy(area + XSAVE_MXCSR_OFFSET, &mxcsr, sizeof(mxcsr));
+
+    if (x86_xsave_is_compacted())
+    {
+        const u64 xcomp_bv = XCOMP_BV_COMPACTED | platform_info->arch_info.xsave_features;
+        memcpy(area + XSAVE_XCOMP_BV_OFFSET, &xcomp_bv, sizeof(xcomp_bv));
+    }
+
+    return area;
+}
+
+void x86_fpu_init_thread(thread_t *thread)
+{
+    thread->platform_options.fpu_cpu = FPU_CPU_NONE;
+    if (thread->mode == THREAD_MODE_KERNEL)
+        return; // no, kernel threads don't have these
+
+    thread->platform_options.xsaveptr = xsave_alloc_area();
+}
+
+void x86_fpu_clone(const thread_t *from, thread_t *to)
+{
+    to->platform_options.fpu_cpu = FPU_CPU_NONE;
+    to->platform_options.xsaveptr = xsave_alloc_area();
+
+    if (fpu_is_loaded_here(from))
+        xsave_to(to->platform_options.xsaveptr); // the saved copy of 'from' is stale anyway
+    else
+        memcpy(to->platform_options.xsaveptr, from->platform_options.xsaveptr, platform_info->arch_info.xsave_size);
+}
 
 void x86_xsave_thread(thread_t *thread)
 {
     if (!thread || thread->mode == THREAD_MODE_KERNEL)
         return; // no, kernel threads don't have these
 
+    if (!fpu_is_loaded_here(thread))
+        return; // already saved, and it hasn't run in userspace since
+
     pr_dcont(scheduler, "saved.");
     MOS_ASSERT(thread->platform_options.xsaveptr);
-    __asm__ volatile("xsave %0" ::"m"(*thread->platform_options.xsaveptr), "a"(low), "d"(high));
+    xsave_to(thread->platform_options.xsaveptr);
 }
 
 void x86_xrstor_thread(thread_t *thread)
@@ -39,7 +135,13 @@ void x86_xrstor_thread(thread_t *thread)
     if (!thread || thread->mode == THREAD_MODE_KERNEL)
         return; // no, kernel threads don't have these
 
+    if (fpu_is_loaded_here(thread))
+        return;
+
+    // the state of the previous owner, if any, was saved when it was switched out
     pr_dcont(scheduler, "restored.");
     MOS_ASSERT(thread->platform_options.xsaveptr);
-    __asm__ volatile("xrstor %0" ::"m"(*thread->platform_options.xsaveptr), "a"(low), "d"(high));
+    xrstor_from(thread->platform_options.xsaveptr);
+    *per_cpu(fpu_owner) = thread;
+    thread->platform_options.fpu_cpu = platform_current_cpu_id();
 }
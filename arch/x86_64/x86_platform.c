@@ -5,6 +5,7 @@
 #include "mos/device/console.h"
 #include "mos/mm/mm.h"
 #include "mos/mm/paging/paging.h"
+#include "mos/mm/physical/pmm.h"
 #include "mos/printk.h"
 #include "mos/tasks/schedule.h"
 #include "mos/x86/acpi/acpi.h"
@@ -18,6 +19,7 @@
 #include "mos/x86/devices/rtc.h"
 #include "mos/x86/devices/serial.h"
 #include "mos/x86/devices/serial_console.h"
+#include "mos/x86/devices/tsc.h"
 #include "mos/x86/interrupt/apic.h"
 #include "mos/x86/mm/mm.h"
 #include "mos/x86/mm/paging_impl.h"
@@ -189,6 +191,54 @@ void x86_dump_stack_at(ptr_t this_frame, bool can_access_vmaps)
     pr_info("-- end of stack trace");
 }
 
+size_t x86_sample_stack(const platform_regs_t *regs, ptr_t *ips, size_t max)
+{
+    size_t depth = 0;
+    ips[depth++] = regs->ip;
+
+    // only follow frames on the interrupted stack, so that a corrupted one, or code without frame pointers, can't fault
+    const bool user = regs->cs & 0x3;
+    const thread_t *thread = current_thread;
+    mm_context_t *mm = current_cpu->mm_context;
+    ptr_t stack_low, stack_high;
+    if (user && mm)
+        stack_low = MOS_PAGE_SIZE, stack_high = MOS_USER_END_VADDR;
+    else if (!user && thread)
+        stack_low = thread->k_stack.top - thread->k_stack.capacity, stack_high = thread->k_stack.top;
+    else
+        return depth;
+
+    ptr_t bp = regs->bp;
+    while (depth < max && bp >= stack_low && bp + sizeof(frame_t) <= stack_high && bp % sizeof(ptr_t) == 0)
+    {
+        frame_t frame;
+        if (user)
+        {
+            // through the direct map, the user page may be unmapped at any time, and a frame never spans two pages
+            if (bp % MOS_PAGE_SIZE > MOS_PAGE_SIZE - sizeof(frame_t))
+                break;
+            const ptr_t paddr = mm_get_phys_addr(mm, bp);
+            if (paddr < MOS_PAGE_SIZE || paddr / MOS_PAGE_SIZE >= pmm_total_frames)
+                break;
+            frame = *(const frame_t *) pa_va(paddr);
+        }
+        else
+        {
+            frame = *(const frame_t *) bp;
+        }
+
+        if (user ? frame.ip == 0 || frame.ip >= MOS_USER_END_VADDR : frame.ip < MOS_KERNEL_START_VADDR)
+            break;
+
+        ips[depth++] = frame.ip;
+        if ((ptr_t) frame.bp <= bp)
+            break; // the callers' frames are above
+        bp = (ptr_t) frame.bp;
+    }
+
+    return depth;
+}
+
 void platform_dump_current_stack(void)
 {
     ptr_t frame;
@@ -210,7 +260,9 @@ void platform_startup_early()
     x86_init_percpu_tss();
 
     x86_cpu_initialise_caps();
+    x86_init_percpu_syscall();
     x86_platform.arch_info.xsave_size = x86_cpu_setup_xsave_area();
+    x86_platform.arch_info.xsave_features = x86_cpu_get_xcr0();
 
 #if MOS_DEBUG_FEATURE(x86_startup)
     pr_info2("cpu features:");
@@ -272,6 +324,7 @@ void platform_startup_late()
     pic_remap_irq();
     ioapic_init();
 
+    tsc_init();
     rtc_init();
 
     x86_install_interrupt_handler(IRQ_CMOS_RTC, rtc_irq_handler);
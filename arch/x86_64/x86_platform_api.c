@@ -17,7 +17,9 @@
 #include <mos/printk.h>
 #include <mos/tasks/process.h>
 #include <mos/tasks/task_types.h>
+#include <mos/x86/acpi/madt.h>
 #include <mos/x86/cpu/cpu.h>
+#include <mos/x86/cpu/pmu.h>
 #include <mos/x86/delays.h>
 #include <mos/x86/devices/port.h>
 #include <mos/x86/interrupt/apic.h>
@@ -51,11 +53,6 @@ void platform_invalidate_tlb(ptr_t vaddr)
         x86_cpu_invlpg(vaddr);
 }
 
-u32 platform_current_cpu_id(void)
-{
-    return x86_cpuid(b, 1, 0) >> 24;
-}
-
 void platform_msleep(u64 ms)
 {
     mdelay(ms);
@@ -76,6 +73,19 @@ u64 platform_get_timestamp()
     return rdtsc();
 }
 
+// for a whole aligned page, 'rep stosq' and 'rep movsq' are fast with or without ERMS
+void platform_page_zero(ptr_t vaddr)
+{
+    size_t count = MOS_PAGE_SIZE / sizeof(u64);
+    __asm__ volatile("rep stosq" : "+D"(vaddr), "+c"(count) : "a"(0) : "memory");
+}
+
+void platform_page_copy(ptr_t dst, ptr_t src)
+{
+    size_t count = MOS_PAGE_SIZE / sizeof(u64);
+    __asm__ volatile("rep movsq" : "+D"(dst), "+S"(src), "+c"(count) : : "memory");
+}
+
 datetime_str_t *platform_get_datetime_str(void)
 {
     static PER_CPU_DECLARE(datetime_str_t, datetime_str);
@@ -96,6 +106,19 @@ void platform_interrupt_disable(void)
     __asm__ volatile("cli");
 }
 
+bool platform_interrupt_disable_save(void)
+{
+    reg_t rflags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(rflags) : : "memory");
+    return rflags & BIT(9); // RFLAGS.IF
+}
+
+void platform_interrupt_restore(bool enabled)
+{
+    if (enabled)
+        __asm__ volatile("sti" : : : "memory");
+}
+
 bool platform_irq_handler_install(u32 irq, irq_handler handler)
 {
     return x86_install_interrupt_handler(irq, handler);
@@ -103,9 +126,32 @@ bool platform_irq_handler_install(u32 irq, irq_handler handler)
 
 void platform_irq_handler_remove(u32 irq, irq_handler handler)
 {
-    // TODO: implement
-    MOS_UNUSED(irq);
-    MOS_UNUSED(handler);
+    x86_remove_interrupt_handler(irq, handler);
+}
+
+bool platform_irq_line_route(u32 irq, u32 cpu)
+{
+    if (irq >= IRQ_MAX_COUNT || irq == IRQ_CASCADE)
+        return false;
+
+    if (ioapic_is_enabled(irq))
+        return false; // taken by the kernel
+
+    // PCI lines are level-triggered, and active-high once routed through an ISA IRQ
+    x86_irq_set_mask_on_delivery(irq, true);
+    ioapic_enable_with_mode(irq, x86_cpu_get_apic_id(cpu), IOAPIC_TRIGGER_MODE_LEVEL, IOAPIC_POLARITY_ACTIVE_HIGH);
+    return true;
+}
+
+void platform_irq_line_unmask(u32 irq)
+{
+    ioapic_set_masked(irq, false);
+}
+
+void platform_irq_line_disable(u32 irq)
+{
+    ioapic_disable(irq);
+    x86_irq_set_mask_on_delivery(irq, false);
 }
 
 void platform_switch_mm(const mm_context_t *mm)
@@ -139,6 +185,7 @@ void platform_dump_thread_kernel_stack(const thread_t *thread)
 
 noreturn void platform_return_to_userspace(platform_regs_t *regs)
 {
+    x86_xrstor_thread(current_thread);
     x86_interrupt_return_impl(regs);
 }
 
@@ -169,8 +216,7 @@ u64 platform_arch_syscall(u64 syscall, u64 __maybe_unused arg1, u64 __maybe_unus
         case X86_SYSCALL_SET_GS_BASE:
         {
             current_thread->platform_options.gs_base = arg1;
-            // x86_update_current_gsbase();
-            MOS_UNIMPLEMENTED("set_gs_base");
+            x86_set_gsbase(current_thread);
             return 0;
         }
         default:
@@ -189,6 +235,28 @@ void platform_ipi_send(u8 target, ipi_type_t type)
         lapic_interrupt(IPI_BASE + type, target, APIC_DELIVER_MODE_NORMAL, LAPIC_DEST_MODE_PHYSICAL, LAPIC_SHORTHAND_NONE);
 }
 
+void platform_sample_timer_set(u32 hz)
+{
+    // the counter's NMI also samples code that runs with interrupts disabled, which the LAPIC timer can't interrupt
+    if (x86_pmu_available())
+    {
+        if (hz)
+            x86_pmu_sample_start(hz);
+        else
+            x86_pmu_sample_stop();
+        return;
+    }
+
+    static bool reported = false;
+    if (hz && !__atomic_exchange_n(&reported, true, __ATOMIC_RELAXED))
+        pr_info("no performance counter, sampling with the LAPIC timer, code running with interrupts disabled won't be sampled");
+
+    if (hz)
+        lapic_timer_start_periodic(LAPIC_TIMER_VECTOR, hz);
+    else
+        lapic_timer_stop();
+}
+
 void platform_jump_to_signal_handler(const platform_regs_t *regs, const sigreturn_data_t *sigreturn_data, const sigaction_t *sa)
 {
     current_thread->u_stack.head = regs->sp - 128;
@@ -204,6 +272,7 @@ void platform_jump_to_signal_handler(const platform_regs_t *regs, const sigretur
 
     ret_regs.di = sigreturn_data->signal; // arg1
     ret_regs.sp = current_thread->u_stack.head;
+    x86_xrstor_thread(current_thread);
     x86_interrupt_return_impl(&ret_regs);
 }
 
@@ -216,6 +285,7 @@ void platform_restore_from_signal_handler(void *sp)
     stack_pop_val(&current_thread->u_stack, regs);
 
     signal_on_returned(&data);
+    x86_xrstor_thread(current_thread);
     x86_interrupt_return_impl(&regs);
 }
 
@@ -2,10 +2,12 @@
 
 #include "mos/device/clocksource.h"
 
+#include "mos/device/timer.h"
 #include "mos/platform/platform.h"
 #include "mos/printk.h"
 #include "mos/tasks/schedule.h"
-#include "mos/tasks/wait.h"
+
+#include <mos_stdlib.h>
 
 #define RESCHEDULE_INTERVAL_MS 1
 list_head clocksources = LIST_HEAD_INIT(clocksources);
@@ -21,26 +23,21 @@ void clocksource_register(clocksource_t *clocksource)
 void clocksource_tick(clocksource_t *clocksource)
 {
     clocksource->ticks++;
+    if (clocksource == active_clocksource)
+        ktimer_tick(clocksource->ticks);
+
     if (clocksource->ticks % (clocksource->frequency / 1000 * RESCHEDULE_INTERVAL_MS) == 0)
         reschedule();
 }
 
-#define active_clocksource_ticks() READ_ONCE(active_clocksource->ticks)
-
-static bool should_continue(wait_condition_t *cond)
-{
-    return active_clocksource_ticks() >= (u64) cond->arg;
-}
-
 void clocksource_msleep(u64 ms)
 {
-    const u64 offset = ms * active_clocksource->frequency / 1000;
-    const u64 target_val = active_clocksource_ticks() + offset;
-    reschedule_for_wait_condition(wc_wait_for((void *) target_val, should_continue, NULL));
-
-    if (current_thread->waiting)
-    {
-        wc_condition_cleanup(current_thread->waiting);
-        current_thread->waiting = NULL;
-    }
+    // the thread is woken up once by its timer, instead of being polled by the scheduler until the time has come,
+    // but a wakeup meant for something else can end the wait early, so sleep again for what is left
+    const u64 frequency = active_clocksource->frequency;
+    const u64 deadline = __atomic_load_n(&active_clocksource->ticks, __ATOMIC_RELAXED) + ms * frequency / 1000;
+
+    u64 now;
+    while ((now = __atomic_load_n(&active_clocksource->ticks, __ATOMIC_RELAXED)) < deadline)
+        ktimer_block_current(MAX((deadline - now) * 1000 / frequency, 1u));
 }
@@ -6,32 +6,38 @@
 #include <mos/io/io.h>
 #include <mos/lib/structures/list.h>
 #include <mos/lib/structures/ring_buffer.h>
+#include <mos/locks/rcu.h>
 #include <mos/printk.h>
 #include <mos/tasks/schedule.h>
 #include <mos/tasks/wait.h>
 #include <mos_string.h>
 
 list_head consoles = LIST_HEAD_INIT(consoles);
+static spinlock_t consoles_lock = SPINLOCK_INIT; // serialises writers, readers use RCU
 
 static size_t console_io_read(io_t *io, void *data, size_t size)
 {
     console_t *con = container_of(io, console_t, io);
 
     spinlock_acquire(&con->read.lock);
-    if (ring_buffer_pos_is_empty(&con->read.pos))
+    while (ring_buffer_pos_is_empty(&con->read.pos))
     {
+        // get on the waitlist before releasing the lock, so that a character arriving in between wakes us up
+        bool ok = waitlist_append(&con->waitlist);
         spinlock_release(&con->read.lock);
-        bool ok = reschedule_for_waitlist(&con->waitlist);
         if (!ok)
         {
             pr_emerg("console: '%s' closed", con->name);
             return -EIO;
         }
+        blocked_reschedule();
         spinlock_acquire(&con->read.lock);
 
         if (signal_has_pending())
         {
             spinlock_release(&con->read.lock);
+            waitlist_remove_me(&con->waitlist);
+            scheduler_discard_wakeup();
             return -ERESTARTSYS;
         }
     }
@@ -77,28 +83,44 @@ void console_register(console_t *con)
 
     ring_buffer_pos_init(&con->read.pos, con->read.size);
     io_init(&con->io, IO_CONSOLE, IO_READABLE | IO_WRITABLE, &console_io_ops);
-    list_node_append(&consoles, list_node(con));
     waitlist_init(&con->waitlist);
+
+    spinlock_acquire(&consoles_lock);
+    list_node_append_rcu(&consoles, list_node(con));
+    spinlock_release(&consoles_lock);
 }
 
+// consoles are never unregistered, so they can be used after the read-side section
 console_t *console_get(const char *name)
 {
-    list_foreach(console_t, con, consoles)
+    console_t *found = NULL;
+    rcu_read_lock();
+    list_foreach_rcu(console_t, con, consoles)
     {
         if (strcmp(con->name, name) == 0)
-            return con;
+        {
+            found = con;
+            break;
+        }
     }
-    return NULL;
+    rcu_read_unlock();
+    return found;
 }
 
 console_t *console_get_by_prefix(const char *prefix)
 {
-    list_foreach(console_t, con, consoles)
+    console_t *found = NULL;
+    rcu_read_lock();
+    list_foreach_rcu(console_t, con, consoles)
     {
         if (strncmp(con->name, prefix, strlen(prefix)) == 0)
-            return con;
+        {
+            found = con;
+            break;
+        }
     }
-    return NULL;
+    rcu_read_unlock();
+    return found;
 }
 
 size_t console_write(console_t *con, const char *data, size_t size)
@@ -127,6 +149,8 @@ size_t console_write_color(console_t *con, const char *data, size_t size, standa
 
 void console_putc(console_t *con, u8 c)
 {
+    spinlock_acquire(&con->read.lock);
     ring_buffer_pos_push_back_byte(con->read.buf, &con->read.pos, c);
+    spinlock_release(&con->read.lock);
     waitlist_wake(&con->waitlist, INT_MAX);
 }
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/device/timekeeping.h"
+
+#include "mos/mm/mm.h"
+#include "mos/mm/paging/paging.h"
+#include "mos/mm/physical/pmm.h"
+#include "mos/platform/platform.h"
+#include "mos/printk.h"
+#include "mos/setup.h"
+
+#include <mos/misc/vdso_types.h>
+#include <mos/mos_global.h>
+
+#define NSEC_PER_SEC      1000000000ULL
+#define TIMEKEEPING_SHIFT 32
+
+static pfn_t vdso_pfn;
+static vdso_data_t *vdso_data;
+
+// days since 1970-01-01 of a proleptic Gregorian date, see https://howardhinnant.github.io/date_algorithms.html
+static s64 days_from_civil(s64 y, u32 m, u32 d)
+{
+    y -= m <= 2;
+    const s64 era = (y >= 0 ? y : y - 399) / 400;
+    const u32 yoe = (u32) (y - era * 400);                              // [0, 399]
+    const u32 doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1; // [0, 365]
+    const u32 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;            // [0, 146096]
+    return era * 146097 + (s64) doe - 719468;
+}
+
+static u64 timeval_to_unix_seconds(const timeval_t *tv)
+{
+    const s64 days = days_from_civil(tv->year, tv->month, tv->day);
+    return days * 86400 + tv->hour * 3600 + tv->minute * 60 + tv->second;
+}
+
+static void timekeeping_init_vdso(void)
+{
+    phyframe_t *frame = mm_get_free_page();
+    MOS_ASSERT_X(frame, "failed to allocate the vDSO data page");
+    pmm_ref_one(frame); // the kernel's reference, the page is never freed
+
+    vdso_pfn = phyframe_pfn(frame);
+    vdso_data = (vdso_data_t *) phyframe_va(frame);
+}
+
+MOS_INIT(POST_MM, timekeeping_init_vdso);
+
+void timekeeping_init(u64 frequency, bool reliable)
+{
+    MOS_ASSERT(frequency > 0);
+
+    timeval_t tv;
+    platform_get_time(&tv);
+    const u64 counter = platform_get_timestamp();
+    const u64 unix_seconds = timeval_to_unix_seconds(&tv);
+
+    vdso_time_data_t *time = &vdso_data->time;
+
+    __atomic_store_n(&time->seq, time->seq + 1, __ATOMIC_RELAXED); // readers will retry until we are done
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    time->counter_base = counter;
+    time->ns_base = unix_seconds * NSEC_PER_SEC;
+    time->frequency = frequency;
+    time->shift = TIMEKEEPING_SHIFT;
+    time->mult = (NSEC_PER_SEC << TIMEKEEPING_SHIFT) / frequency;
+    time->flags = VDSO_TIME_VALID | (reliable ? VDSO_TIME_RELIABLE : 0);
+
+    __atomic_store_n(&time->seq, time->seq + 1, __ATOMIC_RELEASE);
+
+    pr_info("timekeeping: %llu.%03llu MHz counter%s, %04u-%02u-%02u %02u:%02u:%02u", frequency / 1000000, frequency / 1000 % 1000, reliable ? "" : " (unreliable)",
+            tv.year, tv.month, tv.day, tv.hour, tv.minute, tv.second);
+}
+
+u64 timekeeping_now_ns(void)
+{
+    const vdso_time_data_t *time = &vdso_data->time;
+    if (likely(time->flags & VDSO_TIME_VALID))
+        return vdso_counter_to_ns(time, platform_get_timestamp());
+
+    // not calibrated yet, fall back to the (slow, and only second-precise) platform clock
+    timeval_t tv;
+    platform_get_time(&tv);
+    return timeval_to_unix_seconds(&tv) * NSEC_PER_SEC;
+}
+
+u64 timekeeping_counter_to_ns(u64 counter)
+{
+    if (unlikely(!vdso_data || !(vdso_data->time.flags & VDSO_TIME_VALID)))
+        return 0;
+
+    return (u64) (((unsigned __int128) counter * vdso_data->time.mult) >> vdso_data->time.shift);
+}
+
+void timekeeping_map_vdso(mm_context_t *mm)
+{
+    pmm_ref_one(vdso_pfn); // dropped when the vmap is destroyed
+    vmap_t *vmap = mm_map_user_pages(mm, MOS_VDSO_DATA_VADDR, vdso_pfn, 1, VM_USER_RO, VALLOC_EXACT, VMAP_TYPE_SHARED, VMAP_VDSO);
+    if (unlikely(!vmap))
+    {
+        pmm_unref_one(vdso_pfn);
+        mos_warn("failed to map the vDSO data page");
+    }
+}
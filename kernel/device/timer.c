@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/device/timer.h"
+
+#include "mos/device/clocksource.h"
+#include "mos/platform/platform.h"
+#include "mos/printk.h"
+#include "mos/setup.h"
+#include "mos/tasks/schedule.h"
+#include "mos/tasks/task_types.h"
+
+#include <mos/mos_global.h>
+#include <mos_stdlib.h>
+
+#define KTIMER_WHEEL_MASK  (KTIMER_WHEEL_SLOTS - 1)
+#define KTIMER_WHEEL_RANGE (1ULL << (KTIMER_WHEEL_BITS * KTIMER_WHEEL_LEVELS))
+
+#define level_shift(level) (KTIMER_WHEEL_BITS * (level))
+
+static PER_CPU_DECLARE(ktimer_wheel_t, ktimer_wheels);
+
+void ktimer_init(ktimer_t *timer, ktimer_callback_t callback, void *arg)
+{
+    linked_list_init(list_node(timer));
+    timer->deadline = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->wheel = NULL;
+    timer->running = false;
+    timer->running_cpu = 0;
+}
+
+void ktimer_wheel_init(ktimer_wheel_t *wheel, u64 now)
+{
+    wheel->lock = (spinlock_t) SPINLOCK_INIT;
+    wheel->now = now;
+    for (size_t level = 0; level < KTIMER_WHEEL_LEVELS; level++)
+        for (size_t slot = 0; slot < KTIMER_WHEEL_SLOTS; slot++)
+            linked_list_init(&wheel->slots[level][slot]);
+}
+
+static void ktimer_wheel_enqueue_locked(ktimer_wheel_t *wheel, ktimer_t *timer)
+{
+    // overdue timers go to the next slot to be processed
+    u64 expires = MAX(timer->deadline, wheel->now);
+
+    // timers beyond the range of the wheel are parked in the last slot it can reach, and re-filed from there
+    if (expires - wheel->now >= KTIMER_WHEEL_RANGE)
+        expires = wheel->now + KTIMER_WHEEL_RANGE - 1;
+
+    const u64 delta = expires - wheel->now;
+    size_t level = 0;
+    while (level < KTIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << level_shift(level + 1)))
+        level++;
+
+    const size_t slot = (expires >> level_shift(level)) & KTIMER_WHEEL_MASK;
+    list_node_append(&wheel->slots[level][slot], list_node(timer));
+    __atomic_store_n(&timer->wheel, wheel, __ATOMIC_RELEASE);
+}
+
+void ktimer_wheel_add(ktimer_wheel_t *wheel, ktimer_t *timer, u64 deadline)
+{
+    MOS_ASSERT_X(!timer->wheel, "timer is already pending");
+    spinlock_acquire(&wheel->lock);
+    timer->deadline = deadline;
+    ktimer_wheel_enqueue_locked(wheel, timer);
+    spinlock_release(&wheel->lock);
+}
+
+// move the timers due at or before 'now' to 'expired', marking them as running
+static void ktimer_wheel_collect_locked(ktimer_wheel_t *wheel, u64 now, list_head *expired)
+{
+    while (wheel->now <= now)
+    {
+        const u64 tick = wheel->now;
+
+        // when a level wraps around, the next slot of the level above is re-filed into the lower levels
+        for (size_t level = 1; level < KTIMER_WHEEL_LEVELS; level++)
+        {
+            if (tick & ((1ULL << level_shift(level)) - 1))
+                break;
+
+            list_head *slot = &wheel->slots[level][(tick >> level_shift(level)) & KTIMER_WHEEL_MASK];
+            list_head cascade = LIST_HEAD_INIT(cascade);
+            while (!list_is_empty(slot))
+                list_node_append(&cascade, list_node_pop(slot));
+
+            while (!list_is_empty(&cascade))
+                ktimer_wheel_enqueue_locked(wheel, list_entry(list_node_pop(&cascade), ktimer_t));
+        }
+
+        // advance before collecting, so that a callback re-arming its timer for 'now' won't be run again in this round
+        wheel->now++;
+
+        list_head *slot = &wheel->slots[0][tick & KTIMER_WHEEL_MASK];
+        while (!list_is_empty(slot))
+        {
+            ktimer_t *timer = list_entry(list_node_pop(slot), ktimer_t);
+            timer->running_cpu = platform_current_cpu_id(); // the callbacks are called on the CPU that collects them
+            timer->running = true;
+            __atomic_store_n(&timer->wheel, NULL, __ATOMIC_RELEASE);
+            list_node_append(expired, list_node(timer));
+        }
+    }
+}
+
+static size_t ktimer_run_expired(list_head *expired)
+{
+    size_t fired = 0;
+    while (!list_is_empty(expired))
+    {
+        ktimer_t *timer = list_entry(list_node_pop(expired), ktimer_t);
+        timer->callback(timer, timer->arg);
+        __atomic_store_n(&timer->running, false, __ATOMIC_RELEASE); // the last access, the owner may free the timer after this
+        fired++;
+    }
+
+    return fired;
+}
+
+size_t ktimer_wheel_advance(ktimer_wheel_t *wheel, u64 now)
+{
+    list_head expired = LIST_HEAD_INIT(expired);
+    spinlock_acquire(&wheel->lock);
+    ktimer_wheel_collect_locked(wheel, now, &expired);
+    spinlock_release(&wheel->lock);
+    return ktimer_run_expired(&expired);
+}
+
+bool ktimer_cancel(ktimer_t *timer)
+{
+    bool pending = false;
+
+    ktimer_wheel_t *wheel = __atomic_load_n(&timer->wheel, __ATOMIC_ACQUIRE);
+    if (wheel)
+    {
+        spinlock_acquire(&wheel->lock);
+        if (timer->wheel == wheel) // it may have fired in the meantime
+        {
+            list_remove(timer);
+            timer->wheel = NULL;
+            pending = true;
+        }
+        spinlock_release(&wheel->lock);
+    }
+
+    // Nothing else runs on a CPU while it's calling a callback, so if the callback is running here, it is our caller.
+    // Waiting for it would never end.
+    if (__atomic_load_n(&timer->running, __ATOMIC_ACQUIRE) && timer->running_cpu == platform_current_cpu_id())
+        return pending;
+
+    while (__atomic_load_n(&timer->running, __ATOMIC_ACQUIRE))
+        ; // the callback is running on another CPU
+
+    return pending;
+}
+
+void ktimer_add(ktimer_t *timer, u64 deadline)
+{
+    ktimer_wheel_add(per_cpu(ktimer_wheels), timer, deadline);
+}
+
+void ktimer_add_ms(ktimer_t *timer, u64 ms)
+{
+    MOS_ASSERT_X(active_clocksource, "no clocksource to drive the timers");
+    const u64 ticks = ms * active_clocksource->frequency / 1000;
+    ktimer_add(timer, READ_ONCE(active_clocksource->ticks) + ticks);
+}
+
+void ktimer_tick(u64 now)
+{
+    // Only one CPU receives the clock interrupt for now, so it drives the wheels of all CPUs.
+    // A wheel that is locked (e.g. by the thread this interrupt preempted) is skipped, it will catch up on the next tick.
+    for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+    {
+        ktimer_wheel_t *wheel = per_cpu_of(ktimer_wheels, cpu);
+        if (!spinlock_try_acquire(&wheel->lock))
+            continue;
+
+        list_head expired = LIST_HEAD_INIT(expired);
+        ktimer_wheel_collect_locked(wheel, now, &expired);
+        spinlock_release(&wheel->lock);
+        ktimer_run_expired(&expired);
+    }
+}
+
+static void ktimer_wake_thread(ktimer_t *timer, void *arg)
+{
+    MOS_UNUSED(timer);
+    scheduler_wake_thread(arg);
+}
+
+bool ktimer_block_current(u64 ms)
+{
+    thread_t *thread = current_thread;
+
+    ktimer_t timer;
+    ktimer_init(&timer, ktimer_wake_thread, thread);
+    ktimer_add_ms(&timer, ms);
+
+    pr_dinfo2(scheduler, "%pt is now blocked for %llu ms", (void *) thread, ms);
+    blocked_reschedule(); // returns at once if the timer has already fired
+
+    const bool timed_out = !ktimer_cancel(&timer);
+    scheduler_discard_wakeup(); // the timer may have fired after something else had woken us up
+    return timed_out;
+}
+
+static void ktimer_init_wheels(void)
+{
+    for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+        ktimer_wheel_init(per_cpu_of(ktimer_wheels, cpu), 0);
+}
+
+MOS_INIT(POST_MM, ktimer_init_wheels);
@@ -2,15 +2,23 @@
 
 #include "mos/elf/elf.h"
 
+#include "mos/device/timekeeping.h"
+#include "mos/filesystem/inode.h"
 #include "mos/filesystem/vfs.h"
 #include "mos/misc/kutils.h"
 #include "mos/mm/mmap.h"
+#include "mos/mm/mmstat.h"
+#include "mos/mm/paging/paging.h"
+#include "mos/mm/slab_autoinit.h"
 #include "mos/platform/platform.h"
 #include "mos/printk.h"
 #include "mos/tasks/process.h"
 #include "mos/tasks/task_types.h"
 #include "mos/tasks/thread.h"
 
+#include <mos/lib/structures/hashmap.h>
+#include <mos/lib/structures/list.h>
+#include <mos/lib/sync/spinlock.h>
 #include <mos/types.h>
 #include <mos_stdlib.h>
 #include <mos_string.h>
@@ -66,6 +74,161 @@ static ptr_t elf_determine_loadbias(elf_header_t *elf)
     return 0x4000000; // TODO: randomize
 }
 
+// ! exec cache
+
+/**
+ * @brief A parsed executable, everything exec needs from the file except the segment contents
+ */
+typedef struct
+{
+    as_linked_list;            ///< in elf_exec_cache, most recently used first
+    atomic_t refcount;         ///< one for the cache, plus one for each exec using it
+    inode_t *inode;            ///< the executable, the cache holds a reference to it
+    u64 generation;            ///< generation of the inode's page cache when the image was parsed
+    size_t size;               ///< size of the inode when the image was parsed
+    elf_header_t header;       ///< the verified ELF header
+    elf_program_hdr_t *phdrs;  ///< all program headers
+    char *interpreter;         ///< path of the PT_INTERP interpreter, or NULL
+    ptr_t load_bias;           ///< where the segments are loaded, relative to their vaddr
+} elf_image_t;
+
+static slab_t *elf_image_slab = NULL;
+SLAB_AUTOINIT("elf_image", elf_image_slab, elf_image_t);
+
+static list_head elf_exec_cache = LIST_HEAD_INIT(elf_exec_cache);
+static size_t elf_exec_cache_count = 0;
+static spinlock_t elf_exec_cache_lock = SPINLOCK_INIT;
+
+static void elf_image_put(elf_image_t *image)
+{
+    if (--image->refcount > 0)
+        return;
+
+    inode_unref(image->inode);
+    kfree(image->phdrs);
+    if (image->interpreter)
+        kfree(image->interpreter);
+    kfree(image);
+}
+
+static elf_image_t *elf_image_parse(file_t *file)
+{
+    elf_header_t header;
+    if (!elf_read_file(file, &header, 0, sizeof(elf_header_t)) || !elf_verify_header(&header))
+        return NULL;
+
+    if (header.object_type != ET_EXEC && header.object_type != ET_DYN)
+        return NULL;
+
+    if (header.ph.count && header.ph.entry_size != sizeof(elf_program_hdr_t))
+    {
+        pr_warn("'%s' has unexpected program header size %u", dentry_name(file->dentry), header.ph.entry_size);
+        return NULL;
+    }
+
+    elf_image_t *image = kmalloc(elf_image_slab);
+    linked_list_init(list_node(image));
+    image->refcount = 1;
+    image->header = header;
+    image->phdrs = kmalloc(sizeof(elf_program_hdr_t) * (header.ph.count + 1)); // +1 so that an empty table is still a valid allocation
+
+    // one read for the whole program header table, instead of one per entry
+    if (!elf_read_file(file, image->phdrs, header.ph_offset, sizeof(elf_program_hdr_t) * header.ph.count))
+    {
+        pr_emerg("failed to read program headers for '%s'", dentry_name(file->dentry));
+        goto bad_image;
+    }
+
+    for (size_t i = 0; i < header.ph.count; i++)
+    {
+        const elf_program_hdr_t *ph = &image->phdrs[i];
+        if (ph->header_type != ELF_PT_INTERP || image->interpreter)
+            continue;
+
+        image->interpreter = kmalloc(ph->size_in_file + 1);
+        if (!elf_read_file(file, image->interpreter, ph->data_offset, ph->size_in_file))
+        {
+            pr_emerg("failed to read interpreter name for '%s'", dentry_name(file->dentry));
+            goto bad_image;
+        }
+        image->interpreter[ph->size_in_file] = '\0';
+    }
+
+    // only ET_DYN (shared libraries) with an interpreter needs relocation
+    if (header.object_type == ET_DYN && image->interpreter)
+        image->load_bias = elf_determine_loadbias(&header);
+
+    image->inode = file->dentry->inode;
+    image->generation = image->inode->cache.generation;
+    image->size = image->inode->size;
+    inode_ref(image->inode);
+    return image;
+
+bad_image:
+    kfree(image->phdrs);
+    if (image->interpreter)
+        kfree(image->interpreter);
+    kfree(image);
+    return NULL;
+}
+
+/**
+ * @brief Get the parsed image of an executable, from the exec cache if it's still valid
+ *
+ * @return the image, which must be released with elf_image_put(), or NULL if it's not a valid executable
+ */
+static elf_image_t *elf_image_get(file_t *file)
+{
+    inode_t *const inode = file->dentry->inode;
+    elf_image_t *stale = NULL;
+
+    spinlock_acquire(&elf_exec_cache_lock);
+    list_foreach(elf_image_t, image, elf_exec_cache)
+    {
+        if (image->inode != inode)
+            continue;
+
+        list_remove(image);
+        if (image->generation == inode->cache.generation && image->size == inode->size)
+        {
+            list_node_prepend(&elf_exec_cache, list_node(image));
+            image->refcount++;
+            spinlock_release(&elf_exec_cache_lock);
+            return image;
+        }
+
+        // the file has been written to since
+        elf_exec_cache_count--;
+        stale = image;
+        break;
+    }
+    spinlock_release(&elf_exec_cache_lock);
+
+    if (stale)
+        elf_image_put(stale);
+
+    elf_image_t *image = elf_image_parse(file);
+    if (!image || MOS_ELF_EXEC_CACHE_SIZE == 0)
+        return image;
+
+    elf_image_t *victim = NULL;
+    spinlock_acquire(&elf_exec_cache_lock);
+    image->refcount++; // for the cache
+    list_node_prepend(&elf_exec_cache, list_node(image));
+    if (++elf_exec_cache_count > MOS_ELF_EXEC_CACHE_SIZE)
+    {
+        victim = list_entry(elf_exec_cache.prev, elf_image_t);
+        list_remove(victim);
+        elf_exec_cache_count--;
+    }
+    spinlock_release(&elf_exec_cache_lock);
+
+    if (victim)
+        elf_image_put(victim);
+
+    return image;
+}
+
 /**
  * Typical Stack Layout:
  *
@@ -154,6 +317,40 @@ no_argv:
     MOS_ASSERT(thread->u_stack.head % 16 == 0);
 }
 
+#if MOS_CONFIG(MOS_ELF_PREFAULT_TEXT)
+/**
+ * @brief Map the pages of a read-only segment that are already in the page cache
+ *
+ * @details The pages are mapped exactly as the fault handler would map them for a private read fault,
+ * pages that are not cached are left to the fault handler, so that prefaulting never does I/O.
+ */
+static void elf_prefault_segment(mm_context_t *mm, ptr_t vaddr, size_t npages, file_t *file, off_t offset, vm_flags flags)
+{
+    inode_cache_t *const icache = &file->dentry->inode->cache;
+    size_t prefaulted = 0;
+
+    mm_lock_ctx_pair(mm, NULL);
+    vmap_t *const vmap = vmap_obtain(mm, vaddr, NULL);
+    MOS_ASSERT(vmap);
+
+    for (size_t i = 0; i < npages; i++)
+    {
+        phyframe_t *page = hashmap_get(&icache->pages, offset / MOS_PAGE_SIZE + i);
+        if (!page)
+            continue;
+
+        mm_replace_page_locked(mm, vaddr + i * MOS_PAGE_SIZE, phyframe_pfn(page), flags);
+        vmap_stat_inc(vmap, pagecache);
+        vmap_stat_inc(vmap, cow);
+        prefaulted++;
+    }
+
+    spinlock_release(&vmap->lock);
+    mm_unlock_ctx_pair(mm, NULL);
+    pr_dinfo2(elf, "  prefaulted %zu/%zu pages", prefaulted, npages);
+}
+#endif
+
 static void elf_map_segment(const elf_program_hdr_t *const ph, ptr_t map_bias, mm_context_t *mm, file_t *file)
 {
     MOS_ASSERT(ph->header_type == ELF_PT_LOAD);
@@ -179,6 +376,11 @@ static void elf_map_segment(const elf_program_hdr_t *const ph, ptr_t map_bias, m
     const ptr_t vaddr = mmap_file(mm, map_start, MMAP_PRIVATE | MMAP_EXACT, flags, npages, &file->io, aligned_size);
     MOS_ASSERT_X(vaddr == map_start, "failed to map ELF segment at " PTR_FMT, aligned_vaddr);
 
+#if MOS_CONFIG(MOS_ELF_PREFAULT_TEXT)
+    if (!(flags & VM_WRITE) && ph->size_in_file == ph->size_in_mem)
+        elf_prefault_segment(mm, vaddr, npages, file, aligned_size, flags);
+#endif
+
     if (ph->size_in_file < ph->size_in_mem)
     {
         pr_dinfo2(elf, "  ... and zeroing %zu bytes at " PTR_FMT, ph->size_in_mem - ph->size_in_file, map_bias + ph->vaddr + ph->size_in_file);
@@ -196,8 +398,8 @@ static ptr_t elf_map_interpreter(const char *path, mm_context_t *mm)
 
     io_ref(&interp_file->io);
 
-    elf_header_t elf;
-    if (!elf_read_and_verify_executable(interp_file, &elf))
+    elf_image_t *const interp = elf_image_get(interp_file);
+    if (!interp)
     {
         pr_emerg("failed to verify ELF header for '%s'", dentry_name(interp_file->dentry));
         io_unref(&interp_file->io);
@@ -206,24 +408,18 @@ static ptr_t elf_map_interpreter(const char *path, mm_context_t *mm)
 
     ptr_t entry = 0;
 
-    for (size_t i = 0; i < elf.ph.count; i++)
+    for (size_t i = 0; i < interp->header.ph.count; i++)
     {
-        elf_program_hdr_t ph;
-        if (!elf_read_file(interp_file, &ph, elf.ph_offset + i * elf.ph.entry_size, elf.ph.entry_size))
-        {
-            pr_emerg("failed to read program header %zu for '%s'", i, dentry_name(interp_file->dentry));
-            io_unref(&interp_file->io);
-            return 0;
-        }
-
-        if (ph.header_type == ELF_PT_LOAD)
+        const elf_program_hdr_t *ph = &interp->phdrs[i];
+        if (ph->header_type == ELF_PT_LOAD)
         {
             // interpreter is always loaded at vaddr 0
-            elf_map_segment(&ph, MOS_ELF_INTERPRETER_BASE_OFFSET, mm, interp_file);
-            entry = elf.entry_point;
+            elf_map_segment(ph, MOS_ELF_INTERPRETER_BASE_OFFSET, mm, interp_file);
+            entry = interp->header.entry_point;
         }
     }
 
+    elf_image_put(interp);
     io_unref(&interp_file->io);
     return MOS_ELF_INTERPRETER_BASE_OFFSET + entry;
 }
@@ -239,58 +435,53 @@ __nodiscard bool elf_do_fill_process(process_t *proc, file_t *file, elf_header_t
     add_auxv_entry(&info->auxv, AT_EGID, 0);
     add_auxv_entry(&info->auxv, AT_BASE, MOS_ELF_INTERPRETER_BASE_OFFSET);
 
+    elf_image_t *const image = elf_image_get(file);
+    if (!image)
+    {
+        pr_emerg("failed to read program headers for '%s'", dentry_name(file->dentry));
+        return false;
+    }
+
+    MOS_UNUSED(elf); // the cached header is the same one, it's been verified when the image was parsed
+
     // !! after this point, we must make sure that we switch back to the previous address space before returning from this function !!
     mm_context_t *const prev_mm = mm_switch_context(proc->mm);
 
-    bool should_bias = elf.object_type == ET_DYN; // only ET_DYN (shared libraries) needs randomization
-    ptrdiff_t map_bias = 0;                       // ELF segments are loaded at vaddr + load_bias
+    const ptrdiff_t map_bias = image->load_bias; // ELF segments are loaded at vaddr + load_bias
 
-    bool has_interpreter = false;
+    const bool has_interpreter = image->interpreter != NULL;
     ptr_t interp_entrypoint = 0;
     ptr_t auxv_phdr_vaddr = false; // whether we need to add AT_PHDR, AT_PHENT, AT_PHNUM to the auxv vector
 
-    for (size_t i = 0; i < elf.ph.count; i++)
+    for (size_t i = 0; i < image->header.ph.count; i++)
     {
-        elf_program_hdr_t ph;
-        if (!elf_read_file(file, &ph, elf.ph_offset + i * elf.ph.entry_size, elf.ph.entry_size))
-        {
-            pr_emerg("failed to read program header %zu for '%s'", i, dentry_name(file->dentry));
-            goto bad_proc;
-        }
-
-        switch (ph.header_type)
+        const elf_program_hdr_t *ph = &image->phdrs[i];
+        switch (ph->header_type)
         {
             case ELF_PT_NULL: break; // ignore
             case ELF_PT_INTERP:
             {
-                char interp_name[ph.size_in_file];
-                if (!elf_read_file(file, interp_name, ph.data_offset, ph.size_in_file))
-                {
-                    pr_emerg("failed to read interpreter name for '%s'", dentry_name(file->dentry));
-                    goto bad_proc;
-                }
-                pr_dinfo2(elf, "elf interpreter: %s", interp_name);
-                has_interpreter = true;
-                interp_entrypoint = elf_map_interpreter(interp_name, proc->mm);
+                if (interp_entrypoint)
+                    break; // only the first one counts
+
+                pr_dinfo2(elf, "elf interpreter: %s", image->interpreter);
+                interp_entrypoint = elf_map_interpreter(image->interpreter, proc->mm);
                 if (!interp_entrypoint)
                 {
-                    pr_dinfo2(elf, "failed to map interpreter '%s'", interp_name);
+                    pr_dinfo2(elf, "failed to map interpreter '%s'", image->interpreter);
                     goto bad_proc;
                 }
 
-                if (should_bias)
-                    map_bias = elf_determine_loadbias(&elf);
-
                 break;
             }
             case ELF_PT_LOAD:
             {
-                elf_map_segment(&ph, map_bias, proc->mm, file);
+                elf_map_segment(ph, map_bias, proc->mm, file);
                 break;
             }
             case ELF_PT_PHDR:
             {
-                auxv_phdr_vaddr = ph.vaddr;
+                auxv_phdr_vaddr = ph->vaddr;
                 break;
             }
 
@@ -299,12 +490,12 @@ __nodiscard bool elf_do_fill_process(process_t *proc, file_t *file, elf_header_t
             case ELF_PT_TLS: break;     // will be handled by the dynamic linker or libc
             default:
             {
-                if (IN_RANGE(ph.header_type, ELF_PT_OS_LOW, ELF_PT_OS_HIGH))
-                    pr_dinfo2(elf, "ignoring OS-specific program header type 0x%x", ph.header_type);
-                else if (IN_RANGE(ph.header_type, ELF_PT_PROCESSOR_LO, ELF_PT_PROCESSOR_HI))
-                    pr_dinfo2(elf, "ignoring processor-specific program header type 0x%x", ph.header_type);
+                if (IN_RANGE(ph->header_type, ELF_PT_OS_LOW, ELF_PT_OS_HIGH))
+                    pr_dinfo2(elf, "ignoring OS-specific program header type 0x%x", ph->header_type);
+                else if (IN_RANGE(ph->header_type, ELF_PT_PROCESSOR_LO, ELF_PT_PROCESSOR_HI))
+                    pr_dinfo2(elf, "ignoring processor-specific program header type 0x%x", ph->header_type);
                 else
-                    pr_warn("unknown program header type 0x%x", ph.header_type);
+                    pr_warn("unknown program header type 0x%x", ph->header_type);
                 break;
             }
         };
@@ -313,16 +504,18 @@ __nodiscard bool elf_do_fill_process(process_t *proc, file_t *file, elf_header_t
     if (auxv_phdr_vaddr)
     {
         add_auxv_entry(&info->auxv, AT_PHDR, map_bias + auxv_phdr_vaddr);
-        add_auxv_entry(&info->auxv, AT_PHENT, elf.ph.entry_size);
-        add_auxv_entry(&info->auxv, AT_PHNUM, elf.ph.count);
+        add_auxv_entry(&info->auxv, AT_PHENT, image->header.ph.entry_size);
+        add_auxv_entry(&info->auxv, AT_PHNUM, image->header.ph.count);
     }
 
-    add_auxv_entry(&info->auxv, AT_ENTRY, map_bias + elf.entry_point); // the entry point of the executable, not the interpreter
+    add_auxv_entry(&info->auxv, AT_ENTRY, map_bias + image->header.entry_point); // the entry point of the executable, not the interpreter
+
+    timekeeping_map_vdso(proc->mm);
 
     ptr_t user_argv, user_envp;
     thread_t *const main_thread = proc->main_thread;
     elf_setup_main_thread(main_thread, info, &user_argv, &user_envp);
-    platform_context_setup_main_thread(main_thread, has_interpreter ? interp_entrypoint : elf.entry_point, main_thread->u_stack.head, info->argc, user_argv, user_envp);
+    platform_context_setup_main_thread(main_thread, has_interpreter ? interp_entrypoint : image->header.entry_point, main_thread->u_stack.head, info->argc, user_argv, user_envp);
 
     goto done;
 
@@ -333,21 +526,19 @@ done:;
     mm_context_t *prev = mm_switch_context(prev_mm);
     MOS_UNUSED(prev);
 
+    elf_image_put(image);
     return ret;
 }
 
 bool elf_read_and_verify_executable(file_t *file, elf_header_t *header)
 {
-    if (!elf_read_file(file, header, 0, sizeof(elf_header_t)))
-        return false;
-
-    const bool valid = elf_verify_header(header);
-    if (!valid)
-        return false;
-
-    if (header->object_type != ET_EXEC && header->object_type != ET_DYN)
+    // this also populates the exec cache, so the image is ready when the process is filled
+    elf_image_t *image = elf_image_get(file);
+    if (!image)
         return false;
 
+    *header = image->header;
+    elf_image_put(image);
     return true;
 }
 
@@ -246,7 +246,7 @@ static bool cpio_i_lookup(inode_t *parent_dir, dentry_t *dentry)
     return true;
 }
 
-static void cpio_i_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, dentry_iterator_op add_record)
+static void cpio_i_iterate_dir(dentry_t *dentry, vfs_dir_context_t *ctx)
 {
     cpio_inode_t *inode = CPIO_INODE(dentry->inode);
 
@@ -259,11 +259,13 @@ static void cpio_i_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, den
         path_prefix[0] = '\0', prefix_len = 0; // root directory
 
     // find all children of this directory, that starts with 'path' and doesn't have any more slashes
+    // the position is the archive offset of the next header to look at, so resuming does not rescan the archive
     cpio_newc_header_t header;
-    size_t offset = 0;
+    size_t offset = ctx->pos - VFS_DIR_POS_START;
 
     while (true)
     {
+        const size_t header_offset = offset;
         initrd_read(&header, sizeof(cpio_newc_header_t), offset);
         offset += sizeof(cpio_newc_header_t);
 
@@ -294,11 +296,18 @@ static void cpio_i_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, den
             const char *name = filename + prefix_len + (prefix_len == 0 ? 0 : 1);          // +1 for the slash if it's not the root
             const size_t name_len = filename_len - prefix_len - (prefix_len == 0 ? 0 : 1); // -1 for the slash if it's not the root
 
-            add_record(state, ino, name, name_len, type);
+            if (!ctx->emit(ctx, ino, name, name_len, type))
+            {
+                ctx->pos = VFS_DIR_POS_START + header_offset; // retry this entry next time
+                return;
+            }
         }
 
         if (unlikely(is_TRAILER))
+        {
+            ctx->pos = VFS_DIR_POS_START + header_offset; // stay at the trailer, the directory is exhausted
             break;
+        }
 
         offset += filename_len;
         offset = ((offset + 3) & ~0x03); // align to 4 bytes
@@ -306,6 +315,7 @@ static void cpio_i_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, den
         const size_t data_len = strntoll(header.filesize, NULL, 16, sizeof(header.filesize) / sizeof(char));
         offset += data_len;
         offset = ((offset + 3) & ~0x03); // align to 4 bytes (again)
+        ctx->pos = VFS_DIR_POS_START + offset;
     }
 }
 
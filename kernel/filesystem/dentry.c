@@ -424,19 +424,7 @@ dentry_t *dentry_get(dentry_t *starting_dir, dentry_t *root_dir, const char *pat
     return child_ref;
 }
 
-static void dentry_add_dir(vfs_listdir_state_t *state, u64 ino, const char *name, size_t name_len, file_type_t type)
-{
-    vfs_listdir_entry_t *entry = kmalloc(sizeof(vfs_listdir_entry_t));
-    linked_list_init(list_node(entry));
-    entry->ino = ino;
-    entry->name = strndup(name, name_len);
-    entry->name_len = name_len;
-    entry->type = type;
-    list_node_append(&state->entries, list_node(entry));
-    state->n_count++;
-}
-
-void vfs_populate_listdir_buf(dentry_t *dir, vfs_listdir_state_t *state)
+void vfs_iterate_dir(dentry_t *dir, vfs_dir_context_t *ctx)
 {
     inode_t *d_inode = dir->inode;
 
@@ -446,14 +434,25 @@ void vfs_populate_listdir_buf(dentry_t *dir, vfs_listdir_state_t *state)
 
     MOS_ASSERT(d_parent->inode != NULL);
 
-    dentry_add_dir(state, d_inode->ino, ".", 1, FILE_TYPE_DIRECTORY);
-    dentry_add_dir(state, d_parent->inode->ino, "..", 2, FILE_TYPE_DIRECTORY);
+    if (ctx->pos == VFS_DIR_POS_DOT)
+    {
+        if (!ctx->emit(ctx, d_inode->ino, ".", 1, FILE_TYPE_DIRECTORY))
+            return;
+        ctx->pos = VFS_DIR_POS_DOTDOT;
+    }
+
+    if (ctx->pos == VFS_DIR_POS_DOTDOT)
+    {
+        if (!ctx->emit(ctx, d_parent->inode->ino, "..", 2, FILE_TYPE_DIRECTORY))
+            return;
+        ctx->pos = VFS_DIR_POS_START;
+    }
 
     MOS_ASSERT(dir->inode);
 
-    // this call may not write all the entries, because the buffer may not be big enough
+    // the filesystem stops as soon as the output buffer is full, ctx->pos is where the next call resumes
     if (dir->inode->ops && dir->inode->ops->iterate_dir)
-        dir->inode->ops->iterate_dir(dir, state, dentry_add_dir);
+        dir->inode->ops->iterate_dir(dir, ctx);
     else
-        vfs_generic_iterate_dir(dir, state, dentry_add_dir);
+        vfs_generic_iterate_dir(dir, ctx);
 }
@@ -61,6 +61,7 @@ ssize_t vfs_write_pagecache(inode_cache_t *icache, const void *buf, size_t total
 
     size_t bytes_written = 0;
     size_t bytes_left = total_size;
+    icache->generation++;
     while (bytes_left > 0)
     {
         // bytes to copy to the current page
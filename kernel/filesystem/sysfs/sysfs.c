@@ -9,6 +9,7 @@
 #include "mos/filesystem/vfs_types.h"
 #include "mos/filesystem/vfs_utils.h"
 #include "mos/mm/mm.h"
+#include "mos/mm/paging/table_ops.h"
 #include "mos/mm/physical/pmm.h"
 #include "mos/mm/slab.h"
 #include "mos/printk.h"
@@ -30,9 +31,16 @@ typedef struct _sysfs_file
     ssize_t buf_head_offset;
     ssize_t buf_npages;
 
+    // for SYSFS_SEQ items, the buffer holds the output starting at buf_file_offset
+    off_t buf_file_offset;
+    u64 seq_cursor;
+    bool seq_eof;
+
     void *data;
 } sysfs_file_t;
 
+#define SYSFS_SEQ_CHUNK_SIZE (MOS_PAGE_SIZE / 2) // generate records until at least this much output is buffered
+
 static list_head sysfs_dirs = LIST_HEAD_INIT(sysfs_dirs);
 static filesystem_t fs_sysfs;
 static superblock_t *sysfs_sb = NULL;
@@ -59,8 +67,8 @@ static void sysfs_expand_buffer(sysfs_file_t *file, size_t new_npages)
     phyframe_t *oldbuf_page = file->buf_page;
     const size_t oldbuf_npages = file->buf_npages;
 
-    // We need to allocate more pages
-    file->buf_npages = new_npages;
+    // grow geometrically, so that a large output is not copied once per page
+    file->buf_npages = MAX(new_npages, oldbuf_npages * 2);
     file->buf_page = mm_get_free_pages(file->buf_npages);
 
     if (oldbuf_page)
@@ -120,6 +128,9 @@ static bool sysfs_fops_open(inode_t *i, file_t *file, bool create)
     f->buf_page = NULL;
     f->buf_npages = 0;
     f->buf_head_offset = 0;
+    f->buf_file_offset = 0;
+    f->seq_cursor = 0;
+    f->seq_eof = false;
     return true;
 }
 
@@ -129,6 +140,8 @@ static void sysfs_fops_release(file_t *file)
     sysfs_file_t *f = file->dentry->inode->private;
     if (f->buf_page)
         mm_free_pages(f->buf_page, f->buf_npages);
+    f->buf_page = NULL;
+    f->buf_npages = 0;
 }
 
 __nodiscard static bool sysfs_file_ensure_ready(const file_t *file)
@@ -143,9 +156,60 @@ __nodiscard static bool sysfs_file_ensure_ready(const file_t *file)
     return true;
 }
 
+/**
+ * @brief Make sure the buffer of a SYSFS_SEQ file contains the output at offset
+ *
+ * @return false if offset is past the end of the output
+ */
+static bool sysfs_seq_fill(sysfs_file_t *f, off_t offset)
+{
+    if (offset < f->buf_file_offset)
+    {
+        // seeking backwards, regenerate the output from the start
+        f->buf_file_offset = 0;
+        f->buf_head_offset = 0;
+        f->seq_cursor = 0;
+        f->seq_eof = false;
+    }
+
+    while (offset >= f->buf_file_offset + f->buf_head_offset)
+    {
+        // the buffered chunk has been consumed, reuse the buffer for the next one
+        f->buf_file_offset += f->buf_head_offset;
+        f->buf_head_offset = 0;
+
+        if (f->seq_eof)
+        {
+            // only a streaming file (e.g. /sys/kmsg) may have grown since its end was reached
+            if (!f->item->seq.streaming)
+                return false;
+            f->seq_eof = false;
+        }
+
+        while (!f->seq_eof && f->buf_head_offset < SYSFS_SEQ_CHUNK_SIZE)
+            f->seq_eof = !f->item->seq.next(f, &f->seq_cursor);
+
+        if (f->buf_head_offset == 0)
+            return false;
+    }
+
+    return true;
+}
+
 static ssize_t sysfs_fops_read(const file_t *file, void *buf, size_t size, off_t offset)
 {
     sysfs_file_t *f = file->dentry->inode->private;
+    if (f->item->type == SYSFS_SEQ)
+    {
+        if (!sysfs_seq_fill(f, offset))
+            return 0;
+
+        const size_t begin = offset - f->buf_file_offset;
+        const size_t end = MIN(begin + size, (size_t) f->buf_head_offset);
+        memcpy((char *) buf, (char *) phyframe_va(f->buf_page) + begin, end - begin);
+        return end - begin;
+    }
+
     if (f->item->type != SYSFS_RO && f->item->type != SYSFS_RW)
         return -ENOTSUP;
 
@@ -184,8 +248,8 @@ static off_t sysfs_fops_seek(file_t *file, off_t offset, io_seek_whence_t whence
 
     sysfs_file_t *f = file->dentry->inode->private;
 
-    if (f->item->type == SYSFS_MEM)
-        return -1;
+    if (f->item->type == SYSFS_MEM || f->item->type == SYSFS_SEQ)
+        return -1; // the size of a streamed file is not known in advance
 
     if (!sysfs_file_ensure_ready(file))
         return -1;
@@ -203,6 +267,10 @@ bool sysfs_fops_mmap(file_t *file, vmap_t *vmap, off_t offset)
     {
         return f->item->mem.mmap(f, vmap, offset);
     }
+    else if (f->item->type == SYSFS_SEQ)
+    {
+        return false; // streamed files cannot be mapped
+    }
     else
     {
         if (!sysfs_file_ensure_ready(file))
@@ -236,13 +304,32 @@ static const file_ops_t sysfs_file_ops = {
     .munmap = sysfs_fops_munmap,
 };
 
-static void sysfs_iops_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, dentry_iterator_op add_record)
+#define SYSFS_DYN_POS_SHIFT 32 // each dynamic item owns 2^32 positions
+
+typedef struct
+{
+    vfs_dir_context_t ctx; // the context seen by the dynamic item
+    vfs_dir_context_t *parent;
+    u64 base; // the position of the first entry of the dynamic item in the parent context
+    bool full;
+} sysfs_dyn_dir_context_t;
+
+static bool sysfs_dyn_emit(vfs_dir_context_t *ctx, u64 ino, const char *name, size_t name_len, file_type_t type)
+{
+    sysfs_dyn_dir_context_t *dynctx = container_of(ctx, sysfs_dyn_dir_context_t, ctx);
+    dynctx->parent->pos = dynctx->base + ctx->pos - VFS_DIR_POS_START;
+    if (!dynctx->parent->emit(dynctx->parent, ino, name, name_len, type))
+        return dynctx->full = true, false;
+    return true;
+}
+
+static void sysfs_iops_iterate_dir(dentry_t *dentry, vfs_dir_context_t *ctx)
 {
     // root directory
     if (dentry->inode == sysfs_sb->root->inode)
     {
         // list all the directories in the dcache
-        vfs_generic_iterate_dir(dentry, state, add_record);
+        vfs_generic_iterate_dir(dentry, ctx);
         return;
     }
 
@@ -252,24 +339,53 @@ static void sysfs_iops_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state,
     // non-dynamic directory
     if (list_is_empty(&dir->_dynamic_items))
     {
-        vfs_generic_iterate_dir(dentry, state, add_record);
+        vfs_generic_iterate_dir(dentry, ctx);
         return;
     }
 
+    // static items are addressed by their index, the dynamic items take over after them
+    u64 pos = VFS_DIR_POS_START;
     for (size_t j = 0; j < dir->num_items; j++)
     {
         sysfs_item_t *item = &dir->items[j];
         if (item->type == _SYSFS_INVALID || item->type == SYSFS_DYN)
             continue;
 
-        add_record(state, item->ino, item->name, strlen(item->name), FILE_TYPE_REGULAR);
+        if (pos++ < ctx->pos)
+            continue;
+
+        if (!ctx->emit(ctx, item->ino, item->name, strlen(item->name), FILE_TYPE_REGULAR))
+            return;
+
+        ctx->pos = pos;
     }
 
-    // iterate the dynamic items
+    // iterate the dynamic items, each of them gets its own range of positions after the static items
+    const u64 dyn_base = pos;
+    u64 dyn_index = 0;
     list_node_foreach(item_node, &dir->_dynamic_items)
     {
+        const u64 base = dyn_base + (dyn_index++ << SYSFS_DYN_POS_SHIFT);
+        const u64 next_base = base + (1ULL << SYSFS_DYN_POS_SHIFT);
+        if (ctx->pos >= next_base)
+            continue; // this item has been fully listed
+
+        sysfs_dyn_dir_context_t dynctx = {
+            .ctx = { .pos = MAX(ctx->pos, base) - base + VFS_DIR_POS_START, .emit = sysfs_dyn_emit },
+            .parent = ctx,
+            .base = base,
+        };
+
         sysfs_item_t *const dynitem = container_of(item_node, sysfs_item_t, dyn.list_node);
-        dynitem->dyn.iterate(dynitem, dentry, state, add_record);
+        dynitem->dyn.iterate(dynitem, dentry, &dynctx.ctx);
+
+        if (dynctx.full)
+        {
+            ctx->pos = base + dynctx.ctx.pos - VFS_DIR_POS_START;
+            return;
+        }
+
+        ctx->pos = next_base;
     }
 }
 
@@ -401,6 +517,7 @@ void sysfs_register_file(sysfs_dir_t *sysfs_dir, sysfs_item_t *item, void *data)
         case _SYSFS_INVALID: MOS_UNREACHABLE();
         case SYSFS_DYN: MOS_UNREACHABLE();
         case SYSFS_RO: file_i->perm |= PERM_READ; break;
+        case SYSFS_SEQ: file_i->perm |= PERM_READ; break;
         case SYSFS_RW: file_i->perm |= PERM_READ | PERM_WRITE; break;
         case SYSFS_WO: file_i->perm |= PERM_WRITE; break;
         case SYSFS_MEM:
@@ -417,6 +534,46 @@ void sysfs_register_file(sysfs_dir_t *sysfs_dir, sysfs_item_t *item, void *data)
     dentry_create(sysfs_sb, target_dentry, item->name)->inode = file_i;
 }
 
+static bool sysfs_counters_mmap(sysfs_file_t *f, vmap_t *vmap, off_t offset)
+{
+    if (offset != 0 || vmap->npages != 1)
+        return false; // there is exactly one page of counters
+    if (vmap->vmflags & VM_WRITE)
+        return false; // counter pages are read-only
+
+    const phyframe_t *page = sysfs_file_get_data(f);
+    mm_do_map(vmap->mmctx->pgd, vmap->vaddr, phyframe_pfn(page), 1, vmap->vmflags, false); // no need to refcount
+    return true;
+}
+
+static bool sysfs_counters_munmap(sysfs_file_t *f, vmap_t *vmap, bool *unmapped)
+{
+    MOS_UNUSED(f);
+    mm_do_unmap(vmap->mmctx->pgd, vmap->vaddr, vmap->npages, false);
+    *unmapped = true;
+    return true;
+}
+
+sysfs_counters_t *sysfs_register_counters(sysfs_dir_t *sysfs_dir, const char *name, size_t ncounters)
+{
+    MOS_ASSERT_X(sizeof(sysfs_counters_t) + ncounters * sizeof(u64) <= MOS_PAGE_SIZE, "too many counters for '%s'", name);
+
+    phyframe_t *page = mm_get_free_page();
+    if (!page)
+        mos_panic("failed to allocate the counter page for '%s'", name);
+    pmm_ref_one(page); // the page lives as long as the kernel
+
+    sysfs_counters_t *counters = (sysfs_counters_t *) phyframe_va(page);
+    counters->magic = SYSFS_COUNTERS_MAGIC;
+    counters->ncounters = ncounters;
+
+    sysfs_item_t *item = kmalloc(sizeof(sysfs_item_t));
+    *item = (sysfs_item_t) SYSFS_MEM_ITEM(name, sysfs_counters_mmap, sysfs_counters_munmap);
+    item->mem.size = MOS_PAGE_SIZE;
+    sysfs_register_file(sysfs_dir, item, page);
+    return counters;
+}
+
 static void register_sysfs(void)
 {
     vfs_register_filesystem(&fs_sysfs);
@@ -95,7 +95,7 @@ static bool userfs_iop_hardlink(dentry_t *d, inode_t *i, dentry_t *new_d)
     return false;
 }
 
-static void userfs_iop_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state, dentry_iterator_op add_record)
+static void userfs_iop_iterate_dir(dentry_t *dentry, vfs_dir_context_t *ctx)
 {
     userfs_t *userfs = container_of(dentry->superblock->fs, userfs_t, fs);
     mos_rpc_fs_readdir_request req = { 0 };
@@ -106,7 +106,7 @@ static void userfs_iop_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state,
 
     const pf_point_t ev = profile_enter();
     const int result = fs_client_readdir(userfs->rpc_server, &req, &resp);
-    profile_leave(ev, "userfs.'%s'.readdir", userfs->rpc_server_name);
+    profile_leave(ev, "userfs.readdir", dentry->inode->ino);
 
     if (result != RPC_RESULT_OK)
     {
@@ -120,11 +120,14 @@ static void userfs_iop_iterate_dir(dentry_t *dentry, vfs_listdir_state_t *state,
         goto bail_out;
     }
 
-    for (size_t i = 0; i < resp.entries_count; i++)
+    // the server returns the whole directory, the position is the index into it
+    for (size_t i = ctx->pos - VFS_DIR_POS_START; i < resp.entries_count; i++)
     {
         const pb_dirent *pbde = &resp.entries[i];
         MOS_ASSERT(pbde->name);
-        add_record(state, pbde->ino, pbde->name, strlen(pbde->name), (file_type_t) pbde->type);
+        if (!ctx->emit(ctx, pbde->ino, pbde->name, strlen(pbde->name), (file_type_t) pbde->type))
+            break;
+        ctx->pos = VFS_DIR_POS_START + i + 1;
     }
 
 bail_out:
@@ -144,7 +147,7 @@ static bool userfs_iop_lookup(inode_t *dir, dentry_t *dentry)
 
     const pf_point_t ev = profile_enter();
     const int result = fs_client_lookup(userfs->rpc_server, &req, &resp);
-    profile_leave(ev, "userfs.'%s'.lookup", userfs->rpc_server_name);
+    profile_leave(ev, "userfs.lookup", dir->ino);
 
     if (result != RPC_RESULT_OK)
     {
@@ -209,7 +212,7 @@ static size_t userfs_iop_readlink(dentry_t *dentry, char *buffer, size_t buflen)
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_readlink(userfs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.readlink", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.readlink", dentry->inode->ino);
 
     if (result != RPC_RESULT_OK)
     {
@@ -312,7 +315,7 @@ static phyframe_t *userfs_inode_cache_fill_cache(inode_cache_t *cache, off_t pgo
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_getpage(userfs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.getpage", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.getpage", pgoff);
 
     if (result != RPC_RESULT_OK)
     {
@@ -364,7 +367,7 @@ dentry_t *userfs_fsop_mount(filesystem_t *fs, const char *device, const char *op
 
     const pf_point_t pp = profile_enter();
     const int result = fs_client_mount(userfs->rpc_server, &req, &resp);
-    profile_leave(pp, "userfs.'%s'.mount", userfs->rpc_server_name);
+    profile_leave(pp, "userfs.mount", 0);
 
     if (result != RPC_RESULT_OK)
     {
@@ -20,6 +20,7 @@
 #include <mos/lib/structures/list.h>
 #include <mos/lib/structures/tree.h>
 #include <mos/lib/sync/spinlock.h>
+#include <mos/locks/rcu.h>
 #include <mos/mos_global.h>
 #include <mos/platform/platform.h>
 #include <mos/printk.h>
@@ -29,7 +30,7 @@
 #include <mos_string.h>
 
 static list_head vfs_fs_list = LIST_HEAD_INIT(vfs_fs_list); // filesystem_t
-static spinlock_t vfs_fs_list_lock = SPINLOCK_INIT;
+static spinlock_t vfs_fs_list_lock = SPINLOCK_INIT; // serialises writers, readers use RCU
 
 dentry_t *root_dentry = NULL;
 
@@ -52,27 +53,6 @@ static void vfs_io_ops_close(io_t *io)
     kfree(file);
 }
 
-static void vfs_io_ops_close_dir(io_t *io)
-{
-    file_t *file = container_of(io, file_t, io);
-
-    if (file->private_data)
-    {
-        vfs_listdir_state_t *state = file->private_data;
-        list_foreach(vfs_listdir_entry_t, entry, state->entries)
-        {
-            list_remove(entry);
-            kfree(entry->name);
-            kfree(entry);
-        }
-
-        kfree(state);
-        file->private_data = NULL;
-    }
-
-    vfs_io_ops_close(io); // close the file
-}
-
 static size_t vfs_io_ops_read(io_t *io, void *buf, size_t count)
 {
     file_t *file = container_of(io, file_t, io);
@@ -231,9 +211,30 @@ static const io_op_t file_io_ops = {
     .get_name = vfs_op_ops_getname,
 };
 
+static off_t vfs_io_ops_seek_dir(io_t *io, off_t offset, io_seek_whence_t whence)
+{
+    // the offset of a directory is an opaque position cookie, only seeking to a previously returned cookie makes sense
+    file_t *file = container_of(io, file_t, io);
+
+    spinlock_acquire(&file->offset_lock);
+    switch (whence)
+    {
+        case IO_SEEK_SET: file->offset = MAX(offset, 0); break;
+        case IO_SEEK_CURRENT:
+            if (offset != 0)
+                mos_warn("vfs: relative seeking in a directory is not supported");
+            break;
+        default: mos_warn("vfs: unsupported seek type %d for directories", whence); break;
+    }
+    const off_t ret = file->offset;
+    spinlock_release(&file->offset_lock);
+    return ret;
+}
+
 static const io_op_t dir_io_ops = {
     .read = vfs_list_dir,
-    .close = vfs_io_ops_close_dir,
+    .close = vfs_io_ops_close,
+    .seek = vfs_io_ops_seek_dir,
     .get_name = vfs_op_ops_getname,
 };
 
@@ -259,8 +260,8 @@ static void vfs_copy_stat(file_stat_t *statbuf, inode_t *inode)
 static filesystem_t *vfs_find_filesystem(const char *name)
 {
     filesystem_t *fs_found = NULL;
-    spinlock_acquire(&vfs_fs_list_lock);
-    list_foreach(filesystem_t, fs, vfs_fs_list)
+    rcu_read_lock();
+    list_foreach_rcu(filesystem_t, fs, vfs_fs_list)
     {
         if (strcmp(fs->name, name) == 0)
         {
@@ -268,8 +269,8 @@ static filesystem_t *vfs_find_filesystem(const char *name)
             break;
         }
     }
-    spinlock_release(&vfs_fs_list_lock);
-    return fs_found;
+    rcu_read_unlock();
+    return fs_found; // filesystems are never unregistered
 }
 
 static bool vfs_verify_permissions(dentry_t *file_dentry, bool open, bool read, bool create, bool execute, bool write)
@@ -350,7 +351,7 @@ static file_t *vfs_do_open(dentry_t *base, const char *path, open_flags flags)
         io_flags |= IO_MMAPABLE;
 
     if (file->dentry->inode->type == FILE_TYPE_DIRECTORY)
-        io_init(&file->io, IO_DIR, (io_flags | IO_READABLE) & ~IO_SEEKABLE, &dir_io_ops);
+        io_init(&file->io, IO_DIR, io_flags | IO_READABLE | IO_SEEKABLE, &dir_io_ops);
     else
         io_init(&file->io, IO_FILE, io_flags, &file_io_ops);
 
@@ -373,7 +374,7 @@ static file_t *vfs_do_open(dentry_t *base, const char *path, open_flags flags)
 void vfs_register_filesystem(filesystem_t *fs)
 {
     spinlock_acquire(&vfs_fs_list_lock);
-    list_node_append(&vfs_fs_list, list_node(fs));
+    list_node_append_rcu(&vfs_fs_list, list_node(fs));
     spinlock_release(&vfs_fs_list_lock);
 
     pr_dinfo2(vfs, "filesystem '%s' registered", fs->name);
@@ -622,6 +623,23 @@ long vfs_rmdir(const char *path)
     return removed ? 0 : -EIO;
 }
 
+static bool vfs_list_dir_emit(vfs_dir_context_t *ctx, u64 ino, const char *name, size_t name_len, file_type_t type)
+{
+    const size_t entry_size = ALIGN_UP(offsetof(struct dirent, d_name) + name_len + 1, __alignof__(struct dirent)); // +1 for the null terminator
+    if (ctx->written + entry_size > ctx->buf_size)
+        return false;
+
+    struct dirent *dirent = (struct dirent *) ((char *) ctx->buf + ctx->written);
+    dirent->d_ino = ino;
+    dirent->d_type = type;
+    dirent->d_reclen = entry_size;
+    dirent->d_off = ctx->pos; // the cookie of this entry, seeking to it lists this entry again
+    memcpy(dirent->d_name, name, name_len);
+    dirent->d_name[name_len] = '\0';
+    ctx->written += entry_size;
+    return true;
+}
+
 size_t vfs_list_dir(io_t *io, void *user_buf, size_t user_size)
 {
     pr_dinfo2(vfs, "vfs_list_dir(io=%p, buf=%p, size=%zu)", (void *) io, (void *) user_buf, user_size);
@@ -632,45 +650,25 @@ size_t vfs_list_dir(io_t *io, void *user_buf, size_t user_size)
         return 0;
     }
 
-    if (file->private_data == NULL)
-    {
-        vfs_listdir_state_t *const state = file->private_data = kmalloc(sizeof(vfs_listdir_state_t));
-        linked_list_init(&state->entries);
-        state->n_count = state->read_offset = 0;
-        vfs_populate_listdir_buf(file->dentry, state);
-    }
-
-    vfs_listdir_state_t *const state = file->private_data;
-
-    if (state->read_offset >= state->n_count)
-        return 0; // no more entries
-
-    size_t bytes_copied = 0;
-    size_t i = 0;
-    list_foreach(vfs_listdir_entry_t, entry, state->entries)
-    {
-        if (i++ < state->read_offset)
-            continue; // skip the entries we have already read
+    vfs_dir_context_t ctx = {
+        .emit = vfs_list_dir_emit,
+        .buf = user_buf,
+        .buf_size = user_size,
+        .written = 0,
+    };
 
-        if (state->read_offset >= state->n_count)
-            break;
+    // the filesystem may block (e.g. userfs), so the offset lock is not held across the iteration
+    spinlock_acquire(&file->offset_lock);
+    ctx.pos = file->offset;
+    spinlock_release(&file->offset_lock);
 
-        const size_t entry_size = sizeof(ino_t) + sizeof(off_t) + sizeof(short) + sizeof(char) + entry->name_len + 1; // +1 for the null terminator
-        if (bytes_copied + entry_size > user_size)
-            break;
+    vfs_iterate_dir(file->dentry, &ctx);
 
-        struct dirent *dirent = (struct dirent *) (((char *) user_buf) + bytes_copied);
-        dirent->d_ino = entry->ino;
-        dirent->d_type = entry->type;
-        dirent->d_reclen = entry_size;
-        dirent->d_off = entry_size - 1;
-        memcpy(dirent->d_name, entry->name, entry->name_len);
-        dirent->d_name[entry->name_len] = '\0';
-        bytes_copied += entry_size;
-        state->read_offset++;
-    }
+    spinlock_acquire(&file->offset_lock);
+    file->offset = ctx.pos;
+    spinlock_release(&file->offset_lock);
 
-    return bytes_copied;
+    return ctx.written;
 }
 
 long vfs_chdir(const char *path)
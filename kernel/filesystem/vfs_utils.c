@@ -21,6 +21,7 @@ dentry_t *dentry_create(superblock_t *sb, dentry_t *parent, const char *name)
 {
     dentry_t *dentry = kmalloc(dentry_cache);
     dentry->superblock = sb;
+    dentry->next_child_pos = VFS_DIR_POS_START;
     tree_node_init(tree_node(dentry));
 
     if (name)
@@ -28,6 +29,8 @@ dentry_t *dentry_create(superblock_t *sb, dentry_t *parent, const char *name)
 
     if (parent)
     {
+        // children are appended, so their positions are ascending in the order they are listed
+        dentry->dir_pos = parent->next_child_pos++;
         tree_add_child(tree_node(parent), tree_node(dentry));
         dentry->superblock = parent->superblock;
     }
@@ -82,11 +85,18 @@ bool vfs_simple_write_begin(inode_cache_t *icache, off_t offset, size_t size)
     return true;
 }
 
-void vfs_generic_iterate_dir(const dentry_t *dir, vfs_listdir_state_t *state, dentry_iterator_op add_record)
+void vfs_generic_iterate_dir(const dentry_t *dir, vfs_dir_context_t *ctx)
 {
+    // the position of a child is given when it's created, so creating or removing others doesn't move it
     tree_foreach_child(dentry_t, child, dir)
     {
-        if (child->inode)
-            add_record(state, child->inode->ino, child->name, strlen(child->name), child->inode->type);
+        if (!child->inode || child->dir_pos < ctx->pos)
+            continue;
+
+        ctx->pos = child->dir_pos;
+        if (!ctx->emit(ctx, child->inode->ino, child->name, strlen(child->name), child->inode->type))
+            return;
+
+        ctx->pos = child->dir_pos + 1;
     }
 }
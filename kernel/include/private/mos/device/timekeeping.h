@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "mos/platform/platform.h"
+
+#include <mos/mm/mm_types.h>
+#include <mos/types.h>
+
+/**
+ * @brief Start keeping wall-clock time with the platform's free-running counter (i.e. platform_get_timestamp()).
+ *
+ * @param frequency The frequency of the counter, in Hz.
+ * @param reliable Whether the counter runs at a constant rate and is synchronised across CPUs.
+ *
+ * @details The wall-clock time is read once from platform_get_time(), then extrapolated with the counter.
+ * The parameters are also published in the vDSO data page, so that userspace can read the time without a syscall.
+ */
+void timekeeping_init(u64 frequency, bool reliable);
+
+/**
+ * @brief Get the current time, in nanoseconds since the Unix epoch.
+ */
+u64 timekeeping_now_ns(void);
+
+/**
+ * @brief Convert a value of the platform's counter to nanoseconds since it started counting, 0 if it isn't calibrated yet.
+ */
+u64 timekeeping_counter_to_ns(u64 counter);
+
+/**
+ * @brief Map the (read-only) vDSO data page into a user address space, at MOS_VDSO_DATA_VADDR.
+ */
+void timekeeping_map_vdso(mm_context_t *mm);
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/lib/structures/list.h>
+#include <mos/lib/sync/spinlock.h>
+#include <mos/types.h>
+
+#define KTIMER_WHEEL_BITS   6
+#define KTIMER_WHEEL_SLOTS  (1 << KTIMER_WHEEL_BITS)
+#define KTIMER_WHEEL_LEVELS 4 // level N has a granularity of 64^N ticks, the whole wheel spans 2^24 ticks (4.6 hours at 1 kHz)
+
+typedef struct _ktimer ktimer_t;
+typedef struct _ktimer_wheel ktimer_wheel_t;
+
+typedef void (*ktimer_callback_t)(ktimer_t *timer, void *arg);
+
+typedef struct _ktimer
+{
+    as_linked_list;
+    u64 deadline;               ///< the clocksource tick at which the timer fires
+    ktimer_callback_t callback; ///< called without any lock held, possibly from the timer interrupt
+    void *arg;
+    ktimer_wheel_t *wheel; ///< the wheel the timer is pending on, NULL if it's not pending
+    bool running;          ///< the callback is being called
+    u32 running_cpu;       ///< the CPU calling it, valid while 'running' is set
+} ktimer_t;
+
+/**
+ * @brief A hierarchical timer wheel.
+ *
+ * @details Timers due within 64 ticks are kept in level 0, one slot per tick. Later timers are kept in
+ * coarser levels, and are moved down a level (cascaded) when the wheel reaches their slot. So adding,
+ * cancelling and expiring a timer are all O(1), no matter how many timers are pending.
+ */
+typedef struct _ktimer_wheel
+{
+    spinlock_t lock;
+    u64 now; ///< the next tick to be processed
+    list_head slots[KTIMER_WHEEL_LEVELS][KTIMER_WHEEL_SLOTS];
+} ktimer_wheel_t;
+
+void ktimer_init(ktimer_t *timer, ktimer_callback_t callback, void *arg);
+
+void ktimer_wheel_init(ktimer_wheel_t *wheel, u64 now);
+void ktimer_wheel_add(ktimer_wheel_t *wheel, ktimer_t *timer, u64 deadline);
+
+/**
+ * @brief Run the callbacks of all timers on the wheel that are due at or before 'now'.
+ *
+ * @return the number of timers that have fired
+ */
+size_t ktimer_wheel_advance(ktimer_wheel_t *wheel, u64 now);
+
+/**
+ * @brief Arm a timer on the current CPU's wheel.
+ *
+ * @param deadline The tick of the active clocksource at which the timer fires.
+ */
+void ktimer_add(ktimer_t *timer, u64 deadline);
+void ktimer_add_ms(ktimer_t *timer, u64 ms);
+
+/**
+ * @brief Disarm a timer, and wait for its callback if it is running on another CPU.
+ *
+ * @note The callback may cancel its own timer (e.g. after re-arming it), this returns without waiting for it.
+ *
+ * @return true if the timer was pending, i.e. its callback has not been (and will not be) called
+ */
+bool ktimer_cancel(ktimer_t *timer);
+
+/**
+ * @brief Fire all timers that are due, called by the clocksource on every tick.
+ */
+void ktimer_tick(u64 now);
+
+/**
+ * @brief Block the current thread until it is woken up, or 'ms' milliseconds have passed.
+ *
+ * @return true if the thread was woken up by the deadline, false if it was woken up by something else first
+ */
+bool ktimer_block_current(u64 ms);
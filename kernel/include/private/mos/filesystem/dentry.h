@@ -165,14 +165,14 @@ __nodiscard bool dentry_mount(dentry_t *mountpoint, dentry_t *root, filesystem_t
 __nodiscard dentry_t *dentry_unmount(dentry_t *root);
 
 /**
- * @brief List the contents of a directory
+ * @brief Iterate over the contents of a directory
  *
  * @param dir The directory to list
- * @param state The state of the directory iterator
+ * @param ctx The iteration context, entries are emitted starting from ctx->pos
  *
- * @return The number of bytes written to the buffer, which is contained in the state object
+ * @note The iteration stops when ctx->emit returns false, ctx->pos is then the position of the first entry that was not emitted.
  */
-void vfs_populate_listdir_buf(dentry_t *dir, vfs_listdir_state_t *state);
+void vfs_iterate_dir(dentry_t *dir, vfs_dir_context_t *ctx);
 
 /**
  * @brief Get the path of a dentry
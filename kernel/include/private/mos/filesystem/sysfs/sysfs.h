@@ -15,6 +15,7 @@ typedef enum
     SYSFS_WO,
     SYSFS_MEM, ///< memory-backed file
     SYSFS_DYN, ///< dynamic directory items
+    SYSFS_SEQ, ///< read-only file whose content is generated in chunks as it is read
 } sysfs_item_type_t;
 
 typedef struct _sysfs_item
@@ -34,10 +35,17 @@ typedef struct _sysfs_item
             size_t size;
         } mem;
 
+        struct
+        {
+            /// print the record(s) at *cursor and advance it, return false if there are no more records
+            bool (*next)(sysfs_file_t *file, u64 *cursor);
+            bool streaming; ///< the file may grow after its end was reached, so reading past the end polls the generator again
+        } seq;
+
         struct
         {
             as_linked_list;
-            void (*iterate)(struct _sysfs_item *item, dentry_t *dentry, vfs_listdir_state_t *iterator_state, dentry_iterator_op op);
+            void (*iterate)(struct _sysfs_item *item, dentry_t *dentry, vfs_dir_context_t *ctx);
             bool (*lookup)(inode_t *parent_dir, dentry_t *dentry);
             bool (*create)(inode_t *parent_dir, dentry_t *dentry, file_type_t type, file_perm_t perm);
         } dyn;
@@ -49,6 +57,8 @@ typedef struct _sysfs_item
 #define SYSFS_RW_ITEM(_name, _show_fn, _store_fn) { .name = _name, .type = SYSFS_RW, .show = _show_fn, .store = _store_fn }
 #define SYSFS_WO_ITEM(_name, _store_fn) { .name = _name, .type = SYSFS_WO, .store = _store_fn }
 #define SYSFS_MEM_ITEM(_name, _mmap_fn, _munmap_fn) { .name = _name, .type = SYSFS_MEM, .mem.mmap = _mmap_fn, .mem.munmap = _munmap_fn }
+#define SYSFS_SEQ_ITEM(_name, _next_fn) { .name = _name, .type = SYSFS_SEQ, .seq.next = _next_fn }
+#define SYSFS_SEQ_STREAM_ITEM(_name, _next_fn) { .name = _name, .type = SYSFS_SEQ, .seq.next = _next_fn, .seq.streaming = true }
 #define SYSFS_DYN_ITEMS(_name, _iterate_fn, _lookup_fn) { .type = SYSFS_DYN, .dyn.iterate = _iterate_fn, .dyn.lookup = _lookup_fn }
 #define SYSFS_DYN_DIR(_name, _iterate_fn, _lookup_fn, _create_fn) { .type = SYSFS_DYN, .dyn.iterate = _iterate_fn, .dyn.lookup = _lookup_fn, .dyn.create = _create_fn }
 // clang-format on
@@ -93,5 +103,16 @@ void *sysfs_file_get_data(sysfs_file_t *file);
 
 inode_t *sysfs_create_inode(file_type_t type, void *data);
 
+/**
+ * @brief Register a read-only, mmap-able page of live counters
+ *
+ * @param sysfs_dir The directory to register the file in, NULL for the root directory
+ * @param name The name of the file
+ * @param ncounters The number of counters in the page
+ *
+ * @return The counter page, the caller updates the counters in place
+ */
+sysfs_counters_t *sysfs_register_counters(sysfs_dir_t *sysfs_dir, const char *name, size_t ncounters);
+
 __printf(2, 3) ssize_t sysfs_printf(sysfs_file_t *file, const char *fmt, ...);
 ssize_t sysfs_put_data(sysfs_file_t *file, const void *data, size_t count);
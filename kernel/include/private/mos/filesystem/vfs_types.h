@@ -25,30 +25,34 @@ typedef struct _superblock superblock_t;
 typedef struct _filesystem filesystem_t;
 typedef struct _file file_t;
 
-typedef struct
-{
-    as_linked_list;
-    ino_t ino;
-    const char *name;
-    size_t name_len;
-    file_type_t type;
-} vfs_listdir_entry_t;
+typedef struct _vfs_dir_context vfs_dir_context_t;
 
-typedef struct
-{
-    list_head entries;
-    size_t n_count;     ///< number of entries in the list
-    size_t read_offset; ///< user has read up to this offset, start from this offset when reading more entries
-} vfs_listdir_state_t;
+/**
+ * @brief Emit one directory entry into the output of a directory iteration
+ *
+ * @return true if the entry was accepted, false if the output is full and the iteration should stop
+ */
+typedef bool(vfs_dir_emit_t)(vfs_dir_context_t *ctx, u64 ino, const char *name, size_t name_len, file_type_t type);
 
-typedef void(dentry_iterator_op)(vfs_listdir_state_t *state, u64 ino, const char *name, size_t name_len, file_type_t type);
+#define VFS_DIR_POS_DOT    0 ///< the position of the "." entry
+#define VFS_DIR_POS_DOTDOT 1 ///< the position of the ".." entry
+#define VFS_DIR_POS_START  2 ///< the first position that is owned by the filesystem
+
+typedef struct _vfs_dir_context
+{
+    u64 pos;              ///< opaque position cookie, the filesystem advances it past every entry it has emitted
+    vfs_dir_emit_t *emit; ///< the emit function, which writes the entry to the output buffer
+    void *buf;            ///< the output buffer
+    size_t buf_size;      ///< the size of the output buffer
+    size_t written;       ///< the number of bytes written to the output buffer
+} vfs_dir_context_t;
 
 typedef struct
 {
     /// create a hard link
     bool (*hardlink)(dentry_t *old_dentry, inode_t *dir, dentry_t *new_dentry);
-    /// iterate over the contents of a directory
-    void (*iterate_dir)(dentry_t *dentry, vfs_listdir_state_t *iterator_state, dentry_iterator_op op);
+    /// iterate over the contents of a directory, starting from ctx->pos, until ctx->emit returns false
+    void (*iterate_dir)(dentry_t *dentry, vfs_dir_context_t *ctx);
     /// lookup a file in a directory, if it's unset for a directory, the VFS will use the default lookup
     bool (*lookup)(inode_t *dir, dentry_t *dentry);
     /// create a new directory
@@ -104,7 +108,9 @@ typedef struct _dentry
     const char *name;         // for a mounted root, this is NULL
     superblock_t *superblock; // The root of the dentry tree
     bool is_mountpoint;
-    void *private; // fs-specific data
+    u64 dir_pos;        // the position of this entry when its parent is listed, it never changes
+    u64 next_child_pos; // the position the next child that is created gets
+    void *private;      // fs-specific data
 } dentry_t;
 
 #define dentry_name(dentry)                                                                                                                                              \
@@ -130,6 +136,7 @@ typedef struct _inode_cache
     inode_t *owner;
     hashmap_t pages; // page index -> phyframe_t *
     const inode_cache_ops_t *ops;
+    u64 generation; // bumped on every write through the cache, for caches derived from the content
 } inode_cache_t;
 
 typedef struct _inode
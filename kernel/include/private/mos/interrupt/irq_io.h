@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include "mos/io/io.h"
+
+#include <mos/device/irq_types.h>
+#include <mos/types.h>
+
+/**
+ * @brief Open an IRQ object for a legacy interrupt line, which no one else may be using.
+ *
+ * @param irq The IRQ number of the line, e.g. the 'Interrupt Line' register of a PCI device
+ * @param cpu The CPU that receives the interrupt, or IRQ_CPU_ANY
+ * @return An io_t for the interrupt, or an error code on failure
+ */
+io_t *irq_io_open(u32 irq, u32 cpu);
+
+/**
+ * @brief Allocate a message-signalled interrupt, and open an IRQ object for it.
+ *
+ * @param cpu The CPU that receives the interrupt, or IRQ_CPU_ANY
+ * @param message Receives what the device has to be programmed with
+ * @return An io_t for the interrupt, or an error code on failure
+ */
+io_t *irq_io_msi_open(u32 cpu, msi_message_t *message);
+
+/**
+ * @brief Deliver the interrupt of an IRQ object to another CPU.
+ *
+ * @param message For an MSI, receives the new message, the device keeps using the old one until it's reprogrammed
+ */
+long irq_io_set_affinity(io_t *io, u32 cpu, msi_message_t *message);
@@ -19,6 +19,8 @@ typedef enum
     IO_IPC,     // an IPC channel
     IO_PIPE,    // an end of a pipe
     IO_CONSOLE, // a console
+    IO_IRQ,     // an interrupt, delivered to a userspace driver
+    IO_DMA_PIN, // pages of a userspace buffer, pinned for DMA
 } io_type_t;
 
 typedef enum
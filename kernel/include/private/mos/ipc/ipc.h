@@ -18,6 +18,7 @@ ipc_t *ipc_server_accept(ipc_server_t *server);
 void ipc_server_close(ipc_server_t *server);
 
 ipc_t *ipc_connect_to_server(const char *name, size_t buffer_size);
+long ipc_wait_for_server(const char *name); // without connecting to it, returns 0 once it exists or -EINTR
 
 size_t ipc_client_read(ipc_t *ipc, void *buffer, size_t size);
 size_t ipc_client_write(ipc_t *ipc, const void *buffer, size_t size);
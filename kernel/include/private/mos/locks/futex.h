@@ -5,4 +5,11 @@
 #include <mos/types.h>
 
 bool futex_wait(futex_word_t *futex, futex_word_t expected);
+
+/**
+ * @brief Like futex_wait, but give up after 'timeout_ms' milliseconds.
+ *
+ * @return 0 if woken up by futex_wake, -EAGAIN if the value has changed, -ETIMEDOUT, or -EINTR if interrupted by a signal
+ */
+long futex_timedwait(futex_word_t *futex, futex_word_t expected, u64 timeout_ms);
 bool futex_wake(futex_word_t *lock, size_t num_to_wake);
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/lib/structures/list.h>
+#include <mos/types.h>
+
+/**
+ * @defgroup rcu kernel.rcu
+ * @brief Read-copy-update, for data that is read far more often than it is changed.
+ *
+ * @details Readers take no lock, they only mark a read-side critical section, in which they must not block.
+ * Writers serialise among themselves (e.g. with a spinlock), publish changes with rcu_assign_pointer, and
+ * wait for a grace period before freeing what they have unlinked: after synchronize_rcu() returns, or when a
+ * call_rcu() callback is called, no reader can still be looking at it.
+ *
+ * A grace period is over once every CPU has either passed through the scheduler (a quiescent state), or been
+ * seen outside of a read-side critical section.
+ * @{
+ */
+
+typedef struct _rcu_head rcu_head_t;
+typedef void (*rcu_callback_t)(rcu_head_t *head);
+
+/**
+ * @brief Embed this into an object to be freed with call_rcu.
+ */
+typedef struct _rcu_head
+{
+    rcu_head_t *next;
+    rcu_callback_t callback;
+} rcu_head_t;
+
+#define rcu_dereference(p)        __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_assign_pointer(p, v)  __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/**
+ * @brief Enter a read-side critical section, which may be nested.
+ *
+ * @details Interrupts are disabled until the outermost rcu_read_unlock, so the section can't be preempted.
+ */
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+
+/**
+ * @brief Wait for all read-side critical sections that are in progress to finish.
+ *
+ * @note Must not be called from within a read-side critical section, or with a lock a reader may be spinning on.
+ */
+void synchronize_rcu(void);
+
+/**
+ * @brief Call 'callback' after a grace period, without waiting for it.
+ *
+ * @details The callback is called from the scheduler, on whichever CPU notices the end of the grace period.
+ */
+void call_rcu(rcu_head_t *head, rcu_callback_t callback);
+
+/**
+ * @brief Report a quiescent state for the current CPU, called by the scheduler between threads.
+ */
+void rcu_quiescent_state(void);
+
+// ! RCU-protected lists, writers must be serialised by the caller
+
+should_inline void list_node_append_rcu(list_node_t *head, list_node_t *item)
+{
+    item->next = head;
+    item->prev = head->prev;
+    rcu_assign_pointer(head->prev->next, item); // the item is fully initialised before readers can reach it
+    head->prev = item;
+}
+
+/**
+ * @brief Unlink a node, readers that are standing on it can still move on to the next one.
+ *
+ * @note The node can only be freed or reused after a grace period.
+ */
+should_inline void list_node_remove_rcu(list_node_t *node)
+{
+    node->next->prev = node->prev;
+    rcu_assign_pointer(node->prev->next, node->next);
+}
+
+#define list_append_rcu(element, item) list_node_append_rcu(list_node(element), list_node(item))
+#define list_remove_rcu(element)       list_node_remove_rcu(list_node(element))
+
+/**
+ * @brief Iterate over an RCU-protected list, within a read-side critical section.
+ */
+#define list_foreach_rcu(t, v, h)                                                                                                                                        \
+    for (__typeof(list_entry(&(h), t)) v = list_entry(rcu_dereference((h).next), t); list_node(v) != &(h); v = list_entry(rcu_dereference(list_node(v)->next), t))
+
+/** @} */
@@ -11,11 +11,12 @@ typedef u64 pf_point_t;
 
 #if MOS_CONFIG(MOS_PROFILING)
 
+#include "mos/misc/trace.h"
+
 /**
  * @brief Enter a profiling scope
  *
- * @param name Scope name
- * @return id_t The scope ID used to exit the scope
+ * @return pf_point_t The start of the scope, to be passed to profile_leave
  */
 should_inline pf_point_t profile_enter(void)
 {
@@ -23,11 +24,19 @@ should_inline pf_point_t profile_enter(void)
 }
 
 /**
- * @brief Exit a profiling scope
+ * @brief Exit a profiling scope, it's recorded as a TRACE_SCOPE event if that is enabled
  *
- * @param id Scope ID
+ * @param point The start of the scope, from profile_enter
+ * @param scope_name A string literal, the name of the scope
+ * @param arg A number recorded with the scope, e.g. an IRQ or a syscall number
  */
-void profile_leave(pf_point_t point, const char *fmt, ...) __printf(2, 3);
+#define profile_leave(point, scope_name, arg)                                                                                                                            \
+    do                                                                                                                                                                   \
+    {                                                                                                                                                                    \
+        static trace_name_t __trace_name = { .name = scope_name };                                                                                                       \
+        if (trace_event_enabled(TRACE_SCOPE))                                                                                                                            \
+            trace_emit(TRACE_SCOPE, 0, trace_name_id(&__trace_name), point, (u64) (arg));                                                                               \
+    } while (0)
 
 #else
 
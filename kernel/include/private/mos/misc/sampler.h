@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+#define SAMPLER_MAX_DEPTH 16 // the interrupted IP, and the return addresses of the frames below it
+
+#if MOS_CONFIG(MOS_SAMPLER)
+
+/**
+ * @brief Record a sample in the current CPU's buffer, called from the platform's sampling interrupt
+ *
+ * @note It may be an NMI, so this takes no locks, and nothing else records on a CPU while its sampler is running.
+ *
+ * @param user Whether the addresses are in the interrupted process, rather than in the kernel
+ * @param ips The interrupted IP, followed by the return addresses, innermost first
+ * @param depth The number of addresses, at most SAMPLER_MAX_DEPTH
+ */
+void sampler_record(bool user, const ptr_t *ips, size_t depth);
+
+/**
+ * @brief Start sampling every CPU 'hz' times a second, the samples of the previous run are discarded
+ *
+ * @return false if it is already running, or if the buffers can't be allocated
+ */
+bool sampler_start(u32 hz);
+
+void sampler_stop(void);
+
+/**
+ * @brief Start or stop the current CPU's timer to follow the sampler, resetting its buffer when it starts
+ *
+ * @note Called with interrupts disabled, on the CPU that changes the state, and on the others through IPI_TYPE_SAMPLER.
+ */
+void sampler_apply_percpu(void);
+
+/**
+ * @brief Get the number of samples a CPU has recorded in the current (or last) run
+ */
+size_t sampler_get_nsamples(u32 cpu);
+
+/**
+ * @brief Aggregate the samples of the current (or last) run by stack, as /sys/sampler/folded shows them
+ *
+ * @param emit Called once per distinct stack with a line in the folded format of flamegraph.pl, without the newline
+ * @return false if the memory to aggregate them can't be allocated
+ */
+bool sampler_fold(void (*emit)(const char *line, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/misc/trace_types.h>
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+#if MOS_CONFIG(MOS_TRACING)
+
+extern u32 trace_events_enabled; // a bit for each trace_event_t, set through /sys/trace/enable
+
+/**
+ * @brief A name for profiling scopes, registered the first time one of them is recorded
+ */
+typedef struct
+{
+    const char *name;
+    u16 id; // 0 until it's registered
+} trace_name_t;
+
+/**
+ * @brief Append a record to the current CPU's trace buffer
+ *
+ * @note Call it through trace_event(), which only costs a load and a branch while the event is disabled.
+ */
+void trace_emit(trace_event_t event, u8 flags, u16 name, u64 arg0, u64 arg1);
+
+u16 trace_name_register(trace_name_t *name);
+
+should_inline bool trace_event_enabled(trace_event_t event)
+{
+    return unlikely(__atomic_load_n(&trace_events_enabled, __ATOMIC_RELAXED) & (1u << event));
+}
+
+should_inline u16 trace_name_id(trace_name_t *name)
+{
+    const u16 id = __atomic_load_n(&name->id, __ATOMIC_ACQUIRE);
+    return likely(id) ? id : trace_name_register(name);
+}
+
+#define trace_event(event, flags, arg0, arg1)                                                                                                                            \
+    do                                                                                                                                                                   \
+    {                                                                                                                                                                    \
+        if (trace_event_enabled(event))                                                                                                                                  \
+            trace_emit(event, flags, 0, (u64) (arg0), (u64) (arg1));                                                                                                     \
+    } while (0)
+
+/**
+ * @brief Get the trace buffer of a CPU, NULL if tracing has never been enabled
+ */
+trace_buffer_header_t *trace_get_buffer(u32 cpu);
+
+/**
+ * @brief Enable exactly the events in 'mask', allocating the buffers the first time
+ */
+void trace_set_enabled(u32 mask);
+
+#else
+
+#define trace_event(event, flags, arg0, arg1) ((void) 0)
+
+#endif
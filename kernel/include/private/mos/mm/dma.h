@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include "mos/io/io.h"
 #include "mos/mm/mm.h"
 
 #include <mos/types.h>
@@ -20,3 +21,31 @@ bool dmabuf_free(ptr_t vaddr, ptr_t paddr);
 pfn_t dmabuf_share(void *buffer, size_t size);
 
 bool dmabuf_unshare(ptr_t phys, size_t size, void *virt);
+
+/**
+ * @brief Pin the pages of a userspace buffer, and translate it into physically contiguous pieces.
+ *
+ * @param buf The buffer, in anonymous memory of the current process
+ * @param size Size of the buffer
+ * @param device_writes The device writes to the buffer, it must be writable and is unshared from other processes
+ * @param entries Receives the pieces, in order
+ * @param n_entries The capacity of entries, receives the number of pieces (also if the capacity is too small)
+ * @return An io_t that keeps the pages pinned until it's closed, or an error code on failure
+ *
+ * @note Discarding the pages (MEM_ADVICE_DONTNEED) or unmapping them while they are pinned leaves the device
+ *       with pages that no longer belong to the buffer.
+ * @note The same goes for fork(): the pinned pages become copy-on-write in both processes, and the first write by
+ *       the parent moves its buffer to a copy the device doesn't see. Don't fork while a pinning is in use, or pin
+ *       a buffer from dmabuf_alloc instead, which is shared and is not copied.
+ */
+io_t *dmabuf_sg_map(void *buf, size_t size, bool device_writes, dma_sg_entry_t *entries, size_t *n_entries);
+
+/**
+ * @brief Pin the given physical pages, the part of dmabuf_sg_map() that doesn't depend on the process.
+ *
+ * @param pfns The page that holds each MOS_PAGE_SIZE piece of the buffer, starting with the one that holds buf
+ * @param buf Address of the buffer, which only tells the offset into the first page
+ * @param size Size of the buffer
+ * @return See dmabuf_sg_map()
+ */
+io_t *dmabuf_pin_frames(const pfn_t *pfns, ptr_t buf, size_t size, dma_sg_entry_t *entries, size_t *n_entries);
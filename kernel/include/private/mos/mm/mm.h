@@ -19,6 +19,7 @@ typedef enum
     VMAP_FILE,  // file mapping
     VMAP_MMAP,  // mmap mapping
     VMAP_DMA,   // DMA mapping
+    VMAP_VDSO,  // vDSO data page
 } vmap_content_t;
 
 typedef enum
@@ -47,6 +48,13 @@ typedef enum
 
 typedef struct _vmap vmap_t;
 
+typedef struct
+{
+    as_linked_list;
+    ptr_t vaddr;
+    size_t npages;
+} vmap_range_t;
+
 typedef vmfault_result_t (*vmfault_handler_t)(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info);
 
 typedef struct _vmap
@@ -66,6 +74,7 @@ typedef struct _vmap
     vmap_type_t type;
     vmap_stat_t stat;
     vmfault_handler_t on_fault;
+    list_head lazyfree; ///< vmap_range_t, sorted and disjoint, marked with MEM_ADVICE_FREE; their clean pages may be reclaimed
 } vmap_t;
 
 #define pfn_va(pfn)        ((ptr_t) (platform_info->direct_map_base + (pfn) * (MOS_PAGE_SIZE)))
@@ -163,6 +172,37 @@ vmap_t *vmap_split_for_range(vmap_t *vmap, size_t rstart_pgoff, size_t rend_pgof
  */
 void vmap_finalise_init(vmap_t *vmap, vmap_content_t content, vmap_type_t type);
 
+/**
+ * @brief Drop the pages in a range of a vmap, they read as zeroes when they are touched again.
+ *
+ * @param vmap The vmap object, locked
+ * @param vaddr The address of the first page
+ * @param npages Number of pages
+ * @param only_clean Only drop writable pages that have not been written to since they were marked with MEM_ADVICE_FREE
+ * @return size_t The number of pages dropped
+ * @note Dropping all pages in the range also clears the MEM_ADVICE_FREE mark from it.
+ */
+size_t vmap_discard_pages(vmap_t *vmap, ptr_t vaddr, size_t npages, bool only_clean);
+
+/**
+ * @brief Reclaim the clean pages in the ranges marked with MEM_ADVICE_FREE in all address spaces, when memory runs out.
+ *
+ * @details Address spaces and vmaps that are locked at the moment are skipped, so this can be called from any context.
+ *
+ * @return size_t The number of pages reclaimed
+ */
+size_t mm_reclaim_lazyfree(void);
+
+/**
+ * @brief Make the pages of an address space in a vmap reclaimable, see MEM_ADVICE_FREE.
+ * @details The range is recorded on the vmap, mm_reclaim_lazyfree only looks at the recorded ranges.
+ *
+ * @param vmap The vmap object, locked, whose address space is also locked
+ * @param vaddr The address of the first page
+ * @param npages Number of pages
+ */
+void mm_mark_lazyfree_locked(vmap_t *vmap, ptr_t vaddr, size_t npages);
+
 /**
  * @brief Helper function to resolve a copy-on-write fault.
  *
@@ -52,3 +52,12 @@ bool munmap(ptr_t addr, size_t size);
  * @param perm The new permissions for the mapping
  */
 bool vm_protect(mm_context_t *mmctx, ptr_t addr, size_t size, vm_flags perm);
+
+/**
+ * @brief Tell the kernel how a range of private anonymous memory will be used, see @ref mem_advice_t
+ *
+ * @param addr The address of the range, must be page aligned
+ * @param size The size of the range, the range must be within a single mapping
+ * @param advice The advice
+ */
+bool vm_advise(mm_context_t *mmctx, ptr_t addr, size_t size, mem_advice_t advice);
@@ -16,6 +16,8 @@ typedef enum
 
 extern const char *mem_type_names[_MEM_MAX_TYPES];
 
+// /sys/mmstat/counters exports the number of pages of each mmstat_type_t, indexed by type, as a sysfs counter page
+
 /**
  * @brief Increment the memory usage statistics.
  *
@@ -94,6 +94,15 @@ void mm_replace_page_locked(mm_context_t *mmctx, ptr_t vaddr, pfn_t pfn, vm_flag
  */
 vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx);
 
+/**
+ * @brief Clone a vmap to another address space, sharing its page tables.
+ *
+ * @details Same as mm_clone_vmap_locked(), except that the pml1 tables fully covered by the vmap are
+ * shared with the destination instead of being copied, each side gets a private copy of a table on
+ * its first modification. The pages must have been made read-only beforehand.
+ */
+vmap_t *mm_share_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx);
+
 /**
  * @brief Get if a virtual address is mapped in a page table.
  *
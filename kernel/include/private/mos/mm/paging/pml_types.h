@@ -89,7 +89,9 @@ typedef struct
 
 typedef struct
 {
-    bool readonly;
+    bool readonly;             ///< do not create missing tables on the way down
+    bool pml1_readonly;        ///< the walk never modifies pml1 entries, so shared pml1 tables can be walked in place
+    bool pml1_release_shared;  ///< a shared pml1 table fully covered by the walk is released instead of being unshared
     void (*pml4e_pre_traverse)(pml4_t pml4, pml4e_t *e, ptr_t vaddr, void *data);
     void (*pml3e_pre_traverse)(pml3_t pml3, pml3e_t *e, ptr_t vaddr, void *data);
     void (*pml2e_pre_traverse)(pml2_t pml2, pml2e_t *e, ptr_t vaddr, void *data);
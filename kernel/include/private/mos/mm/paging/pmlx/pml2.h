@@ -13,3 +13,14 @@ pml2e_t *pml2_entry(pml2_t pml2, ptr_t vaddr);
 bool pml2e_is_present(const pml2e_t *pml2e);
 
 pml1_t pml2e_get_or_create_pml1(pml2e_t *pml2e);
+
+/**
+ * @brief Page tables shared between address spaces
+ *
+ * On fork, the pml1 tables of private mappings are shared instead of copied, the refcount of the
+ * table's frame counts the address spaces using it. Any walk that modifies a shared pml1 table
+ * first gets a private copy of it with pml2e_unshare_pml1().
+ */
+bool pml1_is_shared(pml1_t pml1);
+void pml2e_share_pml1(pml2e_t *dst, const pml2e_t *src);
+pml1_t pml2e_unshare_pml1(pml2e_t *pml2e);
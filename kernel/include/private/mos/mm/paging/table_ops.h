@@ -9,6 +9,9 @@ void mm_do_map(pgd_t top, ptr_t vaddr, pfn_t pfn, size_t n_pages, vm_flags flags
 void mm_do_flag(pgd_t top, ptr_t vaddr, size_t n_pages, vm_flags flags);
 void mm_do_unmap(pgd_t top, ptr_t vaddr, size_t n_pages, bool do_unref);
 void mm_do_mask_flags(pgd_t max, ptr_t vaddr, size_t n_pages, vm_flags to_remove);
+size_t mm_do_discard(pgd_t top, ptr_t vaddr, size_t n_pages, bool only_clean, size_t *n_writable); // returns the number of pages discarded
+size_t mm_do_clean(pgd_t top, ptr_t vaddr, size_t n_pages);                                          // returns the number of pages cleaned
 void mm_do_copy(pgd_t src, pgd_t dst, ptr_t vaddr, size_t n_pages);
+void mm_do_share(pgd_t src, pgd_t dst, ptr_t vaddr, size_t n_pages);
 pfn_t mm_do_get_pfn(pgd_t top, ptr_t vaddr);
 vm_flags mm_do_get_flags(pgd_t max, ptr_t vaddr);
@@ -0,0 +1,11 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "mos/mm/paging/pml_types.h"
+
+struct pagetable_do_clean_data
+{
+    size_t n_cleaned; ///< writable pages that were marked as not written to
+};
+
+extern const pagetable_walk_options_t pagetable_do_clean_callbacks;
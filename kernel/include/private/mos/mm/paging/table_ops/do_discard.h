@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#pragma once
+
+#include "mos/mm/paging/pml_types.h"
+
+struct pagetable_do_discard_data
+{
+    bool only_clean;   ///< only discard writable pages that have not been written to since their dirty bit was cleared
+    size_t n_writable; ///< discarded pages that were mapped writable
+    size_t n_readonly; ///< discarded pages that were mapped read-only
+};
+
+extern const pagetable_walk_options_t pagetable_do_discard_callbacks;
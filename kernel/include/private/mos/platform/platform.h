@@ -6,18 +6,24 @@
 #include "mos/mm/paging/pml_types.h"
 #include "mos/platform/platform_defs.h"
 
+#include <mos/device/irq_types.h>
 #include <mos/mm/mm_types.h>
 #include <mos/tasks/signal_types.h>
 
 // clang-format off
 #if MOS_CONFIG(MOS_SMP)
-#define PER_CPU_DECLARE(type, name) struct name { type percpu_value[MOS_MAX_CPU_COUNT]; } name
-#define PER_CPU_VAR_INIT { .percpu_value = { 0 } }
-#define per_cpu(var) (&(var.percpu_value[platform_current_cpu_id()]))
+// each CPU's copy lives in its own cache line, so that CPUs updating their own copy don't contend with each other
+#define PER_CPU_DECLARE(type, name) struct name { struct { type value; } __aligned(MOS_PLATFORM_CACHE_LINE_SIZE) percpu_value[MOS_MAX_CPU_COUNT]; } name
+#define PER_CPU_VAR_INIT { .percpu_value = { { 0 } } }
+#define per_cpu(var) (&(var.percpu_value[platform_current_cpu_id()].value))
+#define per_cpu_of(var, cpu) (&(var.percpu_value[(cpu)].value))
+#define PER_CPU_COUNT MOS_MAX_CPU_COUNT
 #else
 #define PER_CPU_DECLARE(type, name) type name
 #define PER_CPU_VAR_INIT 0
 #define per_cpu(var) (&(var))
+#define per_cpu_of(var, cpu) ((void) (cpu), &(var))
+#define PER_CPU_COUNT 1
 #endif
 // clang-format on
 
@@ -79,6 +85,7 @@ typedef enum
     IPI_TYPE_HALT = 0,       // halt the CPU
     IPI_TYPE_INVALIDATE_TLB, // TLB shootdown
     IPI_TYPE_RESCHEDULE,     // Reschedule
+    IPI_TYPE_SAMPLER,        // start or stop the sampling profiler
     IPI_TYPE_MAX,
 } ipi_type_t;
 
@@ -99,6 +106,7 @@ typedef struct
     spinlock_t mm_lock; ///< protects [pgd] and the [mmaps] list (the list itself, not the vmap_t objects)
     pgd_t pgd;
     list_head mmaps;
+    list_node_t reclaim_node; ///< in the list of address spaces that have pages marked with MEM_ADVICE_FREE
 } mm_context_t;
 
 typedef struct _platform_regs platform_regs_t;
@@ -175,7 +183,7 @@ void platform_get_time(timeval_t *val);
 // Platform CPU APIs
 noreturn void platform_halt_cpu(void);
 void platform_invalidate_tlb(ptr_t vaddr);
-u32 platform_current_cpu_id(void);
+u32 platform_current_cpu_id(void); // defined inline in platform_defs.h
 void platform_msleep(u64 ms);
 void platform_usleep(u64 us);
 void platform_cpu_idle(void);
@@ -187,8 +195,23 @@ datetime_str_t *platform_get_datetime_str(void);
 // Platform Interrupt APIs
 void platform_interrupt_enable(void);
 void platform_interrupt_disable(void);
+bool platform_interrupt_disable_save(void); // returns whether interrupts were enabled
+void platform_interrupt_restore(bool enabled);
 bool platform_irq_handler_install(u32 irq, irq_handler handler);
 void platform_irq_handler_remove(u32 irq, irq_handler handler);
+void platform_sample_timer_set(u32 hz); // the sampling profiler's timer on the calling CPU, 0 stops it
+
+// Platform Interrupt Routing APIs, for interrupts handled by userspace drivers, 'cpu' is the index (below num_cpus) of the CPU that receives them
+bool platform_irq_line_route(u32 irq, u32 cpu); // level-triggered, masked when delivered until platform_irq_line_unmask
+void platform_irq_line_unmask(u32 irq);
+void platform_irq_line_disable(u32 irq);
+bool platform_msi_allocate(u32 cpu, u32 *irq, msi_message_t *message); // returns the IRQ number for the handler, and the message for the device
+bool platform_msi_set_affinity(u32 irq, u32 cpu, msi_message_t *message);
+void platform_msi_free(u32 irq);
+
+// Platform Page APIs, both addresses must be page-aligned
+void platform_page_zero(ptr_t vaddr);
+void platform_page_copy(ptr_t dst, ptr_t src);
 
 // Platform Page Table APIs
 pfn_t platform_pml1e_get_pfn(const pml1e_t *pml1);            // returns the physical address contained in the pmlx entry,
@@ -197,6 +220,8 @@ bool platform_pml1e_get_present(const pml1e_t *pml1);         // returns if an e
 void platform_pml1e_set_present(pml1e_t *pml1, bool present); // sets if an entry in this page table is present
 void platform_pml1e_set_flags(pml1e_t *pml1, vm_flags flags); // set bits in the flags field of the pmlx entry
 vm_flags platform_pml1e_get_flags(const pml1e_t *pml1e);      // get bits in the flags field of the pmlx entry
+void platform_pml1e_clear_dirty(pml1e_t *pml1e);              // atomically marks a page as not written to
+bool platform_pml1e_discard_if_clean(pml1e_t *pml1e);         // atomically clears a writable entry if the page has not been written to since
 
 #if MOS_PLATFORM_PAGING_LEVELS >= 2
 pml1_t platform_pml2e_get_pml1(const pml2e_t *pml2);
@@ -63,6 +63,14 @@ __printf(2, 3) void lprintk(mos_loglevel loglevel, const char *format, ...);
 void vprintk(const char *format, va_list args);
 void lvprintk(mos_loglevel loglevel, const char *fmt, va_list args);
 
+/**
+ * @brief Write every message to the console before printk returns from now on, instead of leaving it to the printk thread,
+ * and write out the messages that are still pending.
+ *
+ * @param panic The system is going down because of a panic, don't wait for CPUs that may have stopped while printing
+ */
+void printk_set_sync(bool panic);
+
 bool printk_unquiet(void);
 void printk_set_quiet(bool quiet);
 
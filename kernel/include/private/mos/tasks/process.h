@@ -4,6 +4,7 @@
 
 #include "mos/mm/slab.h"
 
+#include <mos/tasks/spawn_types.h>
 #include <mos/tasks/task_types.h>
 
 #define PROCESS_MAGIC_PROC MOS_FOURCC('P', 'R', 'O', 'C')
@@ -37,6 +38,7 @@ io_t *process_get_fd(process_t *process, fd_t fd);
 bool process_detach_fd(process_t *process, fd_t fd);
 
 ptr_t process_grow_heap(process_t *process, size_t npages);
+ptr_t process_shrink_heap(process_t *process, size_t npages); // the first page of the heap is always kept
 
 pid_t process_wait_for_pid(pid_t pid, u32 *exit_code, u32 flags);
 
@@ -48,3 +50,4 @@ bool process_register_signal_handler(process_t *process, signal_t sig, const sig
 
 process_t *process_do_fork(process_t *process);
 long process_do_execveat(process_t *process, fd_t dirfd, const char *path, const char *const argv[], const char *const envp[], int flags);
+pid_t process_do_spawn(process_t *parent, fd_t dirfd, const char *path, const char *const argv[], const char *const envp[], const spawn_attr_t *attr);
@@ -8,9 +8,37 @@ void tasks_init();
 void unblock_scheduler(void);
 noreturn void scheduler(void);
 
-void reschedule_for_wait_condition(wait_condition_t *wait_condition);
+/**
+ * @brief Put the current thread on a waitlist, and block until it is woken up.
+ *
+ * @return false if the waitlist is closed, in which case the thread doesn't block
+ */
 __nodiscard bool reschedule_for_waitlist(waitlist_t *waitlist);
 
+/**
+ * @brief Make a blocked thread runnable.
+ *
+ * @details If the thread has not blocked yet (i.e. it's between getting on a waitlist and calling blocked_reschedule()),
+ * its next blocked_reschedule() returns immediately instead, so the wakeup is not lost.
+ */
+void scheduler_wake_thread(thread_t *thread);
+
+/**
+ * @brief Drop a wakeup that arrived for the current thread after its wait had already ended.
+ *
+ * @details Call this once the thread is off every waitlist (and timer) it waited on, where a late wakeup would
+ * otherwise make its next, unrelated blocked_reschedule() return at once.
+ */
+void scheduler_discard_wakeup(void);
+
+/**
+ * @brief Wake up a thread, and if it was blocked, switch to it directly, leaving the current thread READY.
+ *
+ * @details This is for handing the CPU to the other end of a synchronous exchange (e.g. a reader waiting
+ * for what we have just written), without a pass through the scheduler.
+ */
+void scheduler_wake_and_yield_to(thread_t *thread);
+
 /**
  * @brief reschedule.
  *
@@ -18,7 +46,7 @@ __nodiscard bool reschedule_for_waitlist(waitlist_t *waitlist);
 void reschedule(void);
 
 /**
- * @brief Mark the current task as blocked and reschedule.
+ * @brief Mark the current task as blocked and reschedule, until it's woken up by scheduler_wake_thread().
  *
  */
 void blocked_reschedule(void);
@@ -8,15 +8,6 @@
 #include <mos/lib/sync/spinlock.h>
 #include <mos/mos_global.h>
 
-typedef struct _wait_condition wait_condition_t;
-
-typedef struct _wait_condition
-{
-    void *arg;
-    bool (*verify)(wait_condition_t *condition); // return true if condition is met
-    void (*cleanup)(wait_condition_t *condition);
-} wait_condition_t;
-
 /**
  * @brief The entry in the waiters list of a process, or a thread
  */
@@ -35,19 +26,12 @@ typedef struct
 
 extern slab_t *waitlist_slab;
 
-typedef bool (*wait_condition_verifier_t)(wait_condition_t *condition);
-typedef void (*wait_condition_cleanup_t)(wait_condition_t *condition);
-
-wait_condition_t *wc_wait_for(void *arg, wait_condition_verifier_t verify, wait_condition_cleanup_t cleanup);
-
-bool wc_condition_verify(wait_condition_t *condition);
-void wc_condition_cleanup(wait_condition_t *condition);
-
 void waitlist_init(waitlist_t *list);
 __nodiscard bool waitlist_append(waitlist_t *list);
 size_t waitlist_wake(waitlist_t *list, size_t max_wakeups);
+size_t waitlist_wake_and_yield(waitlist_t *list, size_t max_wakeups); // like waitlist_wake, and switch to the first waiter if it's blocked
 void waitlist_close(waitlist_t *list);
-void waitlist_remove_me(waitlist_t *waitlist);
+bool waitlist_remove_me(waitlist_t *waitlist); // returns false if the current thread is not on the list
 
 #define waitlist_wake_one(list) waitlist_wake(list, 1)
 #define waitlist_wake_all(list) waitlist_wake(list, SIZE_MAX)
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.h>
+
+/**
+ * @defgroup device.irq Interrupts for userspace drivers
+ * @brief Interrupts delivered to userspace through IRQ objects
+ *
+ * @details An IRQ object is an fd: a read blocks until the interrupt fires and returns a u64, the number of times it
+ * has fired since the last read. A write acknowledges it, for a legacy line this unmasks it again, after the driver has
+ * cleared the interrupt condition on the device.
+ * @{
+ */
+
+#define IRQ_CPU_ANY ((u32) -1) ///< let the kernel choose the CPU that receives the interrupt
+
+/**
+ * @brief What a device has to write, and where, to raise a message-signalled interrupt.
+ *
+ * @details For MSI-X, these are the 'Message Address' and 'Message Data' fields of a table entry.
+ */
+typedef struct
+{
+    u64 address;
+    u32 data;
+} msi_message_t;
+
+/** @} */
@@ -77,6 +77,20 @@ typedef struct
     u64 modified;
 } file_stat_t;
 
+#define SYSFS_COUNTERS_MAGIC 0x43545253 // 'SRTC'
+
+/**
+ * @brief The layout of a sysfs counter page, a read-only mmap view of live kernel counters
+ *
+ * @note The counters are updated in place by the kernel, the meaning of each one is defined by the exporting subsystem.
+ */
+typedef struct
+{
+    u32 magic;      ///< SYSFS_COUNTERS_MAGIC
+    u32 ncounters;  ///< the number of counters that follow
+    u64 counters[]; ///< the counters
+} sysfs_counters_t;
+
 should_inline void file_format_perm(file_perm_t perms, char buf[10])
 {
     buf[0] = perms & (PERM_READ & PERM_OWNER) ? 'r' : '-';
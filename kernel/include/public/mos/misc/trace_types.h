@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+// The trace buffer of each CPU can be mapped read-only from /sys/trace/cpu<N>: a header page, followed by the records.
+
+#define TRACE_BUFFER_MAGIC 0x45435254 // 'TRCE'
+
+typedef enum
+{
+    TRACE_NONE,
+    TRACE_CONTEXT_SWITCH, // tid: the previous thread (0 if none), args: next tid, -, flags: the previous thread's state
+    TRACE_SYSCALL_ENTER,  // args: syscall number, first argument
+    TRACE_SYSCALL_EXIT,   // args: syscall number, return value
+    TRACE_PAGE_FAULT,     // args: fault address, instruction pointer, flags: trace_pagefault_flags_t
+    TRACE_IPC_SEND,       // args: connection, bytes written, flags: 1 if the server side sent it
+    TRACE_IPC_RECV,       // args: connection, bytes read, flags: 1 if the server side received it
+    TRACE_SLAB_ALLOC,     // args: object size, address, flags: 1 if it's too large for a slab and pages were allocated
+    TRACE_SCOPE,          // a profiling scope that ends at 'timestamp', args: start timestamp, argument, name: see /sys/trace/names
+    _TRACE_EVENT_MAX,
+} trace_event_t;
+
+typedef enum
+{
+    TRACE_PF_PRESENT = 1 << 0,
+    TRACE_PF_WRITE = 1 << 1,
+    TRACE_PF_USER = 1 << 2,
+    TRACE_PF_EXEC = 1 << 3,
+} trace_pagefault_flags_t;
+
+typedef struct
+{
+    u64 timestamp; // platform counter, see vdso_counter_to_ns()
+    u32 tid;       // the thread that was running, 0 if there was none
+    u8 event;      // trace_event_t
+    u8 flags;      // event-specific
+    u16 name;      // event-specific
+    u64 args[2];   // event-specific
+} trace_record_t;
+
+MOS_STATIC_ASSERT(sizeof(trace_record_t) == 32, "trace_record_t must be 32 bytes");
+
+typedef struct
+{
+    u32 magic;       // TRACE_BUFFER_MAGIC
+    u32 cpu;         // the CPU that writes to this buffer
+    u32 record_size; // sizeof(trace_record_t)
+    u32 nrecords;    // the capacity of the buffer, a power of two
+    u64 head;        // number of records ever written, record i is at (i % nrecords), until it's overwritten
+} trace_buffer_header_t;
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+// The vDSO data page is mapped read-only into every process at this address.
+#define MOS_VDSO_DATA_VADDR 0x00007FFFFFF00000
+
+typedef enum
+{
+    VDSO_TIME_VALID = 1 << 0,    // the time parameters are set up, otherwise use the clock_gettimeofday syscall
+    VDSO_TIME_RELIABLE = 1 << 1, // the counter runs at a constant rate, and is synchronised across CPUs (i.e. invariant TSC)
+} vdso_time_flags_t;
+
+typedef struct
+{
+    u32 seq;          // odd while the kernel is updating the parameters below
+    u32 flags;        // vdso_time_flags_t
+    u64 counter_base; // the counter value (TSC on x86) when 'ns_base' was taken
+    u64 ns_base;      // nanoseconds since the Unix epoch at 'counter_base'
+    u64 mult;         // ns = ns_base + ((counter - counter_base) * mult) >> shift
+    u32 shift;        // see 'mult'
+    u64 frequency;    // counter ticks per second
+} vdso_time_data_t;
+
+typedef struct
+{
+    vdso_time_data_t time;
+} vdso_data_t;
+
+should_inline u64 vdso_read_counter(void)
+{
+#if defined(__x86_64__)
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64) hi << 32) | lo;
+#else
+#error "unsupported architecture"
+#endif
+}
+
+should_inline u64 vdso_counter_to_ns(const vdso_time_data_t *time, u64 counter)
+{
+    const u64 delta = counter - time->counter_base;
+    return time->ns_base + (u64) (((unsigned __int128) delta * time->mult) >> time->shift);
+}
+
+/**
+ * @brief Read the current time from the vDSO data page, without entering the kernel.
+ *
+ * @return false if the kernel hasn't published the time parameters, use the clock_gettimeofday syscall instead.
+ */
+should_inline bool vdso_get_time_ns(const vdso_data_t *vdso, u64 *ns)
+{
+    const volatile vdso_time_data_t *time = &vdso->time;
+    vdso_time_data_t snapshot;
+    u32 seq;
+
+    do
+    {
+        while ((seq = __atomic_load_n(&time->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        snapshot = *(const vdso_time_data_t *) time;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&time->seq, __ATOMIC_RELAXED) != seq);
+
+    if (!(snapshot.flags & VDSO_TIME_VALID))
+        return false;
+
+    *ns = vdso_counter_to_ns(&snapshot, vdso_read_counter());
+    return true;
+}
@@ -9,4 +9,5 @@ typedef enum
     HEAP_SET_TOP,
     HEAP_GET_SIZE,
     HEAP_GROW_PAGES,
+    HEAP_SHRINK_PAGES,
 } heap_control_op;
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <mos/types.h>
+
 typedef enum
 {
     MEM_PERM_NONE = 0,
@@ -17,3 +19,18 @@ typedef enum
     MMAP_PRIVATE = 1 << 1, // the memory is private, and will be CoWed when forking
     MMAP_SHARED = 1 << 2,  // the memory is shared when forking
 } mmap_flags_t;
+
+typedef enum
+{
+    MEM_ADVICE_DONTNEED = 1, // the pages are dropped now, and read as zeroes when touched again
+    MEM_ADVICE_FREE = 2,     // the pages may be dropped when memory runs out, unless they are written to before that
+} mem_advice_t;
+
+/**
+ * @brief A physically contiguous piece of a userspace buffer, which dmabuf_sg_map has pinned for DMA.
+ */
+typedef struct
+{
+    ptr_t paddr;
+    size_t size;
+} dma_sg_entry_t;
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/filesystem/fs_types.h>
+#include <mos/types.h>
+
+typedef enum
+{
+    SPAWN_FILE_ACTION_OPEN,  // open 'path' with 'open_flags' (relative to the caller's cwd or 'src_fd'), and install it as 'fd'
+    SPAWN_FILE_ACTION_DUP2,  // duplicate the child's 'src_fd' to 'fd'
+    SPAWN_FILE_ACTION_CLOSE, // close the child's 'fd'
+} spawn_file_action_type_t;
+
+typedef struct
+{
+    spawn_file_action_type_t type;
+    fd_t fd;
+    fd_t src_fd; // DUP2: the fd to duplicate, OPEN: the directory fd (of the caller) the path is relative to
+    open_flags open_flags;
+    fd_flags_t fd_flags;
+    const char *path;
+} spawn_file_action_t;
+
+typedef enum
+{
+    SPAWN_ATTR_NONE = 0,
+    SPAWN_ATTR_SETSIGMASK = 1 << 0, // use 'sigmask' for the main thread instead of inheriting the caller's
+    SPAWN_ATTR_CHDIR = 1 << 1,      // start the child in 'working_directory' instead of the caller's cwd
+} spawn_attr_flags_t;
+
+typedef struct
+{
+    spawn_attr_flags_t flags;
+    u64 sigmask; // bit N set means signal N is blocked
+    const char *working_directory;
+    const spawn_file_action_t *file_actions;
+    size_t n_file_actions;
+} spawn_attr_t;
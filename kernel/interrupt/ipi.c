@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "mos/misc/sampler.h"
 #include "mos/tasks/schedule.h"
 
 #include <iso646.h>
@@ -32,6 +33,15 @@ static void ipi_handler_reschedule(ipi_type_t type)
     reschedule();
 }
 
+#if MOS_CONFIG(MOS_SAMPLER)
+static void ipi_handler_sampler(ipi_type_t type)
+{
+    MOS_UNUSED(type);
+    pr_dinfo2(ipi, "Received sampler IPI");
+    sampler_apply_percpu();
+}
+#endif
+
 #define IPI_ENTRY(_type, _handler) [_type] = { .handle = _handler, .nr = PER_CPU_VAR_INIT }
 
 static struct
@@ -42,6 +52,9 @@ static struct
     IPI_ENTRY(IPI_TYPE_HALT, ipi_handler_halt),
     IPI_ENTRY(IPI_TYPE_INVALIDATE_TLB, ipi_handler_invalidate_tlb),
     IPI_ENTRY(IPI_TYPE_RESCHEDULE, ipi_handler_reschedule),
+#if MOS_CONFIG(MOS_SAMPLER)
+    IPI_ENTRY(IPI_TYPE_SAMPLER, ipi_handler_sampler),
+#endif
 };
 
 void ipi_send(u8 target, ipi_type_t type)
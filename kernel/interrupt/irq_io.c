@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// io_t objects that deliver interrupts to userspace drivers
+
+#define pr_fmt(fmt) "irq: " fmt
+
+#include "mos/interrupt/irq_io.h"
+
+#include "mos/mm/slab_autoinit.h"
+#include "mos/platform/platform.h"
+#include "mos/printk.h"
+#include "mos/tasks/schedule.h"
+#include "mos/tasks/signal.h"
+#include "mos/tasks/wait.h"
+
+#include <errno.h>
+#include <mos/lib/structures/list.h>
+#include <mos/lib/sync/spinlock.h>
+#include <mos_stdio.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+typedef struct
+{
+    as_linked_list; // in irq_ios
+    io_t io;
+    u32 irq;
+    u32 cpu;
+    bool msi;
+    bool unacked; // the line fired and is masked, until this driver has acknowledged it
+    u64 pending;  // times the interrupt has fired since the last read
+    waitlist_t waitlist;
+} irq_io_t;
+
+static slab_t *irq_io_slab = NULL;
+SLAB_AUTOINIT("irq_io", irq_io_slab, irq_io_t);
+
+// A legacy line may be shared by several devices, each with its own driver and IRQ object: all of them are told
+// when the line fires, and it's unmasked once every driver has checked its device and acknowledged it.
+
+static spinlock_t irq_routing_lock = SPINLOCK_INIT; // serialises opening, closing and moving interrupts
+static spinlock_t irq_ios_lock = SPINLOCK_INIT;     // protects the list and the state of the objects, taken by the handler
+static list_head irq_ios = LIST_HEAD_INIT(irq_ios);
+static u32 irq_next_cpu = 0; // for IRQ_CPU_ANY
+
+static irq_io_t *irq_io_find_locked(u32 irq, const irq_io_t *except)
+{
+    list_foreach(irq_io_t, irqio, irq_ios)
+    {
+        if (irqio->irq == irq && irqio != except)
+            return irqio;
+    }
+
+    return NULL;
+}
+
+static void irq_io_handler(u32 irq)
+{
+    spinlock_acquire(&irq_ios_lock); // interrupts are already disabled
+    list_foreach(irq_io_t, irqio, irq_ios)
+    {
+        if (irqio->irq != irq)
+            continue;
+
+        irqio->pending++;
+        irqio->unacked = !irqio->msi;
+        waitlist_wake(&irqio->waitlist, INT_MAX);
+    }
+    spinlock_release(&irq_ios_lock);
+}
+
+static size_t irq_io_read(io_t *io, void *buf, size_t size)
+{
+    irq_io_t *irqio = container_of(io, irq_io_t, io);
+    if (size < sizeof(u64))
+        return -EINVAL;
+
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+    while (irqio->pending == 0)
+    {
+        // get on the waitlist before releasing the lock, so that an interrupt in between wakes us up
+        MOS_ASSERT(waitlist_append(&irqio->waitlist));
+        spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+        blocked_reschedule();
+        spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+
+        // a signal may have woken us up before the interrupt did, or both, leave no trace of this wait either way
+        waitlist_remove_me(&irqio->waitlist);
+        scheduler_discard_wakeup();
+
+        if (irqio->pending == 0 && signal_has_pending())
+        {
+            spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+            return -ERESTARTSYS;
+        }
+    }
+
+    const u64 count = irqio->pending;
+    irqio->pending = 0;
+    spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+
+    pr_dinfo2(irq, "irq %u fired %llu times", irqio->irq, count);
+    memcpy(buf, &count, sizeof(count));
+    return sizeof(count);
+}
+
+static size_t irq_io_write(io_t *io, const void *buf, size_t size)
+{
+    MOS_UNUSED(buf);
+    irq_io_t *irqio = container_of(io, irq_io_t, io);
+    if (irqio->msi)
+        return size; // edge-triggered, never masked, nothing to acknowledge
+
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+    const bool was_unacked = irqio->unacked;
+    irqio->unacked = false;
+
+    bool others_unacked = false;
+    list_foreach(irq_io_t, other, irq_ios)
+        others_unacked |= other->irq == irqio->irq && other->unacked;
+
+    if (was_unacked && !others_unacked)
+        platform_irq_line_unmask(irqio->irq);
+    spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+
+    return size;
+}
+
+static void irq_io_close(io_t *io)
+{
+    irq_io_t *irqio = container_of(io, irq_io_t, io);
+
+    spinlock_acquire(&irq_routing_lock);
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+    list_remove(irqio);
+    const bool last = irq_io_find_locked(irqio->irq, NULL) == NULL;
+    spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+
+    if (last)
+    {
+        if (irqio->msi)
+            platform_msi_free(irqio->irq);
+        else
+            platform_irq_line_disable(irqio->irq);
+        platform_irq_handler_remove(irqio->irq, irq_io_handler);
+    }
+    else if (irqio->unacked)
+    {
+        irq_io_write(io, NULL, 0); // the others may be waiting for this driver to acknowledge the line
+    }
+    spinlock_release(&irq_routing_lock);
+
+    pr_dinfo2(irq, "closed irq %u", irqio->irq);
+    kfree(irqio);
+}
+
+static void irq_io_get_name(io_t *io, char *buf, size_t size)
+{
+    const irq_io_t *irqio = container_of(io, irq_io_t, io);
+    snprintf(buf, size, "%s:%u (cpu %u)", irqio->msi ? "msi" : "irq", irqio->irq, irqio->cpu);
+}
+
+static const io_op_t irq_io_ops = {
+    .read = irq_io_read,
+    .write = irq_io_write,
+    .close = irq_io_close,
+    .get_name = irq_io_get_name,
+};
+
+static bool irq_io_resolve_cpu(u32 *cpu)
+{
+    if (*cpu == IRQ_CPU_ANY)
+    {
+        // spread the interrupts of different devices over all CPUs
+        *cpu = __atomic_fetch_add(&irq_next_cpu, 1, __ATOMIC_RELAXED) % platform_info->num_cpus;
+        return true;
+    }
+
+    return *cpu < platform_info->num_cpus;
+}
+
+static irq_io_t *irq_io_create(u32 irq, u32 cpu, bool msi)
+{
+    irq_io_t *irqio = kmalloc(irq_io_slab);
+    linked_list_init(list_node(irqio));
+    irqio->irq = irq;
+    irqio->cpu = cpu;
+    irqio->msi = msi;
+    waitlist_init(&irqio->waitlist);
+    io_init(&irqio->io, IO_IRQ, IO_READABLE | IO_WRITABLE, &irq_io_ops);
+
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+    list_node_append(&irq_ios, list_node(irqio));
+    spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+    return irqio;
+}
+
+io_t *irq_io_open(u32 irq, u32 cpu)
+{
+    if (!irq_io_resolve_cpu(&cpu))
+        return ERR_PTR(-EINVAL);
+
+    spinlock_acquire(&irq_routing_lock);
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+    const irq_io_t *sharing = irq_io_find_locked(irq, NULL);
+    if (sharing && sharing->msi)
+    {
+        spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+        spinlock_release(&irq_routing_lock);
+        return ERR_PTR(-EINVAL); // not a legacy line
+    }
+    cpu = sharing ? sharing->cpu : cpu; // a shared line stays where it was routed to
+    spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+
+    irq_io_t *irqio = irq_io_create(irq, cpu, false);
+    if (!sharing)
+    {
+        // the handler goes first, a line that is masked when delivered and never handled would stay masked
+        const bool installed = platform_irq_handler_install(irq, irq_io_handler);
+        if (!installed || !platform_irq_line_route(irq, cpu))
+        {
+            if (installed)
+                platform_irq_handler_remove(irq, irq_io_handler);
+            spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+            list_remove(irqio);
+            spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+            spinlock_release(&irq_routing_lock);
+            kfree(irqio);
+            pr_dinfo2(irq, "irq %u can't be used by userspace", irq);
+            return ERR_PTR(-EBUSY);
+        }
+    }
+    spinlock_release(&irq_routing_lock);
+
+    pr_dinfo2(irq, "opened irq %u on cpu %u%s", irq, cpu, sharing ? ", shared" : "");
+    return &irqio->io;
+}
+
+io_t *irq_io_msi_open(u32 cpu, msi_message_t *message)
+{
+    if (!irq_io_resolve_cpu(&cpu))
+        return ERR_PTR(-EINVAL);
+
+    spinlock_acquire(&irq_routing_lock);
+    u32 irq;
+    msi_message_t msg;
+    if (!platform_msi_allocate(cpu, &irq, &msg))
+    {
+        spinlock_release(&irq_routing_lock);
+        return ERR_PTR(-ENOSPC);
+    }
+
+    irq_io_t *irqio = irq_io_create(irq, cpu, true);
+    platform_irq_handler_install(irq, irq_io_handler);
+    spinlock_release(&irq_routing_lock);
+
+    pr_dinfo2(irq, "opened msi %u on cpu %u, address " PTR_FMT ", data 0x%x", irq, cpu, (ptr_t) msg.address, msg.data);
+    *message = msg;
+    return &irqio->io;
+}
+
+long irq_io_set_affinity(io_t *io, u32 cpu, msi_message_t *message)
+{
+    if (io->type != IO_IRQ)
+        return -EINVAL;
+
+    if (!irq_io_resolve_cpu(&cpu))
+        return -EINVAL;
+
+    irq_io_t *irqio = container_of(io, irq_io_t, io);
+    spinlock_acquire(&irq_routing_lock);
+    if (irqio->msi)
+    {
+        if (!message)
+        {
+            spinlock_release(&irq_routing_lock);
+            return -EFAULT;
+        }
+
+        platform_msi_set_affinity(irqio->irq, cpu, message);
+        irqio->cpu = cpu;
+    }
+    else
+    {
+        // a line that is waiting to be acknowledged fires again on the new CPU, drivers of shared lines
+        // have to cope with interrupts that weren't for their device anyway
+        platform_irq_line_disable(irqio->irq);
+        MOS_ASSERT(platform_irq_line_route(irqio->irq, cpu));
+
+        bool irq_enabled;
+        spinlock_acquire_irqsave(&irq_ios_lock, irq_enabled);
+        list_foreach(irq_io_t, other, irq_ios)
+        {
+            if (other->irq == irqio->irq)
+                other->cpu = cpu, other->unacked = false;
+        }
+        spinlock_release_irqrestore(&irq_ios_lock, irq_enabled);
+    }
+    spinlock_release(&irq_routing_lock);
+
+    pr_dinfo2(irq, "moved %s %u to cpu %u", irqio->msi ? "msi" : "irq", irqio->irq, cpu);
+    return 0;
+}
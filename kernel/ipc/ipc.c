@@ -8,6 +8,7 @@
 #include "mos/filesystem/sysfs/sysfs_autoinit.h"
 #include "mos/filesystem/vfs_types.h"
 #include "mos/ipc/pipe.h"
+#include "mos/misc/trace.h"
 #include "mos/mm/slab.h"
 #include "mos/mm/slab_autoinit.h"
 #include "mos/platform/platform.h"
@@ -19,6 +20,7 @@
 #include <mos/filesystem/fs_types.h>
 #include <mos/lib/structures/hashmap_common.h>
 #include <mos/lib/structures/list.h>
+#include <mos/locks/rcu.h>
 #include <mos/mos_global.h>
 #include <mos_stdlib.h>
 #include <mos_string.h>
@@ -52,6 +54,7 @@ typedef struct _ipc_server
     const char *name;
     spinlock_t lock;
     inode_t *sysfs_ino; ///< inode for sysfs
+    u64 sysfs_pos;      ///< position in the sysfs listing, servers are appended in the order of their positions
     size_t pending_max, pending_n;
     size_t established_n;
     list_head pending;     ///< list of ipc_t
@@ -68,14 +71,15 @@ SLAB_AUTOINIT("ipc", ipc_slab, ipc_t);
 
 static list_head ipc_servers = LIST_HEAD_INIT(ipc_servers);
 static hashmap_t name_waitlist;             // waitlist for an IPC server, key = name, value = waitlist_t *
-static spinlock_t ipc_lock = SPINLOCK_INIT; ///< protects ipc_servers and name_waitlist
+static spinlock_t ipc_lock = SPINLOCK_INIT; ///< protects name_waitlist and changes to ipc_servers, which is read with RCU
+static u64 ipc_next_sysfs_pos = VFS_DIR_POS_START; ///< protected by ipc_lock
 
 void ipc_server_close(ipc_server_t *server)
 {
     spinlock_acquire(&ipc_lock);
     spinlock_acquire(&server->lock);
-    // remove the server from the list
-    list_remove(server);
+    // remove the server from the list, lookups that have already found it will see it closed
+    list_remove_rcu(server);
 
     waitlist_t *waitlist = hashmap_get(&name_waitlist, (ptr_t) server->name);
     if (waitlist)
@@ -110,30 +114,37 @@ void ipc_server_close(ipc_server_t *server)
     }
     else
     {
-        // now we can free the server
-        kfree(server->name);
+        // now we can free the server, once no lookup can be looking at it
         spinlock_release(&server->lock);
+        synchronize_rcu();
+        kfree(server->name);
         kfree(server);
     }
 }
 
 size_t ipc_client_read(ipc_t *ipc, void *buf, size_t size)
 {
-    return pipe_read(ipc->client_read_pipe, buf, size);
+    const size_t ret = pipe_read(ipc->client_read_pipe, buf, size);
+    trace_event(TRACE_IPC_RECV, 0, ipc, ret);
+    return ret;
 }
 
 size_t ipc_client_write(ipc_t *ipc, const void *buf, size_t size)
 {
+    trace_event(TRACE_IPC_SEND, 0, ipc, size);
     return pipe_write(ipc->client_write_pipe, buf, size);
 }
 
 size_t ipc_server_read(ipc_t *ipc, void *buf, size_t size)
 {
-    return pipe_read(ipc->server_read_pipe, buf, size);
+    const size_t ret = pipe_read(ipc->server_read_pipe, buf, size);
+    trace_event(TRACE_IPC_RECV, 1, ipc, ret);
+    return ret;
 }
 
 size_t ipc_server_write(ipc_t *ipc, const void *buf, size_t size)
 {
+    trace_event(TRACE_IPC_SEND, 1, ipc, size);
     return pipe_write(ipc->server_write_pipe, buf, size);
 }
 
@@ -197,8 +208,10 @@ ipc_server_t *ipc_server_create(const char *name, size_t max_pending)
     server->name = strdup(name);
     server->pending_max = max_pending;
 
+    server->sysfs_pos = ipc_next_sysfs_pos++;
+
     // now announce the server
-    list_node_append(&ipc_servers, list_node(server));
+    list_node_append_rcu(&ipc_servers, list_node(server));
     ipc_sysfs_create_ino(server);
 
     // check and see if there is a waitlist for this name
@@ -220,17 +233,41 @@ ipc_server_t *ipc_server_create(const char *name, size_t max_pending)
 
 ipc_server_t *ipc_get_server(const char *name)
 {
-    spinlock_acquire(&ipc_lock);
-    list_foreach(ipc_server_t, server, ipc_servers)
+    ipc_server_t *found = NULL;
+    rcu_read_lock();
+    list_foreach_rcu(ipc_server_t, server, ipc_servers)
     {
         if (strcmp(server->name, name) == 0)
         {
-            spinlock_release(&ipc_lock);
-            return server;
+            found = server;
+            break;
         }
     }
+    rcu_read_unlock();
+    return found;
+}
 
-    spinlock_release(&ipc_lock);
+// find a server that is not closed, and lock it, without taking ipc_lock
+static ipc_server_t *ipc_find_server_locked(const char *name)
+{
+    rcu_read_lock();
+    list_foreach_rcu(ipc_server_t, server, ipc_servers)
+    {
+        if (strcmp(server->name, name) != 0)
+            continue;
+
+        spinlock_acquire(&server->lock);
+        if (server->pending_max == 0)
+        {
+            spinlock_release(&server->lock); // it's being closed
+            break;
+        }
+
+        rcu_read_unlock(); // with its lock held, the server can't be closed, nor freed
+        return server;
+    }
+
+    rcu_read_unlock();
     return NULL;
 }
 
@@ -246,6 +283,8 @@ retry_accept:
     {
         // now we can free the server
         pr_dinfo2(ipc, "ipc server '%s' is closed, aborting accept()", ipc_server->name);
+        spinlock_release(&ipc_server->lock);
+        synchronize_rcu(); // a lookup may still be looking at it
         kfree(ipc_server->name);
         kfree(ipc_server);
         return ERR_PTR(-ECONNABORTED);
@@ -263,6 +302,7 @@ retry_accept:
         {
             pr_dinfo2(ipc, "woken up by a signal, aborting accept()");
             waitlist_remove_me(&ipc_server->server_waitlist);
+            scheduler_discard_wakeup();
             return ERR_PTR(-EINTR);
         }
 
@@ -289,6 +329,47 @@ retry_accept:
     return ipc;
 }
 
+// the waitlist of threads waiting for a server to be created, created if there isn't one yet
+static waitlist_t *ipc_name_waitlist_locked(const char *name)
+{
+    MOS_ASSERT(spinlock_is_locked(&ipc_lock));
+    waitlist_t *waitlist = hashmap_get(&name_waitlist, (ptr_t) name);
+    if (waitlist)
+        return waitlist;
+
+    waitlist = kmalloc(waitlist_slab);
+    waitlist_init(waitlist);
+    hashmap_put(&name_waitlist, (ptr_t) strdup(name), waitlist); // the key must be in kernel memory, and stays with the waitlist
+    pr_dinfo2(ipc, "created waitlist for ipc server '%s'", name);
+    return waitlist;
+}
+
+long ipc_wait_for_server(const char *name)
+{
+    while (true)
+    {
+        spinlock_acquire(&ipc_lock);
+        if (ipc_get_server(name))
+        {
+            spinlock_release(&ipc_lock);
+            return 0;
+        }
+
+        // servers are created with ipc_lock held, so it can't be announced before we are on the waitlist
+        waitlist_t *waitlist = ipc_name_waitlist_locked(name);
+        MOS_ASSERT(waitlist_append(waitlist));
+        spinlock_release(&ipc_lock);
+        blocked_reschedule();
+
+        if (signal_has_pending())
+        {
+            waitlist_remove_me(waitlist);
+            scheduler_discard_wakeup();
+            return -EINTR;
+        }
+    }
+}
+
 ipc_t *ipc_connect_to_server(const char *name, size_t buffer_size)
 {
     if (buffer_size == 0)
@@ -296,20 +377,27 @@ ipc_t *ipc_connect_to_server(const char *name, size_t buffer_size)
 
     pr_dinfo(ipc, "connecting to ipc server '%s' with buffer_size=%zu", name, buffer_size);
 
+    ipc_server_t *ipc_server;
+
 check_server:
-    // check if the server exists
-    spinlock_acquire(&ipc_lock);
-    ipc_server_t *ipc_server = NULL;
-    list_foreach(ipc_server_t, server, ipc_servers)
+    // check if the server exists, usually it does and ipc_lock is not needed
+    ipc_server = ipc_find_server_locked(name);
+    const bool slow_path = !ipc_server;
+    if (slow_path)
     {
-        if (strcmp(server->name, name) == 0)
+        // look again under ipc_lock, so that the server can't be created between the lookup and waiting for it
+        spinlock_acquire(&ipc_lock);
+        list_foreach(ipc_server_t, server, ipc_servers)
         {
-            ipc_server = server;
-            // we are holding the ipc_servers_lock, so that the server won't deannounce itself
-            // while we are checking the server list, thus the server won't be freed
-            spinlock_acquire(&ipc_server->lock);
-            pr_dinfo2(ipc, "found ipc server '%s'", ipc_server->name);
-            break;
+            if (strcmp(server->name, name) == 0)
+            {
+                ipc_server = server;
+                // we are holding the ipc_servers_lock, so that the server won't deannounce itself
+                // while we are checking the server list, thus the server won't be freed
+                spinlock_acquire(&ipc_server->lock);
+                pr_dinfo2(ipc, "found ipc server '%s'", ipc_server->name);
+                break;
+            }
         }
     }
 
@@ -324,24 +412,7 @@ check_server:
     if (!ipc_server)
     {
         // no server found, wait for it to be created
-        waitlist_t *waitlist = hashmap_get(&name_waitlist, (ptr_t) name);
-        if (!waitlist)
-        {
-            waitlist = kmalloc(waitlist_slab);
-            waitlist_init(waitlist);
-            waitlist_t *const old = hashmap_put(&name_waitlist, (ptr_t) ipc->server_name, waitlist); // the key must be in kernel memory
-            if (old)
-            {
-                // someone else has created the waitlist, but now we have replaced it
-                // so we have to append the old waitlist to the new one
-                list_foreach(thread_t, thread, old->list)
-                {
-                    MOS_ASSERT(waitlist_append(waitlist));
-                }
-            }
-            pr_dinfo2(ipc, "created waitlist for ipc server '%s'", name);
-        }
-
+        waitlist_t *waitlist = ipc_name_waitlist_locked(name);
         pr_dinfo2(ipc, "no ipc server '%s' found, waiting for it to be created...", name);
         MOS_ASSERT(waitlist_append(waitlist));
         spinlock_release(&ipc_lock);
@@ -350,6 +421,8 @@ check_server:
         if (signal_has_pending())
         {
             pr_dinfo2(ipc, "woken up by a signal, aborting connect()");
+            waitlist_remove_me(waitlist);
+            scheduler_discard_wakeup();
             kfree(ipc);
             return ERR_PTR(-EINTR);
         }
@@ -357,7 +430,9 @@ check_server:
         // now check if the server exists again
         goto check_server;
     }
-    spinlock_release(&ipc_lock);
+
+    if (slow_path)
+        spinlock_release(&ipc_lock);
 
     // add the connection to the pending list
     if (ipc_server->pending_n >= ipc_server->pending_max)
@@ -418,15 +493,22 @@ static inode_t *ipc_sysfs_create_ino(ipc_server_t *ipc_server)
     return ipc_server->sysfs_ino;
 }
 
-static void ipc_sysfs_list_ipcs(sysfs_item_t *item, dentry_t *d, vfs_listdir_state_t *state, dentry_iterator_op add_record)
+static void ipc_sysfs_list_ipcs(sysfs_item_t *item, dentry_t *d, vfs_dir_context_t *ctx)
 {
     MOS_UNUSED(item);
     MOS_UNUSED(d);
 
     list_foreach(ipc_server_t, ipc_server, ipc_servers)
     {
+        if (ipc_server->sysfs_pos < ctx->pos)
+            continue;
+
         MOS_ASSERT(ipc_server->sysfs_ino);
-        add_record(state, ipc_server->sysfs_ino->ino, ipc_server->name, strlen(ipc_server->name), ipc_server->sysfs_ino->type);
+        ctx->pos = ipc_server->sysfs_pos;
+        if (!ctx->emit(ctx, ipc_server->sysfs_ino->ino, ipc_server->name, strlen(ipc_server->name), ipc_server->sysfs_ino->type))
+            return;
+
+        ctx->pos = ipc_server->sysfs_pos + 1;
     }
 }
 
@@ -57,9 +57,12 @@ retry_write:;
     {
         // buffer is full, wait for the reader to read some data
         pr_dinfo2(pipe, "%pt: pipe buffer full, waiting...", (void *) current_thread);
+        // wake up any readers that are waiting for data, and wait for them to read some
+        // (getting on the waitlist before releasing the lock, so that a read in between can't be missed)
+        waitlist_wake(&pipe->waitlist, INT_MAX);
+        MOS_ASSERT(waitlist_append(&pipe->waitlist));
         spinlock_release(&pipe->lock);
-        waitlist_wake(&pipe->waitlist, INT_MAX);              // wake up any readers that are waiting for data
-        MOS_ASSERT(reschedule_for_waitlist(&pipe->waitlist)); // wait for the reader to read some data
+        blocked_reschedule();
         spinlock_acquire(&pipe->lock);
 
         // check if the pipe is still valid
@@ -76,8 +79,9 @@ retry_write:;
 
     spinlock_release(&pipe->lock);
 
-    // wake up any readers that are waiting for data
-    waitlist_wake(&pipe->waitlist, INT_MAX);
+    // wake up any readers that are waiting for data, and let the reader run right away,
+    // so that a request-reply exchange over a pipe (or IPC) doesn't wait for the scheduler at every step
+    waitlist_wake_and_yield(&pipe->waitlist, INT_MAX);
     return total_written;
 }
 
@@ -114,9 +118,11 @@ retry_read:;
 
         // buffer is empty, wait for the writer to write some data
         pr_dinfo2(pipe, "%pt: pipe buffer empty, waiting...", (void *) current_thread);
+        // wake up any writers that are waiting for space in the buffer, and wait for them to write some data
+        waitlist_wake(&pipe->waitlist, INT_MAX);
+        MOS_ASSERT(waitlist_append(&pipe->waitlist));
         spinlock_release(&pipe->lock);
-        waitlist_wake(&pipe->waitlist, INT_MAX);              // wake up any writers that are waiting for space in the buffer
-        MOS_ASSERT(reschedule_for_waitlist(&pipe->waitlist)); // wait for the writer to write some data
+        blocked_reschedule();
         spinlock_acquire(&pipe->lock);
         goto retry_read;
     }
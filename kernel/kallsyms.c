@@ -1,22 +1,37 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include <mos/kallsyms.h>
+#include <mos/mos_global.h>
 
-const kallsyms_t *kallsyms_get_symbol(ptr_t addr)
+static size_t kallsyms_count(void)
 {
-    // kallsyms are sorted by address
-    const kallsyms_t *ks = mos_kallsyms;
-    const kallsyms_t *result = NULL;
+    static size_t count = 0; // counted the first time, mos_kallsyms is terminated by a NULL name
+
+    size_t n = __atomic_load_n(&count, __ATOMIC_RELAXED);
+    if (unlikely(!n))
+    {
+        while (mos_kallsyms[n].name)
+            n++;
+        __atomic_store_n(&count, n, __ATOMIC_RELAXED);
+    }
 
-    while (ks->name)
+    return n;
+}
+
+const kallsyms_t *kallsyms_get_symbol(ptr_t addr)
+{
+    // kallsyms are sorted by address, find the last one at or below addr
+    size_t low = 0, high = kallsyms_count();
+    while (low < high)
     {
-        if (ks->address > addr)
-            break;
-        result = ks;
-        ks++;
+        const size_t mid = low + (high - low) / 2;
+        if (mos_kallsyms[mid].address <= addr)
+            low = mid + 1;
+        else
+            high = mid;
     }
 
-    return result;
+    return low ? &mos_kallsyms[low - 1] : NULL;
 }
 
 const char *kallsyms_get_symbol_name(ptr_t addr)
@@ -1,6 +1,10 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "mos/device/clocksource.h"
+#include "mos/device/timer.h"
+#include "mos/device/timekeeping.h"
+#include "mos/interrupt/irq_io.h"
+#include "mos/ipc/ipc.h"
 #include "mos/ipc/ipc_io.h"
 #include "mos/ipc/pipe.h"
 #include "mos/misc/power.h"
@@ -155,6 +159,11 @@ DEFINE_SYSCALL(pid_t, spawn)(const char *path, const char *const argv[], const c
     return process->pid;
 }
 
+DEFINE_SYSCALL(pid_t, spawnat)(fd_t dirfd, const char *path, const char *const argv[], const char *const envp[], const spawn_attr_t *attr)
+{
+    return process_do_spawn(current_process, dirfd, path, argv, envp, attr);
+}
+
 DEFINE_SYSCALL(tid_t, create_thread)(const char *name, thread_entry_t entry, void *arg, size_t stack_size, void *stack)
 {
     thread_t *thread = thread_new(current_process, THREAD_MODE_USER, name, stack_size, stack);
@@ -218,10 +227,7 @@ DEFINE_SYSCALL(ptr_t, heap_control)(heap_control_op op, ptr_t arg)
                 return 0; // no change
 
             if (arg < block->vaddr + block->npages * MOS_PAGE_SIZE)
-            {
-                mos_warn("heap_control: shrinking heap not supported yet");
-                return 0;
-            }
+                return process_shrink_heap(process, block->npages - (arg - block->vaddr) / MOS_PAGE_SIZE);
 
             return process_grow_heap(process, (arg - block->vaddr) / MOS_PAGE_SIZE);
         }
@@ -232,6 +238,7 @@ DEFINE_SYSCALL(ptr_t, heap_control)(heap_control_op op, ptr_t arg)
             // some bad guy would pass a huge value here :)
             return process_grow_heap(process, arg);
         }
+        case HEAP_SHRINK_PAGES: return process_shrink_heap(process, arg);
         default: mos_warn("heap_control: unknown op %d", op); return 0;
     }
 }
@@ -246,6 +253,11 @@ DEFINE_SYSCALL(bool, futex_wait)(futex_word_t *futex, u32 val)
     return futex_wait(futex, val);
 }
 
+DEFINE_SYSCALL(long, futex_timedwait)(futex_word_t *futex, u32 val, u64 timeout_ms)
+{
+    return futex_timedwait(futex, val, timeout_ms);
+}
+
 DEFINE_SYSCALL(bool, futex_wake)(futex_word_t *futex, size_t count)
 {
     return futex_wake(futex, count);
@@ -402,11 +414,22 @@ DEFINE_SYSCALL(bool, vm_protect)(void *addr, size_t size, mem_perm_t perm)
     return vm_protect(current_mm, (ptr_t) addr, size, (vm_flags) perm);
 }
 
+DEFINE_SYSCALL(bool, vm_advise)(void *addr, size_t size, mem_advice_t advice)
+{
+    return vm_advise(current_mm, (ptr_t) addr, size, advice);
+}
+
 DEFINE_SYSCALL(int, io_poll)(struct pollfd *fds, nfds_t nfds, int timeout)
 {
     if (timeout == 0) // poll with timeout 0 is just a check
         return 0;
 
+    if (nfds == 0 && timeout > 0) // nothing to poll, just sleep
+    {
+        ktimer_block_current(timeout);
+        return 0;
+    }
+
     if (!fds || nfds == 0)
         return -1;
 
@@ -440,9 +463,14 @@ DEFINE_SYSCALL(int, io_poll)(struct pollfd *fds, nfds_t nfds, int timeout)
 
 DEFINE_SYSCALL(int, io_pselect)(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, const struct timespec *timeout, const sigset_t *sigmask)
 {
-    MOS_UNUSED(timeout);
     MOS_UNUSED(sigmask);
 
+    if (nfds == 0 && timeout) // nothing to select, just sleep
+    {
+        ktimer_block_current(timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000);
+        return 0;
+    }
+
     for (int i = 0; i < nfds; i++)
     {
         if (readfds && FD_ISSET(i, readfds))
@@ -578,10 +606,9 @@ DEFINE_SYSCALL(long, vfs_unmount)(const char *path)
 
 DEFINE_SYSCALL(long, clock_gettimeofday)(struct timespec *ts)
 {
-    timeval_t tv;
-    platform_get_time(&tv);
-    ts->tv_sec = tv.hour * 3600 + tv.minute * 60 + tv.second;
-    ts->tv_nsec = 0;
+    const u64 ns = timekeeping_now_ns();
+    ts->tv_sec = ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
     return 0;
 }
 
@@ -628,3 +655,50 @@ DEFINE_SYSCALL(long, io_pread)(fd_t fd, void *buf, size_t count, off_t offset)
 
     return io_pread(io, buf, count, offset);
 }
+
+DEFINE_SYSCALL(fd_t, irq_open)(u32 irq, u32 cpu)
+{
+    io_t *io = irq_io_open(irq, cpu);
+    if (IS_ERR(io))
+        return PTR_ERR(io);
+    return process_attach_ref_fd(current_process, io, FD_FLAGS_NONE);
+}
+
+DEFINE_SYSCALL(fd_t, irq_msi_open)(u32 cpu, msi_message_t *message)
+{
+    if (message == NULL)
+        return -EFAULT;
+
+    io_t *io = irq_io_msi_open(cpu, message);
+    if (IS_ERR(io))
+        return PTR_ERR(io);
+    return process_attach_ref_fd(current_process, io, FD_FLAGS_NONE);
+}
+
+DEFINE_SYSCALL(long, irq_set_affinity)(fd_t fd, u32 cpu, msi_message_t *message)
+{
+    io_t *io = process_get_fd(current_process, fd);
+    if (!io)
+        return -EBADF;
+
+    return irq_io_set_affinity(io, cpu, message);
+}
+
+DEFINE_SYSCALL(fd_t, dmabuf_sg_map)(void *buf, size_t size, bool device_writes, dma_sg_entry_t *entries, size_t *n_entries)
+{
+    if (n_entries == NULL || (entries == NULL && *n_entries > 0))
+        return -EFAULT;
+
+    io_t *io = dmabuf_sg_map(buf, size, device_writes, entries, n_entries);
+    if (IS_ERR(io))
+        return PTR_ERR(io);
+    return process_attach_ref_fd(current_process, io, FD_FLAGS_NONE);
+}
+
+DEFINE_SYSCALL(long, ipc_wait)(const char *name)
+{
+    if (name == NULL)
+        return -EFAULT;
+
+    return ipc_wait_for_server(name);
+}
@@ -2,7 +2,7 @@
 
 #include "mos/ksyscall_entry.h"
 
-#include "mos/misc/profiling.h"
+#include "mos/misc/trace.h"
 #include "mos/syscall/table.h"
 #include "mos/tasks/signal.h"
 
@@ -12,9 +12,9 @@
 
 reg_t ksyscall_enter(reg_t number, reg_t arg1, reg_t arg2, reg_t arg3, reg_t arg4, reg_t arg5, reg_t arg6)
 {
-    const pf_point_t ev = profile_enter();
+    trace_event(TRACE_SYSCALL_ENTER, 0, number, arg1);
     reg_t ret = dispatch_syscall(number, arg1, arg2, arg3, arg4, arg5, arg6);
-    profile_leave(ev, "syscall.%lu.%s", num, syscall_names[num]);
+    trace_event(TRACE_SYSCALL_EXIT, 0, number, ret);
 
     if (IS_ERR_VALUE(ret))
     {
@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <errno.h>
+#include <mos/device/timer.h>
 #include <mos/lib/structures/list.h>
 #include <mos/lib/sync/spinlock.h>
 #include <mos/locks/futex.h>
@@ -29,6 +31,32 @@ static futex_key_t futex_get_key(const futex_word_t *futex)
     return mm_get_phys_addr(current_process->mm, vaddr);
 }
 
+static futex_private_t *futex_get_or_create(futex_key_t key)
+{
+    futex_private_t *fu = NULL;
+
+    spinlock_acquire(&futex_list_lock);
+    list_foreach(futex_private_t, f, futex_list_head)
+    {
+        if (f->key == key)
+        {
+            fu = f;
+            break;
+        }
+    }
+
+    if (!fu)
+    {
+        fu = kmalloc(sizeof(futex_private_t));
+        fu->key = key;
+        waitlist_init(&fu->waiters);
+        list_node_append(&futex_list_head, list_node(fu));
+    }
+    spinlock_release(&futex_list_lock);
+
+    return fu;
+}
+
 bool futex_wait(futex_word_t *futex, futex_word_t expected)
 {
     const futex_word_t current_value = __atomic_load_n(futex, __ATOMIC_SEQ_CST);
@@ -62,27 +90,7 @@ bool futex_wait(futex_word_t *futex, futex_word_t expected)
     // if it's not there, create a new one add the current thread to the waiters list
     // then reschedule
     const futex_key_t key = futex_get_key(futex);
-
-    futex_private_t *fu = NULL;
-
-    spinlock_acquire(&futex_list_lock);
-    list_foreach(futex_private_t, f, futex_list_head)
-    {
-        if (f->key == key)
-        {
-            fu = f;
-            break;
-        }
-    }
-
-    if (!fu)
-    {
-        fu = kmalloc(sizeof(futex_private_t));
-        fu->key = key;
-        waitlist_init(&fu->waiters);
-        list_node_append(&futex_list_head, list_node(fu));
-    }
-    spinlock_release(&futex_list_lock);
+    futex_private_t *fu = futex_get_or_create(key);
 
     pr_dinfo2(futex, "tid %pt waiting on lock key=" PTR_FMT, (void *) current_thread, key);
 
@@ -93,6 +101,31 @@ bool futex_wait(futex_word_t *futex, futex_word_t expected)
     return true;
 }
 
+long futex_timedwait(futex_word_t *futex, futex_word_t expected, u64 timeout_ms)
+{
+    if (__atomic_load_n(futex, __ATOMIC_SEQ_CST) != expected)
+        return -EAGAIN; // see futex_wait
+
+    const futex_key_t key = futex_get_key(futex);
+    futex_private_t *fu = futex_get_or_create(key);
+
+    pr_dinfo2(futex, "tid %pt waiting on lock key=" PTR_FMT " for %llu ms", (void *) current_thread, key, timeout_ms);
+
+    const bool ok = waitlist_append(&fu->waiters);
+    MOS_ASSERT(ok);
+
+    const bool timed_out = ktimer_block_current(timeout_ms);
+
+    // futex_wake takes the waiter off the list, if we are still on it, something else woke us up
+    const bool removed = waitlist_remove_me(&fu->waiters);
+    scheduler_discard_wakeup(); // a futex_wake after the timer has already woken us up
+    if (!removed)
+        return 0;
+
+    pr_dinfo2(futex, "tid %pt %s", (void *) current_thread, timed_out ? "timed out" : "interrupted");
+    return timed_out ? -ETIMEDOUT : -EINTR;
+}
+
 bool futex_wake(futex_word_t *futex, size_t num_to_wake)
 {
     if (unlikely(num_to_wake == 0))
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mos/lib/sync/spinlock.h>
+
+#if MOS_SPINLOCK_LOCKSTAT
+
+#include "mos/filesystem/sysfs/sysfs.h"
+#include "mos/filesystem/sysfs/sysfs_autoinit.h"
+#include "mos/platform/platform.h"
+
+#include <mos/mos_global.h>
+
+// every site that has acquired a lock, pushed on first use, and never removed
+static spinlock_site_t *lockstat_sites = NULL;
+
+static void lockstat_register_site(spinlock_site_t *site)
+{
+    if (__atomic_exchange_n(&site->registered, true, __ATOMIC_RELAXED))
+        return;
+
+    spinlock_site_t *head = __atomic_load_n(&lockstat_sites, __ATOMIC_RELAXED);
+    do
+        site->next = head;
+    while (!__atomic_compare_exchange_n(&lockstat_sites, &head, site, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void lockstat_update_max(u64 *max, u64 value)
+{
+    u64 current = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > current && !__atomic_compare_exchange_n(max, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void spinlock_stat_acquire(spinlock_t *lock, spinlock_site_t *site)
+{
+    lockstat_register_site(site);
+
+    const u64 start = platform_get_timestamp();
+    const bool contended = spinlock_ticket_acquire(lock);
+    const u64 now = platform_get_timestamp();
+
+    __atomic_fetch_add(&site->acquisitions, 1, __ATOMIC_RELAXED);
+    if (contended)
+    {
+        __atomic_fetch_add(&site->contentions, 1, __ATOMIC_RELAXED);
+        lockstat_update_max(&site->max_wait, now - start);
+    }
+
+    lock->site = site;
+    lock->acquired_at = now;
+}
+
+void spinlock_stat_release(spinlock_t *lock)
+{
+    spinlock_site_t *site = lock->site;
+    if (site)
+    {
+        lockstat_update_max(&site->max_hold, platform_get_timestamp() - lock->acquired_at);
+        lock->site = NULL;
+    }
+
+    spinlock_ticket_release(lock);
+}
+
+// ! sysfs support
+
+static bool lockstat_sysfs_sites(sysfs_file_t *f, u64 *cursor)
+{
+    if (*cursor == 0)
+        sysfs_printf(f, "%-48s %12s %12s %14s %14s\n", "site", "acquired", "contended", "max wait", "max hold");
+
+    u64 i = 0;
+    for (spinlock_site_t *site = __atomic_load_n(&lockstat_sites, __ATOMIC_ACQUIRE); site; site = site->next)
+    {
+        if (i++ < *cursor)
+            continue;
+
+        sysfs_printf(f, "%40s:%-7d %12llu %12llu %14llu %14llu\n", site->file, site->line, site->acquisitions, site->contentions, site->max_wait, site->max_hold);
+        *cursor = i;
+        return true;
+    }
+
+    return false;
+}
+
+static sysfs_item_t lockstat_sysfs_items[] = {
+    SYSFS_SEQ_ITEM("sites", lockstat_sysfs_sites),
+};
+
+SYSFS_AUTOREGISTER(lockstat, lockstat_sysfs_items);
+
+#endif
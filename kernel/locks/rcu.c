@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/locks/rcu.h"
+
+#include "mos/platform/platform.h"
+
+#include <mos/lib/sync/spinlock.h>
+#include <mos/mos_global.h>
+
+typedef struct
+{
+    u32 nesting;         ///< depth of read-side critical sections, read by other CPUs
+    bool irq_enabled;    ///< whether interrupts were enabled before the outermost rcu_read_lock
+    u64 quiescent_count; ///< incremented every time this CPU passes through the scheduler
+} rcu_cpu_t;
+
+static PER_CPU_DECLARE(rcu_cpu_t, rcu_cpus);
+
+static spinlock_t rcu_lock = SPINLOCK_INIT; ///< protects the batches below
+static rcu_head_t *rcu_next_batch = NULL;   ///< callbacks queued since the current grace period started
+static rcu_head_t *rcu_current_batch = NULL;
+static u64 rcu_current_snapshot[PER_CPU_COUNT]; ///< quiescent counts at the start of the current grace period
+
+void rcu_read_lock(void)
+{
+    const bool irq_enabled = platform_interrupt_disable_save();
+    rcu_cpu_t *cpu = per_cpu(rcu_cpus);
+    if (cpu->nesting == 0)
+    {
+        cpu->irq_enabled = irq_enabled;
+        // ordered before the reads of the section, pairs with the fence in rcu_cpu_passed
+        __atomic_store_n(&cpu->nesting, 1, __ATOMIC_SEQ_CST);
+    }
+    else
+    {
+        __atomic_store_n(&cpu->nesting, cpu->nesting + 1, __ATOMIC_RELAXED);
+    }
+}
+
+void rcu_read_unlock(void)
+{
+    rcu_cpu_t *cpu = per_cpu(rcu_cpus);
+    MOS_ASSERT_X(cpu->nesting, "unbalanced rcu_read_unlock");
+    if (cpu->nesting > 1)
+    {
+        __atomic_store_n(&cpu->nesting, cpu->nesting - 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    const bool irq_enabled = cpu->irq_enabled;
+    __atomic_store_n(&cpu->nesting, 0, __ATOMIC_RELEASE); // the reads of the section are done
+    platform_interrupt_restore(irq_enabled);
+}
+
+static void rcu_take_snapshot(u64 *snapshot)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // the unlinking by the caller is visible to any section that starts from now on
+    for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+        snapshot[cpu] = __atomic_load_n(&per_cpu_of(rcu_cpus, cpu)->quiescent_count, __ATOMIC_ACQUIRE);
+}
+
+// whether a CPU can no longer be in a section that started before the snapshot was taken
+static bool rcu_cpu_passed(u32 cpu, const u64 *snapshot)
+{
+    const rcu_cpu_t *rcu_cpu = per_cpu_of(rcu_cpus, cpu);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&rcu_cpu->nesting, __ATOMIC_ACQUIRE) == 0)
+        return true; // any section it enters from now on sees the new version
+
+    return __atomic_load_n(&rcu_cpu->quiescent_count, __ATOMIC_ACQUIRE) != snapshot[cpu];
+}
+
+void synchronize_rcu(void)
+{
+    MOS_ASSERT_X(per_cpu(rcu_cpus)->nesting == 0, "synchronize_rcu called in a read-side critical section");
+
+    u64 snapshot[PER_CPU_COUNT];
+    rcu_take_snapshot(snapshot);
+
+    // read-side sections run with interrupts disabled, they are short
+    for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+        while (!rcu_cpu_passed(cpu, snapshot))
+            spinlock_cpu_relax();
+}
+
+void call_rcu(rcu_head_t *head, rcu_callback_t callback)
+{
+    head->callback = callback;
+    spinlock_acquire(&rcu_lock);
+    head->next = rcu_next_batch;
+    rcu_next_batch = head;
+    spinlock_release(&rcu_lock);
+}
+
+// returns the batch whose grace period has ended, if any, and starts the next one
+static rcu_head_t *rcu_advance_batches_locked(void)
+{
+    rcu_head_t *done = NULL;
+    if (rcu_current_batch)
+    {
+        for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+            if (!rcu_cpu_passed(cpu, rcu_current_snapshot))
+                return NULL;
+
+        done = rcu_current_batch;
+        rcu_current_batch = NULL;
+    }
+
+    if (rcu_next_batch)
+    {
+        rcu_current_batch = rcu_next_batch;
+        rcu_next_batch = NULL;
+        rcu_take_snapshot(rcu_current_snapshot);
+    }
+
+    return done;
+}
+
+void rcu_quiescent_state(void)
+{
+    rcu_cpu_t *cpu = per_cpu(rcu_cpus);
+    __atomic_store_n(&cpu->quiescent_count, cpu->quiescent_count + 1, __ATOMIC_RELEASE);
+
+    if (!__atomic_load_n(&rcu_current_batch, __ATOMIC_RELAXED) && !__atomic_load_n(&rcu_next_batch, __ATOMIC_RELAXED))
+        return; // nothing to do, the common case
+
+    if (!spinlock_try_acquire(&rcu_lock))
+        return; // another CPU is on it
+
+    rcu_head_t *done = rcu_advance_batches_locked();
+    spinlock_release(&rcu_lock);
+
+    while (done)
+    {
+        rcu_head_t *next = done->next; // the callback may free the head
+        done->callback(done);
+        done = next;
+    }
+}
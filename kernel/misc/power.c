@@ -41,5 +41,6 @@ noreturn void power_shutdown(void)
     }
 
     pr_info("Bye!");
+    printk_set_sync(false);
     platform_shutdown();
 }
@@ -0,0 +1,402 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// A sampling profiler, an interrupt on each CPU records the stack it interrupted, /sys/sampler/folded aggregates them for flamegraph.pl
+
+#define pr_fmt(fmt) "sampler: " fmt
+
+#include "mos/misc/sampler.h"
+
+#include "mos/filesystem/sysfs/sysfs_autoinit.h"
+#include "mos/interrupt/ipi.h"
+#include "mos/io/io.h"
+#include "mos/kallsyms.h"
+#include "mos/mm/mm.h"
+#include "mos/mm/physical/pmm.h"
+#include "mos/platform/platform.h"
+#include "mos/printk.h"
+#include "mos/tasks/process.h"
+#include "mos/tasks/task_types.h"
+
+#include <mos/lib/sync/spinlock.h>
+#include <mos_stdio.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+#if MOS_CONFIG(MOS_SAMPLER)
+
+#define SAMPLER_BUFFER_PAGES MOS_SAMPLER_BUFFER_PAGES
+#define SAMPLER_NSAMPLES     (SAMPLER_BUFFER_PAGES * MOS_PAGE_SIZE / sizeof(sample_t))
+#define SAMPLER_MAX_HZ       10000
+#define SAMPLER_LINE_MAX     ((size_t) SAMPLER_MAX_DEPTH * 128)
+
+typedef struct
+{
+    tid_t tid; // 0 if the CPU wasn't running a thread
+    pid_t pid;
+    bool user; // the addresses are in the process, rather than in the kernel
+    u8 depth;
+    ptr_t ips[SAMPLER_MAX_DEPTH]; // innermost first
+} sample_t;
+
+// Only the CPU that owns a buffer writes to it, from its sampling interrupt. The buffer doesn't wrap around, the samples below
+// the head are left alone until the next run resets it, so they can be read while the sampler is still running.
+typedef struct
+{
+    sample_t *samples;
+    size_t head;
+    size_t lost; // dropped because the buffer was full
+} sample_buffer_t;
+
+// one line of the folded output
+typedef struct
+{
+    const sample_t *sample; // the first sample with this stack, NULL if the slot is free
+    size_t count;
+} folded_stack_t;
+
+static PER_CPU_DECLARE(sample_buffer_t, sample_buffers);
+static spinlock_t sampler_lock = SPINLOCK_INIT;        // serialises starting and stopping
+static u32 sampler_hz = 0;                             // of the current run, 0 when stopped
+static u32 sampler_frequency = MOS_SAMPLER_DEFAULT_HZ; // of the next run
+
+void sampler_record(bool user, const ptr_t *ips, size_t depth)
+{
+    sample_buffer_t *buffer = per_cpu(sample_buffers);
+    if (unlikely(!buffer->samples))
+        return;
+
+    const size_t head = buffer->head;
+    if (unlikely(head == SAMPLER_NSAMPLES))
+    {
+        buffer->lost++;
+        return;
+    }
+
+    const thread_t *thread = current_thread;
+    sample_t *sample = &buffer->samples[head];
+    sample->tid = thread ? thread->tid : 0;
+    sample->pid = thread ? thread->owner->pid : 0;
+    sample->user = user;
+    sample->depth = MIN(depth, (size_t) SAMPLER_MAX_DEPTH);
+    memcpy(sample->ips, ips, sample->depth * sizeof(ptr_t));
+    __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void sampler_apply_percpu(void)
+{
+    const u32 hz = __atomic_load_n(&sampler_hz, __ATOMIC_ACQUIRE);
+    if (hz)
+    {
+        sample_buffer_t *buffer = per_cpu(sample_buffers);
+        buffer->lost = 0;
+        __atomic_store_n(&buffer->head, 0, __ATOMIC_RELEASE);
+    }
+
+    platform_sample_timer_set(hz);
+}
+
+// the caller holds sampler_lock, with interrupts disabled so that the current CPU is left out of the IPI and handled here
+static void sampler_apply_all_locked(void)
+{
+    sampler_apply_percpu();
+    ipi_send_all(IPI_TYPE_SAMPLER);
+}
+
+// the caller holds sampler_lock
+static bool sample_buffers_alloc_locked(void)
+{
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        sample_buffer_t *buffer = per_cpu_of(sample_buffers, cpu);
+        if (buffer->samples)
+            continue;
+
+        phyframe_t *frames = mm_get_free_pages(SAMPLER_BUFFER_PAGES);
+        if (!frames)
+        {
+            pr_warn("failed to allocate the sample buffer of cpu %u", cpu);
+            return false;
+        }
+
+        buffer->samples = (sample_t *) phyframe_va(frames); // kept for the next runs
+    }
+
+    return true;
+}
+
+bool sampler_start(u32 hz)
+{
+    spinlock_acquire(&sampler_lock);
+    if (sampler_hz || !sample_buffers_alloc_locked())
+    {
+        spinlock_release(&sampler_lock);
+        return false;
+    }
+
+    __atomic_store_n(&sampler_hz, hz, __ATOMIC_RELEASE);
+    const bool irq_enabled = platform_interrupt_disable_save();
+    sampler_apply_all_locked();
+    platform_interrupt_restore(irq_enabled);
+    spinlock_release(&sampler_lock);
+
+    pr_dinfo2(sampler, "started at %u Hz", hz);
+    return true;
+}
+
+void sampler_stop(void)
+{
+    spinlock_acquire(&sampler_lock);
+    __atomic_store_n(&sampler_hz, 0, __ATOMIC_RELEASE);
+    const bool irq_enabled = platform_interrupt_disable_save();
+    sampler_apply_all_locked();
+    platform_interrupt_restore(irq_enabled);
+    spinlock_release(&sampler_lock);
+
+    pr_dinfo2(sampler, "stopped");
+}
+
+size_t sampler_get_nsamples(u32 cpu)
+{
+    if (cpu >= platform_info->num_cpus)
+        return 0;
+    return __atomic_load_n(&per_cpu_of(sample_buffers, cpu)->head, __ATOMIC_ACQUIRE);
+}
+
+// ! folded stacks
+
+static u64 sample_stack_hash(const sample_t *sample)
+{
+    u64 hash = 14695981039346656037ull; // FNV-1a, a word at a time
+    hash = (hash ^ (u64) sample->pid) * 1099511628211ull;
+    hash = (hash ^ (u64) sample->user) * 1099511628211ull;
+    for (size_t i = 0; i < sample->depth; i++)
+        hash = (hash ^ sample->ips[i]) * 1099511628211ull;
+    return hash;
+}
+
+static bool sample_same_stack(const sample_t *a, const sample_t *b)
+{
+    return a->pid == b->pid && a->user == b->user && a->depth == b->depth && memcmp(a->ips, b->ips, a->depth * sizeof(ptr_t)) == 0;
+}
+
+// a return address points after the call, which may be the first instruction of the next function
+static ptr_t sample_frame_ip(const sample_t *sample, size_t i)
+{
+    return i ? sample->ips[i] - 1 : sample->ips[i];
+}
+
+// a line of the folded output being built, cut short if a stack doesn't fit
+typedef struct
+{
+    char *buf; // SAMPLER_LINE_MAX bytes
+    size_t len;
+} folded_line_t;
+
+__printf(2, 3) static void folded_line_printf(folded_line_t *line, const char *fmt, ...)
+{
+    if (line->len + 1 >= SAMPLER_LINE_MAX)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    const int n = vsnprintf(line->buf + line->len, SAMPLER_LINE_MAX - line->len, fmt, args);
+    va_end(args);
+
+    if (n > 0)
+        line->len = MIN(line->len + (size_t) n, SAMPLER_LINE_MAX - 1);
+}
+
+// the '_[k]' suffix marks kernel frames, as in the folded output of Linux's perf
+static void sampler_print_kernel_frames(folded_line_t *line, const sample_t *sample)
+{
+    for (size_t i = sample->depth; i-- > 0;)
+    {
+        const kallsyms_t *ks = kallsyms_get_symbol(sample_frame_ip(sample, i));
+        folded_line_printf(line, ";%s_[k]", ks ? ks->name : "[unknown]");
+    }
+}
+
+// resolved through the process's current mappings, as a file and an offset in it, which addr2line can turn into a function
+static void sampler_print_user_frames(folded_line_t *line, process_t *proc, const sample_t *sample)
+{
+    mm_context_t *mm = proc ? proc->mm : NULL;
+    if (mm)
+        spinlock_acquire(&mm->mm_lock);
+
+    for (size_t i = sample->depth; i-- > 0;)
+    {
+        const ptr_t ip = sample_frame_ip(sample, i);
+        vmap_t *vmap = mm ? vmap_obtain(mm, ip, NULL) : NULL;
+        if (vmap && vmap->io)
+        {
+            char path[MOS_PATH_MAX_LENGTH];
+            io_get_name(vmap->io, path, sizeof(path));
+            const char *name = strrchr(path, '/');
+            folded_line_printf(line, ";%s+0x%lx", name ? name + 1 : path, ip - vmap->vaddr + vmap->io_offset);
+        }
+        else
+        {
+            folded_line_printf(line, ";[unknown]");
+        }
+
+        if (vmap)
+            spinlock_release(&vmap->lock);
+    }
+
+    if (mm)
+        spinlock_release(&mm->mm_lock);
+}
+
+static void sampler_print_stack(folded_line_t *line, const folded_stack_t *stack)
+{
+    const sample_t *sample = stack->sample;
+    process_t *proc = sample->pid ? process_get(sample->pid) : NULL; // it may have exited since
+
+    line->len = 0;
+    if (proc)
+        folded_line_printf(line, "%s", proc->name);
+    else if (sample->pid)
+        folded_line_printf(line, "[pid %d]", sample->pid);
+    else
+        folded_line_printf(line, "[kernel]");
+
+    if (sample->user)
+        sampler_print_user_frames(line, proc, sample);
+    else
+        sampler_print_kernel_frames(line, sample);
+
+    folded_line_printf(line, " %zu", stack->count);
+}
+
+bool sampler_fold(void (*emit)(const char *line, void *arg), void *arg)
+{
+    size_t nsamples[MOS_MAX_CPU_COUNT];
+    size_t total = 0;
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+        total += nsamples[cpu] = sampler_get_nsamples(cpu);
+
+    if (total == 0)
+        return true;
+
+    size_t nslots = 1;
+    while (nslots < total * 2)
+        nslots <<= 1;
+
+    folded_stack_t *stacks = kcalloc(nslots, sizeof(folded_stack_t));
+    folded_line_t line = { .buf = kmalloc(SAMPLER_LINE_MAX), .len = 0 };
+    if (!stacks || !line.buf)
+    {
+        kfree(stacks);
+        kfree(line.buf);
+        return false;
+    }
+
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        const sample_buffer_t *buffer = per_cpu_of(sample_buffers, cpu);
+        for (size_t i = 0; i < nsamples[cpu]; i++)
+        {
+            const sample_t *sample = &buffer->samples[i];
+            size_t slot = sample_stack_hash(sample) & (nslots - 1);
+            while (stacks[slot].sample && !sample_same_stack(stacks[slot].sample, sample))
+                slot = (slot + 1) & (nslots - 1);
+
+            stacks[slot].sample = sample;
+            stacks[slot].count++;
+        }
+    }
+
+    for (size_t slot = 0; slot < nslots; slot++)
+    {
+        if (!stacks[slot].sample)
+            continue;
+
+        sampler_print_stack(&line, &stacks[slot]);
+        emit(line.buf, arg);
+    }
+
+    kfree(line.buf);
+    kfree(stacks);
+    return true;
+}
+
+// ! sysfs support
+
+static bool sampler_sysfs_enable_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%d\n", __atomic_load_n(&sampler_hz, __ATOMIC_RELAXED) ? 1 : 0);
+    return true;
+}
+
+// '1' starts a new run at /sys/sampler/frequency, '0' stops it
+static bool sampler_sysfs_enable_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+
+    if (strntoll(buf, NULL, 10, count) == 0)
+    {
+        sampler_stop();
+        return true;
+    }
+
+    if (!sampler_start(__atomic_load_n(&sampler_frequency, __ATOMIC_RELAXED)))
+    {
+        pr_warn("failed to start, is it already running?");
+        return false;
+    }
+
+    return true;
+}
+
+static bool sampler_sysfs_frequency_show(sysfs_file_t *f)
+{
+    sysfs_printf(f, "%u\n", __atomic_load_n(&sampler_frequency, __ATOMIC_RELAXED));
+    return true;
+}
+
+static bool sampler_sysfs_frequency_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+
+    const s64 hz = strntoll(buf, NULL, 10, count);
+    if (hz <= 0 || hz > SAMPLER_MAX_HZ)
+    {
+        pr_warn("the frequency must be between 1 and %d Hz", SAMPLER_MAX_HZ);
+        return false;
+    }
+
+    __atomic_store_n(&sampler_frequency, (u32) hz, __ATOMIC_RELAXED); // used by the next run
+    return true;
+}
+
+static bool sampler_sysfs_stats(sysfs_file_t *f)
+{
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        const sample_buffer_t *buffer = per_cpu_of(sample_buffers, cpu);
+        sysfs_printf(f, "cpu%u: %zu samples, %zu lost\n", cpu, sampler_get_nsamples(cpu), __atomic_load_n(&buffer->lost, __ATOMIC_RELAXED));
+    }
+    return true;
+}
+
+static void sampler_sysfs_folded_emit(const char *line, void *arg)
+{
+    sysfs_printf((sysfs_file_t *) arg, "%s\n", line);
+}
+
+static bool sampler_sysfs_folded(sysfs_file_t *f)
+{
+    return sampler_fold(sampler_sysfs_folded_emit, f);
+}
+
+static sysfs_item_t sampler_sysfs_items[] = {
+    SYSFS_RW_ITEM("enable", sampler_sysfs_enable_show, sampler_sysfs_enable_store),
+    SYSFS_RW_ITEM("frequency", sampler_sysfs_frequency_show, sampler_sysfs_frequency_store),
+    SYSFS_RO_ITEM("stats", sampler_sysfs_stats),
+    SYSFS_RO_ITEM("folded", sampler_sysfs_folded),
+};
+
+SYSFS_AUTOREGISTER(sampler, sampler_sysfs_items);
+
+#endif
@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Binary trace records, written to the buffer of the CPU that emits them, and mapped by userspace from /sys/trace
+
+#define pr_fmt(fmt) "trace: " fmt
+
+#include "mos/misc/trace.h"
+
+#include "mos/filesystem/sysfs/sysfs.h"
+#include "mos/mm/mm.h"
+#include "mos/mm/paging/table_ops.h"
+#include "mos/mm/physical/pmm.h"
+#include "mos/platform/platform.h"
+#include "mos/printk.h"
+#include "mos/setup.h"
+#include "mos/tasks/task_types.h"
+
+#include <mos/lib/sync/spinlock.h>
+#include <mos_stdio.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+#if MOS_CONFIG(MOS_TRACING)
+
+#define TRACE_BUFFER_PAGES MOS_TRACE_BUFFER_PAGES
+#define TRACE_NRECORDS     (TRACE_BUFFER_PAGES * MOS_PAGE_SIZE / sizeof(trace_record_t))
+#define TRACE_MAX_NAMES    1024
+
+MOS_STATIC_ASSERT((TRACE_BUFFER_PAGES & (TRACE_BUFFER_PAGES - 1)) == 0, "the number of trace buffer pages must be a power of two");
+MOS_STATIC_ASSERT(sizeof(trace_buffer_header_t) <= MOS_PAGE_SIZE, "the trace buffer header must fit in a page");
+
+// Only the CPU that owns a buffer writes to it, with interrupts disabled, a record is written before the head is advanced past it.
+// Readers copy the records they want, then check that the head hasn't moved far enough to have overwritten them in the meantime.
+typedef struct
+{
+    trace_buffer_header_t *header; // the first page, followed by the records
+    trace_record_t *records;
+    pfn_t pfn;
+} trace_buffer_t;
+
+static const char *const trace_event_names[_TRACE_EVENT_MAX] = {
+    [TRACE_CONTEXT_SWITCH] = "context_switch", //
+    [TRACE_SYSCALL_ENTER] = "syscall_enter",   //
+    [TRACE_SYSCALL_EXIT] = "syscall_exit",     //
+    [TRACE_PAGE_FAULT] = "page_fault",         //
+    [TRACE_IPC_SEND] = "ipc_send",             //
+    [TRACE_IPC_RECV] = "ipc_recv",             //
+    [TRACE_SLAB_ALLOC] = "slab_alloc",         //
+    [TRACE_SCOPE] = "scope",                   //
+};
+
+u32 trace_events_enabled = 0;
+static PER_CPU_DECLARE(trace_buffer_t, trace_buffers);
+static spinlock_t trace_setup_lock = SPINLOCK_INIT; // serialises enabling events and allocating the buffers
+
+static spinlock_t trace_names_lock = SPINLOCK_INIT;
+static const char *trace_names[TRACE_MAX_NAMES]; // indexed by the id, 0 is never used
+static u16 trace_nnames = 0;
+
+void trace_emit(trace_event_t event, u8 flags, u16 name, u64 arg0, u64 arg1)
+{
+    const bool irq_enabled = platform_interrupt_disable_save();
+    trace_buffer_t *buffer = per_cpu(trace_buffers);
+    if (likely(buffer->header))
+    {
+        const thread_t *thread = current_thread;
+        const u64 head = buffer->header->head; // nobody else writes to it
+        trace_record_t *record = &buffer->records[head & (TRACE_NRECORDS - 1)];
+        record->timestamp = platform_get_timestamp();
+        record->tid = thread ? thread->tid : 0;
+        record->event = event;
+        record->flags = flags;
+        record->name = name;
+        record->args[0] = arg0;
+        record->args[1] = arg1;
+        __atomic_store_n(&buffer->header->head, head + 1, __ATOMIC_RELEASE);
+    }
+    platform_interrupt_restore(irq_enabled);
+}
+
+u16 trace_name_register(trace_name_t *name)
+{
+    bool irq_enabled;
+    spinlock_acquire_irqsave(&trace_names_lock, irq_enabled);
+    u16 id = name->id; // someone else may have registered it in the meantime
+    if (!id && trace_nnames + 1 < TRACE_MAX_NAMES)
+    {
+        id = trace_nnames + 1;
+        trace_names[id] = name->name;
+        __atomic_store_n(&trace_nnames, id, __ATOMIC_RELEASE); // /sys/trace/names reads it without the lock
+        __atomic_store_n(&name->id, id, __ATOMIC_RELEASE);
+    }
+    spinlock_release_irqrestore(&trace_names_lock, irq_enabled);
+    return id; // 0 if there are too many names
+}
+
+// the caller holds trace_setup_lock
+static bool trace_buffers_alloc_locked(void)
+{
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        trace_buffer_t *buffer = per_cpu_of(trace_buffers, cpu);
+        if (buffer->header)
+            continue;
+
+        phyframe_t *frames = mm_get_free_pages(1 + TRACE_BUFFER_PAGES);
+        if (!frames)
+        {
+            pr_warn("failed to allocate the trace buffer of cpu %u", cpu);
+            return false;
+        }
+        pmm_ref(frames, 1 + TRACE_BUFFER_PAGES); // the buffer lives as long as the kernel, userspace maps it without a reference
+
+        trace_buffer_header_t *header = (trace_buffer_header_t *) phyframe_va(frames);
+        memzero(header, MOS_PAGE_SIZE);
+        header->magic = TRACE_BUFFER_MAGIC;
+        header->cpu = cpu;
+        header->record_size = sizeof(trace_record_t);
+        header->nrecords = TRACE_NRECORDS;
+
+        buffer->records = (trace_record_t *) ((ptr_t) header + MOS_PAGE_SIZE);
+        buffer->pfn = phyframe_pfn(frames);
+        __atomic_store_n(&buffer->header, header, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+
+trace_buffer_header_t *trace_get_buffer(u32 cpu)
+{
+    if (cpu >= platform_info->num_cpus)
+        return NULL;
+    return __atomic_load_n(&per_cpu_of(trace_buffers, cpu)->header, __ATOMIC_ACQUIRE);
+}
+
+void trace_set_enabled(u32 mask)
+{
+    spinlock_acquire(&trace_setup_lock);
+    if (mask && !trace_buffers_alloc_locked())
+        mask = 0;
+    __atomic_store_n(&trace_events_enabled, mask & ~1u, __ATOMIC_RELEASE); // TRACE_NONE can't be enabled
+    spinlock_release(&trace_setup_lock);
+    pr_dinfo2(trace, "enabled events: 0x%x", mask);
+}
+
+// ! sysfs support
+
+static bool trace_sysfs_enable_show(sysfs_file_t *f)
+{
+    const u32 mask = __atomic_load_n(&trace_events_enabled, __ATOMIC_RELAXED);
+    for (int event = TRACE_NONE + 1; event < _TRACE_EVENT_MAX; event++)
+    {
+        if (mask & (1u << event))
+            sysfs_printf(f, "%s ", trace_event_names[event]);
+    }
+    sysfs_printf(f, "\n");
+    return true;
+}
+
+// a list of event names separated by spaces or commas, 'all', or 'none'
+static bool trace_sysfs_enable_store(sysfs_file_t *f, const char *buf, size_t count, off_t offset)
+{
+    MOS_UNUSED(f);
+    MOS_UNUSED(offset);
+
+    u32 mask = 0;
+    for (size_t i = 0; i < count;)
+    {
+        if (buf[i] == ' ' || buf[i] == ',' || buf[i] == '\n')
+        {
+            i++;
+            continue;
+        }
+
+        size_t len = 0;
+        while (i + len < count && buf[i + len] != ' ' && buf[i + len] != ',' && buf[i + len] != '\n')
+            len++;
+
+        if (len == 3 && strncmp(buf + i, "all", len) == 0)
+            mask |= ((1u << _TRACE_EVENT_MAX) - 1);
+        else if (len == 4 && strncmp(buf + i, "none", len) == 0)
+            mask = 0;
+        else
+        {
+            int event = TRACE_NONE + 1;
+            while (event < _TRACE_EVENT_MAX && (strlen(trace_event_names[event]) != len || strncmp(buf + i, trace_event_names[event], len) != 0))
+                event++;
+
+            if (event == _TRACE_EVENT_MAX)
+            {
+                pr_warn("unknown event '%.*s'", (int) len, buf + i);
+                return false;
+            }
+            mask |= 1u << event;
+        }
+
+        i += len;
+    }
+
+    trace_set_enabled(mask);
+    return true;
+}
+
+static bool trace_sysfs_events(sysfs_file_t *f)
+{
+    for (int event = TRACE_NONE + 1; event < _TRACE_EVENT_MAX; event++)
+        sysfs_printf(f, "%d %s\n", event, trace_event_names[event]);
+    return true;
+}
+
+static bool trace_sysfs_names(sysfs_file_t *f, u64 *cursor)
+{
+    const u16 nnames = __atomic_load_n(&trace_nnames, __ATOMIC_ACQUIRE);
+    if (*cursor >= nnames)
+        return false;
+
+    const u16 id = ++*cursor;
+    sysfs_printf(f, "%u %s\n", id, trace_names[id]);
+    return true;
+}
+
+static bool trace_sysfs_buffer_mmap(sysfs_file_t *f, vmap_t *vmap, off_t offset)
+{
+    const u32 cpu = (ptr_t) sysfs_file_get_data(f);
+    if (offset % MOS_PAGE_SIZE || vmap->vmflags & VM_WRITE)
+        return false; // the buffers are read-only to userspace
+
+    if (offset / MOS_PAGE_SIZE + vmap->npages > 1 + TRACE_BUFFER_PAGES)
+        return false;
+
+    // a buffer may be mapped before any event is enabled
+    spinlock_acquire(&trace_setup_lock);
+    const bool allocated = trace_buffers_alloc_locked();
+    spinlock_release(&trace_setup_lock);
+    if (!allocated)
+        return false;
+
+    const trace_buffer_t *buffer = per_cpu_of(trace_buffers, cpu);
+    mm_do_map(vmap->mmctx->pgd, vmap->vaddr, buffer->pfn + offset / MOS_PAGE_SIZE, vmap->npages, vmap->vmflags, false); // no need to refcount
+    return true;
+}
+
+static bool trace_sysfs_buffer_munmap(sysfs_file_t *f, vmap_t *vmap, bool *unmapped)
+{
+    MOS_UNUSED(f);
+    mm_do_unmap(vmap->mmctx->pgd, vmap->vaddr, vmap->npages, false);
+    *unmapped = true;
+    return true;
+}
+
+static sysfs_item_t trace_sysfs_items[] = {
+    SYSFS_RW_ITEM("enable", trace_sysfs_enable_show, trace_sysfs_enable_store),
+    SYSFS_RO_ITEM("events", trace_sysfs_events),
+    SYSFS_SEQ_ITEM("names", trace_sysfs_names),
+};
+
+SYSFS_DEFINE_DIR(trace, trace_sysfs_items);
+
+// the CPUs are only known once the platform has started them
+static void trace_sysfs_init(void)
+{
+    sysfs_register(&__sysfs_trace);
+
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "cpu%u", cpu);
+
+        sysfs_item_t *item = kmalloc(sizeof(sysfs_item_t));
+        *item = (sysfs_item_t) SYSFS_MEM_ITEM(strdup(name), trace_sysfs_buffer_mmap, trace_sysfs_buffer_munmap);
+        item->mem.size = (1 + TRACE_BUFFER_PAGES) * MOS_PAGE_SIZE;
+        sysfs_register_file(&__sysfs_trace, item, (void *) (ptr_t) cpu);
+    }
+}
+
+MOS_INIT(KTHREAD, trace_sysfs_init);
+
+#endif
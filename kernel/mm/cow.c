@@ -26,9 +26,8 @@ static phyframe_t *zero_page(void)
 {
     if (unlikely(!_zero_page))
     {
-        _zero_page = pmm_ref_one(mm_get_free_page());
+        _zero_page = pmm_ref_one(mm_get_free_page()); // already zeroed
         MOS_ASSERT(_zero_page);
-        memzero((void *) phyframe_va(_zero_page), MOS_PAGE_SIZE);
     }
 
     return _zero_page;
@@ -69,7 +68,8 @@ vmap_t *cow_clone_vmap_locked(mm_context_t *target_mmctx, vmap_t *src_vmap)
     src_vmap->stat.cow += src_vmap->stat.regular;
     src_vmap->stat.regular = 0; // no longer private
 
-    vmap_t *dst_vmap = mm_clone_vmap_locked(src_vmap, target_mmctx);
+    // the pages are read-only on both sides now, so the page tables can be shared until someone writes
+    vmap_t *dst_vmap = mm_share_vmap_locked(src_vmap, target_mmctx);
 
     if (!src_vmap->on_fault)
         src_vmap->on_fault = cow_zod_fault_handler;
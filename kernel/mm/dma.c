@@ -11,8 +11,26 @@
 #include "mos/platform/platform.h"
 #include "mos/printk.h"
 
+#include <errno.h>
+#include <mos_stdio.h>
+#include <mos_stdlib.h>
 #include <mos_string.h>
 
+#if MOS_PLATFORM_DMA_COHERENT
+#define DMA_VM_FLAGS VM_USER_RW // write-back, devices see what is still in the CPU caches
+#else
+#define DMA_VM_FLAGS (VM_USER_RW | VM_CACHE_DISABLED)
+#endif
+
+#define DMA_PIN_MAX_PAGES 4096 // 16 MiB in one pinning
+
+typedef struct
+{
+    io_t io;
+    size_t npages;
+    pfn_t pfns[]; // one reference on each, which keeps the page in place while the device uses it
+} dma_pin_t;
+
 static pfn_t dmabuf_do_allocate(size_t n_pages, bool do_ref)
 {
     phyframe_t *frames = pmm_allocate_frames(n_pages, PMM_ALLOC_NORMAL);
@@ -24,7 +42,7 @@ static pfn_t dmabuf_do_allocate(size_t n_pages, bool do_ref)
 pfn_t dmabuf_allocate(size_t n_pages, ptr_t *vaddr)
 {
     const pfn_t pfn = dmabuf_do_allocate(n_pages, true);
-    const vmap_t *vmap = mm_map_user_pages(current_mm, MOS_ADDR_USER_MMAP, pfn, n_pages, VM_USER_RW | VM_CACHE_DISABLED, VALLOC_DEFAULT, VMAP_TYPE_SHARED, VMAP_DMA);
+    const vmap_t *vmap = mm_map_user_pages(current_mm, MOS_ADDR_USER_MMAP, pfn, n_pages, DMA_VM_FLAGS, VALLOC_DEFAULT, VMAP_TYPE_SHARED, VMAP_DMA);
     *vaddr = vmap->vaddr;
     pr_dinfo2(dma, "allocated %zu DMA pages at " PFN_FMT " and mapped them at " PTR_FMT, n_pages, pfn, *vaddr);
     return pfn;
@@ -65,3 +83,151 @@ bool dmabuf_unshare(ptr_t phys, size_t size, void *buffer)
     pmm_free_frames(pfn_phyframe(pfn), ALIGN_UP_TO_PAGE(size) / MOS_PAGE_SIZE);
     return true;
 }
+
+static void dma_pin_close(io_t *io)
+{
+    dma_pin_t *pin = container_of(io, dma_pin_t, io);
+    for (size_t i = 0; i < pin->npages; i++)
+        pmm_unref_one(pin->pfns[i]);
+
+    pr_dinfo2(dma, "unpinned %zu pages", pin->npages);
+    kfree(pin);
+}
+
+static void dma_pin_get_name(io_t *io, char *buf, size_t size)
+{
+    const dma_pin_t *pin = container_of(io, dma_pin_t, io);
+    snprintf(buf, size, "dma-pin:%zu pages", pin->npages);
+}
+
+static const io_op_t dma_pin_ops = {
+    .close = dma_pin_close,
+    .get_name = dma_pin_get_name,
+};
+
+static bool dmabuf_pinnable(mm_context_t *mmctx, ptr_t start, ptr_t end, bool device_writes)
+{
+    bool result = true;
+    spinlock_acquire(&mmctx->mm_lock);
+    for (ptr_t addr = start; result && addr < end;)
+    {
+        vmap_t *vmap = vmap_obtain(mmctx, addr, NULL);
+        if (!vmap)
+        {
+            result = false;
+            break;
+        }
+
+        // file mappings may be device memory, or page cache that can be dropped under us
+        const bool anonymous = vmap->content == VMAP_HEAP || vmap->content == VMAP_STACK || vmap->content == VMAP_MMAP || vmap->content == VMAP_DMA;
+        result = anonymous && (vmap->vmflags & (device_writes ? VM_WRITE : VM_READ));
+        addr = vmap->vaddr + vmap->npages * MOS_PAGE_SIZE;
+        spinlock_release(&vmap->lock);
+    }
+    spinlock_release(&mmctx->mm_lock);
+    return result;
+}
+
+// merge physically contiguous pages, the first and the last may be partially used
+static io_t *dma_pin_describe(dma_pin_t *pin, ptr_t buf, size_t size, dma_sg_entry_t *entries, size_t *n_entries)
+{
+    const ptr_t start = ALIGN_DOWN_TO_PAGE(buf);
+
+    size_t n = 0;
+    ptr_t last_end = 0;
+    for (size_t i = 0; i < pin->npages; i++)
+    {
+        const ptr_t page_start = MAX(buf, start + i * MOS_PAGE_SIZE);
+        const ptr_t page_end = MIN(buf + size, start + (i + 1) * MOS_PAGE_SIZE);
+        const ptr_t paddr = pin->pfns[i] * MOS_PAGE_SIZE + page_start % MOS_PAGE_SIZE;
+
+        if (n > 0 && paddr == last_end)
+        {
+            if (n <= *n_entries)
+                entries[n - 1].size += page_end - page_start;
+        }
+        else
+        {
+            if (n < *n_entries)
+                entries[n] = (dma_sg_entry_t){ .paddr = paddr, .size = page_end - page_start };
+            n++;
+        }
+        last_end = paddr + (page_end - page_start);
+    }
+
+    if (n > *n_entries)
+    {
+        pr_dinfo2(dma, "%zu entries are needed to describe the buffer, only %zu were given", n, *n_entries);
+        *n_entries = n;
+        dma_pin_close(&pin->io);
+        return ERR_PTR(-ENOSPC);
+    }
+
+    *n_entries = n;
+    pr_dinfo2(dma, "pinned %zu pages in %zu entries", pin->npages, n);
+    return &pin->io;
+}
+
+io_t *dmabuf_pin_frames(const pfn_t *pfns, ptr_t buf, size_t size, dma_sg_entry_t *entries, size_t *n_entries)
+{
+    const size_t npages = (ALIGN_UP_TO_PAGE(buf + size) - ALIGN_DOWN_TO_PAGE(buf)) / MOS_PAGE_SIZE;
+    dma_pin_t *pin = kmalloc(sizeof(dma_pin_t) + npages * sizeof(pfn_t));
+    if (!pin)
+        return ERR_PTR(-ENOMEM);
+
+    io_init(&pin->io, IO_DMA_PIN, IO_NONE, &dma_pin_ops);
+    for (pin->npages = 0; pin->npages < npages; pin->npages++)
+        pin->pfns[pin->npages] = pmm_ref_one(pfns[pin->npages]);
+
+    return dma_pin_describe(pin, buf, size, entries, n_entries);
+}
+
+io_t *dmabuf_sg_map(void *buf, size_t size, bool device_writes, dma_sg_entry_t *entries, size_t *n_entries)
+{
+    const ptr_t start = ALIGN_DOWN_TO_PAGE((ptr_t) buf);
+    const ptr_t end = ALIGN_UP_TO_PAGE((ptr_t) buf + size);
+    if (size == 0 || (ptr_t) buf + size < (ptr_t) buf || end > MOS_USER_END_VADDR + 1)
+        return ERR_PTR(-EFAULT);
+
+    const size_t npages = (end - start) / MOS_PAGE_SIZE;
+    if (npages > DMA_PIN_MAX_PAGES)
+        return ERR_PTR(-E2BIG);
+
+    mm_context_t *const mmctx = current_mm;
+    if (!dmabuf_pinnable(mmctx, start, end, device_writes))
+        return ERR_PTR(-EFAULT);
+
+    // fault the pages in, and break CoW so that the device writes to this process's copy, the atomic add
+    // of zero is a write that can't lose a concurrent store from another thread
+    for (ptr_t addr = start; addr < end; addr += MOS_PAGE_SIZE)
+    {
+        if (device_writes)
+            __atomic_fetch_add((char *) addr, 0, __ATOMIC_RELAXED);
+        else
+            (void) *(volatile const char *) addr;
+    }
+
+    dma_pin_t *pin = kmalloc(sizeof(dma_pin_t) + npages * sizeof(pfn_t));
+    if (!pin)
+        return ERR_PTR(-ENOMEM);
+
+    pin->npages = 0;
+    spinlock_acquire(&mmctx->mm_lock);
+    for (; pin->npages < npages; pin->npages++)
+    {
+        const pfn_t pfn = mm_get_phys_addr(mmctx, start + pin->npages * MOS_PAGE_SIZE) / MOS_PAGE_SIZE;
+        if (pfn == 0)
+            break; // unmapped since it was faulted in
+        pin->pfns[pin->npages] = pmm_ref_one(pfn);
+    }
+    spinlock_release(&mmctx->mm_lock);
+
+    io_init(&pin->io, IO_DMA_PIN, IO_NONE, &dma_pin_ops);
+    if (pin->npages != npages)
+    {
+        dma_pin_close(&pin->io);
+        return ERR_PTR(-EFAULT);
+    }
+
+    return dma_pin_describe(pin, (ptr_t) buf, size, entries, n_entries);
+}
@@ -4,6 +4,7 @@
 
 #include "mos/filesystem/sysfs/sysfs.h"
 #include "mos/interrupt/ipi.h"
+#include "mos/misc/trace.h"
 #include "mos/mm/cow.h"
 #include "mos/mm/mmstat.h"
 #include "mos/mm/paging/dump.h"
@@ -31,9 +32,18 @@ SLAB_AUTOINIT("vmap", vmap_cache, vmap_t);
 static slab_t *mm_context_cache = NULL;
 SLAB_AUTOINIT("mm_context", mm_context_cache, mm_context_t);
 
+static slab_t *vmap_range_cache = NULL;
+SLAB_AUTOINIT("vmap_range", vmap_range_cache, vmap_range_t);
+
+static spinlock_t lazyfree_lock = SPINLOCK_INIT;              ///< protects lazyfree_mms
+static list_head lazyfree_mms = LIST_HEAD_INIT(lazyfree_mms); ///< address spaces with vmaps marked as lazyfree
+
 phyframe_t *mm_get_free_page_raw(void)
 {
     phyframe_t *frame = pmm_allocate_frames(1, PMM_ALLOC_NORMAL);
+    if (!frame && mm_reclaim_lazyfree())
+        frame = pmm_allocate_frames(1, PMM_ALLOC_NORMAL);
+
     if (!frame)
     {
         pr_emerg("failed to allocate a page");
@@ -48,13 +58,16 @@ phyframe_t *mm_get_free_page(void)
     phyframe_t *frame = mm_get_free_page_raw();
     if (!frame)
         return NULL;
-    memzero((void *) phyframe_va(frame), MOS_PAGE_SIZE);
+    platform_page_zero(phyframe_va(frame));
     return frame;
 }
 
 phyframe_t *mm_get_free_pages(size_t npages)
 {
     phyframe_t *frame = pmm_allocate_frames(npages, PMM_ALLOC_NORMAL);
+    if (!frame && mm_reclaim_lazyfree())
+        frame = pmm_allocate_frames(npages, PMM_ALLOC_NORMAL);
+
     if (!frame)
     {
         pr_emerg("failed to allocate %zd pages", npages);
@@ -68,6 +81,7 @@ mm_context_t *mm_create_context(void)
 {
     mm_context_t *mmctx = kmalloc(mm_context_cache);
     linked_list_init(&mmctx->mmaps);
+    linked_list_init(&mmctx->reclaim_node);
 
     pml4_t pml4 = pml_create_table(pml4);
 
@@ -85,6 +99,11 @@ void mm_destroy_context(mm_context_t *mmctx)
     MOS_ASSERT(mmctx != platform_info->kernel_mm); // you can't destroy the kernel mmctx
     MOS_ASSERT(list_is_empty(&mmctx->mmaps));
 
+    spinlock_acquire(&lazyfree_lock);
+    if (!list_is_empty(&mmctx->reclaim_node))
+        list_node_remove(&mmctx->reclaim_node);
+    spinlock_release(&lazyfree_lock);
+
     ptr_t zero = 0;
     size_t userspace_npages = (MOS_USER_END_VADDR + 1) / MOS_PAGE_SIZE;
     const bool freed = pml5_destroy_range(mmctx->pgd.max, &zero, &userspace_npages);
@@ -156,11 +175,88 @@ static void do_attach_vmap(mm_context_t *mmctx, vmap_t *vmap)
     list_node_append(&mmctx->mmaps, list_node(vmap)); // append at the end
 }
 
+// ! ranges marked with MEM_ADVICE_FREE
+
+static vmap_range_t *vmap_range_create(ptr_t start, ptr_t end)
+{
+    vmap_range_t *range = kmalloc(vmap_range_cache);
+    linked_list_init(list_node(range));
+    range->vaddr = start;
+    range->npages = (end - start) / MOS_PAGE_SIZE;
+    return range;
+}
+
+static void vmap_lazyfree_add(vmap_t *vmap, ptr_t start, ptr_t end)
+{
+    vmap_range_t *next = NULL; // the first range after the new one
+    list_foreach(vmap_range_t, range, vmap->lazyfree)
+    {
+        const ptr_t range_end = range->vaddr + range->npages * MOS_PAGE_SIZE;
+        if (range_end < start)
+            continue;
+
+        if (range->vaddr > end)
+        {
+            next = range;
+            break;
+        }
+
+        // overlapping or adjacent, the new range takes it in
+        start = MIN(start, range->vaddr);
+        end = MAX(end, range_end);
+        list_remove(range);
+        kfree(range);
+    }
+
+    vmap_range_t *range = vmap_range_create(start, end);
+    if (next)
+        list_insert_before(next, range);
+    else
+        list_node_append(&vmap->lazyfree, list_node(range));
+}
+
+static void vmap_lazyfree_remove(vmap_t *vmap, ptr_t start, ptr_t end)
+{
+    list_foreach(vmap_range_t, range, vmap->lazyfree)
+    {
+        const ptr_t range_end = range->vaddr + range->npages * MOS_PAGE_SIZE;
+        if (range_end <= start)
+            continue;
+
+        if (range->vaddr >= end)
+            break;
+
+        if (range->vaddr < start && range_end > end)
+        {
+            // a hole in the middle, the part after it becomes a range of its own
+            list_insert_after(range, vmap_range_create(end, range_end));
+            range->npages = (start - range->vaddr) / MOS_PAGE_SIZE;
+            break;
+        }
+
+        if (range->vaddr < start)
+        {
+            range->npages = (start - range->vaddr) / MOS_PAGE_SIZE;
+        }
+        else if (range_end > end)
+        {
+            range->vaddr = end;
+            range->npages = (range_end - end) / MOS_PAGE_SIZE;
+        }
+        else
+        {
+            list_remove(range);
+            kfree(range);
+        }
+    }
+}
+
 vmap_t *vmap_create(mm_context_t *mmctx, ptr_t vaddr, size_t npages)
 {
     MOS_ASSERT_X(mmctx != platform_info->kernel_mm, "you can't create vmaps in the kernel mmctx");
     vmap_t *map = kmalloc(vmap_cache);
     linked_list_init(list_node(map));
+    linked_list_init(&map->lazyfree);
     spinlock_acquire(&map->lock);
     map->vaddr = vaddr;
     map->npages = npages;
@@ -185,6 +281,7 @@ void vmap_destroy(vmap_t *vmap)
     mm_do_unmap(mm->pgd, vmap->vaddr, vmap->npages, true);
 
 unmapped:
+    vmap_lazyfree_remove(vmap, vmap->vaddr, vmap->vaddr + vmap->npages * MOS_PAGE_SIZE);
     list_remove(vmap);
     kfree(vmap);
 }
@@ -217,10 +314,20 @@ vmap_t *vmap_split(vmap_t *first, size_t split)
     vmap_t *second = kmalloc(vmap_cache);
     *second = *first;                    // copy the whole structure
     linked_list_init(list_node(second)); // except for the list node
+    linked_list_init(&second->lazyfree); // and the marked ranges, which are split below
 
     first->npages = split; // shrink the first vmap
     second->npages -= split;
     second->vaddr += split * MOS_PAGE_SIZE;
+
+    const ptr_t second_end = second->vaddr + second->npages * MOS_PAGE_SIZE;
+    list_foreach(vmap_range_t, range, first->lazyfree)
+    {
+        const ptr_t range_end = range->vaddr + range->npages * MOS_PAGE_SIZE;
+        if (range_end > second->vaddr)
+            list_node_append(&second->lazyfree, list_node(vmap_range_create(MAX(range->vaddr, second->vaddr), range_end)));
+    }
+    vmap_lazyfree_remove(first, second->vaddr, second_end);
     if (first->io)
     {
         second->io = io_ref(first->io); // ref the io again
@@ -265,9 +372,95 @@ void vmap_finalise_init(vmap_t *vmap, vmap_content_t content, vmap_type_t type)
     spinlock_release(&vmap->lock);
 }
 
+size_t vmap_discard_pages(vmap_t *vmap, ptr_t vaddr, size_t npages, bool only_clean)
+{
+    MOS_ASSERT(spinlock_is_locked(&vmap->lock));
+    MOS_ASSERT(vaddr >= vmap->vaddr && vaddr + npages * MOS_PAGE_SIZE <= vmap->vaddr + vmap->npages * MOS_PAGE_SIZE);
+    if (!npages)
+        return 0;
+
+    if (!only_clean)
+        vmap_lazyfree_remove(vmap, vaddr, vaddr + npages * MOS_PAGE_SIZE); // nothing left to reclaim there
+
+    size_t n_writable = 0;
+    const size_t n_discarded = mm_do_discard(vmap->mmctx->pgd, vaddr, npages, only_clean, &n_writable);
+    if (!n_discarded)
+        return 0;
+
+    // the zero page and pages shared after a fork are mapped read-only
+    vmap->stat.regular -= n_writable;
+    vmap->stat.cow -= n_discarded - n_writable;
+    ipi_send_all(IPI_TYPE_INVALIDATE_TLB);
+    return n_discarded;
+}
+
+void mm_mark_lazyfree_locked(vmap_t *vmap, ptr_t vaddr, size_t npages)
+{
+    MOS_ASSERT(spinlock_is_locked(&vmap->mmctx->mm_lock));
+    MOS_ASSERT(spinlock_is_locked(&vmap->lock));
+
+    // a page is reclaimable for as long as its dirty bit stays clear
+    if (!mm_do_clean(vmap->mmctx->pgd, vaddr, npages))
+        return; // nothing has been written to, nothing to reclaim
+
+    ipi_send_all(IPI_TYPE_INVALIDATE_TLB);
+    vmap_lazyfree_add(vmap, vaddr, vaddr + npages * MOS_PAGE_SIZE);
+
+    spinlock_acquire(&lazyfree_lock);
+    if (list_is_empty(&vmap->mmctx->reclaim_node))
+        list_node_append(&lazyfree_mms, &vmap->mmctx->reclaim_node);
+    spinlock_release(&lazyfree_lock);
+}
+
+size_t mm_reclaim_lazyfree(void)
+{
+    // called when an allocation fails, which may happen with any lock held, so nothing here may wait for a lock
+    if (!spinlock_try_acquire(&lazyfree_lock))
+        return 0;
+
+    size_t reclaimed = 0;
+    list_node_t *node = lazyfree_mms.next;
+    while (node != &lazyfree_mms)
+    {
+        mm_context_t *mmctx = container_of(node, mm_context_t, reclaim_node);
+        node = node->next;
+
+        if (!spinlock_try_acquire(&mmctx->mm_lock))
+            continue;
+
+        bool pending = false;
+        list_foreach(vmap_t, vmap, mmctx->mmaps)
+        {
+            if (list_is_empty(&vmap->lazyfree))
+                continue;
+
+            if (!spinlock_try_acquire(&vmap->lock))
+            {
+                pending = true;
+                continue;
+            }
+
+            // pages that have been written to since are in use again, and are no longer reclaimable;
+            // the ranges stay recorded: freeing them could wait for the slab lock of the allocation that got us here, and
+            // what is left in them is either dirty or read-only, neither of which a later reclaim drops
+            list_foreach(vmap_range_t, range, vmap->lazyfree)
+                reclaimed += vmap_discard_pages(vmap, range->vaddr, range->npages, true);
+            spinlock_release(&vmap->lock);
+        }
+
+        if (!pending)
+            list_node_remove(&mmctx->reclaim_node);
+        spinlock_release(&mmctx->mm_lock);
+    }
+    spinlock_release(&lazyfree_lock);
+
+    pr_dinfo2(vmm, "reclaimed %zu lazily freed pages", reclaimed);
+    return reclaimed;
+}
+
 void mm_copy_page(const phyframe_t *src, const phyframe_t *dst)
 {
-    memcpy((void *) phyframe_va(dst), (void *) phyframe_va(src), MOS_PAGE_SIZE);
+    platform_page_copy(phyframe_va(dst), phyframe_va(src));
 }
 
 vmfault_result_t mm_resolve_cow_fault(vmap_t *vmap, ptr_t fault_addr, pagefault_t *info)
@@ -372,6 +565,11 @@ void mm_handle_fault(ptr_t fault_addr, pagefault_t *info)
              fault_addr                                                  //
     );
 
+    trace_event(TRACE_PAGE_FAULT,
+                (info->is_present ? TRACE_PF_PRESENT : 0) | (info->is_write ? TRACE_PF_WRITE : 0) | (info->is_user ? TRACE_PF_USER : 0) |
+                    (info->is_exec ? TRACE_PF_EXEC : 0),
+                fault_addr, info->ip);
+
     if (info->is_write && info->is_exec)
         mos_panic("Cannot write and execute at the same time");
 
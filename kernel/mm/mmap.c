@@ -137,6 +137,51 @@ bool munmap(ptr_t addr, size_t size)
     return true;
 }
 
+bool vm_advise(mm_context_t *mmctx, ptr_t addr, size_t size, mem_advice_t advice)
+{
+    if (addr % MOS_PAGE_SIZE != 0)
+    {
+        pr_warn("vm_advise: address must be page-aligned");
+        return false;
+    }
+
+    const size_t npages = ALIGN_UP_TO_PAGE(size) / MOS_PAGE_SIZE;
+
+    spinlock_acquire(&mmctx->mm_lock);
+    vmap_t *const vmap = vmap_obtain(mmctx, addr, NULL);
+    if (unlikely(!vmap))
+    {
+        spinlock_release(&mmctx->mm_lock);
+        pr_warn("vm_advise: could not find the vmap");
+        return false;
+    }
+
+    bool result = true;
+    if (addr + npages * MOS_PAGE_SIZE > vmap->vaddr + vmap->npages * MOS_PAGE_SIZE)
+    {
+        pr_warn("vm_advise: range spans multiple mappings");
+        result = false;
+    }
+    else if (vmap->io || vmap->type != VMAP_TYPE_PRIVATE || (vmap->content != VMAP_HEAP && vmap->content != VMAP_MMAP))
+    {
+        pr_warn("vm_advise: only private anonymous memory can be advised");
+        result = false;
+    }
+    else
+    {
+        switch (advice)
+        {
+            case MEM_ADVICE_DONTNEED: vmap_discard_pages(vmap, addr, npages, false); break;
+            case MEM_ADVICE_FREE: mm_mark_lazyfree_locked(vmap, addr, npages); break;
+            default: pr_warn("vm_advise: unknown advice %d", advice); result = false;
+        }
+    }
+
+    spinlock_release(&vmap->lock);
+    spinlock_release(&mmctx->mm_lock);
+    return result;
+}
+
 bool vm_protect(mm_context_t *mmctx, ptr_t addr, size_t size, vm_flags perm)
 {
     MOS_ASSERT(addr % MOS_PAGE_SIZE == 0);
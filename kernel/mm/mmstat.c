@@ -13,13 +13,11 @@
 
 #include <mos/mos_global.h>
 #include <mos_stdlib.h>
+#include <mos_string.h>
 
-typedef struct
-{
-    size_t npages;
-} vmap_global_mstat_t;
-
-static vmap_global_mstat_t stat[_MEM_MAX_TYPES] = { 0 };
+// the number of pages of each type, moved to the sysfs counter page once sysfs is up
+static u64 mmstat_early_npages[_MEM_MAX_TYPES] = { 0 };
+static u64 *mmstat_npages = mmstat_early_npages;
 
 const char *mem_type_names[_MEM_MAX_TYPES] = {
     [MEM_PAGETABLE] = "PageTable", //
@@ -32,13 +30,13 @@ const char *mem_type_names[_MEM_MAX_TYPES] = {
 void mmstat_inc(mmstat_type_t type, size_t size)
 {
     MOS_ASSERT(type < _MEM_MAX_TYPES);
-    stat[type].npages += size;
+    mmstat_npages[type] += size;
 }
 
 void mmstat_dec(mmstat_type_t type, size_t size)
 {
     MOS_ASSERT(type < _MEM_MAX_TYPES);
-    stat[type].npages -= size;
+    mmstat_npages[type] -= size;
 }
 
 // ! sysfs support
@@ -57,8 +55,8 @@ static bool mmstat_sysfs_stat(sysfs_file_t *f)
 
     for (u32 i = 0; i < _MEM_MAX_TYPES; i++)
     {
-        format_size(size_buf, sizeof(size_buf), stat[i].npages * MOS_PAGE_SIZE);
-        sysfs_printf(f, "%-20s: %s, %zu pages\n", mem_type_names[i], size_buf, stat[i].npages);
+        format_size(size_buf, sizeof(size_buf), mmstat_npages[i] * MOS_PAGE_SIZE);
+        sysfs_printf(f, "%-20s: %s, %llu pages\n", mem_type_names[i], size_buf, mmstat_npages[i]);
     }
     return true;
 }
@@ -155,4 +153,16 @@ static sysfs_item_t mmstat_sysfs_items[] = {
     SYSFS_RW_ITEM("pagetable", mmstat_sysfs_pagetable_show, mmstat_sysfs_pagetable_store),
 };
 
-SYSFS_AUTOREGISTER(mmstat, mmstat_sysfs_items);
+SYSFS_DEFINE_DIR(mmstat, mmstat_sysfs_items);
+
+static void mmstat_sysfs_init(void)
+{
+    sysfs_register(&__sysfs_mmstat);
+
+    // from now on the counters are updated directly in the page that userspace maps
+    sysfs_counters_t *counters = sysfs_register_counters(&__sysfs_mmstat, "counters", _MEM_MAX_TYPES);
+    memcpy(counters->counters, mmstat_early_npages, sizeof(mmstat_early_npages));
+    mmstat_npages = counters->counters;
+}
+
+MOS_INIT(SYSFS, mmstat_sysfs_init);
@@ -122,14 +122,15 @@ void mm_replace_page_locked(mm_context_t *ctx, ptr_t vaddr, pfn_t pfn, vm_flags
         return;
     }
 
-    if (likely(old_pfn))
-        pmm_unref_one(old_pfn); // unmapped
-
     pmm_ref_one(pfn);
     mm_do_map(ctx->pgd, vaddr, pfn, 1, flags, false);
+
+    // only drop the old page after mapping, unsharing the page table may have taken another reference to it
+    if (likely(old_pfn))
+        pmm_unref_one(old_pfn); // unmapped
 }
 
-vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
+static vmap_t *do_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx, bool share_tables)
 {
     vmap_t *dst_vmap = mm_get_free_vaddr_locked(dst_ctx, src_vmap->npages, src_vmap->vaddr, VALLOC_EXACT);
 
@@ -139,8 +140,11 @@ vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
         return NULL;
     }
 
-    pr_dinfo2(vmm, "copying mapping from " PTR_FMT ", %zu pages", src_vmap->vaddr, src_vmap->npages);
-    mm_do_copy(src_vmap->mmctx->pgd, dst_vmap->mmctx->pgd, src_vmap->vaddr, src_vmap->npages);
+    pr_dinfo2(vmm, "%s mapping from " PTR_FMT ", %zu pages", share_tables ? "sharing" : "copying", src_vmap->vaddr, src_vmap->npages);
+    if (share_tables)
+        mm_do_share(src_vmap->mmctx->pgd, dst_vmap->mmctx->pgd, src_vmap->vaddr, src_vmap->npages);
+    else
+        mm_do_copy(src_vmap->mmctx->pgd, dst_vmap->mmctx->pgd, src_vmap->vaddr, src_vmap->npages);
 
     dst_vmap->vmflags = src_vmap->vmflags;
     dst_vmap->io = src_vmap->io;
@@ -156,6 +160,16 @@ vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
     return dst_vmap;
 }
 
+vmap_t *mm_clone_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
+{
+    return do_clone_vmap_locked(src_vmap, dst_ctx, false);
+}
+
+vmap_t *mm_share_vmap_locked(vmap_t *src_vmap, mm_context_t *dst_ctx)
+{
+    return do_clone_vmap_locked(src_vmap, dst_ctx, true);
+}
+
 bool mm_get_is_mapped_locked(mm_context_t *mmctx, ptr_t vaddr)
 {
     MOS_ASSERT(spinlock_is_locked(&mmctx->mm_lock));
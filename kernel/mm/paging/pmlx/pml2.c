@@ -22,6 +22,22 @@ void pml2_traverse(pml2_t pml2, ptr_t *vaddr, size_t *n_pages, pagetable_walk_op
         if (pml2e_is_present(pml2e))
         {
             pml1 = pml2e_get_or_create_pml1(pml2e);
+            if (!options.pml1_readonly && pml1_is_shared(pml1))
+            {
+                if (options.pml1_release_shared && pml1_index(*vaddr) == 0 && *n_pages >= PML2E_NPAGES)
+                {
+                    // the whole table goes away for us, the other address spaces keep their reference
+                    platform_pml2e_set_present(pml2e, false);
+                    for (size_t p = 0; p < PML2E_NPAGES; p++)
+                        platform_invalidate_tlb(*vaddr + p * MOS_PAGE_SIZE); // the pml1e callbacks won't run for this range
+                    pml_destroy_table(pml1);
+                    *vaddr += PML2E_NPAGES * MOS_PAGE_SIZE;
+                    *n_pages -= PML2E_NPAGES;
+                    continue;
+                }
+
+                pml1 = pml2e_unshare_pml1(pml2e);
+            }
         }
         else
         {
@@ -93,3 +109,41 @@ pml1_t pml2e_get_or_create_pml1(pml2e_t *pml2e)
     platform_pml2e_set_pml1(pml2e, pml1, va_pfn(pml1.table));
     return pml1;
 }
+
+bool pml1_is_shared(pml1_t pml1)
+{
+    return va_phyframe(pml1.table)->allocated_refcount > 1;
+}
+
+void pml2e_share_pml1(pml2e_t *dst, const pml2e_t *src)
+{
+    MOS_ASSERT(pml2e_is_present(src) && !pml2e_is_present(dst));
+
+    const pml1_t pml1 = platform_pml2e_get_pml1(src);
+    phyframe_t *const frame = va_phyframe(pml1.table);
+    if (frame->allocated_refcount == 0)
+        pmm_ref_one(frame); // an exclusively owned table has no refcount, account for the original owner
+    pmm_ref_one(frame);
+
+    platform_pml2e_set_present(dst, true);
+    platform_pml2e_set_pml1(dst, pml1, va_pfn(pml1.table));
+    platform_pml2e_set_flags(dst, platform_pml2e_get_flags(src));
+}
+
+pml1_t pml2e_unshare_pml1(pml2e_t *pml2e)
+{
+    const pml1_t shared = platform_pml2e_get_pml1(pml2e);
+    const pml1_t pml1 = pml_create_table(pml1);
+    memcpy(pml1.table, shared.table, PML1_ENTRIES * sizeof(pml1e_t));
+
+    // the pages are now referenced by one more table
+    for (size_t i = 0; i < PML1_ENTRIES; i++)
+    {
+        if (pml1e_is_present(&pml1.table[i]))
+            pmm_ref_one(pml1e_get_pfn(&pml1.table[i]));
+    }
+
+    platform_pml2e_set_pml1(pml2e, pml1, va_pfn(pml1.table));
+    pml_destroy_table(shared); // drops our reference, the table is still in use by someone else
+    return pml1;
+}
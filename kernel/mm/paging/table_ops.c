@@ -10,7 +10,9 @@
 #include "mos/mm/paging/pmlx/pml3.h"
 #include "mos/mm/paging/pmlx/pml4.h"
 #include "mos/mm/paging/pmlx/pml5.h"
+#include "mos/mm/paging/table_ops/do_clean.h"
 #include "mos/mm/paging/table_ops/do_copy.h"
+#include "mos/mm/paging/table_ops/do_discard.h"
 #include "mos/mm/paging/table_ops/do_flag.h"
 #include "mos/mm/paging/table_ops/do_map.h"
 #include "mos/mm/paging/table_ops/do_mask.h"
@@ -55,6 +57,22 @@ void mm_do_mask_flags(pgd_t max, ptr_t vaddr, size_t n_pages, vm_flags mask)
     pml5_traverse(max.max, &vaddr, &n_pages, pagetable_do_mask_callbacks, &data);
 }
 
+size_t mm_do_discard(pgd_t max, ptr_t vaddr, size_t n_pages, bool only_clean, size_t *n_writable)
+{
+    struct pagetable_do_discard_data data = { .only_clean = only_clean };
+    pml5_traverse(max.max, &vaddr, &n_pages, pagetable_do_discard_callbacks, &data);
+    if (n_writable)
+        *n_writable = data.n_writable;
+    return data.n_writable + data.n_readonly;
+}
+
+size_t mm_do_clean(pgd_t max, ptr_t vaddr, size_t n_pages)
+{
+    struct pagetable_do_clean_data data = { 0 };
+    pml5_traverse(max.max, &vaddr, &n_pages, pagetable_do_clean_callbacks, &data);
+    return data.n_cleaned;
+}
+
 void mm_do_copy(pgd_t src, pgd_t dst, ptr_t vaddr, size_t n_pages)
 {
     struct pagetable_do_copy_data data = {
@@ -65,6 +83,52 @@ void mm_do_copy(pgd_t src, pgd_t dst, ptr_t vaddr, size_t n_pages)
     pml5_traverse(src.max, &vaddr, &n_pages, pagetable_do_copy_callbacks, &data);
 }
 
+void mm_do_share(pgd_t src, pgd_t dst, ptr_t vaddr, size_t n_pages)
+{
+    const size_t pml2e_size = PML2E_NPAGES * MOS_PAGE_SIZE;
+    const ptr_t end = vaddr + n_pages * MOS_PAGE_SIZE;
+    const ptr_t share_start = ALIGN_UP(vaddr, pml2e_size);
+    const ptr_t share_end = ALIGN_DOWN(end, pml2e_size);
+
+    if (share_start >= share_end)
+    {
+        mm_do_copy(src, dst, vaddr, n_pages); // not a single full pml1 table in the range
+        return;
+    }
+
+    if (vaddr < share_start)
+        mm_do_copy(src, dst, vaddr, (share_start - vaddr) / MOS_PAGE_SIZE);
+
+    for (ptr_t addr = share_start; addr < share_end; addr += pml2e_size)
+    {
+        pml5e_t *src_pml5e = pml5_entry(src.max, addr);
+        if (!pml5e_is_present(src_pml5e))
+            continue;
+
+        pml4e_t *src_pml4e = pml4_entry(pml5e_get_or_create_pml4(src_pml5e), addr);
+        if (!pml4e_is_present(src_pml4e))
+            continue;
+
+        pml3e_t *src_pml3e = pml3_entry(pml4e_get_or_create_pml3(src_pml4e), addr);
+        if (!pml3e_is_present(src_pml3e))
+            continue;
+
+        const pml2e_t *src_pml2e = pml2_entry(pml3e_get_or_create_pml2(src_pml3e), addr);
+        if (!pml2e_is_present(src_pml2e))
+            continue;
+
+        pml4e_t *dst_pml4e = pml4_entry(pml5e_get_or_create_pml4(pml5_entry(dst.max, addr)), addr);
+        pml3e_t *dst_pml3e = pml3_entry(pml4e_get_or_create_pml3(dst_pml4e), addr);
+        pml2e_t *dst_pml2e = pml2_entry(pml3e_get_or_create_pml2(dst_pml3e), addr);
+        platform_pml4e_set_flags(dst_pml4e, platform_pml4e_get_flags(src_pml4e));
+        platform_pml3e_set_flags(dst_pml3e, platform_pml3e_get_flags(src_pml3e));
+        pml2e_share_pml1(dst_pml2e, src_pml2e);
+    }
+
+    if (share_end < end)
+        mm_do_copy(src, dst, share_end, (end - share_end) / MOS_PAGE_SIZE);
+}
+
 pfn_t mm_do_get_pfn(pgd_t max, ptr_t vaddr)
 {
     vaddr = ALIGN_DOWN_TO_PAGE(vaddr);
@@ -177,7 +241,18 @@ void *__create_page_table(void)
 
 void __destroy_page_table(void *table)
 {
+    phyframe_t *const frame = va_phyframe(table);
+    if (frame->allocated_refcount > 1)
+    {
+        pr_dinfo2(vmm, "__destroy_page_table: table=" PTR_FMT " is still shared", (ptr_t) table);
+        pmm_unref_one(frame);
+        return;
+    }
+
     mmstat_dec1(MEM_PAGETABLE);
     pr_dinfo2(vmm, "__destroy_page_table: table=" PTR_FMT, (ptr_t) table);
-    mm_free_page(va_phyframe(table));
+    if (frame->allocated_refcount)
+        pmm_unref_one(frame); // was shared, we are the last user
+    else
+        mm_free_page(frame);
 }
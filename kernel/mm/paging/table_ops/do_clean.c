@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/mm/paging/table_ops/do_clean.h"
+
+#include "mos/platform/platform.h"
+
+static void pml1e_do_clean_callback(pml1_t pml1, pml1e_t *e, ptr_t vaddr, void *data)
+{
+    MOS_UNUSED(pml1);
+
+    // read-only pages are either the zero page or shared after a fork, there is nothing to reclaim from them
+    if (!platform_pml1e_get_present(e) || !(platform_pml1e_get_flags(e) & VM_WRITE))
+        return;
+
+    struct pagetable_do_clean_data *clean_data = data;
+    platform_pml1e_clear_dirty(e);
+    platform_invalidate_tlb(vaddr); // the next write must set the dirty bit again
+    clean_data->n_cleaned++;
+}
+
+const pagetable_walk_options_t pagetable_do_clean_callbacks = {
+    .readonly = true,
+    .pml1e_callback = pml1e_do_clean_callback,
+};
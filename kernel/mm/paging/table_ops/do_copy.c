@@ -70,6 +70,7 @@ static void pml4e_do_copy_callback(pml4_t pml4, pml4e_t *e, ptr_t vaddr, void *d
 }
 
 const pagetable_walk_options_t pagetable_do_copy_callbacks = {
+    .pml1_readonly = true, // the source is only read from
     .pml1e_callback = pml1e_do_copy_callback,
     .pml2e_pre_traverse = pml2e_do_copy_callback,
     .pml3e_pre_traverse = pml3e_do_copy_callback,
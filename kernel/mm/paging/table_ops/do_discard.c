@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/mm/paging/table_ops/do_discard.h"
+
+#include "mos/platform/platform.h"
+
+static void pml1e_do_discard_callback(pml1_t pml1, pml1e_t *e, ptr_t vaddr, void *data)
+{
+    MOS_UNUSED(pml1);
+
+    struct pagetable_do_discard_data *discard_data = data;
+    if (!platform_pml1e_get_present(e))
+        return; // nothing to do (page isn't mapped)
+
+    const pfn_t pfn = platform_pml1e_get_pfn(e);
+    const bool writable = platform_pml1e_get_flags(e) & VM_WRITE;
+
+    if (discard_data->only_clean)
+    {
+        if (!platform_pml1e_discard_if_clean(e))
+            return; // read-only, or written to in the meantime
+    }
+    else
+    {
+        platform_pml1e_set_present(e, false);
+    }
+
+    platform_invalidate_tlb(vaddr);
+    pmm_unref_one(pfn);
+
+    if (writable)
+        discard_data->n_writable++;
+    else
+        discard_data->n_readonly++;
+}
+
+const pagetable_walk_options_t pagetable_do_discard_callbacks = {
+    .readonly = true, // nothing to discard in tables that don't exist
+    .pml1e_callback = pml1e_do_discard_callback,
+};
@@ -5,6 +5,7 @@
 
 #include "mos/filesystem/sysfs/sysfs.h"
 #include "mos/filesystem/sysfs/sysfs_autoinit.h"
+#include "mos/misc/trace.h"
 #include "mos/mm/mm.h"
 #include "mos/mm/paging/paging.h"
 #include "mos/platform/platform.h"
@@ -145,6 +146,7 @@ void *slab_alloc(size_t size)
     metadata->pages = page_count;
     metadata->size = size;
 
+    trace_event(TRACE_SLAB_ALLOC, 1, size, ret + MOS_PAGE_SIZE);
     return (void *) ((ptr_t) ret + MOS_PAGE_SIZE);
 }
 
@@ -248,6 +250,7 @@ void *kmemcache_alloc(slab_t *slab)
 
     slab->nobjs++;
     spinlock_release(&slab->lock);
+    trace_event(TRACE_SLAB_ALLOC, 0, slab->ent_size, alloc);
     return alloc;
 }
 
@@ -269,18 +272,21 @@ static void kmemcache_free(slab_t *slab, const void *addr)
 
 // ! sysfs support
 
-static bool slab_sysfs_status(sysfs_file_t *f)
+static bool slab_sysfs_status(sysfs_file_t *f, u64 *cursor)
 {
-    list_foreach(slab_t, slab, slabs_list)
-    {
-        sysfs_printf(f, "%15s, ent_size=%5zu, first_free=" PTR_FMT ", %5zu objects\n", slab->name, slab->ent_size, slab->first_free, slab->nobjs);
-    }
-
+    // the cursor is the last slab printed, slabs are never destroyed, so the next one can be found from it directly
+    const list_node_t *prev = *cursor ? list_node((slab_t *) *cursor) : &slabs_list;
+    if (prev->next == &slabs_list)
+        return false;
+
+    const slab_t *slab = list_entry(prev->next, slab_t);
+    sysfs_printf(f, "%15s, ent_size=%5zu, first_free=" PTR_FMT ", %5zu objects\n", slab->name, slab->ent_size, slab->first_free, slab->nobjs);
+    *cursor = (ptr_t) slab;
     return true;
 }
 
 static sysfs_item_t slab_sysfs_items[] = {
-    SYSFS_RO_ITEM("status", slab_sysfs_status),
+    SYSFS_SEQ_ITEM("status", slab_sysfs_status),
 };
 
 SYSFS_AUTOREGISTER(slab, slab_sysfs_items);
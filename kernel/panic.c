@@ -57,7 +57,7 @@ noreturn void mos_kpanic(const char *func, u32 line, const char *fmt, ...)
     // unlock the consoles, in case we were in the middle of writing something
     list_foreach(console_t, console, consoles)
     {
-        spinlock_release(&console->write.lock);
+        console->write.lock = (spinlock_t) SPINLOCK_INIT;
     }
 
     static bool in_panic = false;
@@ -83,6 +83,8 @@ noreturn void mos_kpanic(const char *func, u32 line, const char *fmt, ...)
         printk_quiet = false; // make sure we print the panic message
     }
 
+    printk_set_sync(true); // the printk thread will never run again
+
     va_list args;
     char message[PRINTK_BUFFER_SIZE];
     va_start(args, fmt);
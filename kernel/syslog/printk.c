@@ -1,17 +1,73 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+// Messages are stored in a lock-free ring on the CPU that printed them, and written to the console by the printk thread
 
 #include <mos/cmdline.h>
 #include <mos/device/console.h>
+#include <mos/device/timekeeping.h>
+#include <mos/filesystem/sysfs/sysfs.h>
 #include <mos/lib/structures/list.h>
 #include <mos/lib/sync/spinlock.h>
+#include <mos/locks/rcu.h>
+#include <mos/platform/platform.h>
 #include <mos/printk.h>
 #include <mos/setup.h>
+#include <mos/tasks/kthread.h>
+#include <mos/tasks/schedule.h>
+#include <mos/tasks/wait.h>
 #include <mos_stdio.h>
+#include <mos_stdlib.h>
 #include <mos_string.h>
 
+#define PRINTK_RING_SIZE         MOS_PRINTK_RING_SIZE
+#define PRINTK_KMSG_BATCH        32 // records printed to /sys/kmsg at a time
+
+MOS_STATIC_ASSERT((PRINTK_RING_SIZE & (PRINTK_RING_SIZE - 1)) == 0, "the printk ring size must be a power of two");
+MOS_STATIC_ASSERT(PRINTK_RING_SIZE >= 16 * PRINTK_BUFFER_SIZE, "the printk ring is too small");
+
+typedef struct
+{
+    u64 seq;       // in the order the messages were printed, over all CPUs
+    u64 timestamp; // platform_get_timestamp()
+    u16 size;      // of the whole record, 0 for the padding at the end of the ring
+    u16 len;       // of the text that follows
+    u8 level;
+    u8 cpu;
+    bool console; // not filtered out by quiet mode
+} printk_record_t;
+
+// Only the CPU that owns a ring writes to it, with interrupts disabled, positions only ever grow.
+// Readers on any CPU copy a record and then check that the tail hasn't moved past it in the meantime.
+typedef struct
+{
+    u64 head;     // where the next record will be written
+    u64 tail;     // the oldest record that hasn't been overwritten
+    bool writing; // a sequence number has been taken, but the record isn't published yet
+    char data[PRINTK_RING_SIZE] __aligned(sizeof(u64));
+} printk_ring_t;
+
+typedef struct
+{
+    u64 seq;                // the next record to be read
+    u64 pos[PER_CPU_COUNT]; // of the next unread record of each CPU
+    u64 dropped;            // records overwritten before they were read
+} printk_reader_t;
+
+static PER_CPU_DECLARE(printk_ring_t, printk_rings);
+static u64 printk_next_seq = 0;
+
 static console_t *printk_console;
 bool printk_quiet;
 
+static bool printk_sync = false;          // every message is written to the console before printk returns
+static bool printk_panicking = false;     // don't wait for other CPUs, they may have stopped in the middle of printing
+static bool printk_flusher_running = false;
+static bool printk_flusher_idle = false;  // it's on the waitlist, or about to be, and the next message has to wake it up
+static thread_t *printk_flusher_thread;
+static waitlist_t printk_flusher_waitlist;
+static spinlock_t printk_flush_lock = SPINLOCK_INIT; // protects the console reader
+static printk_reader_t printk_console_reader;
+static char printk_flush_text[PRINTK_BUFFER_SIZE];
+
 static bool printk_setup_console(const char *kcon_name)
 {
     if (!kcon_name || !strlen(kcon_name))
@@ -49,6 +105,13 @@ static bool printk_setup_quiet(const char *arg)
 }
 MOS_EARLY_SETUP("quiet", printk_setup_quiet);
 
+static bool printk_setup_sync(const char *arg)
+{
+    printk_sync = cmdline_string_truthiness(arg, true);
+    return true;
+}
+MOS_EARLY_SETUP("printk_sync", printk_setup_sync);
+
 static inline void deduce_level_color(int loglevel, standard_color_t *fg, standard_color_t *bg)
 {
     *bg = Black;
@@ -74,25 +137,237 @@ static void print_to_console(console_t *con, mos_loglevel loglevel, const char *
     console_write_color(con, message, len, fg, bg);
 }
 
-void lvprintk(mos_loglevel loglevel, const char *fmt, va_list args)
+// the position of the record at pos, which is after the end of the ring if pos is in the padding
+static u64 printk_ring_skip_padding(const printk_ring_t *ring, u64 pos)
 {
-    // only print warnings and errors if quiet mode is enabled
-    if (printk_quiet && loglevel < MOS_LOG_WARN)
-        return;
+    const size_t offset = pos % PRINTK_RING_SIZE;
+    if (PRINTK_RING_SIZE - offset >= sizeof(printk_record_t) && ((const printk_record_t *) &ring->data[offset])->size != 0)
+        return pos;
+    return pos + PRINTK_RING_SIZE - offset;
+}
 
-    char message[PRINTK_BUFFER_SIZE];
-    const int len = vsnprintf(message, PRINTK_BUFFER_SIZE, fmt, args);
+static void printk_ring_write(mos_loglevel loglevel, bool console, const char *text, size_t len)
+{
+    const bool irq_enabled = platform_interrupt_disable_save();
+    printk_ring_t *ring = per_cpu(printk_rings);
+    __atomic_store_n(&ring->writing, true, __ATOMIC_SEQ_CST); // before the sequence number is taken, see printk_read_next
+
+    // a record is never split, the space left at the end of the ring is skipped if it doesn't fit
+    const size_t size = ALIGN_UP(sizeof(printk_record_t) + len, sizeof(u64));
+    const size_t offset = ring->head % PRINTK_RING_SIZE;
+    const size_t padding = PRINTK_RING_SIZE - offset < size ? PRINTK_RING_SIZE - offset : 0;
+    const u64 pos = ring->head + padding;
+
+    // overwrite the oldest records, readers that are copying them must see the new tail before their data changes
+    u64 tail = ring->tail;
+    while (pos + size - tail > PRINTK_RING_SIZE)
+    {
+        tail = printk_ring_skip_padding(ring, tail);
+        tail += ((const printk_record_t *) &ring->data[tail % PRINTK_RING_SIZE])->size;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (padding >= sizeof(printk_record_t))
+        ((printk_record_t *) &ring->data[offset])->size = 0;
+
+    printk_record_t *record = (printk_record_t *) &ring->data[pos % PRINTK_RING_SIZE];
+    record->seq = __atomic_fetch_add(&printk_next_seq, 1, __ATOMIC_SEQ_CST);
+    record->timestamp = platform_get_timestamp();
+    record->size = size;
+    record->len = len;
+    record->level = loglevel;
+    record->cpu = platform_current_cpu_id();
+    record->console = console;
+    memcpy(record + 1, text, len);
+
+    __atomic_store_n(&ring->head, pos + size, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->writing, false, __ATOMIC_RELEASE);
+    platform_interrupt_restore(irq_enabled);
+}
+
+/**
+ * @brief Copy the first record at or after *pos, and move *pos to it.
+ *
+ * @param text Receives the NUL-terminated text of the record, NULL to only copy the header
+ * @return false if the CPU hasn't printed anything after *pos
+ */
+static bool printk_ring_peek(const printk_ring_t *ring, u64 *pos, printk_record_t *record, char *text)
+{
+    while (true)
+    {
+        const u64 tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        const u64 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        const u64 start = MAX(*pos, tail); // anything before the tail has been overwritten
+        if (start >= head)
+            return false;
+
+        const u64 p = printk_ring_skip_padding(ring, start); // a record always follows the padding
+        const size_t offset = p % PRINTK_RING_SIZE;
+        memcpy(record, &ring->data[offset], sizeof(*record));
+
+        // the header may be garbage if it's being overwritten, don't copy past the buffer or the ring
+        record->len = MIN((size_t) record->len, MIN((size_t) PRINTK_BUFFER_SIZE - 1, PRINTK_RING_SIZE - offset - sizeof(*record)));
+        if (text)
+            memcpy(text, &ring->data[offset + sizeof(*record)], record->len);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&ring->tail, __ATOMIC_RELAXED) > start)
+            continue; // overwritten while it was being copied
+
+        if (text)
+            text[record->len] = '\0';
+        *pos = p;
+        return true;
+    }
+}
+
+static bool printk_writers_busy(void)
+{
+    for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+    {
+        if (__atomic_load_n(&per_cpu_of(printk_rings, cpu)->writing, __ATOMIC_ACQUIRE))
+            return true;
+    }
+    return false;
+}
+
+static void printk_reader_init(printk_reader_t *reader, u64 seq)
+{
+    reader->seq = seq;
+    reader->dropped = 0;
+    for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+    {
+        const printk_ring_t *ring = per_cpu_of(printk_rings, cpu);
+        printk_record_t record;
+        reader->pos[cpu] = 0;
+        while (printk_ring_peek(ring, &reader->pos[cpu], &record, NULL) && record.seq < seq)
+            reader->pos[cpu] += record.size;
+    }
+}
+
+/**
+ * @brief Read the next record in the order they were printed, merging the rings of all CPUs.
+ *
+ * @return false if there is none, or if it hasn't been published yet by the CPU that is printing it
+ */
+static bool printk_read_next(printk_reader_t *reader, printk_record_t *record, char *text)
+{
+    for (int attempt = 0;; attempt++)
+    {
+        u32 best_cpu = 0;
+        bool found = false;
+        for (u32 cpu = 0; cpu < PER_CPU_COUNT; cpu++)
+        {
+            printk_record_t r;
+            if (printk_ring_peek(per_cpu_of(printk_rings, cpu), &reader->pos[cpu], &r, NULL) && (!found || r.seq < record->seq))
+                *record = r, best_cpu = cpu, found = true;
+        }
+
+        if (!found)
+            return false;
+
+        if (record->seq > reader->seq)
+        {
+            // The next record is either still being written, or has been overwritten. A CPU sets 'writing' before
+            // it takes a sequence number, and clears it after publishing the record, so if no CPU is writing now,
+            // a record that was being written when we looked will be seen when we look again.
+            if (printk_writers_busy() && !printk_panicking)
+                return false;
+            if (attempt == 0)
+                continue;
+            reader->dropped += record->seq - reader->seq;
+        }
+
+        const u64 seq = record->seq;
+        if (!printk_ring_peek(per_cpu_of(printk_rings, best_cpu), &reader->pos[best_cpu], record, text) || record->seq != seq)
+            continue; // overwritten in the meantime
+
+        reader->pos[best_cpu] += record->size;
+        reader->seq = record->seq + 1;
+        return true;
+    }
+}
 
+static console_t *printk_get_console(void)
+{
     if (unlikely(!printk_console))
     {
-        list_foreach(console_t, con, consoles)
+        rcu_read_lock();
+        list_foreach_rcu(console_t, con, consoles)
         {
             printk_console = con; // set the first console as the default
             break;
         }
+        rcu_read_unlock();
+    }
+
+    return printk_console;
+}
+
+static bool printk_flush_one(void)
+{
+    console_t *con = printk_get_console();
+    if (!con)
+        return false; // keep the messages until there is a console to print them to
+
+    printk_record_t record;
+    const u64 dropped = printk_console_reader.dropped;
+    if (!printk_read_next(&printk_console_reader, &record, printk_flush_text))
+        return false;
+
+    if (unlikely(printk_console_reader.dropped != dropped))
+    {
+        char message[64];
+        const int len = snprintf(message, sizeof(message), "\r\nprintk: %llu messages dropped", printk_console_reader.dropped - dropped);
+        print_to_console(con, MOS_LOG_WARN, message, len);
     }
 
-    print_to_console(printk_console, loglevel, message, len);
+    if (record.console)
+        print_to_console(con, record.level, printk_flush_text, record.len);
+    return true;
+}
+
+static void printk_flush(void)
+{
+    // whoever holds the lock also writes out the messages that are printed while it's flushing
+    while (spinlock_try_acquire(&printk_flush_lock))
+    {
+        while (printk_flush_one())
+            ;
+        spinlock_release(&printk_flush_lock);
+
+        // a message published after the last one was read, but before the lock was released, is ours to write out
+        const bool pending = printk_console_reader.seq < __atomic_load_n(&printk_next_seq, __ATOMIC_ACQUIRE);
+        if (!pending || printk_panicking || !printk_console)
+            break;
+    }
+}
+
+void lvprintk(mos_loglevel loglevel, const char *fmt, va_list args)
+{
+    char message[PRINTK_BUFFER_SIZE];
+    const int len = vsnprintf(message, PRINTK_BUFFER_SIZE, fmt, args);
+
+    // only print warnings and errors if quiet mode is enabled, the others are still kept for /sys/kmsg
+    const bool console = !printk_quiet || loglevel >= MOS_LOG_WARN;
+    printk_ring_write(loglevel, console, message, MIN(len, PRINTK_BUFFER_SIZE - 1));
+
+    if (printk_sync || !__atomic_load_n(&printk_flusher_running, __ATOMIC_ACQUIRE))
+        printk_flush();
+    else if (current_thread != printk_flusher_thread && __atomic_exchange_n(&printk_flusher_idle, false, __ATOMIC_SEQ_CST))
+        waitlist_wake(&printk_flusher_waitlist, 1); // only the first message after it went idle, the flusher prints them all
+}
+
+void printk_set_sync(bool panic)
+{
+    printk_sync = true;
+    if (panic)
+    {
+        printk_panicking = true;
+        printk_flush_lock = (spinlock_t) SPINLOCK_INIT; // its holder may never get to release it
+    }
+    printk_flush();
 }
 
 bool printk_unquiet(void)
@@ -127,3 +402,76 @@ void vprintk(const char *format, va_list args)
 {
     lvprintk(MOS_LOG_INFO, format, args);
 }
+
+// whether there are messages the flusher can write out, those printed without a console wait for the next message after it's set
+static bool printk_flusher_has_work(void)
+{
+    return printk_console && __atomic_load_n(&printk_console_reader.seq, __ATOMIC_RELAXED) < __atomic_load_n(&printk_next_seq, __ATOMIC_SEQ_CST);
+}
+
+static void printk_flusher(void *arg)
+{
+    MOS_UNUSED(arg);
+    printk_flusher_thread = current_thread; // it never wakes itself up, it's already looking for messages
+    __atomic_store_n(&printk_flusher_running, true, __ATOMIC_RELEASE);
+    while (true)
+    {
+        printk_flush();
+
+        // get on the waitlist and go idle before looking for messages, so that one printed in between wakes us up
+        MOS_ASSERT(waitlist_append(&printk_flusher_waitlist));
+        __atomic_store_n(&printk_flusher_idle, true, __ATOMIC_SEQ_CST);
+        if (printk_flusher_has_work())
+            __atomic_store_n(&printk_flusher_idle, false, __ATOMIC_RELAXED);
+        else
+            blocked_reschedule();
+
+        waitlist_remove_me(&printk_flusher_waitlist);
+        scheduler_discard_wakeup();
+    }
+}
+
+static void printk_flusher_init(void)
+{
+    waitlist_init(&printk_flusher_waitlist);
+    if (!printk_sync)
+        kthread_create(printk_flusher, NULL, "printk");
+}
+
+MOS_INIT(KTHREAD, printk_flusher_init);
+
+// one line per record: "<level>,<seq>,<microseconds since boot>,<cpu>;<text>", a gap in <seq> means records were lost
+static bool printk_sysfs_kmsg(sysfs_file_t *f, u64 *cursor)
+{
+    printk_reader_t reader;
+    printk_reader_init(&reader, *cursor);
+
+    printk_record_t record;
+    char text[PRINTK_BUFFER_SIZE];
+    size_t n = 0;
+    for (; n < PRINTK_KMSG_BATCH && printk_read_next(&reader, &record, text); n++)
+    {
+        // the text of a message starts with a line break (see lprintk_wrapper), continuations don't
+        const char *line = text;
+        size_t len = record.len;
+        while (len && (*line == '\r' || *line == '\n'))
+            line++, len--;
+        while (len && (line[len - 1] == '\r' || line[len - 1] == '\n'))
+            len--;
+
+        const u64 us = timekeeping_counter_to_ns(record.timestamp) / 1000;
+        sysfs_printf(f, "%u,%llu,%llu,%u;%.*s\n", record.level, record.seq, us, record.cpu, (int) len, line);
+    }
+
+    *cursor = reader.seq;
+    return n == PRINTK_KMSG_BATCH;
+}
+
+static sysfs_item_t printk_kmsg_item = SYSFS_SEQ_STREAM_ITEM("kmsg", printk_sysfs_kmsg);
+
+static void printk_sysfs_init(void)
+{
+    sysfs_register_root_file(&printk_kmsg_item, NULL);
+}
+
+MOS_INIT(SYSFS, printk_sysfs_init);
@@ -2,6 +2,7 @@
 
 #include "mos/filesystem/dentry.h"
 #include "mos/filesystem/vfs.h"
+#include "mos/misc/profiling.h"
 #include "mos/mm/mm.h"
 #include "mos/tasks/signal.h"
 
@@ -26,6 +27,7 @@ extern const char *vmap_type_str[];
 process_t *process_do_fork(process_t *parent)
 {
     MOS_ASSERT(process_is_valid(parent));
+    const pf_point_t pp = profile_enter();
 
     process_t *child_p = process_allocate(parent, parent->name);
     if (unlikely(!child_p))
@@ -57,6 +59,7 @@ process_t *process_do_fork(process_t *parent)
     }
 
     mm_unlock_ctx_pair(parent->mm, child_p->mm);
+    profile_leave(pp, "fork.mm", parent->pid);
 
     // copy the parent's files
     for (int i = 0; i < MOS_PROCESS_MAX_OPEN_FILES; i++)
@@ -97,5 +100,6 @@ process_t *process_do_fork(process_t *parent)
 
     hashmap_put(&process_table, child_p->pid, child_p);
     thread_complete_init(child_t);
+    profile_leave(pp, "fork", child_p->pid);
     return child_p;
 }
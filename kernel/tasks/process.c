@@ -40,6 +40,7 @@ static const char *vmap_content_str[] = {
     [VMAP_FILE] = "file",       //
     [VMAP_MMAP] = "mmap",       //
     [VMAP_DMA] = "DMA",         //
+    [VMAP_VDSO] = "vdso",       //
 };
 
 const char *vmap_type_str[] = {
@@ -223,31 +224,41 @@ pid_t process_wait_for_pid(pid_t pid, u32 *exit_code, u32 flags)
         if (list_is_empty(&current_process->children))
             return -ECHILD; // no children to wait for at all
 
+        waitlist_t *const waitlist = &current_process->signal_info.sigchild_waitlist;
+        MOS_ASSERT_X(!waitlist->closed, "waitlist is in use");
+
     find_dead_child:;
-        // first find if there are any dead children
+        // get on the waitlist before looking, so that a child dying right after we've looked still wakes us up
+        const bool ok = waitlist_append(waitlist);
+        MOS_ASSERT(ok);
+
         list_foreach(process_t, child, current_process->children)
         {
             if (child->exited)
             {
+                waitlist_remove_me(waitlist);
+                scheduler_discard_wakeup(); // another child may have exited in the meantime and woken us up
                 pid = child->pid;
                 goto child_dead;
             }
         }
 
         if (flags & WNOHANG)
+        {
+            waitlist_remove_me(waitlist);
+            scheduler_discard_wakeup();
             return 0; // no dead children, and we don't want to wait
+        }
 
         // we have to wait for a child to die
-        MOS_ASSERT_X(!current_process->signal_info.sigchild_waitlist.closed, "waitlist is in use");
-
-        const bool ok = reschedule_for_waitlist(&current_process->signal_info.sigchild_waitlist);
-        MOS_ASSERT(ok); // we just created the waitlist, it should be empty
+        blocked_reschedule();
+        waitlist_remove_me(waitlist); // in case we are woken up by something else
+        scheduler_discard_wakeup();
 
         // we are woken up by a signal, or a child dying
         if (signal_has_pending())
         {
             pr_dinfo2(process, "woken up by signal");
-            waitlist_remove_me(&current_process->signal_info.sigchild_waitlist);
             return -ERESTARTSYS;
         }
 
@@ -271,6 +282,8 @@ child_dead:;
         // wait for the child to die
         bool ok = reschedule_for_waitlist(&current_process->signal_info.sigchild_waitlist);
         MOS_ASSERT(ok);
+        waitlist_remove_me(&current_process->signal_info.sigchild_waitlist); // if something else woke us up
+        scheduler_discard_wakeup();
     }
 
     list_remove(target_proc); // remove from parent's children list
@@ -389,6 +402,35 @@ ptr_t process_grow_heap(process_t *process, size_t npages)
     return heap_top + npages * MOS_PAGE_SIZE;
 }
 
+ptr_t process_shrink_heap(process_t *process, size_t npages)
+{
+    MOS_ASSERT(process_is_valid(process));
+
+    spinlock_acquire(&process->mm->mm_lock);
+    vmap_t *heap = NULL;
+    list_foreach(vmap_t, mmap, process->mm->mmaps)
+    {
+        if (mmap->content == VMAP_HEAP)
+        {
+            heap = mmap;
+            spinlock_acquire(&heap->lock);
+            break;
+        }
+    }
+
+    MOS_ASSERT(heap != NULL);
+
+    npages = MIN(npages, heap->npages - 1);
+    const ptr_t heap_top = heap->vaddr + (heap->npages - npages) * MOS_PAGE_SIZE;
+    vmap_discard_pages(heap, heap_top, npages, false);
+    heap->npages -= npages;
+
+    pr_dinfo2(process, "shrank heap of process %pp by %zu pages", (void *) process, npages);
+    spinlock_release(&heap->lock);
+    spinlock_release(&process->mm->mm_lock);
+    return heap_top;
+}
+
 void process_dump_mmaps(const process_t *process)
 {
     pr_info("process %pp:", (void *) process);
@@ -1,9 +1,11 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "mos/misc/trace.h"
 #include "mos/tasks/signal.h"
 
 #include <mos/lib/structures/hashmap.h>
 #include <mos/lib/sync/spinlock.h>
+#include <mos/locks/rcu.h>
 #include <mos/platform/platform.h>
 #include <mos/printk.h>
 #include <mos/tasks/process.h>
@@ -32,21 +34,9 @@ static bool should_schedule_to_thread(thread_t *thread)
             return true;
         }
         case THREAD_STATE_BLOCKED:
-        {
-            // if the thread is blocked, check if the condition (if any) is met
-            if (!thread->waiting)
-                return false;
-
-            if (!wc_condition_verify(thread->waiting))
-                return false;
-            wc_condition_cleanup(thread->waiting);
-            thread->waiting = NULL;
-            pr_dinfo2(scheduler, "%pt's wait condition is resolved", (void *) thread);
-            return true;
-        }
         case THREAD_STATE_NONINTERRUPTIBLE:
         {
-            return false;
+            return false; // blocked threads are made READY by whoever wakes them up, see scheduler_wake_thread
         }
         case THREAD_STATE_DEAD:
         case THREAD_STATE_RUNNING:
@@ -60,29 +50,19 @@ static bool should_schedule_to_thread(thread_t *thread)
     }
 }
 
-static bool schedule_to_thread(uintn key, void *value, void *data)
+// mark a thread as RUNNING, the caller must hold its state lock
+static switch_flags_t claim_thread_locked(thread_t *thread)
 {
-    MOS_UNUSED(data);
-    tid_t tid = key;
-    thread_t *thread = (thread_t *) value;
-
-    MOS_ASSERT_X(thread->tid == tid, "something is wrong with the thread table");
-
     switch_flags_t switch_flags = 0;
-    spinlock_acquire(&thread->state_lock);
-    if (!should_schedule_to_thread(thread))
-    {
-        spinlock_release(&thread->state_lock);
-        return true;
-    }
-    else
-    {
-        if (thread->state == THREAD_STATE_CREATED)
-            switch_flags |= thread->mode == THREAD_MODE_KERNEL ? SWITCH_TO_NEW_KERNEL_THREAD : SWITCH_TO_NEW_USER_THREAD;
-        thread->state = THREAD_STATE_RUNNING;
-        spinlock_release(&thread->state_lock);
-    }
+    if (thread->state == THREAD_STATE_CREATED)
+        switch_flags |= thread->mode == THREAD_MODE_KERNEL ? SWITCH_TO_NEW_KERNEL_THREAD : SWITCH_TO_NEW_USER_THREAD;
+    thread->state = THREAD_STATE_RUNNING;
+    return switch_flags;
+}
 
+// save the current context to 'old_stack', and switch to 'thread' in one step
+static void switch_to_thread(ptr_t *old_stack, thread_t *thread, switch_flags_t switch_flags)
+{
     cpu_t *cpu = current_cpu;
     pr_dinfo2(scheduler, "switching %pt -> %pt, flags: %c%c",        //
               (void *) current_thread,                               //
@@ -91,6 +71,8 @@ static bool schedule_to_thread(uintn key, void *value, void *data)
               switch_flags & SWITCH_TO_NEW_KERNEL_THREAD ? 'K' : '-' //
     );
 
+    trace_event(TRACE_CONTEXT_SWITCH, current_thread ? current_thread->state : 0, thread->tid, 0);
+
     const bool should_switch_mm = cpu->mm_context != thread->owner->mm;
     if (should_switch_mm)
     {
@@ -98,7 +80,30 @@ static bool schedule_to_thread(uintn key, void *value, void *data)
         MOS_UNUSED(old);
     }
 
-    platform_switch_to_thread(&cpu->scheduler_stack, thread, switch_flags);
+    platform_switch_to_thread(old_stack, thread, switch_flags);
+}
+
+static bool schedule_to_thread(uintn key, void *value, void *data)
+{
+    MOS_UNUSED(data);
+    tid_t tid = key;
+    thread_t *thread = (thread_t *) value;
+
+    MOS_ASSERT_X(thread->tid == tid, "something is wrong with the thread table");
+
+    rcu_quiescent_state(); // we are between threads, so this CPU can't be in a read-side critical section
+
+    spinlock_acquire(&thread->state_lock);
+    if (!should_schedule_to_thread(thread))
+    {
+        spinlock_release(&thread->state_lock);
+        return true;
+    }
+
+    const switch_flags_t switch_flags = claim_thread_locked(thread);
+    spinlock_release(&thread->state_lock);
+
+    switch_to_thread(&current_cpu->scheduler_stack, thread, switch_flags);
     return true;
 }
 
@@ -120,37 +125,65 @@ noreturn void scheduler(void)
         hashmap_foreach(&thread_table, schedule_to_thread, NULL);
 }
 
-void reschedule_for_wait_condition(wait_condition_t *wait_condition)
-{
-    thread_t *t = current_cpu->thread;
-    MOS_ASSERT_X(t->state != THREAD_STATE_BLOCKED, "thread %d is already blocked", t->tid);
-    MOS_ASSERT_X(t->waiting == NULL, "thread %d is already waiting for something else", t->tid);
-    spinlock_acquire(&t->state_lock);
-    t->state = THREAD_STATE_BLOCKED;
-    pr_dinfo2(scheduler, "%pt is now blocked for wait-condition", (void *) t);
-    spinlock_release(&t->state_lock);
-    t->waiting = wait_condition;
-    platform_switch_to_scheduler(&t->k_stack.head, current_cpu->scheduler_stack);
-}
-
 bool reschedule_for_waitlist(waitlist_t *waitlist)
 {
     thread_t *t = current_cpu->thread;
     MOS_ASSERT_X(t->state != THREAD_STATE_BLOCKED, "thread %d is already blocked", t->tid);
-    MOS_ASSERT_X(t->waiting == NULL, "thread %d is already waiting for something else", t->tid);
 
     if (!waitlist_append(waitlist))
         return false; // waitlist is closed, process is dead
 
-    spinlock_release(&t->state_lock);
-    t->state = THREAD_STATE_BLOCKED;
     pr_dinfo2(scheduler, "%pt is now blocked for waitlist", (void *) t);
-    spinlock_release(&t->state_lock);
-    platform_switch_to_scheduler(&t->k_stack.head, current_cpu->scheduler_stack);
-
+    blocked_reschedule();
     return true;
 }
 
+void scheduler_wake_thread(thread_t *thread)
+{
+    spinlock_acquire(&thread->state_lock);
+    switch (thread->state)
+    {
+        case THREAD_STATE_BLOCKED: thread->state = THREAD_STATE_READY; break;
+        case THREAD_STATE_RUNNING: thread->wakeup_pending = true; break; // it's about to block, don't let it
+        default: break;                                                 // already runnable, or dead
+    }
+    spinlock_release(&thread->state_lock);
+}
+
+void scheduler_discard_wakeup(void)
+{
+    thread_t *const self = current_thread;
+    spinlock_acquire(&self->state_lock);
+    self->wakeup_pending = false;
+    spinlock_release(&self->state_lock);
+}
+
+void scheduler_wake_and_yield_to(thread_t *thread)
+{
+    thread_t *const self = current_thread;
+    MOS_ASSERT(thread != self);
+
+    spinlock_acquire(&thread->state_lock);
+    if (thread->state != THREAD_STATE_BLOCKED)
+    {
+        // it's running elsewhere (or about to block), already runnable, or dead, a plain wakeup is all we can do
+        spinlock_release(&thread->state_lock);
+        scheduler_wake_thread(thread);
+        return;
+    }
+
+    const switch_flags_t switch_flags = claim_thread_locked(thread);
+    spinlock_release(&thread->state_lock);
+
+    spinlock_acquire(&self->state_lock);
+    MOS_ASSERT_X(self->state == THREAD_STATE_RUNNING, "thread %pt must be running", (void *) self);
+    self->state = THREAD_STATE_READY;
+    spinlock_release(&self->state_lock);
+
+    // hand the CPU over without a round trip through the scheduler stack
+    switch_to_thread(&self->k_stack.head, thread, switch_flags);
+}
+
 void reschedule(void)
 {
     // A thread can jump to the scheduler if it is:
@@ -184,6 +217,14 @@ void blocked_reschedule(void)
 {
     cpu_t *cpu = current_cpu;
     spinlock_acquire(&cpu->thread->state_lock);
+    if (cpu->thread->wakeup_pending)
+    {
+        // the event we are about to wait for has already happened
+        cpu->thread->wakeup_pending = false;
+        spinlock_release(&cpu->thread->state_lock);
+        return;
+    }
+
     current_thread->state = THREAD_STATE_BLOCKED;
     pr_dinfo2(scheduler, "block-rescheduling %pt", (void *) cpu->thread);
     spinlock_release(&cpu->thread->state_lock);
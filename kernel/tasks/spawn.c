@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos/elf/elf.h"
+#include "mos/filesystem/dentry.h"
+#include "mos/filesystem/vfs.h"
+#include "mos/mm/cow.h"
+#include "mos/tasks/process.h"
+#include "mos/tasks/task_types.h"
+#include "mos/tasks/thread.h"
+
+#include <errno.h>
+#include <mos/filesystem/fs_types.h>
+#include <mos/lib/structures/hashmap.h>
+#include <mos/lib/structures/list.h>
+#include <mos/mm/paging/paging.h>
+#include <mos/printk.h>
+#include <mos/tasks/spawn_types.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+// Unlike fork + execve, spawning never clones the parent's address space: the child starts with
+// a fresh mm that only ever contains the new executable, so no COW mappings are created in the
+// parent just to be torn down a moment later by the child.
+
+static long spawn_apply_file_action(process_t *proc, const spawn_file_action_t *action)
+{
+    if (action->fd < 0 || action->fd >= MOS_PROCESS_MAX_OPEN_FILES)
+        return -EBADF;
+
+    switch (action->type)
+    {
+        case SPAWN_FILE_ACTION_OPEN:
+        {
+            if (!action->path)
+                return -EFAULT;
+
+            // the path is resolved in the context of the caller, which is the one currently running
+            file_t *file = vfs_openat(action->src_fd, action->path, action->open_flags);
+            if (IS_ERR(file))
+                return PTR_ERR(file);
+
+            process_detach_fd(proc, action->fd);
+            proc->files[action->fd].io = io_ref(&file->io);
+            proc->files[action->fd].flags = action->fd_flags;
+            return 0;
+        }
+        case SPAWN_FILE_ACTION_DUP2:
+        {
+            io_t *io = process_get_fd(proc, action->src_fd);
+            if (!io_valid(io))
+                return -EBADF;
+
+            if (action->src_fd == action->fd)
+            {
+                proc->files[action->fd].flags &= ~FD_FLAGS_CLOEXEC; // as posix_spawn_file_actions_adddup2 does
+                return 0;
+            }
+
+            io_ref(io); // take the reference before detaching, in case the target fd is the only other holder
+            process_detach_fd(proc, action->fd);
+            proc->files[action->fd].io = io;
+            proc->files[action->fd].flags = action->fd_flags;
+            return 0;
+        }
+        case SPAWN_FILE_ACTION_CLOSE:
+        {
+            return process_detach_fd(proc, action->fd) ? 0 : -EBADF;
+        }
+    }
+
+    return -EINVAL;
+}
+
+static void spawn_discard_process(process_t *proc)
+{
+    for (int i = 0; i < MOS_PROCESS_MAX_OPEN_FILES; i++)
+        process_detach_fd(proc, i);
+
+    if (proc->working_directory)
+        dentry_unref(proc->working_directory);
+
+    list_remove(proc); // from the parent's children list
+    process_destroy(proc);
+}
+
+pid_t process_do_spawn(process_t *parent, fd_t dirfd, const char *path, const char *const argv[], const char *const envp[], const spawn_attr_t *attr)
+{
+    MOS_ASSERT(parent == current_process); // paths and file actions are resolved in the caller's context
+
+    // open and verify the executable before anything is allocated, so that the common failures are cheap
+    file_t *file = vfs_openat(dirfd, path, OPEN_READ | OPEN_EXECUTE);
+    if (IS_ERR(file))
+        return PTR_ERR(file);
+
+    io_ref(&file->io);
+
+    long ret = 0;
+    elf_header_t header;
+    if (!elf_read_and_verify_executable(file, &header))
+    {
+        ret = -ENOEXEC;
+        goto bail_close_file;
+    }
+
+    dentry_t *cwd = NULL;
+    if (attr && (attr->flags & SPAWN_ATTR_CHDIR))
+    {
+        if (!attr->working_directory)
+        {
+            ret = -EFAULT;
+            goto bail_close_file;
+        }
+
+        const char *wd = attr->working_directory;
+        dentry_t *base = path_is_absolute(wd) ? root_dentry : parent->working_directory;
+        cwd = dentry_get(base, root_dentry, wd, RESOLVE_EXPECT_EXIST | RESOLVE_EXPECT_DIR);
+        if (IS_ERR(cwd))
+        {
+            ret = PTR_ERR(cwd);
+            goto bail_close_file;
+        }
+    }
+    else
+    {
+        cwd = dentry_ref_up_to(parent->working_directory, root_dentry);
+    }
+
+    process_t *proc = process_allocate(parent, file->dentry->name);
+    if (unlikely(!proc))
+    {
+        dentry_unref(cwd);
+        ret = -ENOMEM;
+        goto bail_close_file;
+    }
+
+    pr_dinfo2(process, "spawning %pp from %pp, '%s'", (void *) proc, (void *) parent, path);
+    proc->working_directory = cwd;
+
+    // inherit everything that would have survived an execve
+    for (int i = 0; i < MOS_PROCESS_MAX_OPEN_FILES; i++)
+    {
+        const fd_type f = parent->files[i];
+        if (io_valid(f.io) && !(f.flags & FD_FLAGS_CLOEXEC))
+        {
+            proc->files[i].io = io_ref(f.io);
+            proc->files[i].flags = f.flags;
+        }
+    }
+
+    for (size_t i = 0; attr && i < attr->n_file_actions; i++)
+    {
+        ret = spawn_apply_file_action(proc, &attr->file_actions[i]);
+        if (ret < 0)
+        {
+            pr_dinfo2(process, "spawn: file action %zu failed: %ld", i, ret);
+            goto bail_discard;
+        }
+    }
+
+    proc->main_thread = thread_new(proc, THREAD_MODE_USER, proc->name, 0, NULL);
+
+    thread_signal_info_t *const siginfo = &proc->main_thread->signal_info;
+    if (attr && (attr->flags & SPAWN_ATTR_SETSIGMASK))
+    {
+        for (signal_t sig = 1; sig < SIGNAL_MAX_N && sig < 64; sig++)
+            siginfo->masks[sig] = attr->sigmask & (1ULL << sig);
+    }
+    else
+    {
+        spinlock_acquire(&current_thread->signal_info.lock);
+        memcpy(siginfo->masks, current_thread->signal_info.masks, sizeof(siginfo->masks));
+        spinlock_release(&current_thread->signal_info.lock);
+    }
+
+    if (!elf_fill_process(proc, file, path, argv, envp))
+    {
+        ret = -ENOEXEC;
+        goto bail_discard;
+    }
+
+    vmap_t *heap = cow_allocate_zeroed_pages(proc->mm, 1, MOS_ADDR_USER_HEAP, VALLOC_DEFAULT, VM_USER_RW);
+    vmap_finalise_init(heap, VMAP_HEAP, VMAP_TYPE_PRIVATE);
+
+    void *old_proc = hashmap_put(&process_table, proc->pid, proc);
+    MOS_ASSERT_X(old_proc == NULL, "process already exists, go and buy yourself a lottery :)");
+    thread_complete_init(proc->main_thread);
+    io_unref(&file->io);
+    return proc->pid;
+
+bail_discard:
+    spawn_discard_process(proc);
+bail_close_file:
+    io_unref(&file->io);
+    return ret;
+}
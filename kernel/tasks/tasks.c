@@ -51,39 +51,75 @@ void tasks_init()
 
 // ! sysfs support
 
-bool _process_do_print(uintn key, void *val, void *data)
+#define TASKS_SYSFS_BATCH 16 // records printed per chunk
+
+// the cursor is the last pid/tid printed, so that tasks coming and going between chunks don't shift the rest
+typedef struct
+{
+    sysfs_file_t *file;
+    uintn cursor;                  ///< print the entries with a key above this...
+    uintn bound;                   ///< ...and at most this
+    uintn keys[TASKS_SYSFS_BATCH]; ///< the smallest keys above the cursor, in ascending order
+    size_t nkeys;
+    bool is_thread;
+} tasks_sysfs_batch_t;
+
+static bool tasks_sysfs_find_keys(uintn key, void *val, void *data)
 {
-    MOS_UNUSED(key);
-    sysfs_file_t *f = data;
-    process_t *proc = val;
-    sysfs_printf(f, "%pp\n", (void *) proc);
+    MOS_UNUSED(val);
+    tasks_sysfs_batch_t *batch = data;
+    if (key <= batch->cursor)
+        return true;
+    if (batch->nkeys == TASKS_SYSFS_BATCH && key >= batch->keys[TASKS_SYSFS_BATCH - 1])
+        return true;
+
+    size_t i = MIN(batch->nkeys, (size_t) TASKS_SYSFS_BATCH - 1);
+    for (; i > 0 && batch->keys[i - 1] > key; i--)
+        batch->keys[i] = batch->keys[i - 1];
+    batch->keys[i] = key;
+    batch->nkeys = MIN(batch->nkeys + 1, (size_t) TASKS_SYSFS_BATCH);
     return true;
 }
 
-bool _thread_do_print(uintn key, void *val, void *data)
+static bool tasks_sysfs_do_print(uintn key, void *val, void *data)
 {
-    MOS_UNUSED(key);
-    sysfs_file_t *f = data;
-    thread_t *thread = val;
-    sysfs_printf(f, "%pt\n", (void *) thread);
+    tasks_sysfs_batch_t *batch = data;
+    if (key <= batch->cursor || key > batch->bound)
+        return true;
+
+    if (batch->is_thread)
+        sysfs_printf(batch->file, "%pt\n", val);
+    else
+        sysfs_printf(batch->file, "%pp\n", val);
     return true;
 }
 
-static bool tasks_sysfs_process_list(sysfs_file_t *f)
+static bool tasks_sysfs_print_batch(sysfs_file_t *f, u64 *cursor, hashmap_t *table, bool is_thread)
 {
-    hashmap_foreach(&process_table, _process_do_print, (void *) f);
-    return true;
+    tasks_sysfs_batch_t batch = { .file = f, .cursor = *cursor, .is_thread = is_thread };
+    hashmap_foreach(table, tasks_sysfs_find_keys, &batch);
+    if (batch.nkeys == 0)
+        return false;
+
+    batch.bound = batch.keys[batch.nkeys - 1];
+    hashmap_foreach(table, tasks_sysfs_do_print, &batch);
+    *cursor = batch.bound;
+    return batch.nkeys == TASKS_SYSFS_BATCH; // a partial batch means the end of the table
 }
 
-static bool tasks_sysfs_thread_list(sysfs_file_t *f)
+static bool tasks_sysfs_process_list(sysfs_file_t *f, u64 *cursor)
 {
-    hashmap_foreach(&thread_table, _thread_do_print, (void *) f);
-    return true;
+    return tasks_sysfs_print_batch(f, cursor, &process_table, false);
+}
+
+static bool tasks_sysfs_thread_list(sysfs_file_t *f, u64 *cursor)
+{
+    return tasks_sysfs_print_batch(f, cursor, &thread_table, true);
 }
 
 static sysfs_item_t task_sysfs_items[] = {
-    SYSFS_RO_ITEM("processes", tasks_sysfs_process_list),
-    SYSFS_RO_ITEM("threads", tasks_sysfs_thread_list),
+    SYSFS_SEQ_ITEM("processes", tasks_sysfs_process_list),
+    SYSFS_SEQ_ITEM("threads", tasks_sysfs_thread_list),
 };
 
 SYSFS_AUTOREGISTER(tasks, task_sysfs_items);
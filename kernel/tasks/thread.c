@@ -33,7 +33,7 @@ thread_t *thread_allocate(process_t *owner, thread_mode tflags)
     t->owner = owner;
     t->state = THREAD_STATE_CREATED;
     t->mode = tflags;
-    t->waiting = NULL;
+    t->wakeup_pending = false;
     waitlist_init(&t->waiters);
     linked_list_init(&t->signal_info.pending);
     linked_list_init(list_node(t));
@@ -7,6 +7,7 @@
 #include <mos/lib/sync/spinlock.h>
 #include <mos/platform/platform.h>
 #include <mos/printk.h>
+#include <mos/tasks/schedule.h>
 #include <mos/tasks/task_types.h>
 #include <mos/tasks/thread.h>
 #include <mos/tasks/wait.h>
@@ -19,28 +20,6 @@ SLAB_AUTOINIT("waitlist", waitlist_slab, waitlist_t);
 static slab_t *waitlist_listentry_slab = NULL;
 SLAB_AUTOINIT("waitlist_entry", waitlist_listentry_slab, waitable_list_entry_t);
 
-wait_condition_t *wc_wait_for(void *arg, wait_condition_verifier_t verify, wait_condition_cleanup_t cleanup)
-{
-    wait_condition_t *condition = kmalloc(sizeof(wait_condition_t));
-    condition->arg = arg;
-    condition->verify = verify;
-    condition->cleanup = cleanup;
-    return condition;
-}
-
-bool wc_condition_verify(wait_condition_t *condition)
-{
-    MOS_ASSERT_X(condition->verify, "wait condition has no verify function");
-    return condition->verify(condition);
-}
-
-void wc_condition_cleanup(wait_condition_t *condition)
-{
-    if (condition->cleanup)
-        condition->cleanup(condition);
-    kfree(condition);
-}
-
 void waitlist_init(waitlist_t *list)
 {
     memzero(list, sizeof(waitlist_t));
@@ -63,7 +42,7 @@ bool waitlist_append(waitlist_t *list)
     return true;
 }
 
-size_t waitlist_wake(waitlist_t *list, size_t max_wakeups)
+static size_t waitlist_do_wake(waitlist_t *list, size_t max_wakeups, bool yield)
 {
     spinlock_acquire(&list->lock);
 
@@ -73,6 +52,7 @@ size_t waitlist_wake(waitlist_t *list, size_t max_wakeups)
         return 0;
     }
 
+    thread_t *yield_to = NULL;
     size_t wakeups = 0;
     while (wakeups < max_wakeups && !list_is_empty(&list->list))
     {
@@ -82,10 +62,10 @@ size_t waitlist_wake(waitlist_t *list, size_t max_wakeups)
         thread_t *thread = thread_get(entry->waiter);
         MOS_ASSERT(thread);
 
-        spinlock_acquire(&thread->state_lock);
-        MOS_ASSERT(thread->state == THREAD_STATE_BLOCKED || thread->state == THREAD_STATE_READY);
-        thread->state = THREAD_STATE_READY;
-        spinlock_release(&thread->state_lock);
+        if (yield && !yield_to && thread != current_thread)
+            yield_to = thread; // switched to after the list is unlocked
+        else
+            scheduler_wake_thread(thread); // it may not have blocked yet, scheduler_wake_thread takes care of that
 
         kfree(entry);
         wakeups++;
@@ -93,9 +73,22 @@ size_t waitlist_wake(waitlist_t *list, size_t max_wakeups)
 
     spinlock_release(&list->lock);
 
+    if (yield_to)
+        scheduler_wake_and_yield_to(yield_to);
+
     return wakeups;
 }
 
+size_t waitlist_wake(waitlist_t *list, size_t max_wakeups)
+{
+    return waitlist_do_wake(list, max_wakeups, false);
+}
+
+size_t waitlist_wake_and_yield(waitlist_t *list, size_t max_wakeups)
+{
+    return waitlist_do_wake(list, max_wakeups, true);
+}
+
 void waitlist_close(waitlist_t *list)
 {
     spinlock_acquire(&list->lock);
@@ -106,8 +99,9 @@ void waitlist_close(waitlist_t *list)
     spinlock_release(&list->lock);
 }
 
-void waitlist_remove_me(waitlist_t *waitlist)
+bool waitlist_remove_me(waitlist_t *waitlist)
 {
+    bool removed = false;
     spinlock_acquire(&waitlist->lock);
 
     list_foreach(waitable_list_entry_t, entry, waitlist->list)
@@ -116,9 +110,11 @@ void waitlist_remove_me(waitlist_t *waitlist)
         {
             list_remove(entry);
             kfree(entry);
+            removed = true;
             break;
         }
     }
 
     spinlock_release(&waitlist->lock);
+    return removed;
 }
@@ -119,7 +119,7 @@
 #define _RPC_ARGTYPE_INT32  s32
 #define _RPC_ARGTYPE_INT64  s64
 #define _RPC_ARGTYPE_STRING const char *
-#define _RPC_ARGTYPE_BUFFER const void *
+#define _RPC_ARGTYPE_BUFFER rpc_buffer_t
 
 #define _RPC_GETARG_UINT8  u8
 #define _RPC_GETARG_UINT16 u16
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <librpc/macro_magic.h>
+#include <stddef.h>
 
 typedef enum
 {
@@ -21,6 +22,15 @@ typedef enum
     RPC_ARGTYPE_BUFFER,  // (const) void *, size_t
 } rpc_argtype_t;
 
+/**
+ * @brief An argument of type RPC_ARGTYPE_BUFFER, as it's passed to and received from the generated functions
+ */
+typedef struct
+{
+    const void *data;
+    size_t size;
+} rpc_buffer_t;
+
 typedef enum
 {
     RPC_RESULT_OK,
@@ -154,6 +154,7 @@ MOSAPI s16 rpc_arg_next_s16(rpc_context_t *args);
 MOSAPI s32 rpc_arg_next_s32(rpc_context_t *args);
 MOSAPI s64 rpc_arg_next_s64(rpc_context_t *args);
 MOSAPI const char *rpc_arg_next_string(rpc_context_t *context);
+MOSAPI rpc_buffer_t rpc_arg_next_buffer(rpc_context_t *context);
 
 MOSAPI const void *rpc_arg(const rpc_context_t *context, size_t iarg, rpc_argtype_t type, size_t *argsize);
 MOSAPI u8 rpc_arg_u8(const rpc_context_t *context, size_t iarg);
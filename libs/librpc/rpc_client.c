@@ -284,6 +284,12 @@ rpc_result_code_t rpc_simple_callv(rpc_server_stub_t *stub, u32 funcid, rpc_resu
                 rpc_call_arg(call, RPC_ARGTYPE_STRING, arg, strlen(arg) + 1); // also send the null terminator
                 break;
             }
+            case 'b':
+            {
+                const rpc_buffer_t arg = va_arg(args, rpc_buffer_t);
+                rpc_call_arg(call, RPC_ARGTYPE_BUFFER, arg.data, arg.size);
+                break;
+            }
             default: mos_warn("rpc_call: invalid argspec '%c'", *c); return RPC_RESULT_CLIENT_INVALID_ARGSPEC;
         }
     }
@@ -368,6 +368,13 @@ const char *rpc_arg_next_string(rpc_context_t *context)
     return rpc_arg_next(context, NULL);
 }
 
+rpc_buffer_t rpc_arg_next_buffer(rpc_context_t *context)
+{
+    rpc_buffer_t buffer = { 0 };
+    buffer.data = rpc_arg_next(context, &buffer.size);
+    return buffer;
+}
+
 const void *rpc_arg(const rpc_context_t *context, size_t iarg, rpc_argtype_t type, size_t *argsize)
 {
     // iterate over arguments
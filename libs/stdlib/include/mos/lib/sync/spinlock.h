@@ -5,31 +5,111 @@
 #include <mos/mos_global.h>
 #include <mos/types.h>
 
+#if MOS_DEBUG_FEATURE(spinlock) && defined(__MOS_KERNEL__)
+#define MOS_SPINLOCK_LOCKSTAT 1
+#else
+#define MOS_SPINLOCK_LOCKSTAT 0
+#endif
+
+#if MOS_SPINLOCK_LOCKSTAT
+/**
+ * @brief Statistics of the locks acquired at one place in the source code, see /sys/lockstat.
+ */
+typedef struct _spinlock_site
+{
+    const char *file;
+    int line;
+    bool registered;
+    struct _spinlock_site *next;
+    u64 acquisitions;
+    u64 contentions;
+    u64 max_wait; ///< in timestamp ticks
+    u64 max_hold; ///< in timestamp ticks
+} spinlock_site_t;
+#endif
+
+/**
+ * @brief A ticket spinlock.
+ *
+ * @details Each waiter takes a ticket, and the lock is handed over in ticket order, so no waiter can be starved.
+ * While waiting, a CPU only reads the lock, and backs off for longer the further back it is in the queue.
+ * An all-zero spinlock_t is unlocked.
+ */
 typedef struct
 {
-    bool flag;
+    union
+    {
+        u32 value; ///< both halves, for spinlock_try_acquire
+        struct
+        {
+            u16 serving; ///< the ticket that holds the lock
+            u16 next;    ///< the ticket the next waiter will get
+        };
+    };
 #if MOS_DEBUG_FEATURE(spinlock)
     const char *file;
     int line;
 #endif
+#if MOS_SPINLOCK_LOCKSTAT
+    spinlock_site_t *site;
+    u64 acquired_at;
+#endif
 } spinlock_t;
 
 // clang-format off
-#define SPINLOCK_INIT { 0 }
+#define SPINLOCK_INIT { .value = 0 }
 // clang-format on
 
-#define _spinlock_real_acquire(lock)                                                                                                                                     \
-    do                                                                                                                                                                   \
-    {                                                                                                                                                                    \
-        while (__atomic_test_and_set(&(lock)->flag, __ATOMIC_ACQUIRE))                                                                                                   \
-            ;                                                                                                                                                            \
-    } while (0)
+should_inline void spinlock_cpu_relax(void)
+{
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
 
-#define _spinlock_real_release(lock)                                                                                                                                     \
+/**
+ * @brief Take a ticket and spin until it is served.
+ *
+ * @return true if the lock was contended, i.e. the caller had to wait
+ */
+should_inline bool spinlock_ticket_acquire(spinlock_t *lock)
+{
+    const u16 ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    u16 serving = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE);
+    if (likely(serving == ticket))
+        return false;
+
+    do
+    {
+        // proportional backoff, the waiters ahead of us will each hold the lock for a while
+        for (u16 ahead = ticket - serving; ahead; ahead--)
+            spinlock_cpu_relax();
+        serving = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE);
+    } while (serving != ticket);
+
+    return true;
+}
+
+should_inline void spinlock_ticket_release(spinlock_t *lock)
+{
+    // only the holder writes 'serving'
+    __atomic_store_n(&lock->serving, (u16) (lock->serving + 1), __ATOMIC_RELEASE);
+}
+
+#if MOS_SPINLOCK_LOCKSTAT
+void spinlock_stat_acquire(spinlock_t *lock, spinlock_site_t *site);
+void spinlock_stat_release(spinlock_t *lock);
+#define _spinlock_real_acquire(lock)                                                                                                                                     \
     do                                                                                                                                                                   \
     {                                                                                                                                                                    \
-        __atomic_clear(&(lock)->flag, __ATOMIC_RELEASE);                                                                                                                 \
+        static spinlock_site_t __spinlock_site = { .file = __FILE__, .line = __LINE__ };                                                                                 \
+        spinlock_stat_acquire(lock, &__spinlock_site);                                                                                                                   \
     } while (0)
+#define _spinlock_real_release(lock) spinlock_stat_release(lock)
+#else
+#define _spinlock_real_acquire(lock) spinlock_ticket_acquire(lock)
+#define _spinlock_real_release(lock) spinlock_ticket_release(lock)
+#endif
 
 #if MOS_DEBUG_FEATURE(spinlock)
 #define spinlock_acquire(lock)                                                                                                                                           \
@@ -51,12 +131,58 @@ typedef struct
 #define spinlock_release(lock) _spinlock_real_release(lock)
 #endif
 
-#define spinlock_acquire_nodebug(lock) _spinlock_real_acquire(lock)
-#define spinlock_release_nodebug(lock) _spinlock_real_release(lock)
+#define spinlock_acquire_nodebug(lock) spinlock_ticket_acquire(lock)
+#define spinlock_release_nodebug(lock) spinlock_ticket_release(lock)
+
+#ifdef __MOS_KERNEL__
+bool platform_interrupt_disable_save(void);
+void platform_interrupt_restore(bool enabled);
+
+/**
+ * @brief Disable interrupts on this CPU and acquire the lock, for locks that are also taken by interrupt handlers.
+ *
+ * @param flags A bool that receives whether interrupts were enabled, to be passed to spinlock_release_irqrestore.
+ */
+#define spinlock_acquire_irqsave(lock, flags)                                                                                                                            \
+    do                                                                                                                                                                   \
+    {                                                                                                                                                                    \
+        (flags) = platform_interrupt_disable_save();                                                                                                                     \
+        spinlock_acquire(lock);                                                                                                                                          \
+    } while (0)
+#define spinlock_release_irqrestore(lock, flags)                                                                                                                         \
+    do                                                                                                                                                                   \
+    {                                                                                                                                                                    \
+        spinlock_release(lock);                                                                                                                                          \
+        platform_interrupt_restore(flags);                                                                                                                               \
+    } while (0)
+#endif
+
+/**
+ * @brief Acquire the lock if it is free, without spinning.
+ *
+ * @return true if the lock has been acquired
+ */
+should_inline bool spinlock_try_acquire(spinlock_t *lock)
+{
+    spinlock_t snapshot;
+    snapshot.value = __atomic_load_n(&lock->value, __ATOMIC_RELAXED);
+    if (snapshot.serving != snapshot.next)
+        return false; // someone holds it, or is waiting for it
+
+    u32 expected = snapshot.value;
+    snapshot.next++; // take the ticket being served
+    if (!__atomic_compare_exchange_n(&lock->value, &expected, snapshot.value, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return false;
+
+#if MOS_SPINLOCK_LOCKSTAT
+    lock->site = NULL; // not accounted
+#endif
+    return true;
+}
 
 should_inline bool spinlock_is_locked(const spinlock_t *lock)
 {
-    return lock->flag;
+    return __atomic_load_n(&lock->serving, __ATOMIC_RELAXED) != __atomic_load_n(&lock->next, __ATOMIC_RELAXED);
 }
 
 typedef struct
@@ -99,5 +225,5 @@ should_inline void recursive_spinlock_release(recursive_spinlock_t *lock, void *
 
 should_inline bool recursive_spinlock_is_locked(recursive_spinlock_t *lock)
 {
-    return lock->lock.flag;
+    return spinlock_is_locked(&lock->lock);
 }
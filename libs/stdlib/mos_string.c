@@ -5,20 +5,120 @@
 #include <mos/moslib_global.h>
 #include <mos_stdlib.h>
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#if defined(__SSE2__) && !defined(__MOS_KERNEL__)
+#include <immintrin.h>
+#define MOS_STRING_SIMD 1 // the kernel never touches the vector registers, they belong to userspace
+#endif
+#endif
+
+#ifndef MOS_STRING_SIMD
+#define MOS_STRING_SIMD 0
+#endif
+
+// keep GCC from turning the copy loops below into calls to themselves
+#if defined(__GNUC__) && !defined(__clang__)
+#define __string_impl __attribute__((optimize("no-tree-loop-distribute-patterns")))
+#else
+#define __string_impl
+#endif
+
+typedef u64 __attribute__((may_alias, aligned(1))) unaligned_u64;
+typedef u32 __attribute__((may_alias, aligned(1))) unaligned_u32;
+typedef u16 __attribute__((may_alias, aligned(1))) unaligned_u16;
+typedef u64 __attribute__((may_alias)) aliased_u64; // aligned word loads over char data
+
+#define WORD_ONES  0x0101010101010101ULL
+#define WORD_HIGHS 0x8080808080808080ULL
+
+// non-zero if any byte of 'v' is zero, and the lowest set bit marks the first one
+#define word_has_zero(v) (((v) - WORD_ONES) & ~(v) & WORD_HIGHS)
+
+// below this size, a loop beats the startup cost of 'rep movsb' on CPUs without FSRM
+#define REP_MOVSB_THRESHOLD 2048
+
+enum
+{
+    STRING_FEATURES_DETECTED = BIT(0),
+    STRING_FEATURE_ERMS = BIT(1), ///< Enhanced REP MOVSB/STOSB
+    STRING_FEATURE_FSRM = BIT(2), ///< Fast Short REP MOVSB
+    STRING_FEATURE_AVX2 = BIT(3), ///< AVX2, and the OS saves the YMM registers
+};
+
+static u32 string_features;
+
+static u32 string_detect_features(void)
+{
+    u32 features = STRING_FEATURES_DETECTED;
+#if defined(__x86_64__)
+    u32 a, b, c, d;
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d))
+    {
+        if (b & BIT(9))
+            features |= STRING_FEATURE_ERMS;
+        if (d & BIT(4))
+            features |= STRING_FEATURE_FSRM;
+#if MOS_STRING_SIMD
+        const bool avx2 = b & BIT(5);
+        if (avx2 && __get_cpuid(1, &a, &b, &c, &d) && (c & BIT(27))) // OSXSAVE
+        {
+            u32 xcr0_lo, xcr0_hi;
+            __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+            if ((xcr0_lo & 0x6) == 0x6) // SSE and AVX state
+                features |= STRING_FEATURE_AVX2;
+        }
+#endif
+    }
+#endif
+    __atomic_store_n(&string_features, features, __ATOMIC_RELAXED);
+    return features;
+}
+
+// CPUID is slow (and traps under a hypervisor), so it's only executed on first use
+should_inline u32 string_get_features(void)
+{
+    const u32 features = __atomic_load_n(&string_features, __ATOMIC_RELAXED);
+    return likely(features) ? features : string_detect_features();
+}
+
 size_t strlen(const char *str)
 {
-    size_t len = 0;
-    while (str[len])
-        len++;
-    return len;
+    const char *s = str;
+    for (; (ptr_t) s % sizeof(u64); s++)
+        if (!*s)
+            return s - str;
+
+    // aligned words never cross a page boundary, so this never reads from an unmapped page
+    const aliased_u64 *w = (const aliased_u64 *) s;
+    u64 zero;
+    while (!(zero = word_has_zero(*w)))
+        w++;
+
+    return (const char *) w + __builtin_ctzll(zero) / 8 - str;
 }
 
 s32 strcmp(const char *s1, const char *s2)
 {
-    size_t i = 0;
-    while (s1[i] && s2[i] && s1[i] == s2[i])
-        i++;
-    return s1[i] - s2[i];
+    const u8 *p1 = (const u8 *) s1, *p2 = (const u8 *) s2;
+
+    // compare a word at a time when both strings can be aligned at once
+    if ((ptr_t) p1 % sizeof(u64) == (ptr_t) p2 % sizeof(u64))
+    {
+        for (; (ptr_t) p1 % sizeof(u64); p1++, p2++)
+            if (!*p1 || *p1 != *p2)
+                return *p1 - *p2;
+
+        const aliased_u64 *w1 = (const aliased_u64 *) p1, *w2 = (const aliased_u64 *) p2;
+        while (*w1 == *w2 && !word_has_zero(*w1))
+            w1++, w2++;
+
+        p1 = (const u8 *) w1, p2 = (const u8 *) w2; // the difference or the terminator is in this word
+    }
+
+    while (*p1 && *p1 == *p2)
+        p1++, p2++;
+    return *p1 - *p2;
 }
 
 s32 strncmp(const char *str1, const char *str2, size_t n)
@@ -53,87 +153,159 @@ s32 strncasecmp(const char *a, const char *b, size_t n)
     return 0;
 }
 
-void *memcpy(void *__restrict _dst, const void *__restrict _src, size_t n)
+// copy up to 16 bytes, with loads done before stores so that it also works for overlapping areas
+should_inline void small_copy(u8 *dst, const u8 *src, size_t n)
 {
-    // https://github.com/eblot/newlib/blob/master/newlib/libc/string/memcpy.c
-
-#define UNALIGNED(X, Y) (((long) X & (sizeof(long) - 1)) | ((long) Y & (sizeof(long) - 1))) // Nonzero if either X or Y is not aligned on a "long" boundary.
-#define BIGBLOCKSIZE    (sizeof(long) << 2)                                                 // How many bytes are copied each iteration of the 4X unrolled loop.
-#define LITTLEBLOCKSIZE (sizeof(long))                                                      // How many bytes are copied each iteration of the word copy loop.
-#define TOO_SMALL(LEN)  ((LEN) < BIGBLOCKSIZE)                                              // Threshhold for punting to the byte copier.
+    if (n >= 8)
+    {
+        const u64 head = *(const unaligned_u64 *) src, tail = *(const unaligned_u64 *) (src + n - 8);
+        *(unaligned_u64 *) dst = head;
+        *(unaligned_u64 *) (dst + n - 8) = tail;
+    }
+    else if (n >= 4)
+    {
+        const u32 head = *(const unaligned_u32 *) src, tail = *(const unaligned_u32 *) (src + n - 4);
+        *(unaligned_u32 *) dst = head;
+        *(unaligned_u32 *) (dst + n - 4) = tail;
+    }
+    else if (n)
+    {
+        const u8 first = src[0], middle = src[n / 2], last = src[n - 1];
+        dst[0] = first, dst[n / 2] = middle, dst[n - 1] = last;
+    }
+}
 
-    char *dst = _dst;
-    const char *src = _src;
+#if MOS_STRING_SIMD
+__attribute__((target("avx2"))) static void avx2_copy(u8 *dst, const u8 *src, size_t n)
+{
+    const __m256i tail = _mm256_loadu_si256((const __m256i *) (src + n - 32));
+    for (size_t i = 0; i + 32 < n; i += 32)
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_loadu_si256((const __m256i *) (src + i)));
+    _mm256_storeu_si256((__m256i *) (dst + n - 32), tail);
+    _mm256_zeroupper();
+}
 
-    /* If the size is small, or either SRC or DST is unaligned,
-       then punt into the byte copy loop.  This should be rare.  */
-    if (!TOO_SMALL(n) && !UNALIGNED(src, dst))
-    {
-        long *aligned_dst = (long *) dst;
-        const long *aligned_src = (long *) src;
+static void sse2_copy(u8 *dst, const u8 *src, size_t n)
+{
+    const __m128i tail = _mm_loadu_si128((const __m128i *) (src + n - 16));
+    for (size_t i = 0; i + 16 < n; i += 16)
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_loadu_si128((const __m128i *) (src + i)));
+    _mm_storeu_si128((__m128i *) (dst + n - 16), tail);
+}
+#endif
 
-        /* Copy 4X long words at a time if possible.  */
-        while (n >= BIGBLOCKSIZE)
-        {
-            *aligned_dst++ = *aligned_src++;
-            *aligned_dst++ = *aligned_src++;
-            *aligned_dst++ = *aligned_src++;
-            *aligned_dst++ = *aligned_src++;
-            n -= BIGBLOCKSIZE;
-        }
+__string_impl void *memcpy(void *__restrict _dst, const void *__restrict _src, size_t n)
+{
+    u8 *dst = _dst;
+    const u8 *src = _src;
 
-        /* Copy one long word at a time if possible.  */
-        while (n >= LITTLEBLOCKSIZE)
-        {
-            *aligned_dst++ = *aligned_src++;
-            n -= LITTLEBLOCKSIZE;
-        }
+    if (n <= 16)
+    {
+        small_copy(dst, src, n);
+        return _dst;
+    }
 
-        /* Pick up any residual with a byte copier.  */
-        dst = (char *) aligned_dst;
-        src = (char *) aligned_src;
+#if defined(__x86_64__)
+    const u32 features = string_get_features();
+    if ((features & STRING_FEATURE_FSRM) || ((features & STRING_FEATURE_ERMS) && n >= REP_MOVSB_THRESHOLD))
+    {
+        __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+        return _dst;
     }
+#endif
 
-    while (n--)
-        *dst++ = *src++;
+#if MOS_STRING_SIMD
+    if (n >= 256 && (features & STRING_FEATURE_AVX2))
+        avx2_copy(dst, src, n);
+    else
+        sse2_copy(dst, src, n);
+#else
+    const u64 tail = *(const unaligned_u64 *) (src + n - 8);
+    for (size_t i = 0; i + 8 < n; i += 8)
+        *(unaligned_u64 *) (dst + i) = *(const unaligned_u64 *) (src + i);
+    *(unaligned_u64 *) (dst + n - 8) = tail;
+#endif
 
     return _dst;
 }
 
-void *memmove(void *dest, const void *source, size_t length)
+__string_impl void *memmove(void *dest, const void *source, size_t length)
 {
-    // https://github.com/eblot/newlib/blob/master/newlib/libc/string/memmove.c
-    char *dst = dest;
-    const char *src = source;
+    u8 *dst = dest;
+    const u8 *src = source;
 
-    if (src < dst && dst < src + length)
+    if (length <= 16)
     {
-        /* Have to copy backwards */
-        src += length;
-        dst += length;
-        while (length--)
-            *--dst = *--src;
+        small_copy(dst, src, length);
+        return dest;
     }
-    else
+
+    // a forward copy is fine unless the destination starts inside the source
+    if (dst <= src || dst >= src + length)
     {
+        if ((ptr_t) src - (ptr_t) dst >= length)
+            return memcpy(dest, source, length);
+
+        // overlapping, with the destination below: copy forward a word at a time
+        while (length >= 8)
+        {
+            *(unaligned_u64 *) dst = *(const unaligned_u64 *) src;
+            dst += 8, src += 8, length -= 8;
+        }
         while (length--)
             *dst++ = *src++;
+        return dest;
     }
 
+    // copy backwards, a word at a time
+    dst += length, src += length;
+    while (length >= 8)
+    {
+        dst -= 8, src -= 8, length -= 8;
+        *(unaligned_u64 *) dst = *(const unaligned_u64 *) src;
+    }
+    while (length--)
+        *--dst = *--src;
+
     return dest;
 }
 
-void *memset(void *s, int c, size_t n)
+__string_impl void *memset(void *s, int c, size_t n)
 {
     u8 *d = s;
-    for (size_t i = 0; i < n; i++)
-        d[i] = c;
+    const u64 pattern = (u8) c * WORD_ONES;
+
+    if (n < 8)
+    {
+        for (size_t i = 0; i < n; i++)
+            d[i] = c;
+        return s;
+    }
+
+#if defined(__x86_64__)
+    if ((string_get_features() & STRING_FEATURE_ERMS) && n >= REP_MOVSB_THRESHOLD)
+    {
+        __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+        return s;
+    }
+#endif
+
+    for (size_t i = 0; i + 8 < n; i += 8)
+        *(unaligned_u64 *) (d + i) = pattern;
+    *(unaligned_u64 *) (d + n - 8) = pattern;
     return s;
 }
 
 int memcmp(const void *s1, const void *s2, size_t n)
 {
     const u8 *p1 = s1, *p2 = s2;
+    for (; n >= 8; p1 += 8, p2 += 8, n -= 8)
+    {
+        const u64 a = *(const unaligned_u64 *) p1, b = *(const unaligned_u64 *) p2;
+        if (a != b)
+            return __builtin_bswap64(a) < __builtin_bswap64(b) ? -1 : 1; // the first differing byte decides
+    }
+
     for (size_t i = 0; i < n; i++)
     {
         if (p1[i] != p2[i])
@@ -144,22 +316,7 @@ int memcmp(const void *s1, const void *s2, size_t n)
 
 void memzero(void *s, size_t n)
 {
-    typedef u64 largeint_t;
-    largeint_t *lsrc = (largeint_t *) s;
-
-    while (n >= sizeof(largeint_t))
-    {
-        *lsrc++ = 0;
-        n -= sizeof(largeint_t);
-    }
-
-    char *csrc = (char *) lsrc;
-
-    while (n > 0)
-    {
-        *csrc++ = 0;
-        n--;
-    }
+    memset(s, 0, n);
 }
 
 char *strcpy(char *__restrict dest, const char *__restrict src)
@@ -74,6 +74,7 @@ def select_format(type: str) -> str:
         "ptr_t": "\" PTR_FMT \"",
         "file_type_t": "%d",
         "mem_perm_t": "%d",
+        "mem_advice_t": "%d",
         "mmap_flags_t": "%d",
         "io_seek_whence_t": "%d",
         "signal_t": "%d",
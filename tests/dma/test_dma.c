@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <errno.h>
+#include <mos/mm/dma.h>
+#include <mos/mm/mm.h>
+#include <mos/mm/physical/pmm.h>
+
+#define TEST_DMA_NPAGES 4
+
+// frames with one reference, standing in for the mapping of the buffer that is being pinned
+static pfn_t test_dma_get_frames(void)
+{
+    phyframe_t *frames = mm_get_free_pages(TEST_DMA_NPAGES);
+    pmm_ref(frames, TEST_DMA_NPAGES);
+    return phyframe_pfn(frames);
+}
+
+static size_t test_dma_refcount(pfn_t pfn)
+{
+    return pfn_phyframe(pfn)->allocated_refcount;
+}
+
+MOS_TEST_CASE(dma_pin_merges_contiguous_pages)
+{
+    const pfn_t base = test_dma_get_frames();
+
+    // two contiguous pages, a gap, then one page; the buffer starts and ends in the middle of a page
+    const pfn_t pfns[] = { base, base + 1, base + 3 };
+    const ptr_t buf = 0x1000000 + 0x100;
+    const size_t size = 3 * MOS_PAGE_SIZE - 0x200;
+
+    dma_sg_entry_t entries[3];
+    size_t n_entries = MOS_ARRAY_SIZE(entries);
+    io_t *pin = dmabuf_pin_frames(pfns, buf, size, entries, &n_entries);
+    MOS_TEST_ASSERT(!IS_ERR(pin), "pinning failed: %ld", PTR_ERR(pin));
+
+    MOS_TEST_CHECK(n_entries, 2);
+    MOS_TEST_CHECK(entries[0].paddr, base * MOS_PAGE_SIZE + 0x100);
+    MOS_TEST_CHECK(entries[0].size, 2 * MOS_PAGE_SIZE - 0x100);
+    MOS_TEST_CHECK(entries[1].paddr, (base + 3) * MOS_PAGE_SIZE);
+    MOS_TEST_CHECK(entries[1].size, MOS_PAGE_SIZE - 0x100);
+
+    io_unref(io_ref(pin));
+    pmm_unref(base, TEST_DMA_NPAGES);
+}
+
+MOS_TEST_CASE(dma_pin_reports_the_entries_it_needs)
+{
+    const pfn_t base = test_dma_get_frames();
+
+    // no two pages are contiguous
+    const pfn_t pfns[] = { base + 2, base, base + 3 };
+    dma_sg_entry_t entries[2];
+    size_t n_entries = MOS_ARRAY_SIZE(entries);
+    io_t *pin = dmabuf_pin_frames(pfns, 0x1000000, 3 * MOS_PAGE_SIZE, entries, &n_entries);
+
+    MOS_TEST_CHECK(PTR_ERR(pin), -ENOSPC);
+    MOS_TEST_CHECK(n_entries, 3);
+    for (size_t i = 0; i < TEST_DMA_NPAGES; i++)
+        MOS_TEST_CHECK(test_dma_refcount(base + i), 1); // a failed pinning leaves nothing pinned
+
+    pmm_unref(base, TEST_DMA_NPAGES);
+}
+
+MOS_TEST_CASE(dma_pin_is_released_on_close)
+{
+    const pfn_t base = test_dma_get_frames();
+    const pfn_t pfns[] = { base, base + 1 };
+
+    dma_sg_entry_t entry;
+    size_t n_entries = 1;
+    io_t *pin = dmabuf_pin_frames(pfns, 0x1000000, 2 * MOS_PAGE_SIZE, &entry, &n_entries);
+    MOS_TEST_ASSERT(!IS_ERR(pin), "pinning failed: %ld", PTR_ERR(pin));
+    MOS_TEST_CHECK(test_dma_refcount(base), 2);
+    MOS_TEST_CHECK(test_dma_refcount(base + 1), 2);
+    MOS_TEST_CHECK(test_dma_refcount(base + 2), 1);
+
+    // the pin is held by one fd, closing it drops the last reference
+    io_unref(io_ref(pin));
+    MOS_TEST_CHECK(test_dma_refcount(base), 1);
+    MOS_TEST_CHECK(test_dma_refcount(base + 1), 1);
+
+    pmm_unref(base, TEST_DMA_NPAGES);
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/interrupt/irq_io.h>
+#include <mos/io/io.h>
+#include <mos/platform/platform.h>
+
+MOS_TEST_CASE(irq_msi_open_and_close)
+{
+    msi_message_t first, second;
+    io_t *a = irq_io_msi_open(0, &first);
+    MOS_TEST_ASSERT(!IS_ERR(a), "failed to allocate an MSI");
+    io_t *b = irq_io_msi_open(IRQ_CPU_ANY, &second);
+    MOS_TEST_ASSERT(!IS_ERR(b), "failed to allocate a second MSI");
+    MOS_TEST_CHECK(a->type, IO_IRQ);
+    MOS_TEST_ASSERT(first.data != second.data, "two MSIs got the same message");
+
+    // the vector of a closed MSI is handed out again
+    const u32 freed_data = first.data;
+    io_unref(a);
+    a = irq_io_msi_open(0, &first);
+    MOS_TEST_ASSERT(!IS_ERR(a), "failed to allocate an MSI after freeing one");
+    MOS_TEST_CHECK(first.data, freed_data);
+
+    // acknowledging an MSI is a no-op
+    const u64 ack = 0;
+    MOS_TEST_CHECK(io_write(a, &ack, sizeof(ack)), sizeof(ack));
+
+    io_unref(a);
+    io_unref(b);
+}
+
+MOS_TEST_CASE(irq_msi_set_affinity)
+{
+    msi_message_t message, moved;
+    io_t *io = irq_io_msi_open(0, &message);
+    MOS_TEST_ASSERT(!IS_ERR(io), "failed to allocate an MSI");
+
+    const u32 cpu = platform_info->num_cpus - 1;
+    MOS_TEST_CHECK(irq_io_set_affinity(io, cpu, &moved), 0);
+    MOS_TEST_CHECK(moved.data, message.data); // only the destination changes
+    MOS_TEST_CHECK(irq_io_set_affinity(io, platform_info->num_cpus, &moved), -EINVAL);
+    MOS_TEST_CHECK(irq_io_set_affinity(io, cpu, NULL), -EFAULT);
+    io_unref(io);
+}
+
+MOS_TEST_CASE(irq_invalid_lines_are_refused)
+{
+    // not a line that exists on any platform
+    io_t *io = irq_io_open(1000, IRQ_CPU_ANY);
+    MOS_TEST_CHECK(IS_ERR(io), true);
+    MOS_TEST_CHECK(PTR_ERR(io), -EBUSY);
+
+    io = irq_io_open(0, platform_info->num_cpus);
+    MOS_TEST_CHECK(PTR_ERR(io), -EINVAL);
+}
@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "mos/mm/mm.h"
+#include "mos/platform/platform.h"
 #include "test_engine_impl.h"
 
 #include <mos_stdlib.h>
@@ -73,3 +75,192 @@ MOS_TEST_CASE(test_memmove_overlapped_backwards)
         MOS_TEST_CHECK(src[i], i);
     kfree(src);
 }
+
+MOS_TEST_CASE(test_memops_all_sizes_and_alignments)
+{
+    u8 *src = kmalloc(512);
+    u8 *dst = kmalloc(512);
+    u8 *ref = kmalloc(512);
+
+    for (size_t i = 0; i < 512; i++)
+        src[i] = i * 7 + 3;
+
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        for (size_t n = 0; n < 300; n++)
+        {
+            memset(dst, 0xAA, 512);
+            memcpy(dst + offset, src + 8 - offset, n);
+            for (size_t i = 0; i < 512; i++)
+            {
+                const u8 expected = i >= offset && i < offset + n ? src[8 - offset + (i - offset)] : 0xAA;
+                if (dst[i] != expected)
+                {
+                    MOS_TEST_CHECK(dst[i], expected);
+                    break;
+                }
+            }
+
+            MOS_TEST_CHECK(memcmp(dst + offset, src + 8 - offset, n), 0);
+
+            // memmove within the same buffer, both directions
+            memcpy(ref, src, 512);
+            memmove(ref + offset + 3, ref + 3, n);
+            MOS_TEST_CHECK(memcmp(ref + offset + 3, src + 3, n), 0);
+            memcpy(ref, src, 512);
+            memmove(ref + 3, ref + offset + 3, n);
+            MOS_TEST_CHECK(memcmp(ref + 3, src + offset + 3, n), 0);
+
+            memset(dst + offset, 0x5C, n);
+            for (size_t i = 0; i < n; i++)
+            {
+                if (dst[offset + i] != 0x5C)
+                {
+                    MOS_TEST_CHECK(dst[offset + i], 0x5C);
+                    break;
+                }
+            }
+            if (n)
+                MOS_TEST_CHECK(dst[offset + n], 0xAA); // not a byte past the end
+        }
+    }
+
+    kfree(src);
+    kfree(dst);
+    kfree(ref);
+}
+
+MOS_TEST_CASE(test_memcmp_ordering)
+{
+    u8 a[40], b[40];
+    for (size_t i = 0; i < 40; i++)
+        a[i] = b[i] = i;
+
+    // the first differing byte decides, no matter where it is in a word
+    for (size_t i = 0; i < 40; i++)
+    {
+        b[i] = 0xFF;
+        if (i + 1 < 40)
+            a[i + 1] = 0xFF;
+        MOS_TEST_CHECK(memcmp(a, b, 40) < 0, true);
+        MOS_TEST_CHECK(memcmp(b, a, 40) > 0, true);
+        MOS_TEST_CHECK(memcmp(a, b, i), 0);
+        b[i] = i;
+        if (i + 1 < 40)
+            a[i + 1] = i + 1;
+    }
+}
+
+MOS_TEST_CASE(test_strlen_strcmp_word_at_a_time)
+{
+    char *buf = kmalloc(128);
+    char *other = kmalloc(128);
+    for (size_t start = 0; start < 8; start++)
+    {
+        for (size_t len = 0; len < 40; len++)
+        {
+            for (size_t i = 0; i < len; i++)
+                buf[start + i] = 'a' + (i % 26);
+            buf[start + len] = '\0';
+            MOS_TEST_CHECK(strlen(buf + start), len);
+
+            for (size_t ostart = 0; ostart < 8; ostart += 3)
+            {
+                memcpy(other + ostart, buf + start, len + 1);
+                MOS_TEST_CHECK(strcmp(buf + start, other + ostart), 0);
+                if (len)
+                {
+                    other[ostart + len - 1] = '\xF0'; // compared as unsigned char
+                    MOS_TEST_CHECK(strcmp(buf + start, other + ostart) < 0, true);
+                    other[ostart + len - 1] = '\0';
+                    MOS_TEST_CHECK(strcmp(buf + start, other + ostart) > 0, true);
+                }
+            }
+        }
+    }
+    kfree(buf);
+    kfree(other);
+}
+
+#define MEMOPS_BENCH_BYTES (4 MB) // per size class
+
+static const size_t memops_bench_sizes[] = { 16, 64, 256, 1 KB, 4 KB, 64 KB };
+
+MOS_TEST_CASE(test_memops_benchmark)
+{
+    u8 *src = kmalloc(64 KB + 64);
+    u8 *dst = kmalloc(64 KB + 64);
+    memset(src, 'x', 64 KB + 64);
+    src[64 KB] = '\0';
+
+    for (size_t i = 0; i < MOS_ARRAY_SIZE(memops_bench_sizes); i++)
+    {
+        const size_t size = memops_bench_sizes[i];
+        const size_t iterations = MEMOPS_BENCH_BYTES / size;
+        volatile int sink = 0;
+
+        u64 start = platform_get_timestamp();
+        for (size_t j = 0; j < iterations; j++)
+            memcpy(dst, src, size);
+        const u64 memcpy_cycles = platform_get_timestamp() - start;
+
+        start = platform_get_timestamp();
+        for (size_t j = 0; j < iterations; j++)
+            memmove(dst + 8, dst, size);
+        const u64 memmove_cycles = platform_get_timestamp() - start;
+
+        start = platform_get_timestamp();
+        for (size_t j = 0; j < iterations; j++)
+            memset(dst, j, size);
+        const u64 memset_cycles = platform_get_timestamp() - start;
+
+        memcpy(dst, src, size);
+        start = platform_get_timestamp();
+        for (size_t j = 0; j < iterations; j++)
+            sink += memcmp(dst, src, size);
+        const u64 memcmp_cycles = platform_get_timestamp() - start;
+
+        src[size - 1] = '\0';
+        start = platform_get_timestamp();
+        for (size_t j = 0; j < iterations; j++)
+            sink += strlen((const char *) src);
+        const u64 strlen_cycles = platform_get_timestamp() - start;
+        src[size - 1] = 'x';
+
+        MOS_TEST_CHECK(memcmp(dst, src, size), 0);
+        MOS_UNUSED(sink);
+
+        // bytes per 100 cycles, so that small sizes are still readable
+#define per_100_cycles(cycles) (MEMOPS_BENCH_BYTES * 100 / MAX((cycles), 1ULL))
+        pr_info2("%6zu bytes: memcpy %5llu, memmove %5llu, memset %5llu, memcmp %5llu, strlen %5llu bytes per 100 cycles", size, per_100_cycles(memcpy_cycles),
+                 per_100_cycles(memmove_cycles), per_100_cycles(memset_cycles), per_100_cycles(memcmp_cycles), per_100_cycles(strlen_cycles));
+#undef per_100_cycles
+    }
+
+    kfree(src);
+    kfree(dst);
+}
+
+MOS_TEST_CASE(test_page_zero_and_copy)
+{
+    phyframe_t *a = mm_get_free_page();
+    phyframe_t *b = mm_get_free_page();
+    u8 *pa = (u8 *) phyframe_va(a), *pb = (u8 *) phyframe_va(b);
+
+    for (size_t i = 0; i < MOS_PAGE_SIZE; i++)
+        MOS_TEST_CHECK(pa[i], 0);
+
+    for (size_t i = 0; i < MOS_PAGE_SIZE; i++)
+        pa[i] = i ^ 0x5A;
+    platform_page_copy((ptr_t) pb, (ptr_t) pa);
+    MOS_TEST_CHECK(memcmp(pa, pb, MOS_PAGE_SIZE), 0);
+
+    const u64 start = platform_get_timestamp();
+    for (int i = 0; i < 1000; i++)
+        platform_page_zero((ptr_t) pb);
+    pr_info2("page zero: %llu cycles per page", (platform_get_timestamp() - start) / 1000);
+    MOS_TEST_CHECK(pb[MOS_PAGE_SIZE - 1], 0);
+
+    mm_free_page(a);
+    mm_free_page(b);
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/mm/mm.h>
+#include <mos/mm/paging/paging.h>
+#include <mos/mm/paging/table_ops.h>
+#include <mos/mm/physical/pmm.h>
+
+#define TEST_PAGING_VADDR 0x40000000 // aligned to a full pml1 table
+
+MOS_TEST_CASE(paging_unmap_shared_table_flushes_tlb)
+{
+    mm_context_t *owner = mm_create_context();
+    mm_context_t *sharer = mm_create_context();
+
+    phyframe_t *frames = mm_get_free_pages(PML2E_NPAGES);
+    const pfn_t pfn = phyframe_pfn(frames);
+    *(u8 *) phyframe_va(frames) = 0xaa;
+    mm_do_map(owner->pgd, TEST_PAGING_VADDR, pfn, PML2E_NPAGES, VM_RW, true);
+    mm_do_share(owner->pgd, sharer->pgd, TEST_PAGING_VADDR, PML2E_NPAGES);
+    MOS_TEST_CHECK(mm_do_get_pfn(sharer->pgd, TEST_PAGING_VADDR), pfn);
+
+    // bring the shared translation into the TLB of this CPU
+    mm_context_t *prev = mm_switch_context(sharer);
+    MOS_TEST_CHECK(*(volatile u8 *) TEST_PAGING_VADDR, 0xaa);
+
+    // the range covers the whole table, so it is released rather than unshared
+    mm_do_unmap(sharer->pgd, TEST_PAGING_VADDR, PML2E_NPAGES, true);
+    MOS_TEST_CHECK(mm_do_get_pfn(sharer->pgd, TEST_PAGING_VADDR), 0);
+    MOS_TEST_CHECK(mm_do_get_pfn(owner->pgd, TEST_PAGING_VADDR), pfn);
+    MOS_TEST_CHECK(frames->allocated_refcount, 1);
+
+    // a stale TLB entry would still read the old page
+    phyframe_t *other = mm_get_free_page();
+    *(u8 *) phyframe_va(other) = 0x55;
+    mm_do_map(sharer->pgd, TEST_PAGING_VADDR, phyframe_pfn(other), 1, VM_RW, true);
+    MOS_TEST_CHECK(*(volatile u8 *) TEST_PAGING_VADDR, 0x55);
+
+    MOS_UNUSED(mm_switch_context(prev));
+
+    mm_do_unmap(sharer->pgd, TEST_PAGING_VADDR, 1, true);
+    mm_do_unmap(owner->pgd, TEST_PAGING_VADDR, PML2E_NPAGES, true);
+    mm_destroy_context(sharer);
+    mm_destroy_context(owner);
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/platform/platform.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#define PERCPU_BENCH_ITERATIONS 100000
+
+static PER_CPU_DECLARE(u64, test_percpu_counter);
+
+MOS_TEST_CASE(percpu_cpu_id_is_stable)
+{
+    const u32 id = platform_current_cpu_id();
+    MOS_TEST_ASSERT(id < MOS_MAX_CPU_COUNT, "cpu id out of range");
+
+    for (int i = 0; i < 100; i++)
+        MOS_TEST_CHECK(platform_current_cpu_id(), id);
+}
+
+#if MOS_CONFIG(MOS_SMP)
+MOS_TEST_CASE(percpu_slots_do_not_share_cache_lines)
+{
+    MOS_TEST_CHECK(sizeof(test_percpu_counter.percpu_value[0]) % MOS_PLATFORM_CACHE_LINE_SIZE, 0);
+    MOS_TEST_CHECK(is_aligned(per_cpu(test_percpu_counter), MOS_PLATFORM_CACHE_LINE_SIZE), true);
+
+    for (size_t i = 1; i < MOS_MAX_CPU_COUNT; i++)
+    {
+        const ptr_t prev = (ptr_t) &test_percpu_counter.percpu_value[i - 1].value;
+        const ptr_t this = (ptr_t) &test_percpu_counter.percpu_value[i].value;
+        MOS_TEST_CHECK(this - prev >= MOS_PLATFORM_CACHE_LINE_SIZE, true);
+    }
+
+    *per_cpu(test_percpu_counter) = 0;
+    for (int i = 0; i < 10; i++)
+        (*per_cpu(test_percpu_counter))++;
+    MOS_TEST_CHECK(test_percpu_counter.percpu_value[platform_current_cpu_id()].value, 10);
+}
+#endif
+
+MOS_TEST_CASE(percpu_access_benchmark)
+{
+    // every per_cpu(), current_cpu and current_thread starts with a lookup of the CPU id
+    volatile u32 sink = 0;
+    u64 start = platform_get_timestamp();
+    for (int i = 0; i < PERCPU_BENCH_ITERATIONS; i++)
+        sink = platform_current_cpu_id();
+    const u64 percpu_cycles = platform_get_timestamp() - start;
+    MOS_TEST_CHECK(sink, platform_current_cpu_id());
+
+    pr_info2("per-CPU area lookup: %llu cycles per access", percpu_cycles / PERCPU_BENCH_ITERATIONS);
+
+#if defined(__x86_64__)
+    // how the CPU id used to be found, for comparison
+    start = platform_get_timestamp();
+    for (int i = 0; i < PERCPU_BENCH_ITERATIONS; i++)
+    {
+        u32 a, b, c, d;
+        __get_cpuid(1, &a, &b, &c, &d);
+        sink = b >> 24;
+    }
+    const u64 cpuid_cycles = platform_get_timestamp() - start;
+    MOS_TEST_CHECK(sink, platform_current_cpu_id());
+
+    pr_info2("CPUID lookup: %llu cycles per access", cpuid_cycles / PERCPU_BENCH_ITERATIONS);
+#endif
+}
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/locks/rcu.h>
+#include <mos/platform/platform.h>
+
+typedef struct
+{
+    as_linked_list;
+    int value;
+} test_rcu_item_t;
+
+MOS_TEST_CASE(rcu_list_append_and_remove)
+{
+    static list_head head = LIST_HEAD_INIT(head);
+    test_rcu_item_t items[3];
+    for (int i = 0; i < 3; i++)
+    {
+        linked_list_init(list_node(&items[i]));
+        items[i].value = i;
+        list_node_append_rcu(&head, list_node(&items[i]));
+    }
+
+    int expected = 0;
+    rcu_read_lock();
+    list_foreach_rcu(test_rcu_item_t, item, head)
+        MOS_TEST_CHECK(item->value, expected++);
+    rcu_read_unlock();
+    MOS_TEST_CHECK(expected, 3);
+
+    // a reader standing on a removed item can still move on
+    list_remove_rcu(&items[1]);
+    MOS_TEST_CHECK(list_node(&items[1])->next, list_node(&items[2]));
+
+    int sum = 0;
+    rcu_read_lock();
+    list_foreach_rcu(test_rcu_item_t, item, head)
+        sum += item->value;
+    rcu_read_unlock();
+    MOS_TEST_CHECK(sum, 0 + 2);
+
+    synchronize_rcu();
+    list_remove_rcu(&items[0]);
+    list_remove_rcu(&items[2]);
+    MOS_TEST_CHECK(list_is_empty(&head), true);
+}
+
+MOS_TEST_CASE(rcu_read_lock_nests)
+{
+    const bool was_enabled = platform_interrupt_disable_save();
+
+    rcu_read_lock();
+    rcu_read_lock();
+    rcu_read_unlock();
+    MOS_TEST_CHECK(platform_interrupt_disable_save(), false); // still in the outer section
+    rcu_read_unlock();
+    MOS_TEST_CHECK(platform_interrupt_disable_save(), false); // it was disabled before the section
+
+    synchronize_rcu(); // no one is reading
+    platform_interrupt_restore(was_enabled);
+}
+
+typedef struct
+{
+    rcu_head_t rcu;
+    size_t called;
+} test_rcu_object_t;
+
+static void test_rcu_object_callback(rcu_head_t *head)
+{
+    __atomic_fetch_add(&container_of(head, test_rcu_object_t, rcu)->called, 1, __ATOMIC_RELEASE);
+}
+
+MOS_TEST_CASE(rcu_callback_after_grace_period)
+{
+    test_rcu_object_t object = { 0 };
+    call_rcu(&object.rcu, test_rcu_object_callback);
+
+    // the first quiescent state starts the grace period, which no CPU is holding up, so it ends by the next one
+    // (unless another CPU's scheduler gets there first)
+    for (int i = 0; i < 100000 && !__atomic_load_n(&object.called, __ATOMIC_ACQUIRE); i++)
+        rcu_quiescent_state();
+
+    MOS_TEST_CHECK(__atomic_load_n(&object.called, __ATOMIC_ACQUIRE), 1);
+}
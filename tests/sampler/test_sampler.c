@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/kallsyms.h>
+#include <mos/misc/sampler.h>
+#include <mos/platform/platform.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+MOS_TEST_CASE(kallsyms_finds_the_enclosing_function)
+{
+    const kallsyms_t *ks = kallsyms_get_symbol((ptr_t) sampler_record + 1);
+    MOS_TEST_ASSERT(ks != NULL, "no symbol for an address in the kernel");
+    MOS_TEST_CHECK(ks->address, (ptr_t) sampler_record);
+    MOS_TEST_CHECK_STRING(ks->name, "sampler_record");
+    MOS_TEST_CHECK(kallsyms_get_symbol(0), NULL);
+}
+
+typedef struct
+{
+    const char *stack;
+    size_t count; // of the line with that stack, 0 if there isn't one
+} folded_search_t;
+
+static void find_folded_stack(const char *line, void *arg)
+{
+    folded_search_t *search = arg;
+    const char *frames = strchr(line, ';'); // after the process name
+    const size_t len = strlen(search->stack);
+    if (frames && strncmp(frames, search->stack, len) == 0 && frames[len] == ' ')
+        search->count = strntoll(frames + len + 1, NULL, 10, strlen(frames + len + 1));
+}
+
+MOS_TEST_CASE(sampler_folds_recorded_stacks)
+{
+    MOS_TEST_ASSERT(sampler_start(1), "failed to start the sampler");
+    MOS_TEST_ASSERT(!sampler_start(1), "started the sampler twice");
+    sampler_stop(); // its buffers are kept until the next run, and nothing else records into them now
+
+    // innermost first, the return addresses point after a call
+    const ptr_t ips[] = { (ptr_t) sampler_record + 1, (ptr_t) sampler_start + 1 };
+    const ptr_t other_ips[] = { (ptr_t) sampler_record + 1, (ptr_t) sampler_stop + 1 };
+    sampler_record(false, ips, MOS_ARRAY_SIZE(ips));
+    sampler_record(false, other_ips, MOS_ARRAY_SIZE(other_ips));
+    sampler_record(false, ips, MOS_ARRAY_SIZE(ips));
+
+    folded_search_t search = { .stack = ";sampler_start_[k];sampler_record_[k]" };
+    MOS_TEST_ASSERT(sampler_fold(find_folded_stack, &search), "failed to fold the samples");
+    MOS_TEST_CHECK(search.count, 2);
+
+    search = (folded_search_t){ .stack = ";sampler_stop_[k];sampler_record_[k]" };
+    MOS_TEST_ASSERT(sampler_fold(find_folded_stack, &search), "failed to fold the samples");
+    MOS_TEST_CHECK(search.count, 1);
+
+    MOS_TEST_CHECK(sampler_get_nsamples(platform_info->num_cpus), 0);
+}
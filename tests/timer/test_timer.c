@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/device/timer.h>
+#include <mos_stdlib.h>
+
+static u64 test_timer_now; // the tick being processed by the test
+
+typedef struct
+{
+    size_t fired;
+    u64 fired_at;
+} test_timer_record_t;
+
+static void test_timer_callback(ktimer_t *timer, void *arg)
+{
+    MOS_UNUSED(timer);
+    test_timer_record_t *record = arg;
+    record->fired++;
+    record->fired_at = test_timer_now;
+}
+
+static ktimer_wheel_t *test_timer_new_wheel(u64 now)
+{
+    ktimer_wheel_t *wheel = kmalloc(sizeof(ktimer_wheel_t));
+    ktimer_wheel_init(wheel, now);
+    return wheel;
+}
+
+MOS_TEST_CASE(timer_fires_exactly_at_deadline)
+{
+    // one timer in each level, and on both sides of each level boundary
+    static const u64 deadlines[] = { 0, 1, 63, 64, 65, 100, 4095, 4096, 4097, 10000, 262143, 262144, 300000 };
+    ktimer_t timers[MOS_ARRAY_SIZE(deadlines)];
+    test_timer_record_t records[MOS_ARRAY_SIZE(deadlines)] = { 0 };
+
+    ktimer_wheel_t *wheel = test_timer_new_wheel(0);
+    for (size_t i = 0; i < MOS_ARRAY_SIZE(deadlines); i++)
+    {
+        ktimer_init(&timers[i], test_timer_callback, &records[i]);
+        ktimer_wheel_add(wheel, &timers[i], deadlines[i]);
+    }
+
+    size_t total = 0;
+    for (test_timer_now = 0; test_timer_now <= 300000; test_timer_now++)
+        total += ktimer_wheel_advance(wheel, test_timer_now);
+
+    MOS_TEST_CHECK(total, MOS_ARRAY_SIZE(deadlines));
+    for (size_t i = 0; i < MOS_ARRAY_SIZE(deadlines); i++)
+    {
+        MOS_TEST_CHECK(records[i].fired, 1);
+        MOS_TEST_CHECK(records[i].fired_at, deadlines[i]);
+    }
+
+    kfree(wheel);
+}
+
+MOS_TEST_CASE(timer_cancel)
+{
+    ktimer_wheel_t *wheel = test_timer_new_wheel(1000);
+    test_timer_record_t record = { 0 };
+
+    ktimer_t timer;
+    ktimer_init(&timer, test_timer_callback, &record);
+    MOS_TEST_CHECK(ktimer_cancel(&timer), false); // never armed
+
+    ktimer_wheel_add(wheel, &timer, 5000);
+    test_timer_now = 4000;
+    ktimer_wheel_advance(wheel, test_timer_now);
+    MOS_TEST_CHECK(ktimer_cancel(&timer), true);
+
+    test_timer_now = 10000;
+    MOS_TEST_CHECK(ktimer_wheel_advance(wheel, test_timer_now), 0);
+    MOS_TEST_CHECK(record.fired, 0);
+
+    // cancelling a timer that has fired does nothing
+    ktimer_wheel_add(wheel, &timer, 10005);
+    test_timer_now = 10005;
+    MOS_TEST_CHECK(ktimer_wheel_advance(wheel, test_timer_now), 1);
+    MOS_TEST_CHECK(ktimer_cancel(&timer), false);
+    MOS_TEST_CHECK(record.fired, 1);
+
+    kfree(wheel);
+}
+
+MOS_TEST_CASE(timer_overdue_and_far_deadlines)
+{
+    ktimer_wheel_t *wheel = test_timer_new_wheel(500);
+    test_timer_record_t overdue_record = { 0 }, far_record = { 0 };
+
+    ktimer_t overdue, far;
+    ktimer_init(&overdue, test_timer_callback, &overdue_record);
+    ktimer_init(&far, test_timer_callback, &far_record);
+
+    // a deadline in the past fires on the next tick
+    ktimer_wheel_add(wheel, &overdue, 100);
+    test_timer_now = 500;
+    MOS_TEST_CHECK(ktimer_wheel_advance(wheel, test_timer_now), 1);
+    MOS_TEST_CHECK(overdue_record.fired, 1);
+
+    // a deadline beyond the range of the wheel is neither early nor lost
+    const u64 far_deadline = 501 + (1ULL << (KTIMER_WHEEL_BITS * KTIMER_WHEEL_LEVELS)) + 12345;
+    ktimer_wheel_add(wheel, &far, far_deadline);
+    test_timer_now = far_deadline - 1;
+    MOS_TEST_CHECK(ktimer_wheel_advance(wheel, test_timer_now), 0);
+    test_timer_now = far_deadline;
+    MOS_TEST_CHECK(ktimer_wheel_advance(wheel, test_timer_now), 1);
+    MOS_TEST_CHECK(far_record.fired_at, far_deadline);
+
+    kfree(wheel);
+}
+
+typedef struct
+{
+    ktimer_wheel_t *wheel;
+    size_t count;
+} test_timer_rearm_t;
+
+static void test_timer_rearm_callback(ktimer_t *timer, void *arg)
+{
+    test_timer_rearm_t *rearm = arg;
+    rearm->count++;
+    ktimer_wheel_add(rearm->wheel, timer, test_timer_now); // due immediately, but must wait for the next round
+}
+
+MOS_TEST_CASE(timer_rearm_from_callback)
+{
+    test_timer_rearm_t rearm = { .wheel = test_timer_new_wheel(0), .count = 0 };
+
+    ktimer_t timer;
+    ktimer_init(&timer, test_timer_rearm_callback, &rearm);
+    ktimer_wheel_add(rearm.wheel, &timer, 10);
+
+    for (test_timer_now = 10; test_timer_now < 13; test_timer_now++)
+        MOS_TEST_CHECK(ktimer_wheel_advance(rearm.wheel, test_timer_now), 1);
+
+    MOS_TEST_CHECK(rearm.count, 3);
+    MOS_TEST_CHECK(ktimer_cancel(&timer), true);
+    kfree(rearm.wheel);
+}
+
+typedef struct
+{
+    ktimer_wheel_t *wheel;
+    size_t count;
+    bool cancelled; // ktimer_cancel() returned true in the callback, which mustn't wait for itself
+} test_timer_self_cancel_t;
+
+static void test_timer_self_cancel_callback(ktimer_t *timer, void *arg)
+{
+    test_timer_self_cancel_t *self_cancel = arg;
+    self_cancel->count++;
+    ktimer_wheel_add(self_cancel->wheel, timer, test_timer_now + 1);
+    self_cancel->cancelled = ktimer_cancel(timer);
+}
+
+MOS_TEST_CASE(timer_cancel_from_callback)
+{
+    test_timer_self_cancel_t self_cancel = { .wheel = test_timer_new_wheel(0), .count = 0, .cancelled = false };
+
+    ktimer_t timer;
+    ktimer_init(&timer, test_timer_self_cancel_callback, &self_cancel);
+    ktimer_wheel_add(self_cancel.wheel, &timer, 10);
+
+    test_timer_now = 10;
+    MOS_TEST_CHECK(ktimer_wheel_advance(self_cancel.wheel, test_timer_now), 1);
+    MOS_TEST_CHECK(self_cancel.cancelled, true);
+    test_timer_now = 20;
+    MOS_TEST_CHECK(ktimer_wheel_advance(self_cancel.wheel, test_timer_now), 0);
+
+    MOS_TEST_CHECK(self_cancel.count, 1);
+    MOS_TEST_CHECK(ktimer_cancel(&timer), false);
+    kfree(self_cancel.wheel);
+}
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/misc/trace.h>
+#include <mos/platform/platform.h>
+#include <mos/tasks/task_types.h>
+
+MOS_TEST_CASE(trace_records_only_enabled_events)
+{
+    const u32 old_mask = trace_events_enabled;
+    trace_set_enabled(1u << TRACE_SLAB_ALLOC);
+
+    for (u32 cpu = 0; cpu < platform_info->num_cpus; cpu++)
+        MOS_TEST_ASSERT(trace_get_buffer(cpu) != NULL, "enabling an event didn't allocate the buffers");
+    MOS_TEST_CHECK(trace_get_buffer(platform_info->num_cpus), NULL);
+
+    // stay on this CPU while looking at its buffer
+    const bool irq_enabled = platform_interrupt_disable_save();
+    trace_buffer_header_t *header = trace_get_buffer(platform_current_cpu_id());
+    MOS_TEST_CHECK(header->magic, TRACE_BUFFER_MAGIC);
+    MOS_TEST_CHECK(header->record_size, sizeof(trace_record_t));
+
+    const u64 head = header->head;
+    trace_event(TRACE_SLAB_ALLOC, 0, 42, 0x1234);
+    trace_event(TRACE_PAGE_FAULT, 0, 1, 2); // not enabled
+    MOS_TEST_CHECK(header->head, head + 1);
+
+    const trace_record_t *records = (const trace_record_t *) ((ptr_t) header + MOS_PAGE_SIZE);
+    const trace_record_t *record = &records[head & (header->nrecords - 1)];
+    MOS_TEST_CHECK(record->event, TRACE_SLAB_ALLOC);
+    MOS_TEST_CHECK(record->args[0], 42);
+    MOS_TEST_CHECK(record->args[1], 0x1234);
+    MOS_TEST_CHECK(record->tid, current_thread ? (u32) current_thread->tid : 0);
+    platform_interrupt_restore(irq_enabled);
+
+    trace_set_enabled(old_mask);
+}
+
+MOS_TEST_CASE(trace_names_are_registered_once)
+{
+    static trace_name_t first = { .name = "test.first" };
+    static trace_name_t second = { .name = "test.second" };
+
+    const u16 id = trace_name_id(&first);
+    MOS_TEST_ASSERT(id != 0, "failed to register a name");
+    MOS_TEST_CHECK(trace_name_id(&first), id);
+    MOS_TEST_ASSERT(trace_name_id(&second) != id, "two names got the same id");
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "test_engine_impl.h"
+
+#include <mos/mm/cow.h>
+#include <mos/mm/mm.h>
+#include <mos/mm/mmap.h>
+#include <mos/mm/paging/table_ops.h>
+
+#define TEST_ADVISE_VADDR  0x40000000
+#define TEST_ADVISE_NPAGES 4
+
+#define test_page(i) ((volatile u8 *) (TEST_ADVISE_VADDR + (i) * MOS_PAGE_SIZE))
+
+// an address space with a private anonymous mapping, which the calling CPU switches to
+static mm_context_t *test_advise_setup(mm_context_t **prev)
+{
+    mm_context_t *mm = mm_create_context();
+    vmap_t *vmap = cow_allocate_zeroed_pages(mm, TEST_ADVISE_NPAGES, TEST_ADVISE_VADDR, VALLOC_EXACT, VM_USER_RW);
+    vmap_finalise_init(vmap, VMAP_MMAP, VMAP_TYPE_PRIVATE);
+    *prev = mm_switch_context(mm);
+
+    for (size_t i = 0; i < TEST_ADVISE_NPAGES; i++)
+        *test_page(i) = 0x10 + i;
+    return mm;
+}
+
+static void test_advise_teardown(mm_context_t *mm, mm_context_t *prev)
+{
+    MOS_UNUSED(mm_switch_context(prev));
+    spinlock_acquire(&mm->mm_lock);
+    vmap_destroy(vmap_obtain(mm, TEST_ADVISE_VADDR, NULL));
+    spinlock_release(&mm->mm_lock);
+    mm_destroy_context(mm);
+}
+
+MOS_TEST_CASE(vm_advise_dontneed_reads_zeroes)
+{
+    mm_context_t *prev;
+    mm_context_t *mm = test_advise_setup(&prev);
+
+    MOS_TEST_CHECK(vm_advise(mm, TEST_ADVISE_VADDR + MOS_PAGE_SIZE, 2 * MOS_PAGE_SIZE, MEM_ADVICE_DONTNEED), true);
+    MOS_TEST_CHECK(mm_do_get_pfn(mm->pgd, (ptr_t) test_page(1)), 0);
+    MOS_TEST_CHECK(*test_page(0), 0x10);
+    MOS_TEST_CHECK(*test_page(1), 0);
+    MOS_TEST_CHECK(*test_page(2), 0);
+    MOS_TEST_CHECK(*test_page(3), 0x13);
+
+    test_advise_teardown(mm, prev);
+}
+
+MOS_TEST_CASE(vm_advise_free_is_cancelled_by_a_write)
+{
+    mm_context_t *prev;
+    mm_context_t *mm = test_advise_setup(&prev);
+
+    // a clean page outside the advised range, as one that the kernel filled through the direct map
+    mm_do_clean(mm->pgd, (ptr_t) test_page(3), 1);
+
+    MOS_TEST_CHECK(vm_advise(mm, TEST_ADVISE_VADDR + MOS_PAGE_SIZE, 2 * MOS_PAGE_SIZE, MEM_ADVICE_FREE), true);
+    *test_page(2) = 0x22; // in use again
+
+    MOS_TEST_CHECK(mm_reclaim_lazyfree(), 1);
+    MOS_TEST_CHECK(mm_do_get_pfn(mm->pgd, (ptr_t) test_page(1)), 0);
+    MOS_TEST_CHECK(*test_page(0), 0x10);
+    MOS_TEST_CHECK(*test_page(1), 0);
+    MOS_TEST_CHECK(*test_page(2), 0x22);
+    MOS_TEST_CHECK(*test_page(3), 0x13);
+
+    test_advise_teardown(mm, prev);
+}
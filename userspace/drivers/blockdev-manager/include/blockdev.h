@@ -14,3 +14,7 @@
 #define BLOCKDEV_SERVER_RPC_X(ARGS, PB, arg)                                                                                                                             \
     PB(arg, 1, read_block, READ_BLOCK, mos_rpc_blockdev_read_request, mos_rpc_blockdev_read_response)                                                                    \
     PB(arg, 2, write_block, WRITE_BLOCK, mos_rpc_blockdev_write_request, mos_rpc_blockdev_write_response)
+
+// optional, implemented by drivers that keep several requests in flight
+#define BLOCKDEV_SERVER_STATS_RPC_X(ARGS, PB, arg)                                                                                                                       \
+    PB(arg, 3, get_stats, GET_STATS, mos_rpc_blockdev_stats_request, mos_rpc_blockdev_stats_response)
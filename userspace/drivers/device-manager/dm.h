@@ -7,6 +7,6 @@
 
 bool start_load_drivers(const config_t *config);
 void dm_run_server(rpc_server_t *server);
-bool try_start_driver(u16 vendor, u16 device, u32 location, u64 mmio_base);
+bool try_start_driver(u16 vendor, u16 device, u32 location, u64 mmio_base, s32 irq); // irq is -1 if the device has no interrupt line
 
 extern const config_t *dm_config;
@@ -8,11 +8,11 @@
 
 RPC_DECL_SERVER_PROTOTYPES(dm, DM_RPCS_X)
 
-static rpc_result_code_t dm_register_device(rpc_context_t *context, s32 vendor, s32 devid, s32 location, s64 mmio_base)
+static rpc_result_code_t dm_register_device(rpc_context_t *context, s32 vendor, s32 devid, s32 location, s64 mmio_base, s32 irq)
 {
     MOS_UNUSED(context);
     rpc_result_code_t result = RPC_RESULT_OK;
-    try_start_driver(vendor, devid, location, mmio_base);
+    try_start_driver(vendor, devid, location, mmio_base, irq);
     return result;
 }
 
@@ -4,10 +4,12 @@
 #include "dm/common.h"
 
 #include <libconfig/libconfig.h>
+#include <mos/syscall/usermode.h>
 #include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 bool start_load_drivers(const config_t *config)
 {
@@ -29,7 +31,7 @@ bool start_load_drivers(const config_t *config)
     return true;
 }
 
-bool try_start_driver(u16 vendor, u16 device, u32 location, u64 mmio_base)
+bool try_start_driver(u16 vendor, u16 device, u32 location, u64 mmio_base, s32 irq)
 {
     char vendor_str[5];
     char vendor_device_str[10];
@@ -66,16 +68,24 @@ bool try_start_driver(u16 vendor, u16 device, u32 location, u64 mmio_base)
     char device_str[16];
     char location_str[16];
     char mmio_base_str[16];
+    char irq_fd_str[16];
     snprintf(device_str, sizeof(device_str), "%04x", device);
     snprintf(location_str, sizeof(location_str), "%04x", location);
     snprintf(mmio_base_str, sizeof(mmio_base_str), "%llx", mmio_base);
 
+    // the driver inherits the IRQ object, and waits on it instead of polling the device
+    const fd_t irq_fd = irq >= 0 ? syscall_irq_open(irq, IRQ_CPU_ANY) : -1;
+    if (irq >= 0 && irq_fd < 0)
+        fprintf(stderr, "Failed to open IRQ %d for %s, the driver has to poll\n", irq, driver_path);
+    snprintf(irq_fd_str, sizeof(irq_fd_str), "%d", irq_fd);
+
     const char *argv[] = {
         driver_path,                  //
         "--vendor-id", vendor_str,    //
         "--device-id", device_str,    //
         "--location",  location_str,  //
         "--mmio-base", mmio_base_str, //
+        irq_fd >= 0 ? "--irq-fd" : NULL, irq_fd_str, // argv ends early if there's no IRQ object
         NULL,
     };
     printf("Starting driver: ");
@@ -86,6 +96,8 @@ bool try_start_driver(u16 vendor, u16 device, u32 location, u64 mmio_base)
     pid_t driver_pid;
     posix_spawn(&driver_pid, driver_path, NULL, NULL, (char *const *) argv, NULL);
 
+    if (irq_fd >= 0)
+        close(irq_fd);
     free(dup);
 
     return driver_pid > 0;
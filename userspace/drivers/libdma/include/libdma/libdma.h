@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/mm/mm_types.h>
+#include <mos/mos_global.h>
+#include <mos/types.h>
+
+/**
+ * @brief A DMA pool, one DMA allocation carved into objects of the same size.
+ */
+typedef struct _libdma_pool libdma_pool_t;
+
+MOSAPI void libdma_init(void);
+MOSAPI void libdma_exit(void);
+
+/**
+ * @brief Allocate physically contiguous memory for DMA.
+ *
+ * @param n_pages Number of pages to allocate
+ * @param phys Receives the physical address
+ * @param virt Receives the virtual address
+ * @return true on success
+ */
+MOSAPI bool libdma_alloc(size_t n_pages, ptr_t *phys, ptr_t *virt);
+MOSAPI bool libdma_dealloc(ptr_t virt, ptr_t phys, size_t n_pages);
+
+MOSAPI bool libdma_share_buffer(void *buffer, size_t size, ptr_t *phyaddr);
+MOSAPI bool libdma_unshare_buffer(ptr_t phyaddr, void *buffer, size_t size);
+
+MOSAPI ptr_t libdma_map_physical_address(ptr_t paddr, size_t n_pages, ptr_t vaddr);
+
+/**
+ * @brief Create a pool of n_objects objects of object_size bytes each.
+ *
+ * @return The pool, or NULL if the DMA memory could not be allocated
+ */
+MOSAPI libdma_pool_t *libdma_pool_create(size_t object_size, size_t n_objects);
+
+/**
+ * @brief Take an object from the pool.
+ *
+ * @param pool The pool
+ * @param phys Receives the physical address of the object
+ * @return The virtual address of the object, or NULL if the pool is empty
+ */
+MOSAPI void *libdma_pool_alloc(libdma_pool_t *pool, ptr_t *phys);
+MOSAPI void libdma_pool_free(libdma_pool_t *pool, void *object);
+MOSAPI void libdma_pool_destroy(libdma_pool_t *pool);
+
+/**
+ * @brief Pin a userspace buffer for DMA, without copying it.
+ *
+ * @param buffer The buffer
+ * @param size Size of the buffer
+ * @param device_writes Whether the device writes to the buffer
+ * @param entries Receives the physically contiguous pieces of the buffer
+ * @param n_entries On input, the capacity of entries; on output, the number of entries used (or needed, on -ENOSPC)
+ * @return A pin handle for libdma_sg_unmap, or a negative error code
+ *
+ * @note The pages stay pinned until libdma_sg_unmap is called.
+ */
+MOSAPI fd_t libdma_sg_map(void *buffer, size_t size, bool device_writes, dma_sg_entry_t *entries, size_t *n_entries);
+MOSAPI void libdma_sg_unmap(fd_t pin);
@@ -1,10 +1,13 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "libdma/libdma.h"
+
 #include <bits/null.h>
 #include <fcntl.h>
 #include <mos/mm/mm_types.h>
 #include <mos/syscall/usermode.h>
 #include <mos/types.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,6 +64,83 @@ ptr_t libdma_map_physical_address(ptr_t paddr, size_t n_pages, ptr_t vaddr)
     return (ptr_t) syscall_mmap_file(vaddr, n_pages * MOS_PAGE_SIZE, MEM_PERM_READ | MEM_PERM_WRITE, flags, sysmem_fd, paddr);
 }
 
+// a pool is one DMA allocation, made once and carved into objects of the same size
+struct _libdma_pool
+{
+    ptr_t phys, virt;
+    size_t n_pages;
+    size_t object_size;
+    pthread_mutex_t lock;
+    size_t n_free;
+    size_t free[]; // indices of the free objects
+};
+
+libdma_pool_t *libdma_pool_create(size_t object_size, size_t n_objects)
+{
+    libdma_pool_t *pool = malloc(sizeof(libdma_pool_t) + n_objects * sizeof(size_t));
+    if (!pool)
+        return NULL;
+
+    pool->n_pages = ALIGN_UP_TO_PAGE(object_size * n_objects) / MOS_PAGE_SIZE;
+    if (!libdma_alloc(pool->n_pages, &pool->phys, &pool->virt))
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pool->object_size = object_size;
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->n_free = n_objects;
+    for (size_t i = 0; i < n_objects; i++)
+        pool->free[i] = n_objects - 1 - i; // hand out the lowest addresses first
+
+    libdma_debug("pool of %zu objects of %zu bytes at " PTR_FMT, n_objects, object_size, pool->phys);
+    return pool;
+}
+
+void *libdma_pool_alloc(libdma_pool_t *pool, ptr_t *phys)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (pool->n_free == 0)
+    {
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+
+    const size_t index = pool->free[--pool->n_free];
+    pthread_mutex_unlock(&pool->lock);
+
+    *phys = pool->phys + index * pool->object_size;
+    return (void *) (pool->virt + index * pool->object_size);
+}
+
+void libdma_pool_free(libdma_pool_t *pool, void *object)
+{
+    const size_t index = ((ptr_t) object - pool->virt) / pool->object_size;
+    pthread_mutex_lock(&pool->lock);
+    pool->free[pool->n_free++] = index;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void libdma_pool_destroy(libdma_pool_t *pool)
+{
+    libdma_dealloc(pool->virt, pool->phys, pool->n_pages);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+fd_t libdma_sg_map(void *buffer, size_t size, bool device_writes, dma_sg_entry_t *entries, size_t *n_entries)
+{
+    const fd_t pin = syscall_dmabuf_sg_map(buffer, size, device_writes, entries, n_entries);
+    libdma_debug("sg map: buffer=%p, size=%zu, %zu entries, pin=%d", buffer, size, *n_entries, pin);
+    return pin;
+}
+
+void libdma_sg_unmap(fd_t pin)
+{
+    syscall_io_close(pin);
+}
+
 void libdma_exit(void)
 {
     close(sysmem_fd);
@@ -21,14 +21,17 @@ static rpc_server_stub_t *dm;
 
 #define PCI_RPC_SERVER_NAME "drivers.pci"
 
-static void scan_callback(u8 bus, u8 device, u8 function, u16 vendor_id, u16 device_id, u8 base_class, u8 sub_class, u8 prog_if)
+static void scan_callback(u8 bus, u8 device, u8 function, u16 vendor_id, u16 device_id, u8 base_class, u8 sub_class, u8 prog_if, u8 irq)
 {
     const char *class_name = get_known_class_name(base_class, sub_class, prog_if);
-    printf("PCI: %02x:%02x.%01x: [%04x:%04x] %s (%02x:%02x:%02x)\n", bus, device, function, vendor_id, device_id, class_name, base_class, sub_class, prog_if);
+    printf("PCI: %02x:%02x.%01x: [%04x:%04x] %s (%02x:%02x:%02x)", bus, device, function, vendor_id, device_id, class_name, base_class, sub_class, prog_if);
+    if (irq != PCI_IRQ_NONE)
+        printf(", IRQ %u", irq);
+    putchar('\n');
     free((void *) class_name);
 
     const u32 location = (bus << 16) | (device << 8) | function;
-    dm_register_device(dm, vendor_id, device_id, location, mmio_base);
+    dm_register_device(dm, vendor_id, device_id, location, mmio_base, irq == PCI_IRQ_NONE ? -1 : irq);
 }
 
 typedef struct
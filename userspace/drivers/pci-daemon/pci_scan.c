@@ -54,8 +54,10 @@ void scan_function(u8 bus, u8 device, u8 function, pci_scan_callback_t callback)
     const u8 progIF = pcie_read8(bus, device, function, PCI_OFFSET_PROG_IF);
     const u16 deviceID = pci_read16(bus, device, function, PCI_OFFSET_DEVICE_ID);
     const u16 vendorID = pci_read16(bus, device, function, PCI_OFFSET_VENDOR_ID);
+    const u8 irqPin = pcie_read8(bus, device, function, PCI_OFFSET_IRQ_PIN);
+    const u8 irqLine = irqPin ? pcie_read8(bus, device, function, PCI_OFFSET_IRQ_LINE) : PCI_IRQ_NONE; // as routed by the firmware
 
-    callback(bus, device, function, vendorID, deviceID, baseClass, subClass, progIF);
+    callback(bus, device, function, vendorID, deviceID, baseClass, subClass, progIF, irqLine);
 
     if ((baseClass == 0x6) && (subClass == 0x4))
     {
@@ -10,10 +10,13 @@
 #define PCI_OFFSET_SUB_CLASS   0x0A
 #define PCI_OFFSET_BASE_CLASS  0x0B
 #define PCI_OFFSET_HEADER_TYPE 0x0E
+#define PCI_OFFSET_IRQ_LINE    0x3C
+#define PCI_OFFSET_IRQ_PIN     0x3D
 
 #define PCI_HEADER_TYPE_MULTIFUNC 0x80
+#define PCI_IRQ_NONE              0xFF // the device doesn't use a legacy interrupt line
 
-typedef void (*pci_scan_callback_t)(u8 bus, u8 device, u8 function, u16 vendor_id, u16 device_id, u8 base_class, u8 sub_class, u8 prog_if);
+typedef void (*pci_scan_callback_t)(u8 bus, u8 device, u8 function, u16 vendor_id, u16 device_id, u8 base_class, u8 sub_class, u8 prog_if, u8 irq);
 
 extern ptr_t mmio_base;
 
@@ -0,0 +1,101 @@
+use std::sync::{Condvar, Mutex};
+
+use virtio_drivers::PAGE_SIZE;
+
+use crate::hal::{
+    dma_region_register, dma_region_unregister, libdma_alloc, libdma_dealloc, DmaRegion,
+};
+
+/// Fixed-size DMA buffers carved out of one allocation, which is made once and reused for every request.
+pub(crate) struct DmaPool {
+    region: DmaRegion,
+    n_pages: usize,
+    slot_size: usize,
+    free: Mutex<Vec<usize>>,
+    available: Condvar,
+}
+
+/// A buffer taken from a DmaPool, returned to the pool when dropped.
+pub(crate) struct DmaSlot<'a> {
+    pool: &'a DmaPool,
+    index: usize,
+}
+
+impl DmaPool {
+    pub fn new(slot_size: usize, n_slots: usize) -> DmaPool {
+        let n_pages = (slot_size * n_slots + PAGE_SIZE - 1) / PAGE_SIZE;
+
+        let mut paddr: usize = 0;
+        let mut vaddr: *mut u8 = std::ptr::null_mut();
+        if unsafe { !libdma_alloc(n_pages, &mut paddr, &mut vaddr) } {
+            panic!("Failed to allocate DMA pool");
+        }
+
+        let region = DmaRegion {
+            vaddr: vaddr as usize,
+            paddr,
+            size: n_pages * PAGE_SIZE,
+        };
+        dma_region_register(region);
+
+        DmaPool {
+            region,
+            n_pages,
+            slot_size,
+            free: Mutex::new((0..n_slots).rev().collect()),
+            available: Condvar::new(),
+        }
+    }
+
+    /// The memory of a slot, whether it's taken or not, for pools that are indexed by the slots of another pool.
+    pub fn slot_ptr(&self, index: usize) -> *mut u8 {
+        (self.region.vaddr + index * self.slot_size) as *mut u8
+    }
+
+    /// Take a slot, waiting for one to be returned if all of them are in use.
+    pub fn get(&self) -> DmaSlot<'_> {
+        let mut free = self.free.lock().unwrap();
+        loop {
+            if let Some(index) = free.pop() {
+                return DmaSlot { pool: self, index };
+            }
+            free = self.available.wait(free).unwrap();
+        }
+    }
+
+    pub fn try_get(&self) -> Option<DmaSlot<'_>> {
+        let index = self.free.lock().unwrap().pop()?;
+        Some(DmaSlot { pool: self, index })
+    }
+}
+
+impl Drop for DmaPool {
+    fn drop(&mut self) {
+        dma_region_unregister(self.region.vaddr);
+        unsafe {
+            libdma_dealloc(
+                self.region.vaddr as *const u8,
+                self.region.paddr,
+                self.n_pages,
+            );
+        }
+    }
+}
+
+impl DmaSlot<'_> {
+    pub fn index(&self) -> usize {
+        self.index
+    }
+
+    pub fn as_mut_slice(&mut self, len: usize) -> &mut [u8] {
+        assert!(len <= self.pool.slot_size, "DMA slot overflow");
+        unsafe { std::slice::from_raw_parts_mut(self.pool.slot_ptr(self.index), len) }
+    }
+}
+
+impl Drop for DmaSlot<'_> {
+    fn drop(&mut self) {
+        self.pool.free.lock().unwrap().push(self.index);
+        self.pool.available.notify_one();
+    }
+}
@@ -1,41 +1,326 @@
-use std::sync::{Arc, Mutex};
+use std::{
+    collections::{HashMap, VecDeque},
+    fs::File,
+    io::{Read, Write},
+    os::fd::FromRawFd,
+    sync::{
+        atomic::{AtomicBool, Ordering},
+        Arc, Condvar, Mutex, MutexGuard,
+    },
+    thread,
+    time::Instant,
+};
 
 use librpc_rs::{
     rpc_server_function, RpcCallContext, RpcCallFuncInfo, RpcResult, RpcServer, RpcStub,
 };
 use protobuf::MessageField;
 use virtio_drivers::{
-    device::blk::VirtIOBlk,
+    device::blk::{BlkReq, BlkResp, VirtIOBlk},
     transport::pci::{bus::DeviceFunction, PciTransport},
 };
 
 use crate::{
+    dma_pool::{DmaPool, DmaSlot},
     hal::MOSHal,
     mos_rpc::blockdev::{
-        Read_request, Read_response, Register_dev_request, Register_dev_response, Write_request,
-        Write_response,
+        Read_request, Read_response, Register_dev_request, Register_dev_response, Stats_request,
+        Stats_response, Write_request, Write_response,
     },
     result_err, result_ok,
 };
 
-struct SafeVirtIOBlk(VirtIOBlk<MOSHal, PciTransport>);
-unsafe impl Send for SafeVirtIOBlk {}
+const SECTOR_SIZE: usize = 512;
+const MAX_TRANSFER_SIZE: usize = 64 * 1024; // larger requests are split, and the parts are submitted together
+const HEADER_SIZE: usize = 64; // a BlkReq and a BlkResp, for each request
+
+#[derive(Clone, Copy)]
+enum Op {
+    Read,
+    Write,
+}
+
+struct Inflight {
+    slot: usize,
+    op: Op,
+    len: usize,
+    submitted: Instant,
+}
+
+#[derive(Default)]
+struct QueueStats {
+    max_inflight: usize,
+    requests: u64,
+    batches: u64,
+    total_latency_us: u64,
+    max_latency_us: u64,
+}
+
+struct Queue {
+    blk: VirtIOBlk<MOSHal, PciTransport>,
+    inflight: HashMap<u16, Inflight>, // by descriptor token
+    results: Vec<Option<Result<(), virtio_drivers::Error>>>, // by slot, until the submitter picks it up
+    stats: QueueStats,
+}
+unsafe impl Send for Queue {}
+
+/// Requests from all clients go to the device as they come, each in a slot of the DMA pools, and the submitter
+/// sleeps until the completion thread (or, without an interrupt, the submitter itself) collects the result.
+///
+/// RpcServer::run serves each connection on one thread, one call after another, so a client connection only has the
+/// parts of one call here at a time: small requests only queue up behind each other with several connections (one per
+/// client, or a client that opens more than one to issue requests concurrently).
+struct BlkQueue {
+    queue: Mutex<Queue>,
+    completed: Vec<Condvar>, // by slot
+    space: Condvar,          // the virtqueue had no free descriptors
+    headers: DmaPool,        // indexed by the slots of 'buffers'
+    buffers: DmaPool,
+    queue_size: usize,
+    polling: AtomicBool, // set under the queue lock, also when the interrupt stops working
+}
+
+impl BlkQueue {
+    fn new(blk: VirtIOBlk<MOSHal, PciTransport>, polling: bool) -> BlkQueue {
+        let queue_size = blk.virt_queue_size() as usize;
+        BlkQueue {
+            queue: Mutex::new(Queue {
+                blk,
+                inflight: HashMap::new(),
+                results: (0..queue_size).map(|_| None).collect(),
+                stats: QueueStats::default(),
+            }),
+            completed: (0..queue_size).map(|_| Condvar::new()).collect(),
+            space: Condvar::new(),
+            headers: DmaPool::new(HEADER_SIZE, queue_size),
+            buffers: DmaPool::new(MAX_TRANSFER_SIZE, queue_size),
+            queue_size,
+            polling: AtomicBool::new(polling),
+        }
+    }
+
+    #[allow(clippy::mut_from_ref)]
+    unsafe fn slot_header(&self, slot: usize) -> (&mut BlkReq, &mut BlkResp) {
+        let header = self.headers.slot_ptr(slot);
+        let req = header as *mut BlkReq;
+        let resp = header.add(HEADER_SIZE / 2) as *mut BlkResp;
+        (&mut *req, &mut *resp)
+    }
+
+    fn submit(
+        &self,
+        op: Op,
+        sector: usize,
+        slot: &mut DmaSlot,
+        len: usize,
+    ) -> Result<(), virtio_drivers::Error> {
+        let index = slot.index();
+        let buf = slot.as_mut_slice(len);
+        let (req, resp) = unsafe {
+            let header = self.headers.slot_ptr(index);
+            (header as *mut BlkReq).write(BlkReq::default());
+            (header.add(HEADER_SIZE / 2) as *mut BlkResp).write(BlkResp::default());
+            self.slot_header(index)
+        };
+
+        let mut queue = self.queue.lock().unwrap();
+        let token = loop {
+            let result = unsafe {
+                match op {
+                    Op::Read => queue.blk.read_blocks_nb(sector, req, buf, resp),
+                    Op::Write => queue.blk.write_blocks_nb(sector, req, buf, resp),
+                }
+            };
+
+            match result {
+                Ok(token) => break token,
+                Err(virtio_drivers::Error::QueueFull) if !queue.inflight.is_empty() => {
+                    queue = self.wait(queue, &self.space);
+                }
+                Err(e) => return Err(e),
+            }
+        };
+
+        queue.inflight.insert(
+            token,
+            Inflight {
+                slot: index,
+                op,
+                len,
+                submitted: Instant::now(),
+            },
+        );
+        // at most the parts of one call per client connection, see BlkQueue
+        queue.stats.max_inflight = queue.stats.max_inflight.max(queue.inflight.len());
+        Ok(())
+    }
+
+    /// Wait for the request in a slot to complete.
+    fn wait_slot(&self, slot: &DmaSlot) -> Result<(), virtio_drivers::Error> {
+        let mut queue = self.queue.lock().unwrap();
+        loop {
+            if let Some(result) = queue.results[slot.index()].take() {
+                return result;
+            }
+            queue = self.wait(queue, &self.completed[slot.index()]);
+        }
+    }
+
+    fn wait<'a>(&'a self, queue: MutexGuard<'a, Queue>, cond: &Condvar) -> MutexGuard<'a, Queue> {
+        if !self.polling.load(Ordering::Relaxed) {
+            return cond.wait(queue).unwrap();
+        }
+
+        let mut queue = queue;
+        if self.complete(&mut queue) == 0 {
+            drop(queue);
+            thread::yield_now();
+            queue = self.queue.lock().unwrap();
+        }
+        queue
+    }
+
+    /// Collect every request the device has finished, and wake up the submitters.
+    fn complete(&self, queue: &mut Queue) -> usize {
+        let mut n = 0;
+        while let Some(token) = queue.blk.peek_used() {
+            let Some(inflight) = queue.inflight.remove(&token) else {
+                break;
+            };
+
+            let buf = unsafe {
+                std::slice::from_raw_parts_mut(self.buffers.slot_ptr(inflight.slot), inflight.len)
+            };
+            let (req, resp) = unsafe { self.slot_header(inflight.slot) };
+            let result = unsafe {
+                match inflight.op {
+                    Op::Read => queue.blk.complete_read_blocks(token, req, buf, resp),
+                    Op::Write => queue.blk.complete_write_blocks(token, req, buf, resp),
+                }
+            };
+            queue.results[inflight.slot] = Some(result);
+            self.completed[inflight.slot].notify_one();
+
+            let latency = inflight.submitted.elapsed().as_micros() as u64;
+            queue.stats.requests += 1;
+            queue.stats.total_latency_us += latency;
+            queue.stats.max_latency_us = queue.stats.max_latency_us.max(latency);
+            n += 1;
+        }
+
+        if n > 0 {
+            queue.stats.batches += 1;
+            self.space.notify_all();
+        }
+        n
+    }
+
+    fn run_completions(&self, mut irq: File) {
+        let mut count = [0u8; 8];
+        loop {
+            if let Err(e) = irq.read_exact(&mut count) {
+                println!("failed to wait for interrupt: {}, polling instead", e);
+                self.fall_back_to_polling();
+                return;
+            }
+
+            {
+                let mut queue = self.queue.lock().unwrap();
+                queue.blk.ack_interrupt(); // reading the ISR deasserts the line
+                self.complete(&mut queue);
+            }
+
+            let _ = irq.write(&count); // unmask the line
+        }
+    }
+
+    /// Make the submitters collect their own completions, including those already waiting for the interrupt.
+    fn fall_back_to_polling(&self) {
+        let _queue = self.queue.lock().unwrap();
+        self.polling.store(true, Ordering::Relaxed);
+        for cond in &self.completed {
+            cond.notify_all();
+        }
+        self.space.notify_all();
+    }
+
+    /// Read or write consecutive sectors, with up to a pool's worth of the parts in flight at once.
+    fn transfer(
+        &self,
+        op: Op,
+        sector: usize,
+        data: &mut [u8],
+    ) -> Result<(), virtio_drivers::Error> {
+        let mut submitted: VecDeque<(DmaSlot, usize)> = VecDeque::new();
+        let mut result = Ok(());
+
+        for offset in (0..data.len()).step_by(MAX_TRANSFER_SIZE) {
+            // never wait for a slot while holding some, or two large requests could starve each other
+            let mut slot = loop {
+                if let Some(slot) = self.buffers.try_get() {
+                    break slot;
+                }
+                match submitted.pop_front() {
+                    Some(oldest) => self.finish(op, oldest, data, &mut result),
+                    None => break self.buffers.get(),
+                }
+            };
+
+            let len = (data.len() - offset).min(MAX_TRANSFER_SIZE);
+            if let Op::Write = op {
+                slot.as_mut_slice(len)
+                    .copy_from_slice(&data[offset..offset + len]);
+            }
+
+            match self.submit(op, sector + offset / SECTOR_SIZE, &mut slot, len) {
+                Ok(()) => submitted.push_back((slot, offset)),
+                Err(e) => {
+                    result = Err(e);
+                    break;
+                }
+            }
+        }
+
+        while let Some(part) = submitted.pop_front() {
+            self.finish(op, part, data, &mut result);
+        }
+        result
+    }
+
+    fn finish(
+        &self,
+        op: Op,
+        (mut slot, offset): (DmaSlot, usize),
+        data: &mut [u8],
+        result: &mut Result<(), virtio_drivers::Error>,
+    ) {
+        let len = (data.len() - offset).min(MAX_TRANSFER_SIZE);
+        match self.wait_slot(&slot) {
+            Ok(()) => {
+                if let Op::Read = op {
+                    data[offset..offset + len].copy_from_slice(slot.as_mut_slice(len));
+                }
+            }
+            Err(e) => *result = Err(e),
+        }
+    }
+}
 
 #[derive(Clone)]
 struct BlockDevDriver {
     blockdev_manager: RpcStub,
     devname: String,
     server_name: String,
-    blockdev: Arc<Mutex<SafeVirtIOBlk>>,
+    blockdev: Arc<BlkQueue>,
 }
 
 impl BlockDevDriver {
     pub fn register(&mut self) -> RpcResult<()> {
-        let dev = &self.blockdev.lock().unwrap().0;
+        let capacity = self.blockdev.queue.lock().unwrap().blk.capacity();
 
         let request = Register_dev_request {
             block_size: 512,
-            num_blocks: dev.capacity() / 512,
+            num_blocks: capacity / 512,
             server_name: self.server_name.clone(),
             blockdev_name: self.devname.clone(),
             ..Default::default()
@@ -59,11 +344,12 @@ impl BlockDevDriver {
 
     pub fn on_read(&mut self, ctx: &mut RpcCallContext) -> RpcResult<()> {
         let arg: Read_request = ctx.get_arg_pb(0)?;
-        let mut buf = vec![0u8; 512 * arg.n_blocks as usize];
-
-        let virtioblk = &mut self.blockdev.lock().unwrap().0;
+        let mut buf = vec![0u8; SECTOR_SIZE * arg.n_blocks as usize];
 
-        let resp = match virtioblk.read_blocks(arg.n_boffset as _, &mut buf) {
+        let resp = match self
+            .blockdev
+            .transfer(Op::Read, arg.n_boffset as _, &mut buf)
+        {
             Ok(()) => Read_response {
                 result: result_ok!(),
                 data: buf,
@@ -79,11 +365,12 @@ impl BlockDevDriver {
     }
 
     pub fn on_write(&mut self, ctx: &mut RpcCallContext) -> RpcResult<()> {
-        let arg: Write_request = ctx.get_arg_pb(0)?;
+        let mut arg: Write_request = ctx.get_arg_pb(0)?;
 
-        let virtioblk = &mut self.blockdev.lock().unwrap().0;
-
-        let resp = match virtioblk.write_blocks(arg.n_boffset as _, &arg.data) {
+        let resp = match self
+            .blockdev
+            .transfer(Op::Write, arg.n_boffset as _, &mut arg.data)
+        {
             Ok(()) => Write_response {
                 result: result_ok!(),
                 ..Default::default()
@@ -96,14 +383,39 @@ impl BlockDevDriver {
 
         ctx.write_response_pb(&resp)
     }
+
+    pub fn on_stats(&mut self, ctx: &mut RpcCallContext) -> RpcResult<()> {
+        let _arg: Stats_request = ctx.get_arg_pb(0)?;
+
+        let queue = self.blockdev.queue.lock().unwrap();
+        let resp = Stats_response {
+            result: result_ok!(),
+            queue_size: self.blockdev.queue_size as u32,
+            inflight: queue.inflight.len() as u32,
+            max_inflight: queue.stats.max_inflight as u32,
+            requests: queue.stats.requests,
+            batches: queue.stats.batches,
+            total_latency_us: queue.stats.total_latency_us,
+            max_latency_us: queue.stats.max_latency_us,
+            ..Default::default()
+        };
+        drop(queue);
+
+        ctx.write_response_pb(&resp)
+    }
 }
 
 const FUNCTIONS: &[RpcCallFuncInfo<BlockDevDriver>] = &[
     rpc_server_function!(1, BlockDevDriver::on_read, Buffer),
     rpc_server_function!(2, BlockDevDriver::on_write, Buffer),
+    rpc_server_function!(3, BlockDevDriver::on_stats, Buffer),
 ];
 
-pub fn run_blockdev(transport: PciTransport, function: DeviceFunction) -> RpcResult<()> {
+pub fn run_blockdev(
+    transport: PciTransport,
+    function: DeviceFunction,
+    irq_fd: Option<i32>,
+) -> RpcResult<()> {
     let devlocation = format!(
         "{:02x}:{:02x}:{:02x}",
         function.bus, function.device, function.function
@@ -118,13 +430,30 @@ pub fn run_blockdev(transport: PciTransport, function: DeviceFunction) -> RpcRes
         return Ok(());
     }
 
+    let blk = VirtIOBlk::new(transport).expect("failed to create blockdev");
+    let blockdev = Arc::new(BlkQueue::new(blk, irq_fd.is_none()));
+    println!(
+        "{}: {} requests in flight, {}",
+        devname,
+        blockdev.queue_size,
+        if irq_fd.is_some() {
+            "interrupt-driven"
+        } else {
+            "polling"
+        }
+    );
+
+    if let Some(irq_fd) = irq_fd {
+        let irq = unsafe { File::from_raw_fd(irq_fd) };
+        let blockdev = blockdev.clone();
+        thread::spawn(move || blockdev.run_completions(irq));
+    }
+
     let mut driver = BlockDevDriver {
         blockdev_manager: RpcStub::new("mos.blockdev-manager")?,
         devname,
         server_name,
-        blockdev: Arc::new(Mutex::new(SafeVirtIOBlk(
-            VirtIOBlk::new(transport).expect("failed to create blockdev"),
-        ))),
+        blockdev,
     };
 
     let mut rpc_server = RpcServer::create(&driver.server_name, FUNCTIONS)?;
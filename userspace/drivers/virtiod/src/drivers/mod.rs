@@ -13,9 +13,10 @@ mod gpu;
 pub(crate) fn start_device(
     transport: PciTransport,
     function: DeviceFunction,
+    irq_fd: Option<i32>,
 ) -> Result<(), Box<dyn Error>> {
     match transport.device_type() {
-        DeviceType::Block => run_blockdev(transport, function),
+        DeviceType::Block => run_blockdev(transport, function, irq_fd),
         DeviceType::GPU => Ok(run_gpu(transport)?),
         t => unimplemented!("Unrecognized virtio device: {:?}", t),
     }
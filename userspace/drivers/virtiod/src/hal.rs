@@ -1,6 +1,7 @@
 use virtio_drivers::{Hal, PAGE_SIZE};
 
 use core::ptr::NonNull;
+use std::sync::RwLock;
 
 extern "C" {
 
@@ -29,6 +30,79 @@ extern "C" {
 
 }
 
+// the DMA pool and scatter-gather parts of libdma, virtiod keeps its own DmaPool for now
+#[allow(dead_code)]
+extern "C" {
+
+    // libdma_pool_t *libdma_pool_create(size_t object_size, size_t n_objects)
+    pub fn libdma_pool_create(object_size: usize, n_objects: usize) -> *mut LibdmaPool;
+
+    // void *libdma_pool_alloc(libdma_pool_t *pool, ptr_t *phys)
+    pub fn libdma_pool_alloc(pool: *mut LibdmaPool, phys: *mut usize) -> *mut u8;
+
+    // void libdma_pool_free(libdma_pool_t *pool, void *object)
+    pub fn libdma_pool_free(pool: *mut LibdmaPool, object: *mut u8);
+
+    // void libdma_pool_destroy(libdma_pool_t *pool)
+    pub fn libdma_pool_destroy(pool: *mut LibdmaPool);
+
+    // fd_t libdma_sg_map(void *buffer, size_t size, bool device_writes, dma_sg_entry_t *entries, size_t *n_entries)
+    pub fn libdma_sg_map(
+        buffer: *mut u8,
+        size: usize,
+        device_writes: bool,
+        entries: *mut DmaSgEntry,
+        n_entries: *mut usize,
+    ) -> i32;
+
+    // void libdma_sg_unmap(fd_t pin)
+    pub fn libdma_sg_unmap(pin: i32);
+
+}
+
+/// libdma_pool_t, only ever used behind a pointer
+#[allow(dead_code)]
+#[repr(C)]
+pub struct LibdmaPool {
+    _private: [u8; 0],
+}
+
+/// dma_sg_entry_t, a physically contiguous piece of a buffer pinned by libdma_sg_map
+#[allow(dead_code)]
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct DmaSgEntry {
+    pub paddr: usize,
+    pub size: usize,
+}
+
+/// A physically contiguous DMA allocation, buffers inside it can be given to the device without bouncing
+#[derive(Clone, Copy)]
+pub(crate) struct DmaRegion {
+    pub vaddr: usize,
+    pub paddr: usize,
+    pub size: usize,
+}
+
+static DMA_REGIONS: RwLock<Vec<DmaRegion>> = RwLock::new(Vec::new());
+
+pub(crate) fn dma_region_register(region: DmaRegion) {
+    DMA_REGIONS.write().unwrap().push(region);
+}
+
+pub(crate) fn dma_region_unregister(vaddr: usize) {
+    DMA_REGIONS.write().unwrap().retain(|r| r.vaddr != vaddr);
+}
+
+fn dma_region_translate(vaddr: usize, size: usize) -> Option<usize> {
+    DMA_REGIONS
+        .read()
+        .unwrap()
+        .iter()
+        .find(|r| vaddr >= r.vaddr && vaddr + size <= r.vaddr + r.size)
+        .map(|r| r.paddr + (vaddr - r.vaddr))
+}
+
 pub(crate) struct MOSHal {}
 
 macro_rules! align_up {
@@ -74,6 +148,10 @@ unsafe impl Hal for MOSHal {
         buffer: NonNull<[u8]>,
         _direction: virtio_drivers::BufferDirection,
     ) -> virtio_drivers::PhysAddr {
+        if let Some(paddr) = dma_region_translate(buffer.as_ptr() as *mut u8 as usize, buffer.len()) {
+            return paddr; // already DMA memory, no need to copy
+        }
+
         let mut phyaddr: usize = 0;
         if unsafe { !libdma_share_buffer(buffer.as_ptr() as *mut u8, buffer.len(), &mut phyaddr) } {
             panic!("Failed to share buffer");
@@ -86,6 +164,10 @@ unsafe impl Hal for MOSHal {
         buffer: NonNull<[u8]>,
         _direction: virtio_drivers::BufferDirection,
     ) {
+        if dma_region_translate(buffer.as_ptr() as *mut u8 as usize, buffer.len()).is_some() {
+            return;
+        }
+
         if !libdma_unshare_buffer(paddr as usize, buffer.as_ptr() as *mut u8, buffer.len()) {
             panic!("Failed to unshare buffer");
         }
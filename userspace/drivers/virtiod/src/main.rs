@@ -10,6 +10,7 @@ use virtio_drivers::transport::pci::{
     PciTransport,
 };
 
+mod dma_pool;
 mod drivers;
 mod hal;
 mod mos_rpc;
@@ -34,6 +35,10 @@ struct Args {
     /// MMIO Base Address
     #[arg(short, long, value_parser=parse_hex64, default_value_t = 0xb0000000)]
     mmio_base: u64,
+
+    /// IRQ object of the device's interrupt line, opened by the device manager
+    #[arg(long)]
+    irq_fd: Option<i32>,
 }
 
 fn main() -> () {
@@ -60,6 +65,10 @@ fn main() -> () {
         location.bus, location.device, location.function
     );
 
+    if let Some(irq_fd) = args.irq_fd {
+        println!("IRQ object: fd {}", irq_fd);
+    }
+
     let mut pci_root = unsafe {
         libdma_init();
         PciRoot::new(
@@ -94,7 +103,7 @@ fn main() -> () {
     #[cfg(feature = "debug")]
     println!("Detected virtio PCI device '{:?}'", transport.device_type());
 
-    start_device(transport, location).expect("Failed to start device");
+    start_device(transport, location, args.irq_fd).expect("Failed to start device");
 
     unsafe {
         libdma_exit();
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.h>
+
+/**
+ * @brief Statistics of the userspace allocator, see malloc_get_stats.
+ */
+typedef struct
+{
+    size_t allocations;       ///< malloc calls, summed over all threads
+    size_t frees;             ///< free calls, summed over all threads
+    size_t refills;           ///< times a thread cache went to the shared runs for more objects
+    size_t flushes;           ///< times a thread cache gave objects back to the shared runs
+    size_t threads;           ///< threads that currently have a cache
+    size_t runs;              ///< runs carved out of the heap, in use or not
+    size_t empty_runs;        ///< runs with no objects in use, kept for reuse, the kernel may reclaim their pages
+    size_t heap_bytes;        ///< bytes of heap that hold runs
+    size_t large_allocations; ///< large objects that are currently mapped
+    size_t large_bytes;       ///< bytes mapped for large objects
+} malloc_stats_t;
+
+void malloc_init(void);
+
+/**
+ * @brief Give the objects cached by the calling thread back, called before the thread exits.
+ */
+void malloc_thread_exit(void);
+
+/**
+ * @brief The number of bytes that can be used in an allocated object, which is at least the requested size.
+ */
+size_t malloc_usable_size(const void *ptr);
+
+void malloc_get_stats(malloc_stats_t *stats);
+void malloc_dump_stats(void);
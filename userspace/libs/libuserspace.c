@@ -1,6 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
-#include "liballoc.h"
+#include "mos_malloc.h"
 #include "mos_string.h"
 #include "struct_file.h"
 
@@ -43,9 +43,9 @@ static void invoke_init(void)
         (*func)();
 }
 
-static void __attribute__((constructor)) __liballoc_userspace_init(void)
+static void __attribute__((constructor)) __malloc_userspace_init(void)
 {
-    liballoc_init();
+    malloc_init();
 }
 
 void _start(size_t argc, char **argv, char **envp)
@@ -85,6 +85,7 @@ static void thread_start(void *_arg)
     void *entry_arg = ((thread_start_args_t *) _arg)->arg;
     free(_arg);
     entry(entry_arg);
+    malloc_thread_exit();
     syscall_thread_exit();
 }
 
@@ -104,14 +105,7 @@ noreturn void abort()
 
 pid_t spawn(const char *path, const char *const argv[])
 {
-    pid_t pid = syscall_fork();
-    if (pid == 0)
-    {
-        syscall_execveat(FD_CWD, path, argv, (const char *const *) environ, 0);
-        syscall_exit(-1);
-    }
-
-    return pid;
+    return syscall_spawnat(FD_CWD, path, argv, (const char *const *) environ, NULL);
 }
 
 pid_t shell_execute(const char *command)
@@ -0,0 +1,558 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mos_malloc.h"
+
+#include <mos/lib/structures/list.h>
+#include <mos/lib/sync/mutex.h>
+#include <mos/mm/heap_ops.h>
+#include <mos/mm/mm_types.h>
+#include <mos/mos_global.h>
+#include <mos/moslib_global.h>
+#include <mos/syscall/usermode.h>
+#include <mos_stdio.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+// Small objects are grouped by size class into runs, which are carved out of the heap. Each thread keeps a cache of free objects per
+// class, so that most malloc and free calls take no lock at all; the caches are refilled from, and flushed to, the runs in batches,
+// under a lock per class. Large objects are mapped on their own.
+
+#define MALLOC_ALIGNMENT     16
+#define MALLOC_RUN_SIZE      (64 KB) // runs are aligned to their size, an object finds its run by masking its address
+#define MALLOC_SMALL_MAX     (8 KB)  // larger objects are mapped on their own
+#define MALLOC_NCLASSES      32
+#define MALLOC_BIN_MAX_BYTES (16 KB) // how much a thread caches per size class, before giving objects back
+#define MALLOC_TRIM_MIN      (256 KB) // how much empty space at the top of the heap is worth giving back
+
+#define MALLOC_RUN_MAGIC   MOS_FOURCC('R', 'U', 'N', 'S')
+#define MALLOC_LARGE_MAGIC MOS_FOURCC('L', 'A', 'R', 'G')
+#define MALLOC_DEAD        MOS_FOURCC('D', 'E', 'A', 'D')
+
+typedef struct _malloc_object
+{
+    struct _malloc_object *next;
+} malloc_object_t;
+
+typedef struct
+{
+    as_linked_list; ///< in the partial list of its class, or in the list of empty runs
+    u32 magic;
+    u32 size_class;
+    u32 capacity;               ///< number of objects that fit in the run
+    u32 in_use;                 ///< objects that have been handed out, to a thread cache or to the user
+    bool empty;                 ///< in the list of empty runs, protected by malloc_heap_lock
+    malloc_object_t *free_list; ///< objects that were given back to the run
+    char *bump;                 ///< where the part of the run that has never been handed out starts
+} malloc_run_t;
+
+#define MALLOC_RUN_HEADER_SIZE ALIGN_UP(sizeof(malloc_run_t), MALLOC_ALIGNMENT)
+
+typedef struct
+{
+    mutex_t lock;
+    list_head partial_runs; ///< runs that have objects left
+} malloc_class_t;
+
+typedef struct
+{
+    size_t size; ///< size of the whole mapping
+    u32 magic;
+} __aligned(MALLOC_ALIGNMENT) malloc_large_header_t;
+
+typedef struct
+{
+    malloc_object_t *head;
+    u32 count;
+} malloc_bin_t;
+
+typedef struct
+{
+    as_linked_list; ///< in malloc_thread_caches
+    malloc_bin_t bins[MALLOC_NCLASSES];
+    size_t allocations, frees; ///< only updated by the owner thread
+} malloc_thread_cache_t;
+
+static malloc_class_t malloc_classes[MALLOC_NCLASSES];
+
+static mutex_t malloc_heap_lock = MUTEX_INIT;
+static ptr_t malloc_heap_start = 0, malloc_heap_end = 0; ///< the part of the heap that holds runs
+static list_head malloc_empty_runs;
+
+static mutex_t malloc_threads_lock = MUTEX_INIT;
+static list_head malloc_thread_caches;
+static size_t malloc_exited_allocations = 0, malloc_exited_frees = 0; ///< from threads whose caches are gone
+
+static malloc_stats_t malloc_stats; ///< counters of the slow paths, updated atomically
+
+#define malloc_stat_add(field, n) __atomic_fetch_add(&malloc_stats.field, (n), __ATOMIC_RELAXED)
+#define malloc_stat_sub(field, n) __atomic_fetch_sub(&malloc_stats.field, (n), __ATOMIC_RELAXED)
+
+// 16 to 128 bytes in steps of 16, then 4 classes between consecutive powers of two, up to MALLOC_SMALL_MAX
+static u32 malloc_size_class(size_t size)
+{
+    if (size <= 128)
+        return size ? (size - 1) / 16 : 0;
+
+    const u32 shift = 63 - __builtin_clzl(size - 1); // 2^shift < size <= 2^(shift + 1)
+    return 8 + (shift - 7) * 4 + ((size - 1) >> (shift - 2)) - 4;
+}
+
+static size_t malloc_class_size(u32 size_class)
+{
+    if (size_class < 8)
+        return (size_class + 1) * 16;
+
+    const size_t base = 128UL << ((size_class - 8) / 4);
+    return base + ((size_class - 8) % 4 + 1) * (base / 4);
+}
+
+static u32 malloc_bin_limit(u32 size_class)
+{
+    return MAX(4UL, MIN(256UL, MALLOC_BIN_MAX_BYTES / malloc_class_size(size_class)));
+}
+
+should_inline bool malloc_is_small(const void *ptr)
+{
+    // the range only shrinks over runs that hold no objects, so a pointer that is being freed can't drop out of it
+    return (ptr_t) ptr >= __atomic_load_n(&malloc_heap_start, __ATOMIC_RELAXED) && (ptr_t) ptr < __atomic_load_n(&malloc_heap_end, __ATOMIC_ACQUIRE);
+}
+
+should_inline malloc_run_t *malloc_run_of(const void *ptr)
+{
+    return (malloc_run_t *) ALIGN_DOWN((ptr_t) ptr, MALLOC_RUN_SIZE);
+}
+
+// ! thread caches, found through the GS base of each thread
+// FS belongs to the TLS of whatever runtime the program uses, GS is reserved for the allocator
+
+should_inline malloc_thread_cache_t *malloc_get_thread_cache(void)
+{
+#if defined(__x86_64__)
+    ptr_t base;
+    __asm__ volatile("rdgsbase %0" : "=r"(base));
+    return (malloc_thread_cache_t *) base;
+#else
+#error "unsupported architecture"
+#endif
+}
+
+static void malloc_set_thread_cache(malloc_thread_cache_t *cache)
+{
+#if defined(__x86_64__)
+    syscall_arch_syscall(X86_SYSCALL_SET_GS_BASE, (ptr_t) cache, 0, 0, 0);
+#else
+#error "unsupported architecture"
+#endif
+}
+
+static malloc_thread_cache_t *malloc_create_thread_cache(void)
+{
+    // new threads start with a GS base of zero, a forked child keeps (a copy of) the cache of its parent thread
+    malloc_thread_cache_t *cache = syscall_mmap_anonymous(0, ALIGN_UP_TO_PAGE(sizeof(malloc_thread_cache_t)), MEM_PERM_READ | MEM_PERM_WRITE, MMAP_PRIVATE);
+    if (!cache)
+        mos_panic("malloc: cannot allocate a thread cache");
+
+    linked_list_init(list_node(cache));
+    mutex_acquire(&malloc_threads_lock);
+    list_node_append(&malloc_thread_caches, list_node(cache));
+    mutex_release(&malloc_threads_lock);
+    malloc_stat_add(threads, 1);
+
+    malloc_set_thread_cache(cache);
+    return cache;
+}
+
+// ! runs
+
+// grow the heap by one run, the runs must be contiguous, so the heap can't have been grown by anyone else
+static bool malloc_heap_grow_locked(void)
+{
+    const ptr_t top = syscall_heap_control(HEAP_GROW_PAGES, MALLOC_RUN_SIZE / MOS_PAGE_SIZE);
+    if (!top)
+        return false;
+
+    if (top != malloc_heap_end + MALLOC_RUN_SIZE)
+    {
+        syscall_heap_control(HEAP_SHRINK_PAGES, MALLOC_RUN_SIZE / MOS_PAGE_SIZE); // it isn't ours to use
+        return false;
+    }
+
+    return true;
+}
+
+static malloc_run_t *malloc_run_new(u32 size_class)
+{
+    malloc_run_t *run = NULL;
+
+    mutex_acquire(&malloc_heap_lock);
+    if (!list_is_empty(&malloc_empty_runs))
+    {
+        run = list_entry(list_node_pop(&malloc_empty_runs), malloc_run_t);
+        run->empty = false;
+        malloc_stat_sub(empty_runs, 1);
+    }
+    else if (malloc_heap_grow_locked())
+    {
+        run = (malloc_run_t *) malloc_heap_end;
+        __atomic_store_n(&malloc_heap_end, malloc_heap_end + MALLOC_RUN_SIZE, __ATOMIC_RELEASE);
+        malloc_stat_add(runs, 1);
+        malloc_stat_add(heap_bytes, MALLOC_RUN_SIZE);
+    }
+    mutex_release(&malloc_heap_lock);
+
+    if (!run)
+        return NULL;
+
+    linked_list_init(list_node(run));
+    run->magic = MALLOC_RUN_MAGIC;
+    run->size_class = size_class;
+    run->capacity = (MALLOC_RUN_SIZE - MALLOC_RUN_HEADER_SIZE) / malloc_class_size(size_class);
+    run->in_use = 0;
+    run->free_list = NULL;
+    run->bump = (char *) run + MALLOC_RUN_HEADER_SIZE;
+    return run;
+}
+
+// give the empty runs at the top of the heap back to the kernel, once there are enough of them
+static void malloc_heap_trim_locked(void)
+{
+    ptr_t top = malloc_heap_end;
+    while (top > malloc_heap_start && ((malloc_run_t *) (top - MALLOC_RUN_SIZE))->empty)
+        top -= MALLOC_RUN_SIZE;
+
+    if (malloc_heap_end - top < MALLOC_TRIM_MIN)
+        return;
+
+    if (syscall_heap_control(HEAP_GET_TOP, 0) != malloc_heap_end)
+        return; // the heap has grown past the runs, setting the top would take the other memory away
+
+    const size_t nruns = (malloc_heap_end - top) / MALLOC_RUN_SIZE;
+    for (ptr_t run = top; run < malloc_heap_end; run += MALLOC_RUN_SIZE)
+        list_remove((malloc_run_t *) run); // while the headers are still mapped
+
+    // nothing can be freed into the range any more, it held no objects
+    __atomic_store_n(&malloc_heap_end, top, __ATOMIC_RELEASE);
+    syscall_heap_control(HEAP_SET_TOP, top);
+
+    malloc_stat_sub(runs, nruns);
+    malloc_stat_sub(empty_runs, nruns);
+    malloc_stat_sub(heap_bytes, nruns * MALLOC_RUN_SIZE);
+}
+
+static void malloc_run_release(malloc_run_t *run)
+{
+    mutex_acquire(&malloc_heap_lock);
+
+    // keep the run for reuse, but let the kernel take its pages when memory runs out, except for the one with the header;
+    // this must happen before the run can be reused, or the new objects could be lost
+    syscall_vm_advise((char *) run + MOS_PAGE_SIZE, MALLOC_RUN_SIZE - MOS_PAGE_SIZE, MEM_ADVICE_FREE);
+    run->empty = true;
+    list_node_append(&malloc_empty_runs, list_node(run));
+    malloc_stat_add(empty_runs, 1);
+
+    malloc_heap_trim_locked();
+    mutex_release(&malloc_heap_lock);
+}
+
+// ! moving objects between the thread caches and the runs
+
+static u32 malloc_run_take(malloc_run_t *run, malloc_bin_t *bin, u32 n)
+{
+    const size_t object_size = malloc_class_size(run->size_class);
+    u32 taken = 0;
+    for (; taken < n && run->in_use < run->capacity; taken++)
+    {
+        malloc_object_t *object = run->free_list;
+        if (object)
+        {
+            run->free_list = object->next;
+        }
+        else
+        {
+            object = (malloc_object_t *) run->bump;
+            run->bump += object_size;
+        }
+
+        object->next = bin->head;
+        bin->head = object;
+        run->in_use++;
+    }
+
+    bin->count += taken;
+    return taken;
+}
+
+static bool malloc_bin_refill(malloc_bin_t *bin, u32 size_class)
+{
+    malloc_class_t *class = &malloc_classes[size_class];
+    const u32 wanted = malloc_bin_limit(size_class) / 2;
+    u32 got = 0;
+
+    mutex_acquire(&class->lock);
+    while (got < wanted)
+    {
+        if (list_is_empty(&class->partial_runs))
+        {
+            malloc_run_t *run = malloc_run_new(size_class);
+            if (!run)
+                break;
+            list_node_append(&class->partial_runs, list_node(run));
+        }
+
+        malloc_run_t *run = list_entry(class->partial_runs.next, malloc_run_t);
+        got += malloc_run_take(run, bin, wanted - got);
+        if (run->in_use == run->capacity)
+            list_remove(run); // full, until an object is given back
+    }
+    mutex_release(&class->lock);
+
+    malloc_stat_add(refills, 1);
+    return got > 0;
+}
+
+static void malloc_bin_flush(malloc_bin_t *bin, u32 size_class, u32 n)
+{
+    malloc_class_t *class = &malloc_classes[size_class];
+
+    mutex_acquire(&class->lock);
+    for (; n && bin->head; n--)
+    {
+        malloc_object_t *object = bin->head;
+        bin->head = object->next;
+        bin->count--;
+
+        malloc_run_t *run = malloc_run_of(object);
+        const bool was_full = run->in_use == run->capacity;
+        object->next = run->free_list;
+        run->free_list = object;
+        run->in_use--;
+
+        if (run->in_use == 0)
+        {
+            if (!was_full)
+                list_remove(run);
+            malloc_run_release(run);
+        }
+        else if (was_full)
+        {
+            list_node_append(&class->partial_runs, list_node(run));
+        }
+    }
+    mutex_release(&class->lock);
+
+    malloc_stat_add(flushes, 1);
+}
+
+// ! large objects
+
+static void *malloc_large(size_t size)
+{
+    const size_t mapped = ALIGN_UP_TO_PAGE(size + sizeof(malloc_large_header_t));
+    if (mapped < size)
+        return NULL; // overflow
+
+    malloc_large_header_t *header = syscall_mmap_anonymous(0, mapped, MEM_PERM_READ | MEM_PERM_WRITE, MMAP_PRIVATE);
+    if (!header)
+        return NULL;
+
+    header->size = mapped;
+    header->magic = MALLOC_LARGE_MAGIC;
+    malloc_stat_add(large_allocations, 1);
+    malloc_stat_add(large_bytes, mapped);
+    return header + 1;
+}
+
+static malloc_large_header_t *malloc_large_header_of(const void *ptr)
+{
+    malloc_large_header_t *header = (malloc_large_header_t *) ptr - 1;
+    if (header->magic == MALLOC_DEAD)
+        mos_panic("malloc: double free of %p", ptr);
+    if (header->magic != MALLOC_LARGE_MAGIC)
+        mos_panic("malloc: bad free(%p)", ptr);
+    return header;
+}
+
+static void malloc_large_free(void *ptr)
+{
+    malloc_large_header_t *header = malloc_large_header_of(ptr);
+    const size_t mapped = header->size;
+    header->magic = MALLOC_DEAD;
+    malloc_stat_sub(large_allocations, 1);
+    malloc_stat_sub(large_bytes, mapped);
+    syscall_munmap(header, mapped);
+}
+
+// ! public API
+
+void malloc_init(void)
+{
+    MOS_LIB_ASSERT_X(once(), "malloc_init() called twice");
+
+    for (size_t i = 0; i < MALLOC_NCLASSES; i++)
+    {
+        mutex_init(&malloc_classes[i].lock);
+        linked_list_init(&malloc_classes[i].partial_runs);
+    }
+
+    linked_list_init(&malloc_empty_runs);
+    linked_list_init(&malloc_thread_caches);
+
+    // align the start of the runs, every run grows the heap by exactly one run afterwards
+    const ptr_t top = syscall_heap_control(HEAP_GET_TOP, 0);
+    const ptr_t start = ALIGN_UP(top, MALLOC_RUN_SIZE);
+    if (start != top && syscall_heap_control(HEAP_GROW_PAGES, (start - top) / MOS_PAGE_SIZE) != start)
+        mos_panic("malloc: cannot grow the heap");
+
+    malloc_heap_start = malloc_heap_end = start;
+}
+
+void *malloc(size_t size)
+{
+    if (unlikely(size > MALLOC_SMALL_MAX))
+        return malloc_large(size);
+
+    malloc_thread_cache_t *cache = malloc_get_thread_cache();
+    if (unlikely(!cache))
+        cache = malloc_create_thread_cache();
+
+    const u32 size_class = malloc_size_class(size);
+    malloc_bin_t *bin = &cache->bins[size_class];
+    if (unlikely(!bin->head) && !malloc_bin_refill(bin, size_class))
+        return NULL;
+
+    malloc_object_t *object = bin->head;
+    bin->head = object->next;
+    bin->count--;
+    cache->allocations++;
+    return object;
+}
+
+void free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    if (unlikely(!malloc_is_small(ptr)))
+    {
+        malloc_large_free(ptr);
+        return;
+    }
+
+    const malloc_run_t *run = malloc_run_of(ptr);
+    if (unlikely(run->magic != MALLOC_RUN_MAGIC))
+        mos_panic("malloc: bad free(%p)", ptr);
+
+    malloc_thread_cache_t *cache = malloc_get_thread_cache();
+    if (unlikely(!cache))
+        cache = malloc_create_thread_cache();
+
+    const u32 size_class = run->size_class;
+    malloc_bin_t *bin = &cache->bins[size_class];
+    malloc_object_t *object = ptr;
+    object->next = bin->head;
+    bin->head = object;
+    bin->count++;
+    cache->frees++;
+
+    const u32 limit = malloc_bin_limit(size_class);
+    if (unlikely(bin->count > limit))
+        malloc_bin_flush(bin, size_class, bin->count - limit / 2);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t total;
+    if (__builtin_mul_overflow(nmemb, size, &total))
+        return NULL;
+
+    void *ptr = malloc(total);
+    if (ptr)
+        memset(ptr, 0, total);
+    return ptr;
+}
+
+size_t malloc_usable_size(const void *ptr)
+{
+    if (!ptr)
+        return 0;
+
+    if (malloc_is_small(ptr))
+        return malloc_class_size(malloc_run_of(ptr)->size_class);
+
+    return malloc_large_header_of(ptr)->size - sizeof(malloc_large_header_t);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return malloc(size);
+
+    if (size == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    // keep the object if it still fits, and would not be in a smaller size class
+    const size_t usable = malloc_usable_size(ptr);
+    if (size <= usable)
+    {
+        if (malloc_is_small(ptr) ? malloc_size_class(size) == malloc_run_of(ptr)->size_class : size > MALLOC_SMALL_MAX)
+            return ptr;
+    }
+
+    void *new_ptr = malloc(size);
+    if (!new_ptr)
+        return NULL;
+
+    memcpy(new_ptr, ptr, MIN(size, usable));
+    free(ptr);
+    return new_ptr;
+}
+
+void malloc_thread_exit(void)
+{
+    malloc_thread_cache_t *cache = malloc_get_thread_cache();
+    if (!cache)
+        return;
+
+    for (u32 size_class = 0; size_class < MALLOC_NCLASSES; size_class++)
+        if (cache->bins[size_class].count)
+            malloc_bin_flush(&cache->bins[size_class], size_class, cache->bins[size_class].count);
+
+    mutex_acquire(&malloc_threads_lock);
+    list_remove(cache);
+    malloc_exited_allocations += cache->allocations;
+    malloc_exited_frees += cache->frees;
+    mutex_release(&malloc_threads_lock);
+    malloc_stat_sub(threads, 1);
+
+    malloc_set_thread_cache(NULL);
+    syscall_munmap(cache, ALIGN_UP_TO_PAGE(sizeof(malloc_thread_cache_t)));
+}
+
+void malloc_get_stats(malloc_stats_t *stats)
+{
+    *stats = malloc_stats;
+
+    // the counters of other threads are read without synchronisation, they may be slightly behind
+    mutex_acquire(&malloc_threads_lock);
+    stats->allocations = malloc_exited_allocations;
+    stats->frees = malloc_exited_frees;
+    list_foreach(malloc_thread_cache_t, cache, malloc_thread_caches)
+    {
+        stats->allocations += __atomic_load_n(&cache->allocations, __ATOMIC_RELAXED);
+        stats->frees += __atomic_load_n(&cache->frees, __ATOMIC_RELAXED);
+    }
+    mutex_release(&malloc_threads_lock);
+}
+
+void malloc_dump_stats(void)
+{
+    malloc_stats_t stats;
+    malloc_get_stats(&stats);
+
+    printf("malloc: %zu allocations, %zu frees, %zu refills, %zu flushes, %zu threads\n", stats.allocations, stats.frees, stats.refills, stats.flushes, stats.threads);
+    printf("malloc: %zu runs (%zu empty), %zu KiB of heap\n", stats.runs, stats.empty_runs, stats.heap_bytes / 1024);
+    printf("malloc: %zu large objects, %zu KiB mapped\n", stats.large_allocations, stats.large_bytes / 1024);
+}
@@ -1,5 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "services.h"
+
 #include <argparse/libargparse.h>
 #include <libconfig/libconfig.h>
 #include <mos/syscall/usermode.h>
@@ -38,34 +40,6 @@ static char *string_trim(char *in)
     return in;
 }
 
-bool start_services(void)
-{
-    size_t num_drivers;
-    const char **services = config_get_all(config, "service", &num_drivers);
-    if (!services)
-        return true;
-
-    for (size_t i = 0; i < num_drivers; i++)
-    {
-        const char *service = services[i];
-        pid_t driver_pid = fork();
-        if (driver_pid == 0)
-        {
-            // child
-            execl(service, service, NULL);
-            exit(-1);
-        }
-
-        if (driver_pid <= 0)
-            fprintf(stderr, "Failed to start service: %s\n", service);
-
-        usleep(100000); // so that it looks better
-    }
-
-    free(services);
-    return true;
-}
-
 static bool create_directories(void)
 {
     size_t num_dirs;
@@ -213,7 +187,7 @@ int main(int argc, const char *argv[])
     if (!mount_filesystems())
         return DYN_ERROR_CODE;
 
-    if (!start_services())
+    if (!services_start(config))
         return DYN_ERROR_CODE;
 
     // start the shell
@@ -233,10 +207,12 @@ int main(int argc, const char *argv[])
     shell_argv[shell_argc] = NULL;
 
 start_shell:;
-    const pid_t shell_pid = fork();
-    if (shell_pid == 0)
-        if (execv(shell, (char **) shell_argv) <= 0)
-            return DYN_ERROR_CODE;
+    const pid_t shell_pid = syscall_spawnat(FD_CWD, shell, shell_argv, (const char *const *) environ, NULL);
+    if (shell_pid <= 0)
+    {
+        fprintf(stderr, "init: failed to start shell '%s'\n", shell);
+        return DYN_ERROR_CODE;
+    }
 
     while (true)
     {
@@ -249,6 +225,7 @@ start_shell:;
         else
         {
             printf("init: process %d exited\n", pid);
+            services_handle_exit(pid);
         }
     }
 
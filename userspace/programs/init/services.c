@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Services are started as soon as everything they depend on is ready, a service that announces an IPC server is
+// ready once the server exists, otherwise once it has been started.
+
+#include "services.h"
+
+#include <mos/syscall/usermode.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum
+{
+    SERVICE_WAITING,  // for its dependencies
+    SERVICE_STARTING, // started, waiting for its IPC server to be announced
+    SERVICE_READY,
+    SERVICE_FAILED,
+} service_state_t;
+
+typedef struct
+{
+    const char *name;
+    const char *path;
+    const char *announces; // the IPC server whose creation means the service is ready, or NULL
+    const char **depends;
+    size_t n_depends;
+
+    service_state_t state;
+    pid_t pid;
+    u64 start_ns, ready_ns; // since init started
+} service_t;
+
+static service_t *services;
+static size_t n_services;
+static u64 init_start_ns;
+static pthread_mutex_t services_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t services_changed = PTHREAD_COND_INITIALIZER;
+
+static u64 clock_ns(void)
+{
+    struct timespec ts;
+    syscall_clock_gettimeofday(&ts);
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u64 now_ns(void)
+{
+    return clock_ns() - init_start_ns;
+}
+
+static service_t *service_find(const char *name)
+{
+    for (size_t i = 0; i < n_services; i++)
+        if (strcmp(services[i].name, name) == 0)
+            return &services[i];
+    return NULL;
+}
+
+static bool services_parse(const config_t *config)
+{
+    const char **entries = config_get_all(config, "service", &n_services);
+    if (!entries)
+        return true;
+
+    services = calloc(n_services, sizeof(service_t));
+    for (size_t i = 0; i < n_services; i++)
+    {
+        // format: [<Name>] <Path>, the name defaults to the file name of the executable
+        service_t *service = &services[i];
+        char *saveptr;
+        char *first = strtok_r(strdup(entries[i]), " ", &saveptr);
+        char *second = strtok_r(NULL, " ", &saveptr);
+        if (!first)
+            return false;
+
+        service->path = second ? second : first;
+        service->name = second ? first : (strrchr(first, '/') ? strrchr(first, '/') + 1 : first);
+
+        char key[128];
+        snprintf(key, sizeof(key), "%s.announces", service->name);
+        service->announces = config_get(config, key);
+
+        // each line may list several dependencies
+        size_t n_lines;
+        snprintf(key, sizeof(key), "%s.depends", service->name);
+        const char **lines = config_get_all(config, key, &n_lines);
+        for (size_t j = 0; j < n_lines; j++)
+        {
+            for (char *dep = strtok_r(strdup(lines[j]), " ", &saveptr); dep; dep = strtok_r(NULL, " ", &saveptr))
+            {
+                service->depends = realloc(service->depends, (service->n_depends + 1) * sizeof(char *));
+                service->depends[service->n_depends++] = dep;
+            }
+        }
+        free(lines);
+    }
+
+    free(entries);
+    return true;
+}
+
+// SERVICE_READY if all of them are ready, SERVICE_FAILED if any of them failed or doesn't exist
+static service_state_t service_dependencies_state(const service_t *service)
+{
+    service_state_t state = SERVICE_READY;
+    for (size_t i = 0; i < service->n_depends; i++)
+    {
+        const service_t *dep = service_find(service->depends[i]);
+        if (!dep || dep->state == SERVICE_FAILED)
+            return SERVICE_FAILED;
+        if (dep->state != SERVICE_READY)
+            state = SERVICE_WAITING;
+    }
+
+    return state;
+}
+
+static void *service_wait_ready(void *arg)
+{
+    service_t *service = arg;
+    const long ret = syscall_ipc_wait(service->announces);
+
+    pthread_mutex_lock(&services_lock);
+    if (service->state != SERVICE_STARTING)
+    {
+        // it has exited before announcing its server, see services_handle_exit()
+        pthread_mutex_unlock(&services_lock);
+        return NULL;
+    }
+
+    service->state = ret == 0 ? SERVICE_READY : SERVICE_FAILED;
+    service->ready_ns = now_ns();
+    if (ret == 0)
+        printf("init: [%6llu ms] %s is ready\n", service->ready_ns / 1000000, service->name);
+    pthread_cond_broadcast(&services_changed);
+    pthread_mutex_unlock(&services_lock);
+    return NULL;
+}
+
+static void service_start(service_t *service)
+{
+    const char *argv[] = { service->path, NULL };
+    service->start_ns = now_ns();
+    service->pid = syscall_spawnat(FD_CWD, service->path, argv, (const char *const *) environ, NULL);
+    if (service->pid <= 0)
+    {
+        fprintf(stderr, "init: failed to start service %s (%s)\n", service->name, service->path);
+        service->state = SERVICE_FAILED;
+        return;
+    }
+
+    printf("init: [%6llu ms] started %s, pid %d\n", service->start_ns / 1000000, service->name, service->pid);
+    if (!service->announces)
+    {
+        service->state = SERVICE_READY;
+        service->ready_ns = service->start_ns;
+        return;
+    }
+
+    service->state = SERVICE_STARTING;
+    pthread_t thread;
+    pthread_create(&thread, NULL, service_wait_ready, service);
+    pthread_detach(thread);
+}
+
+// start the services whose dependencies are ready, and give up on those whose dependencies have failed
+static bool services_start_ready_locked(void)
+{
+    bool progress = false;
+    for (size_t i = 0; i < n_services; i++)
+    {
+        service_t *service = &services[i];
+        if (service->state != SERVICE_WAITING)
+            continue;
+
+        switch (service_dependencies_state(service))
+        {
+            case SERVICE_READY: service_start(service); progress = true; break;
+            case SERVICE_FAILED:
+                fprintf(stderr, "init: not starting %s, a service it depends on has failed or doesn't exist\n", service->name);
+                service->state = SERVICE_FAILED;
+                progress = true;
+                break;
+            default: break;
+        }
+    }
+
+    return progress;
+}
+
+static void *services_manager(void *arg)
+{
+    MOS_UNUSED(arg);
+    pthread_mutex_lock(&services_lock);
+    while (true)
+    {
+        const bool progress = services_start_ready_locked();
+
+        bool waiting = false, starting = false;
+        for (size_t i = 0; i < n_services; i++)
+        {
+            waiting |= services[i].state == SERVICE_WAITING;
+            starting |= services[i].state == SERVICE_STARTING;
+        }
+
+        if (!waiting && !starting)
+            break;
+
+        if (!progress && !starting)
+        {
+            // nothing is going to become ready, the rest depend on each other
+            for (size_t i = 0; i < n_services; i++)
+            {
+                if (services[i].state != SERVICE_WAITING)
+                    continue;
+                fprintf(stderr, "init: not starting %s, its dependencies form a cycle\n", services[i].name);
+                services[i].state = SERVICE_FAILED;
+            }
+            continue;
+        }
+
+        if (!progress)
+            pthread_cond_wait(&services_changed, &services_lock);
+    }
+
+    puts("init: services:");
+    for (size_t i = 0; i < n_services; i++)
+    {
+        const service_t *service = &services[i];
+        if (service->state == SERVICE_FAILED)
+            printf("  %-24s failed\n", service->name);
+        else
+            printf("  %-24s pid %-4d started %6llu ms, ready %6llu ms\n", service->name, service->pid, service->start_ns / 1000000,
+                   service->ready_ns / 1000000);
+    }
+    pthread_mutex_unlock(&services_lock);
+    return NULL;
+}
+
+void services_handle_exit(pid_t pid)
+{
+    pthread_mutex_lock(&services_lock);
+    for (size_t i = 0; i < n_services; i++)
+    {
+        service_t *service = &services[i];
+        if (service->pid != pid || service->state != SERVICE_STARTING)
+            continue;
+
+        // its waiter stays blocked until the server appears, if ever, and then finds the service already failed
+        fprintf(stderr, "init: [%6llu ms] %s exited before it was ready\n", now_ns() / 1000000, service->name);
+        service->state = SERVICE_FAILED;
+        pthread_cond_broadcast(&services_changed);
+        break;
+    }
+    pthread_mutex_unlock(&services_lock);
+}
+
+bool services_start(const config_t *config)
+{
+    init_start_ns = clock_ns();
+
+    if (!services_parse(config))
+        return false;
+
+    if (n_services == 0)
+        return true;
+
+    // the services that don't depend on anything are started right away, the manager takes care of the rest
+    pthread_mutex_lock(&services_lock);
+    services_start_ready_locked();
+    pthread_mutex_unlock(&services_lock);
+
+    pthread_t manager;
+    if (pthread_create(&manager, NULL, services_manager, NULL) != 0)
+        return false;
+    pthread_detach(manager);
+    return true;
+}
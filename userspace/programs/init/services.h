@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <libconfig/libconfig.h>
+#include <mos/types.h>
+
+/**
+ * @brief Start the services in the configuration, each once the services it depends on are ready.
+ *
+ * @details Services that don't depend on each other are started together, the ones that are waiting for their
+ *          dependencies are started in the background, so this returns without waiting for any of them.
+ *
+ * @return false if the configuration is invalid
+ */
+bool services_start(const config_t *config);
+
+/**
+ * @brief Tell the services that a child of init has exited.
+ *
+ * @details A service that exits before it becomes ready has failed, the services depending on it are not started.
+ */
+void services_handle_exit(pid_t pid);
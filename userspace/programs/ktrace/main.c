@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// control the kernel trace buffers, and export them as Chrome trace JSON (which Perfetto also reads)
+
+#include <fcntl.h>
+#include <mos/misc/trace_types.h>
+#include <mos/misc/vdso_types.h>
+#include <mos/mos_global.h>
+#include <mos/syscall/table.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TRACE_SYSFS_DIR "/sys/trace"
+#define MAX_NAMES       1024
+
+static const char *const event_names[_TRACE_EVENT_MAX] = {
+    [TRACE_CONTEXT_SWITCH] = "context_switch", //
+    [TRACE_SYSCALL_ENTER] = "syscall_enter",   //
+    [TRACE_SYSCALL_EXIT] = "syscall_exit",     //
+    [TRACE_PAGE_FAULT] = "page_fault",         //
+    [TRACE_IPC_SEND] = "ipc_send",             //
+    [TRACE_IPC_RECV] = "ipc_recv",             //
+    [TRACE_SLAB_ALLOC] = "slab_alloc",         //
+    [TRACE_SCOPE] = "scope",                   //
+};
+
+static char *scope_names[MAX_NAMES];
+static const vdso_time_data_t *vdso_time;
+static u64 first_ns;
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s enable <event>... | all | none\n", program);
+    fprintf(stderr, "       %s export [output.json]\n", program);
+    fprintf(stderr, "  events: see %s/events\n", TRACE_SYSFS_DIR);
+}
+
+static int do_enable(int argc, char **argv)
+{
+    FILE *f = fopen(TRACE_SYSFS_DIR "/enable", "w");
+    if (!f)
+    {
+        fprintf(stderr, "failed to open " TRACE_SYSFS_DIR "/enable\n");
+        return 1;
+    }
+
+    for (int i = 0; i < argc; i++)
+        fprintf(f, "%s ", argv[i]);
+    const bool ok = fflush(f) == 0;
+    fclose(f);
+
+    if (!ok)
+        fprintf(stderr, "failed to enable the events\n");
+    return ok ? 0 : 1;
+}
+
+static void load_scope_names(void)
+{
+    FILE *f = fopen(TRACE_SYSFS_DIR "/names", "r");
+    if (!f)
+        return;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        char *name;
+        const unsigned long id = strtoul(line, &name, 10);
+        if (id == 0 || id >= MAX_NAMES || *name != ' ')
+            continue;
+
+        name++;
+        name[strcspn(name, "\n")] = '\0';
+        scope_names[id] = strdup(name);
+    }
+    fclose(f);
+}
+
+// microseconds, relative to the first record
+static double to_us(u64 counter)
+{
+    return (double) (vdso_counter_to_ns(vdso_time, counter) - first_ns) / 1000.0;
+}
+
+/**
+ * @brief Copy the records of a CPU that haven't been overwritten, oldest first
+ *
+ * @param dropped Receives the number of records that were overwritten before they could be copied
+ * @return false if the CPU has no buffer
+ */
+static bool read_buffer(u32 cpu, trace_record_t **records_out, size_t *count, size_t *dropped)
+{
+    char path[64];
+    snprintf(path, sizeof(path), TRACE_SYSFS_DIR "/cpu%u", cpu);
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    const trace_buffer_header_t *header = mmap(NULL, MOS_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED || header->magic != TRACE_BUFFER_MAGIC || header->record_size != sizeof(trace_record_t))
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t nrecords = header->nrecords;
+    const size_t size = MOS_PAGE_SIZE + nrecords * sizeof(trace_record_t);
+    munmap((void *) header, MOS_PAGE_SIZE);
+    header = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED)
+        return false;
+
+    const trace_record_t *ring = (const trace_record_t *) ((const char *) header + MOS_PAGE_SIZE);
+    const u64 head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+    const u64 first = head > nrecords ? head - nrecords : 0;
+
+    trace_record_t *records = malloc((head - first + 1) * sizeof(trace_record_t));
+    for (u64 i = first; i < head; i++)
+        records[i - first] = ring[i % nrecords];
+
+    // the kernel kept writing while we were copying, drop the records it may have overwritten; it writes
+    // the slot of new_head before it moves the head on, so the record that used that slot may be half gone too
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const u64 new_head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    const u64 overwritten = new_head >= nrecords ? new_head - nrecords + 1 : 0;
+    size_t skip = 0;
+    if (overwritten > first)
+        skip = overwritten - first > head - first ? head - first : overwritten - first;
+
+    memmove(records, records + skip, (head - first - skip) * sizeof(trace_record_t));
+    munmap((void *) header, size);
+
+    *records_out = records;
+    *count = head - first - skip;
+    *dropped = first + skip;
+    return true;
+}
+
+static const char *syscall_name(u64 number)
+{
+    if (number < MOS_ARRAY_SIZE(syscall_names) && syscall_names[number])
+        return syscall_names[number];
+    return "unknown";
+}
+
+// every event is put in one process, so that a syscall that blocks and returns on another CPU is still one slice
+static void export_record(FILE *out, u32 cpu, const trace_record_t *r, bool *first_event)
+{
+    fprintf(out, "%s\n", *first_event ? "" : ",");
+    *first_event = false;
+
+    const double ts = to_us(r->timestamp);
+    fprintf(out, "{\"pid\":0,\"tid\":%u,", r->tid);
+    switch ((trace_event_t) r->event)
+    {
+        case TRACE_SYSCALL_ENTER:
+            fprintf(out, "\"ph\":\"B\",\"ts\":%.3f,\"name\":\"%s\",\"cat\":\"syscall\",\"args\":{\"arg1\":%llu", ts, syscall_name(r->args[0]),
+                    (unsigned long long) r->args[1]);
+            break;
+        case TRACE_SYSCALL_EXIT:
+            fprintf(out, "\"ph\":\"E\",\"ts\":%.3f,\"name\":\"%s\",\"cat\":\"syscall\",\"args\":{\"ret\":%lld", ts, syscall_name(r->args[0]), (long long) r->args[1]);
+            break;
+        case TRACE_SCOPE:
+        {
+            const char *name = r->name < MAX_NAMES && scope_names[r->name] ? scope_names[r->name] : "scope";
+            const double start = to_us(r->args[0]);
+            fprintf(out, "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"name\":\"%s\",\"cat\":\"scope\",\"args\":{\"arg\":%llu", start, ts - start, name,
+                    (unsigned long long) r->args[1]);
+            break;
+        }
+        case TRACE_CONTEXT_SWITCH:
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"name\":\"switch to %llu\",\"cat\":\"sched\",\"args\":{\"prev_state\":%u", ts,
+                    (unsigned long long) r->args[0], r->flags);
+            break;
+        default:
+        {
+            const char *name = r->event < _TRACE_EVENT_MAX && event_names[r->event] ? event_names[r->event] : "unknown";
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"name\":\"%s\",\"cat\":\"kernel\",\"args\":{\"arg0\":\"0x%llx\",\"arg1\":\"0x%llx\",\"flags\":%u", ts, name,
+                    (unsigned long long) r->args[0], (unsigned long long) r->args[1], r->flags);
+            break;
+        }
+    }
+    fprintf(out, ",\"cpu\":%u}}", cpu);
+}
+
+static int do_export(const char *path)
+{
+    vdso_time = &((const vdso_data_t *) MOS_VDSO_DATA_VADDR)->time;
+    if (!(vdso_time->flags & VDSO_TIME_VALID))
+    {
+        fprintf(stderr, "the kernel hasn't published the time parameters\n");
+        return 1;
+    }
+
+    FILE *out = path ? fopen(path, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "failed to open '%s'\n", path);
+        return 1;
+    }
+
+    load_scope_names();
+
+    trace_record_t *records[MOS_MAX_CPU_COUNT] = { 0 };
+    size_t counts[MOS_MAX_CPU_COUNT] = { 0 };
+    size_t dropped = 0;
+    u32 ncpus = 0;
+    first_ns = UINT64_MAX;
+    for (; ncpus < MOS_MAX_CPU_COUNT; ncpus++)
+    {
+        size_t cpu_dropped = 0;
+        if (!read_buffer(ncpus, &records[ncpus], &counts[ncpus], &cpu_dropped))
+            break;
+        dropped += cpu_dropped;
+        if (counts[ncpus] && vdso_counter_to_ns(vdso_time, records[ncpus][0].timestamp) < first_ns)
+            first_ns = vdso_counter_to_ns(vdso_time, records[ncpus][0].timestamp);
+    }
+
+    if (ncpus == 0)
+    {
+        fprintf(stderr, "no trace buffers in " TRACE_SYSFS_DIR "\n");
+        return 1;
+    }
+
+    // a scope is recorded when it ends, it may have started before the oldest record
+    for (u32 cpu = 0; cpu < ncpus; cpu++)
+        for (size_t i = 0; i < counts[cpu]; i++)
+            if (records[cpu][i].event == TRACE_SCOPE && vdso_counter_to_ns(vdso_time, records[cpu][i].args[0]) < first_ns)
+                first_ns = vdso_counter_to_ns(vdso_time, records[cpu][i].args[0]);
+
+    size_t total = 0;
+    bool first_event = false; // after the metadata
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    fprintf(out, "\n{\"ph\":\"M\",\"pid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"kernel\"}}");
+    for (u32 cpu = 0; cpu < ncpus; cpu++)
+    {
+        for (size_t i = 0; i < counts[cpu]; i++)
+            export_record(out, cpu, &records[cpu][i], &first_event);
+        total += counts[cpu];
+        free(records[cpu]);
+    }
+    fprintf(out, "\n]}\n");
+
+    if (out != stdout)
+        fclose(out);
+    fprintf(stderr, "exported %zu records from %u CPUs, %zu dropped\n", total, ncpus, dropped);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "enable") == 0)
+        return do_enable(argc - 2, argv + 2);
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "export") == 0)
+        return do_export(argc == 3 ? argv[2] : NULL);
+
+    usage(argv[0]);
+    return 1;
+}
@@ -8,7 +8,8 @@
 #include <mos_stdio.h>
 #include <sys/stat.h>
 
-#define BUFSIZE 4096
+#define BUFSIZE        4096
+#define DIRENT_BUFSIZE 16384 // large enough to list most directories in a single call
 
 static const char *type_to_string[] = {
     [FILE_TYPE_DIRECTORY] = "directory", [FILE_TYPE_REGULAR] = "regular", [FILE_TYPE_CHAR_DEVICE] = "chardev", [FILE_TYPE_BLOCK_DEVICE] = "blockdev",
@@ -37,10 +38,10 @@ int main(int argc, char *argv[])
     printf("Directory listing of '%s':\n\n", path);
     printf("%-10s %-15s %-5s %-5s %-8s %-10s %-10s\n", "Inode", "Permission", "UID", "GID", "Size", "Type", "Name");
 
-    char buffer[BUFSIZE];
+    static char buffer[DIRENT_BUFSIZE];
     do
     {
-        size_t sz = syscall_vfs_list_dir(dirfd, buffer, BUFSIZE);
+        size_t sz = syscall_vfs_list_dir(dirfd, buffer, DIRENT_BUFSIZE);
         if (sz == 0)
             break;
 
@@ -8,7 +8,8 @@
 #include <mos_stdlib.h>
 #include <mos_string.h>
 
-#define dirent_next(d) ((struct dirent *) ((char *) d + d->d_reclen))
+#define dirent_next(d)  ((struct dirent *) ((char *) d + d->d_reclen))
+#define DIRENT_BUFSIZE 8192 // one buffer per level of recursion
 static size_t depth = 1;
 
 static void print_entry(const struct dirent *dirent)
@@ -27,10 +28,10 @@ static void do_tree(void)
         return;
     }
 
-    char buffer[1024];
+    char *buffer = malloc(DIRENT_BUFSIZE);
     do
     {
-        size_t sz = syscall_vfs_list_dir(dirfd, buffer, sizeof(buffer));
+        size_t sz = syscall_vfs_list_dir(dirfd, buffer, DIRENT_BUFSIZE);
         if (sz == 0)
             break;
 
@@ -56,6 +57,7 @@ static void do_tree(void)
 
     } while (true);
 
+    free(buffer);
     syscall_io_close(dirfd);
 }
 
@@ -16,6 +16,7 @@
 
 RPC_CLIENT_DEFINE_SIMPLECALL(blockdev_manager, BLOCKDEV_MANAGER_RPC_X)
 RPC_CLIENT_DEFINE_SIMPLECALL(blockdev, BLOCKDEV_SERVER_RPC_X)
+RPC_CLIENT_DEFINE_SIMPLECALL(blockdev, BLOCKDEV_SERVER_STATS_RPC_X)
 
 const std::optional<std::string> query_server_name(const char *device_name)
 {
@@ -103,15 +104,59 @@ void do_peek_blocks(const std::string &server_name, off_t start, size_t n_blocks
     rpc_client_destroy(stub);
 }
 
+void do_print_stats(const std::string &server_name)
+{
+    rpc_server_stub_t *stub = rpc_client_create(server_name.c_str());
+    if (!stub)
+    {
+        std::cerr << "Failed to connect to blockdev" << std::endl;
+        return;
+    }
+
+    mos_rpc_blockdev_stats_request stats_req{};
+    mos_rpc_blockdev_stats_response stats_resp;
+
+    const auto result = blockdev_get_stats(stub, &stats_req, &stats_resp);
+    if (result != RPC_RESULT_OK)
+    {
+        std::cerr << "Failed to get stats: error " << result << " (not every driver keeps them)" << std::endl;
+        rpc_client_destroy(stub);
+        return;
+    }
+
+    if (!stats_resp.result.success)
+    {
+        if (stats_resp.result.error)
+            std::cerr << "Failed to get stats: " << stats_resp.result.error << std::endl;
+        else
+            std::cerr << "Failed to get stats, unknown error." << std::endl;
+        pb_release(mos_rpc_blockdev_stats_response_fields, &stats_resp);
+        rpc_client_destroy(stub);
+        return;
+    }
+
+    std::cout << "Queue size:       " << stats_resp.queue_size << std::endl;
+    std::cout << "In flight:        " << stats_resp.inflight << " (at most " << stats_resp.max_inflight << ")" << std::endl;
+    std::cout << "Requests:         " << stats_resp.requests << ", in " << stats_resp.batches << " batches" << std::endl;
+    if (stats_resp.requests)
+        std::cout << "Average latency:  " << stats_resp.total_latency_us / stats_resp.requests << " us" << std::endl;
+    std::cout << "Maximum latency:  " << stats_resp.max_latency_us << " us" << std::endl;
+
+    pb_release(mos_rpc_blockdev_stats_response_fields, &stats_resp);
+    rpc_client_destroy(stub);
+}
+
 int main(int argc, char **argv)
 {
     MOS_UNUSED(argc);
     MOS_UNUSED(argv);
 
-    if (argc != 4)
+    const bool stats = argc == 3 && std::string(argv[2]) == "--stats";
+    if (argc != 4 && !stats)
     {
         std::cout << "Peek Blocks" << std::endl;
         std::cerr << "Usage: " << argv[0] << " <blockdev> <start> <count>" << std::endl;
+        std::cerr << "       " << argv[0] << " <blockdev> --stats" << std::endl;
         std::cerr << "Example: " << argv[0] << " ramdisk 0 1" << std::endl;
         return 1;
     }
@@ -123,6 +168,12 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (stats)
+    {
+        do_print_stats(*server_name);
+        return 0;
+    }
+
     const auto start = std::stoll(argv[2]);
     const auto count = std::stoll(argv[3]);
     do_peek_blocks(*server_name, start, count);
@@ -2,10 +2,66 @@
 
 #pragma once
 
+#include <librpc/macro_magic.h>
+#include <librpc/rpc.h>
+#include <mos/types.h>
+
+typedef enum
+{
+    SYSLOG_DEBUG,
+    SYSLOG_INFO,
+    SYSLOG_NOTICE,
+    SYSLOG_WARNING,
+    SYSLOG_ERROR,
+    SYSLOG_CRITICAL,
+} syslog_level_t;
+
+// a record sent by a client in a batch, followed by the category and the message, neither of them NUL-terminated
+typedef struct
+{
+    u64 timestamp; // nanoseconds since the epoch, when the message was logged; syslogd caps it at the time it receives the batch
+    u16 size;      // of the whole record, a multiple of 8
+    u8 level;      // syslog_level_t
+    u8 category_len;
+    u16 message_len;
+    u16 reserved;
+} syslog_record_t;
+
+// a record returned by the tail call, followed by the client's name, the category and the message
+typedef struct
+{
+    u64 seq; // in the order syslogd received the records
+    u64 timestamp;
+    u16 size;
+    u8 level;
+    u8 client_len;
+    u8 category_len;
+    u8 reserved;
+    u16 message_len;
+} syslog_tail_record_t;
+
+// the result of the tail call, followed by the records
+typedef struct
+{
+    u64 next;    // the cursor for the next call
+    u64 dropped; // records that were overwritten before they could be returned
+} syslog_tail_header_t;
+
+#define SYSLOG_RECORD_MAX_SIZE  1024 // category and message are truncated to fit
+#define SYSLOG_CLIENT_RING_SIZE 256  // records syslogd keeps for subscribers, per client; older ones are reported as dropped
+
+// log and logc are unbuffered, and may be used before a client has anything else set up
+// subscribe sets the filter of the connection for tail, an empty string matches any client or category
+// tail blocks until there are records at or after the cursor that match the filter
 #define SYSLOGD_RPC_X(ARGS, PB, arg)                                                                                                                                     \
     ARGS(arg, 0, set_name, SET_NAME, "s", ARG(STRING, name))                                                                                                             \
     ARGS(arg, 1, log, LOG, "s", ARG(STRING, message))                                                                                                                    \
-    ARGS(arg, 2, logc, LOGC, "ss", ARG(STRING, category), ARG(STRING, message))
+    ARGS(arg, 2, logc, LOGC, "ss", ARG(STRING, category), ARG(STRING, message))                                                                                          \
+    ARGS(arg, 3, log_batch, LOG_BATCH, "b", ARG(BUFFER, records))                                                                                                        \
+    ARGS(arg, 4, subscribe, SUBSCRIBE, "iss", ARG(INT32, min_level), ARG(STRING, client), ARG(STRING, category))                                                         \
+    ARGS(arg, 5, tail, TAIL, "l", ARG(INT64, cursor))
+
+RPC_DEFINE_ENUMS(syslogd, SYSLOGD, SYSLOGD_RPC_X)
 
 #define SYSLOGD_SERVICE_NAME "syslogd"
 
@@ -29,4 +85,155 @@ should_inline void syslogd_logf(rpc_server_stub_t *logger, const char *fmt, ...)
     syslogd_log(logger, buffer);
     va_end(args);
 }
+
+#ifndef __MOS_MINIMAL_LIBC__
+#include <mos/misc/vdso_types.h>
+#include <mos/syscall/usermode.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYSLOG_BATCH_SIZE        4096
+#define SYSLOG_FLUSH_INTERVAL_NS 100000000ULL // a batch isn't held back for longer than this, once another message is logged
+
+/**
+ * @brief A buffered connection to syslogd
+ *
+ * @details Messages are appended to a local buffer, which is sent to syslogd in one call when it's full, when a
+ * message of SYSLOG_WARNING or above is logged, when the oldest buffered message is older than
+ * SYSLOG_FLUSH_INTERVAL_NS, and by syslog_flush(). A client that goes idle should call syslog_flush().
+ */
+typedef struct
+{
+    rpc_server_stub_t *server;
+    pthread_mutex_t lock;
+    size_t used;
+    u64 oldest; // timestamp of the first buffered record
+    char buffer[SYSLOG_BATCH_SIZE] __aligned(sizeof(u64));
+} syslog_client_t;
+
+should_inline u64 syslog_now_ns(void)
+{
+    u64 ns;
+    if (likely(vdso_get_time_ns((const vdso_data_t *) MOS_VDSO_DATA_VADDR, &ns)))
+        return ns;
+
+    struct timespec ts;
+    syscall_clock_gettimeofday(&ts);
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+should_inline syslog_client_t *syslog_client_create(const char *name)
+{
+    rpc_server_stub_t *server = rpc_client_create(SYSLOGD_SERVICE_NAME);
+    if (!server)
+        return NULL;
+
+    syslog_client_t *client = (syslog_client_t *) malloc(sizeof(syslog_client_t));
+    client->server = server;
+    pthread_mutex_init(&client->lock, NULL);
+    client->used = 0;
+    client->oldest = 0;
+    syslogd_set_name(server, name);
+    return client;
+}
+
+// the caller holds the lock
+should_inline void syslog_client_send(syslog_client_t *client)
+{
+    if (client->used == 0)
+        return;
+
+    const rpc_buffer_t records = { client->buffer, client->used };
+    syslogd_log_batch(client->server, records);
+    client->used = 0;
+}
+
+should_inline void syslog_flush(syslog_client_t *client)
+{
+    pthread_mutex_lock(&client->lock);
+    syslog_client_send(client);
+    pthread_mutex_unlock(&client->lock);
+}
+
+should_inline void syslog_client_destroy(syslog_client_t *client)
+{
+    syslog_flush(client);
+    rpc_client_destroy(client->server);
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+}
+
+should_inline void syslog_write(syslog_client_t *client, syslog_level_t level, const char *category, const char *message)
+{
+    const u64 now = syslog_now_ns();
+    size_t category_len = category ? strlen(category) : 0;
+    category_len = category_len > 255 ? 255 : category_len;
+    size_t message_len = strlen(message);
+    const size_t message_max = SYSLOG_RECORD_MAX_SIZE - sizeof(syslog_record_t) - category_len;
+    message_len = message_len > message_max ? message_max : message_len;
+    const size_t size = ALIGN_UP(sizeof(syslog_record_t) + category_len + message_len, sizeof(u64));
+
+    pthread_mutex_lock(&client->lock);
+    if (client->used + size > SYSLOG_BATCH_SIZE)
+        syslog_client_send(client);
+
+    if (client->used == 0)
+        client->oldest = now;
+
+    syslog_record_t *record = (syslog_record_t *) &client->buffer[client->used];
+    record->timestamp = now;
+    record->size = size;
+    record->level = level;
+    record->category_len = category_len;
+    record->message_len = message_len;
+    record->reserved = 0;
+    if (category_len)
+        memcpy(record + 1, category, category_len);
+    memcpy((char *) (record + 1) + category_len, message, message_len);
+    client->used += size;
+
+    if (level >= SYSLOG_WARNING || now - client->oldest >= SYSLOG_FLUSH_INTERVAL_NS)
+        syslog_client_send(client);
+    pthread_mutex_unlock(&client->lock);
+}
+
+__printf(4, 5) should_inline void syslog_printf(syslog_client_t *client, syslog_level_t level, const char *category, const char *fmt, ...)
+{
+    char message[SYSLOG_RECORD_MAX_SIZE];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    syslog_write(client, level, category, message);
+}
+
+/**
+ * @brief Wait for records at or after *cursor that match the filter set by syslogd_subscribe
+ *
+ * @param server A connection that is only used for tailing, the call blocks it until there are matching records
+ * @param cursor The sequence number to start at (0 for the oldest record syslogd still has), updated for the next call
+ * @param size Receives the size of the returned data
+ * @return A syslog_tail_header_t followed by the records, to be freed by the caller, or NULL on failure
+ */
+should_inline syslog_tail_header_t *syslog_tail(rpc_server_stub_t *server, u64 *cursor, size_t *size)
+{
+    rpc_call_t *call = rpc_call_create(server, SYSLOGD_TAIL);
+    rpc_call_arg_s64(call, (s64) *cursor);
+
+    void *result = NULL;
+    const rpc_result_code_t code = rpc_call_exec(call, &result, size);
+    rpc_call_destroy(call);
+    if (code != RPC_RESULT_OK || !result || *size < sizeof(syslog_tail_header_t))
+    {
+        free(result);
+        return NULL;
+    }
+
+    syslog_tail_header_t *header = (syslog_tail_header_t *) result;
+    *cursor = header->next;
+    return header;
+}
+#endif
 #endif
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// the log files are reused in turn, since there's no way to rename or remove a file
+
+#include "logfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char *logfile_path;
+static size_t logfile_max_size, logfile_max_files;
+static FILE *logfile;
+static size_t logfile_size;
+static size_t logfile_index;
+
+static bool logfile_switch(size_t index)
+{
+    if (logfile)
+        fclose(logfile);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s.%zu", logfile_path, index);
+    logfile = fopen(path, "w");
+    logfile_size = 0;
+    logfile_index = index;
+    if (!logfile)
+    {
+        fprintf(stderr, "syslogd: failed to open '%s'\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool logfile_open(const char *path, size_t max_size, size_t max_files)
+{
+    logfile_path = strdup(path);
+    logfile_max_size = max_size;
+    logfile_max_files = max_files;
+    return logfile_switch(0);
+}
+
+void logfile_printf(const char *fmt, ...)
+{
+    if (!logfile)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    const int written = vfprintf(logfile, fmt, args);
+    va_end(args);
+
+    if (written > 0)
+        logfile_size += written;
+
+    if (logfile_size >= logfile_max_size)
+        logfile_switch((logfile_index + 1) % logfile_max_files);
+}
+
+void logfile_flush(void)
+{
+    if (logfile)
+        fflush(logfile);
+}
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <mos/types.h>
+#include <stdarg.h>
+
+/**
+ * @brief Start writing to <path>.0, switching to the next of <path>.0 ... <path>.<max_files - 1> (and truncating it)
+ * whenever the current one has grown to max_size bytes.
+ *
+ * @return false if the first file can't be created, nothing will be written then
+ */
+bool logfile_open(const char *path, size_t max_size, size_t max_files);
+
+__printf(1, 2) void logfile_printf(const char *fmt, ...);
+
+/**
+ * @brief Write out what has been buffered, after each batch of records.
+ */
+void logfile_flush(void);
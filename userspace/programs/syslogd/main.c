@@ -1,68 +1,407 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include "logfile.h"
 #include "mos-syslog.h"
 
 #include <librpc/internal.h>
 #include <librpc/macro_magic.h>
 #include <librpc/rpc.h>
 #include <librpc/rpc_server.h>
+#include <mos/lib/structures/list.h>
+#include <mos/syscall/usermode.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#define CLIENT_RING_SIZE      SYSLOG_CLIENT_RING_SIZE
+#define MAX_RETIRED_CLIENTS   16  // disconnected clients whose records are still kept
+#define TAIL_BATCH            64  // records returned by a tail call at most
+#define DEFAULT_LOG_PATH      "/tmp/syslog"
+#define DEFAULT_MAX_FILE_SIZE (256 * 1024)
+#define DEFAULT_MAX_FILES     4
+
+typedef struct
+{
+    u64 seq;
+    u64 timestamp;
+    syslog_level_t level;
+    u16 category_len, message_len;
+    char text[]; // the category, followed by the message
+} entry_t;
+
+typedef struct
+{
+    as_linked_list; // in clients or retired_clients
+    char *name;
+    u64 last_timestamp; // the records of a client are stamped with a time that never goes backwards
+    entry_t *ring[CLIENT_RING_SIZE];
+    u64 n_records; // ever received, the newest record is at (n_records - 1) % CLIENT_RING_SIZE
+
+    // the subscription of this connection, for tail
+    syslog_level_t filter_level;
+    char *filter_client, *filter_category;
+} client_t;
+
 RPC_DECL_SERVER_PROTOTYPES(syslogd, SYSLOGD_RPC_X)
 
+static const char *const level_names[] = { "debug", "info", "notice", "warning", "error", "critical" };
+
+// protects the clients, their records and the log file, held while a batch is stored
+static pthread_mutex_t syslogd_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t records_added = PTHREAD_COND_INITIALIZER;
+static list_head clients = LIST_HEAD_INIT(clients);
+static list_head retired_clients = LIST_HEAD_INIT(retired_clients);
+static size_t n_retired_clients = 0;
+static u64 next_seq = 1;
+static bool has_logfile = false;
+
+static u64 syslogd_now_ns(void)
+{
+    struct timespec ts;
+    syscall_clock_gettimeofday(&ts);
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// index of the oldest record that is still in the ring
+static u64 client_first_kept(const client_t *client)
+{
+    return client->n_records > CLIENT_RING_SIZE ? client->n_records - CLIENT_RING_SIZE : 0;
+}
+
+static size_t client_name_len(const client_t *client)
+{
+    const size_t len = strlen(client->name);
+    return len > 255 ? 255 : len;
+}
+
+static void client_free(client_t *client)
+{
+    for (size_t i = 0; i < CLIENT_RING_SIZE; i++)
+        free(client->ring[i]);
+    free(client->name);
+    free(client->filter_client);
+    free(client->filter_category);
+    free(client);
+}
+
+// the caller holds syslogd_lock
+static void client_store(client_t *client, syslog_level_t level, u64 timestamp, const char *category, size_t category_len, const char *message, size_t message_len)
+{
+    entry_t *entry = malloc(sizeof(entry_t) + category_len + message_len);
+    entry->seq = next_seq++;
+    entry->timestamp = timestamp > client->last_timestamp ? timestamp : client->last_timestamp;
+    entry->level = level;
+    entry->category_len = category_len;
+    entry->message_len = message_len;
+    memcpy(entry->text, category, category_len);
+    memcpy(entry->text + category_len, message, message_len);
+    client->last_timestamp = entry->timestamp;
+
+    entry_t **slot = &client->ring[client->n_records++ % CLIENT_RING_SIZE];
+    free(*slot);
+    *slot = entry;
+
+    const u64 us = entry->timestamp / 1000;
+    const int clen = (int) category_len, mlen = (int) message_len;
+    logfile_printf("%llu.%06llu %-8s %s: %s%.*s%s%.*s\n", us / 1000000, us % 1000000, level_names[level], client->name, clen ? "[" : "", clen, category,
+                   clen ? "] " : "", mlen, message);
+
+    // the console only gets what needs attention, unless there's nowhere else to write to
+    if (level >= SYSLOG_WARNING || !has_logfile)
+        printf("[%s] %s%.*s%s%.*s\n", client->name, clen ? "[" : "", clen, category, clen ? "] " : "", mlen, message);
+}
+
 static void syslogd_on_connect(rpc_context_t *context)
 {
-    const char *name = "<unknown>";
-    rpc_context_set_data(context, strdup(name));
+    client_t *client = calloc(1, sizeof(client_t));
+    linked_list_init(list_node(client));
+    client->name = strdup("<unknown>");
+
+    pthread_mutex_lock(&syslogd_lock);
+    list_node_append(&clients, list_node(client));
+    pthread_mutex_unlock(&syslogd_lock);
+    rpc_context_set_data(context, client);
 }
 
 static void syslogd_on_disconnect(rpc_context_t *context)
 {
-    void *data = rpc_context_get_data(context);
-    if (data != NULL)
-        free(data); // client name
-    MOS_UNUSED(context);
+    client_t *client = rpc_context_get_data(context);
+    if (!client)
+        return;
+
+    // keep the last records of a client that has gone away, a subscriber may not have seen them yet
+    pthread_mutex_lock(&syslogd_lock);
+    list_remove(client);
+    if (client->n_records == 0)
+    {
+        client_free(client);
+    }
+    else
+    {
+        list_node_append(&retired_clients, list_node(client));
+        if (++n_retired_clients > MAX_RETIRED_CLIENTS)
+        {
+            client_free(list_entry(list_node_pop(&retired_clients), client_t));
+            n_retired_clients--;
+        }
+    }
+    pthread_mutex_unlock(&syslogd_lock);
 }
 
 static rpc_result_code_t syslogd_set_name(rpc_context_t *context, const char *name)
 {
-    MOS_UNUSED(context);
-
     if (name == NULL)
         return RPC_RESULT_INVALID_ARGUMENT;
 
-    printf("syslogd: setting name to '%s'\n", name);
-    void *old = rpc_context_set_data(context, strdup(name));
-    if (old != NULL)
-        free(old);
+    client_t *client = rpc_context_get_data(context);
+    pthread_mutex_lock(&syslogd_lock);
+    free(client->name);
+    client->name = strdup(name);
+    pthread_mutex_unlock(&syslogd_lock);
     return RPC_RESULT_OK;
 }
 
 static rpc_result_code_t syslogd_log(rpc_context_t *context, const char *message)
 {
-    MOS_UNUSED(context);
-    void *data = rpc_context_get_data(context);
-    printf("[%s] %s\n", (char *) data, message);
-    return RPC_RESULT_OK;
+    return syslogd_logc(context, "", message);
 }
 
 static rpc_result_code_t syslogd_logc(rpc_context_t *context, const char *category, const char *message)
 {
-    MOS_UNUSED(context);
-    void *data = rpc_context_get_data(context);
-    printf("[%s] [%s] %s\n", (char *) data, category, message);
+    if (!category || !message)
+        return RPC_RESULT_INVALID_ARGUMENT;
+
+    client_t *client = rpc_context_get_data(context);
+    pthread_mutex_lock(&syslogd_lock);
+    client_store(client, SYSLOG_INFO, syslogd_now_ns(), category, strlen(category), message, strlen(message));
+    logfile_flush();
+    pthread_mutex_unlock(&syslogd_lock);
+    pthread_cond_broadcast(&records_added);
+    return RPC_RESULT_OK;
+}
+
+static rpc_result_code_t syslogd_log_batch(rpc_context_t *context, rpc_buffer_t records)
+{
+    client_t *client = rpc_context_get_data(context);
+    rpc_result_code_t result = RPC_RESULT_OK;
+
+    // a record keeps the time the client logged it, which is when it happened, a batch may be sent much later; both come
+    // from the kernel clock, and a client can't put a record after the time it arrives, or before its earlier records
+    const u64 now = syslogd_now_ns();
+
+    pthread_mutex_lock(&syslogd_lock);
+    for (size_t offset = 0; offset < records.size;)
+    {
+        const syslog_record_t *record = (const syslog_record_t *) ((const char *) records.data + offset);
+        if (records.size - offset < sizeof(*record) || record->size < sizeof(*record) + record->category_len + record->message_len ||
+            record->size > records.size - offset || record->level > SYSLOG_CRITICAL)
+        {
+            result = RPC_RESULT_INVALID_ARGUMENT; // the records before this one are kept
+            break;
+        }
+
+        const char *category = (const char *) (record + 1);
+        const u64 timestamp = record->timestamp < now ? record->timestamp : now;
+        client_store(client, record->level, timestamp, category, record->category_len, category + record->category_len, record->message_len);
+        offset += record->size;
+    }
+    logfile_flush();
+    pthread_mutex_unlock(&syslogd_lock);
+
+    pthread_cond_broadcast(&records_added);
+    return result;
+}
+
+static rpc_result_code_t syslogd_subscribe(rpc_context_t *context, s32 min_level, const char *client_name, const char *category)
+{
+    if (!client_name || !category || min_level < SYSLOG_DEBUG || min_level > SYSLOG_CRITICAL)
+        return RPC_RESULT_INVALID_ARGUMENT;
+
+    client_t *client = rpc_context_get_data(context);
+    pthread_mutex_lock(&syslogd_lock);
+    free(client->filter_client);
+    free(client->filter_category);
+    client->filter_level = min_level;
+    client->filter_client = strlen(client_name) ? strdup(client_name) : NULL;
+    client->filter_category = strlen(category) ? strdup(category) : NULL;
+    pthread_mutex_unlock(&syslogd_lock);
+    return RPC_RESULT_OK;
+}
+
+static bool subscription_matches(const client_t *subscriber, const client_t *client, const entry_t *entry)
+{
+    if (entry->level < subscriber->filter_level)
+        return false;
+    if (subscriber->filter_client && strcmp(subscriber->filter_client, client->name) != 0)
+        return false;
+    if (subscriber->filter_category)
+    {
+        const size_t len = strlen(subscriber->filter_category);
+        if (len != entry->category_len || memcmp(subscriber->filter_category, entry->text, len) != 0)
+            return false;
+    }
+    return true;
+}
+
+typedef struct
+{
+    const client_t *client;
+    const entry_t *entry;
+} tail_match_t;
+
+static int tail_match_compare(const void *a, const void *b)
+{
+    const u64 x = ((const tail_match_t *) a)->entry->seq, y = ((const tail_match_t *) b)->entry->seq;
+    return (x > y) - (x < y);
+}
+
+// the caller holds syslogd_lock, runs the statements for every record that is still kept
+#define foreach_kept_record(client, entry, ...)                                                                                                                          \
+    do                                                                                                                                                                   \
+    {                                                                                                                                                                    \
+        list_head *const heads[] = { &clients, &retired_clients };                                                                                                       \
+        for (size_t h = 0; h < MOS_ARRAY_SIZE(heads); h++)                                                                                                               \
+        {                                                                                                                                                                \
+            list_foreach(client_t, client, *heads[h])                                                                                                                    \
+            {                                                                                                                                                            \
+                for (u64 i = client_first_kept(client); i < client->n_records; i++)                                                                                      \
+                {                                                                                                                                                        \
+                    const entry_t *entry = client->ring[i % CLIENT_RING_SIZE];                                                                                           \
+                    __VA_ARGS__                                                                                                                                          \
+                }                                                                                                                                                        \
+            }                                                                                                                                                            \
+        }                                                                                                                                                                \
+    } while (0)
+
+static rpc_result_code_t syslogd_tail(rpc_context_t *context, s64 cursor_arg)
+{
+    const client_t *subscriber = rpc_context_get_data(context);
+    u64 cursor = cursor_arg;
+    u64 dropped = 0;
+
+    size_t n_kept = 0;
+    tail_match_t *matches = NULL;
+    size_t n_matches = 0;
+
+    pthread_mutex_lock(&syslogd_lock);
+    if (cursor == 0)
+    {
+        // start at the oldest record that is still kept
+        cursor = next_seq;
+        foreach_kept_record(client, entry, cursor = entry->seq < cursor ? entry->seq : cursor;);
+    }
+
+    while (true)
+    {
+        n_kept = 0;
+        list_foreach(client_t, client, clients) n_kept += client->n_records - client_first_kept(client);
+        list_foreach(client_t, client, retired_clients) n_kept += client->n_records - client_first_kept(client);
+        matches = realloc(matches, sizeof(tail_match_t) * (n_kept + 1));
+
+        // the records between the cursor and next_seq that are no longer kept have been dropped
+        n_matches = 0;
+        u64 n_kept_after_cursor = 0;
+        foreach_kept_record(client, entry, {
+            if (entry->seq < cursor)
+                continue;
+            n_kept_after_cursor++;
+            if (subscription_matches(subscriber, client, entry))
+                matches[n_matches++] = (tail_match_t){ client, entry };
+        });
+
+        if (cursor < next_seq)
+            dropped += (next_seq - cursor) - n_kept_after_cursor;
+
+        if (n_matches > 0)
+            break;
+
+        cursor = next_seq; // nothing after the cursor matches, wait for more records
+        pthread_cond_wait(&records_added, &syslogd_lock);
+    }
+
+    qsort(matches, n_matches, sizeof(tail_match_t), tail_match_compare);
+    if (n_matches > TAIL_BATCH)
+    {
+        // the records after the last returned one will be looked at again, and so will the dropped ones among them
+        const u64 next = matches[TAIL_BATCH - 1].entry->seq + 1;
+        u64 n_kept_after_next = 0;
+        foreach_kept_record(client, entry, n_kept_after_next += entry->seq >= next;);
+        dropped -= (next_seq - next) - n_kept_after_next;
+        n_matches = TAIL_BATCH;
+    }
+
+    size_t size = sizeof(syslog_tail_header_t);
+    for (size_t i = 0; i < n_matches; i++)
+    {
+        const size_t client_len = client_name_len(matches[i].client);
+        size += ALIGN_UP(sizeof(syslog_tail_record_t) + client_len + matches[i].entry->category_len + matches[i].entry->message_len, sizeof(u64));
+    }
+
+    char *result = malloc(size);
+    syslog_tail_header_t *header = (syslog_tail_header_t *) result;
+    header->next = n_matches == TAIL_BATCH ? matches[TAIL_BATCH - 1].entry->seq + 1 : next_seq;
+    header->dropped = dropped;
+
+    size_t offset = sizeof(syslog_tail_header_t);
+    for (size_t i = 0; i < n_matches; i++)
+    {
+        const entry_t *entry = matches[i].entry;
+        const size_t client_len = client_name_len(matches[i].client);
+        const size_t text_len = entry->category_len + entry->message_len;
+
+        syslog_tail_record_t *record = (syslog_tail_record_t *) (result + offset);
+        record->seq = entry->seq;
+        record->timestamp = entry->timestamp;
+        record->size = ALIGN_UP(sizeof(syslog_tail_record_t) + client_len + text_len, sizeof(u64));
+        record->level = entry->level;
+        record->client_len = client_len;
+        record->category_len = entry->category_len;
+        record->reserved = 0;
+        record->message_len = entry->message_len;
+        memcpy(record + 1, matches[i].client->name, client_len);
+        memcpy((char *) (record + 1) + client_len, entry->text, text_len);
+        offset += record->size;
+    }
+    pthread_mutex_unlock(&syslogd_lock);
+
+    rpc_write_result(context, result, size);
+    free(result);
+    free(matches);
     return RPC_RESULT_OK;
 }
 
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-f path] [-s max-file-size] [-n max-files]\n", program);
+    fprintf(stderr, "  the log is written to <path>.0 ... <path>.<max-files - 1> in turn, default %s, %d bytes, %d files\n", DEFAULT_LOG_PATH, DEFAULT_MAX_FILE_SIZE,
+            DEFAULT_MAX_FILES);
+}
+
 int main(int argc, char **argv)
 {
-    MOS_UNUSED(argc);
-    MOS_UNUSED(argv);
+    const char *path = DEFAULT_LOG_PATH;
+    size_t max_size = DEFAULT_MAX_FILE_SIZE;
+    size_t max_files = DEFAULT_MAX_FILES;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-f") == 0)
+            path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            max_size = strtoul(argv[++i], NULL, 0);
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+            max_files = strtoul(argv[++i], NULL, 0);
+        else
+            return usage(argv[0]), 1;
+    }
+
+    if (max_size == 0 || max_files == 0)
+        return usage(argv[0]), 1;
 
     puts("syslogd: starting");
+    has_logfile = logfile_open(path, max_size, max_files);
 
     rpc_server_t *const server = rpc_server_create(SYSLOGD_SERVICE_NAME, NULL);
     rpc_server_set_on_connect(server, syslogd_on_connect);
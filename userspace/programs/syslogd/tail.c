@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// follow the records syslogd receives, optionally only those of a client, category or level
+
+#include "mos-syslog.h"
+
+#include <librpc/rpc_client.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const level_names[] = { "debug", "info", "notice", "warning", "error", "critical" };
+
+static int parse_level(const char *name)
+{
+    for (size_t i = 0; i < MOS_ARRAY_SIZE(level_names); i++)
+        if (strcmp(name, level_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-l level] [-c client] [-C category]\n", program);
+    fprintf(stderr, "  level is one of debug, info, notice, warning, error, critical\n");
+}
+
+int main(int argc, char **argv)
+{
+    int level = SYSLOG_DEBUG;
+    const char *client = "";
+    const char *category = "";
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-l") == 0)
+            level = parse_level(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+            client = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "-C") == 0)
+            category = argv[++i];
+        else
+            return usage(argv[0]), 1;
+    }
+
+    if (level < 0)
+        return usage(argv[0]), 1;
+
+    rpc_server_stub_t *server = rpc_client_create(SYSLOGD_SERVICE_NAME);
+    if (!server)
+    {
+        fprintf(stderr, "failed to connect to syslogd\n");
+        return 1;
+    }
+
+    syslogd_subscribe(server, level, client, category);
+
+    u64 cursor = 0;
+    while (true)
+    {
+        size_t size;
+        syslog_tail_header_t *header = syslog_tail(server, &cursor, &size);
+        if (!header)
+        {
+            fprintf(stderr, "syslogd went away\n");
+            break;
+        }
+
+        if (header->dropped)
+            printf("-- %llu records dropped --\n", (unsigned long long) header->dropped);
+
+        for (size_t offset = sizeof(*header); offset + sizeof(syslog_tail_record_t) <= size;)
+        {
+            const syslog_tail_record_t *record = (const syslog_tail_record_t *) ((const char *) header + offset);
+            const char *text = (const char *) (record + 1);
+            const u64 us = record->timestamp / 1000;
+            printf("%llu.%06llu %-8s %.*s: ", (unsigned long long) (us / 1000000), (unsigned long long) (us % 1000000), level_names[record->level],
+                   (int) record->client_len, text);
+            text += record->client_len;
+            if (record->category_len)
+                printf("[%.*s] ", (int) record->category_len, text);
+            printf("%.*s\n", (int) record->message_len, text + record->category_len);
+            offset += record->size;
+        }
+
+        fflush(stdout);
+        free(header);
+    }
+
+    rpc_client_destroy(server);
+    return 1;
+}
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mos/syscall/usermode.h>
+#include <mos_malloc.h>
+#include <mos_stdio.h>
+#include <mos_stdlib.h>
+#include <mos_string.h>
+
+#define SMALL_MAX    (8 KB) // the largest object that is not mapped on its own
+#define NCLASSES     32
+#define NOBJECTS     512 // more than a thread cache keeps, so that some are flushed before the thread exits
+#define NCACHED      64  // fewer than a thread cache keeps, so that they are only flushed when the thread exits
+#define OBJECT_BYTES 48
+
+static int failures = 0;
+
+#define check(cond, fmt, ...)                                                                                                              \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        if (!(cond))                                                                                                                       \
+        {                                                                                                                                  \
+            printf("FAILED: %s:%d: " fmt "\n", __func__, __LINE__ __VA_OPT__(, ) __VA_ARGS__);                                           \
+            failures++;                                                                                                                    \
+        }                                                                                                                                  \
+    } while (0)
+
+static void fill(void *ptr, size_t size, u8 seed)
+{
+    for (size_t i = 0; i < size; i++)
+        ((u8 *) ptr)[i] = (u8) (seed + i);
+}
+
+static bool verify(const void *ptr, size_t size, u8 seed)
+{
+    for (size_t i = 0; i < size; i++)
+        if (((const u8 *) ptr)[i] != (u8) (seed + i))
+            return false;
+    return true;
+}
+
+static void test_size_classes(void)
+{
+    // the next size past the usable size of an object always lands in the next class
+    void *objects[NCLASSES + 1] = { 0 };
+    size_t sizes[NCLASSES + 1] = { 0 };
+    size_t n = 0;
+
+    for (size_t size = 1; size <= SMALL_MAX && n <= NCLASSES; n++)
+    {
+        objects[n] = malloc(size);
+        sizes[n] = malloc_usable_size(objects[n]);
+        check(objects[n], "malloc(%zu) failed", size);
+        check((ptr_t) objects[n] % 16 == 0, "malloc(%zu) returned %p, which is not aligned", size, objects[n]);
+        check(sizes[n] >= size, "malloc(%zu) has only %zu usable bytes", size, sizes[n]);
+        check(n == 0 || sizes[n] > sizes[n - 1], "class %zu is not larger than the one before", n);
+        fill(objects[n], sizes[n], n);
+        size = sizes[n] + 1;
+    }
+
+    check(n == NCLASSES, "%zu size classes, expected %d", n, NCLASSES);
+    check(sizes[n - 1] == SMALL_MAX, "the largest class holds %zu bytes", sizes[n - 1]);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        check(verify(objects[i], sizes[i], i), "object of %zu bytes was overwritten", sizes[i]);
+        free(objects[i]);
+    }
+}
+
+static void test_realloc(void)
+{
+    // grow through small classes into a large object, then shrink back
+    const size_t steps[] = { 24, 200, 3000, SMALL_MAX, SMALL_MAX + 1, 100 KB, 5000, 130, 16 };
+    size_t size = steps[0];
+    u8 *ptr = malloc(size);
+    fill(ptr, size, 0x5a);
+
+    for (size_t i = 1; i < MOS_ARRAY_SIZE(steps); i++)
+    {
+        const size_t old_usable = malloc_usable_size(ptr);
+        u8 *new_ptr = realloc(ptr, steps[i]);
+        check(new_ptr, "realloc(%zu -> %zu) failed", size, steps[i]);
+        if (!new_ptr)
+            break;
+
+        const size_t kept = MIN(size, steps[i]);
+        check(verify(new_ptr, kept, 0x5a), "realloc(%zu -> %zu) lost the contents", size, steps[i]);
+        check(malloc_usable_size(new_ptr) >= steps[i], "realloc(%zu -> %zu) is too small", size, steps[i]);
+        if (steps[i] < size)
+            check(malloc_usable_size(new_ptr) < old_usable, "shrinking %zu -> %zu kept the old class", size, steps[i]);
+
+        ptr = new_ptr, size = steps[i];
+        fill(ptr, size, 0x5a);
+    }
+
+    free(ptr);
+    check(realloc(NULL, 32) != NULL, "realloc(NULL) failed");
+}
+
+static void test_large_objects(void)
+{
+    malloc_stats_t before, during, after;
+    malloc_get_stats(&before);
+
+    u8 *small = malloc(SMALL_MAX), *large = malloc(SMALL_MAX + 1), *huge = malloc(1 MB);
+    check(small && large && huge, "allocation failed");
+    fill(large, SMALL_MAX + 1, 1);
+    fill(huge, 1 MB, 2);
+
+    malloc_get_stats(&during);
+    check(during.large_allocations == before.large_allocations + 2, "%zu large objects, expected %zu", during.large_allocations,
+          before.large_allocations + 2);
+    check(during.large_bytes >= before.large_bytes + 1 MB + SMALL_MAX + 1, "only %zu bytes mapped", during.large_bytes);
+    check(verify(large, SMALL_MAX + 1, 1) && verify(huge, 1 MB, 2), "large objects were overwritten");
+
+    free(huge);
+    free(large);
+    free(small);
+
+    malloc_get_stats(&after);
+    check(after.large_allocations == before.large_allocations, "%zu large objects left, expected %zu", after.large_allocations,
+          before.large_allocations);
+    check(after.large_bytes == before.large_bytes, "%zu bytes left mapped, expected %zu", after.large_bytes, before.large_bytes);
+}
+
+typedef struct
+{
+    void **objects;
+    size_t n_objects;
+    size_t threads_seen; ///< malloc_stats_t::threads, seen by the thread while it runs
+    size_t flushes_seen; ///< malloc_stats_t::flushes, seen by the thread before it exits
+} thread_work_t;
+
+static void free_objects_thread(void *arg)
+{
+    thread_work_t *work = arg;
+    for (size_t i = 0; i < work->n_objects; i++)
+    {
+        check(verify(work->objects[i], OBJECT_BYTES, i), "object %zu was overwritten", i);
+        free(work->objects[i]);
+    }
+
+    malloc_stats_t stats;
+    malloc_get_stats(&stats);
+    work->threads_seen = stats.threads;
+}
+
+static void alloc_free_thread(void *arg)
+{
+    thread_work_t *work = arg;
+    for (size_t i = 0; i < work->n_objects; i++)
+        work->objects[i] = malloc(OBJECT_BYTES);
+
+    // all back in the cache of this thread, which must be flushed when it exits
+    for (size_t i = 0; i < work->n_objects; i++)
+        free(work->objects[i]);
+
+    malloc_stats_t stats;
+    malloc_get_stats(&stats);
+    work->threads_seen = stats.threads;
+    work->flushes_seen = stats.flushes;
+}
+
+static void run_thread(const char *name, thread_entry_t entry, thread_work_t *work)
+{
+    const tid_t tid = start_thread(name, entry, work);
+    check(tid > 0, "cannot start %s", name);
+    if (tid > 0)
+        syscall_wait_for_thread(tid);
+}
+
+static void test_cross_thread_free(void)
+{
+    void *objects[NOBJECTS];
+    for (size_t i = 0; i < NOBJECTS; i++)
+    {
+        objects[i] = malloc(OBJECT_BYTES);
+        fill(objects[i], OBJECT_BYTES, i);
+    }
+
+    malloc_stats_t before, after;
+    malloc_get_stats(&before);
+
+    thread_work_t work = { .objects = objects, .n_objects = NOBJECTS };
+    run_thread("malloc-free", free_objects_thread, &work);
+
+    malloc_get_stats(&after);
+    check(work.threads_seen == before.threads + 1, "%zu threads while freeing, expected %zu", work.threads_seen, before.threads + 1);
+    check(after.frees >= before.frees + NOBJECTS, "%zu frees, expected at least %zu", after.frees - before.frees, (size_t) NOBJECTS);
+
+    // the objects went back to the runs, and can be handed out again here
+    for (size_t i = 0; i < NOBJECTS; i++)
+    {
+        objects[i] = malloc(OBJECT_BYTES);
+        fill(objects[i], OBJECT_BYTES, ~i);
+    }
+
+    for (size_t i = 0; i < NOBJECTS; i++)
+    {
+        check(verify(objects[i], OBJECT_BYTES, ~i), "reused object %zu was overwritten", i);
+        free(objects[i]);
+    }
+}
+
+static void test_thread_exit_flush(void)
+{
+    void *objects[NCACHED];
+    malloc_stats_t before, after;
+    malloc_get_stats(&before);
+
+    thread_work_t work = { .objects = objects, .n_objects = NCACHED };
+    run_thread("malloc-exit", alloc_free_thread, &work);
+
+    malloc_get_stats(&after);
+    check(work.threads_seen == before.threads + 1, "%zu threads while running, expected %zu", work.threads_seen, before.threads + 1);
+    check(after.threads == before.threads, "%zu threads after exit, expected %zu", after.threads, before.threads);
+    check(after.allocations >= before.allocations + NCACHED, "the allocations of the exited thread were lost");
+    check(after.frees >= before.frees + NCACHED, "the frees of the exited thread were lost");
+    check(after.flushes > work.flushes_seen, "the cache of the exited thread was not flushed");
+}
+
+int main(void)
+{
+    puts("MOS userspace allocator test");
+
+    test_size_classes();
+    test_realloc();
+    test_large_objects();
+    test_cross_thread_free();
+    test_thread_exit_flush();
+
+    malloc_dump_stats();
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    puts("all tests passed");
+    return 0;
+}
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mos/misc/vdso_types.h>
+#include <mos/syscall/number.h>
+#include <mos/syscall/usermode.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 100000
+
+static u64 rdtsc(void)
+{
+    u32 lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64) hi << 32) | lo;
+}
+
+// the 'int 0x88' fallback, regardless of how platform_syscall0 is configured
+static pid_t get_pid_int88(void)
+{
+    reg_t result = 0;
+    __asm__ volatile("int $0x88" : "=a"(result) : "a"((reg_t) SYSCALL_get_pid) : "memory");
+    return (pid_t) result;
+}
+
+static pid_t get_pid_syscall(void)
+{
+    reg_t result = 0;
+    __asm__ volatile("syscall" : "=a"(result) : "a"((reg_t) SYSCALL_get_pid) : "rcx", "r11", "memory");
+    return (pid_t) result;
+}
+
+static u64 bench(const char *name, pid_t (*func)(void), pid_t expected, long iterations)
+{
+    // warm up
+    for (int i = 0; i < 100; i++)
+        func();
+
+    const u64 start = rdtsc();
+    for (long i = 0; i < iterations; i++)
+    {
+        if (func() != expected)
+        {
+            printf("%s: wrong result\n", name);
+            exit(1);
+        }
+    }
+    const u64 cycles = (rdtsc() - start) / iterations;
+
+    printf("%-10s %8llu cycles per round trip\n", name, (unsigned long long) cycles);
+    return cycles;
+}
+
+static void bench_clock(long iterations)
+{
+    const vdso_data_t *vdso = (const vdso_data_t *) MOS_VDSO_DATA_VADDR;
+    u64 ns;
+    if (!vdso_get_time_ns(vdso, &ns))
+    {
+        printf("vDSO time is not available\n");
+        return;
+    }
+
+    // both read the same clock, so two readings taken back to back should agree to well within a millisecond
+    struct timespec ts;
+    syscall_clock_gettimeofday(&ts);
+    vdso_get_time_ns(vdso, &ns);
+    const u64 syscall_ns = (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (syscall_ns > ns || ns - syscall_ns > 1000000)
+    {
+        printf("clock: vDSO and syscall disagree (%llu vs %llu)\n", (unsigned long long) ns, (unsigned long long) syscall_ns);
+        exit(1);
+    }
+
+    u64 start = rdtsc();
+    for (long i = 0; i < iterations; i++)
+        syscall_clock_gettimeofday(&ts);
+    const u64 syscall_cycles = (rdtsc() - start) / iterations;
+
+    start = rdtsc();
+    for (long i = 0; i < iterations; i++)
+        vdso_get_time_ns(vdso, &ns);
+    const u64 vdso_cycles = (rdtsc() - start) / iterations;
+
+    printf("clock read, %ld iterations:\n", iterations);
+    printf("%-10s %8llu cycles per read\n", "syscall", (unsigned long long) syscall_cycles);
+    printf("%-10s %8llu cycles per read\n", "vdso", (unsigned long long) vdso_cycles);
+}
+
+int main(int argc, char **argv)
+{
+    const long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    if (iterations <= 0)
+    {
+        printf("usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    const pid_t pid = syscall_get_pid();
+    printf("syscall round trip (get_pid), %ld iterations:\n", iterations);
+
+    const u64 int88 = bench("int 0x88", get_pid_int88, pid, iterations);
+    const u64 fast = bench("syscall", get_pid_syscall, pid, iterations);
+
+    if (fast)
+        printf("syscall is %llu.%02llux faster than int 0x88\n", (unsigned long long) (int88 / fast), (unsigned long long) (int88 * 100 / fast % 100));
+
+    bench_clock(iterations);
+    return 0;
+}
@@ -4,6 +4,69 @@
 
 #include <librpc/rpc_client.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WRAP_EXTRA 44 // records sent past what syslogd keeps for a client
+
+// a subscriber that falls behind by more than syslogd keeps is told how many records it missed
+static bool test_tail_wraparound(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "syslog-test-wrap-%d", getpid()); // not to match the records of an earlier run
+
+    rpc_server_stub_t *tail = rpc_client_create(SYSLOGD_SERVICE_NAME);
+    syslog_client_t *client = syslog_client_create(name);
+    if (!tail || !client)
+    {
+        fprintf(stderr, "wraparound: failed to connect to syslogd\n");
+        return false;
+    }
+
+    syslogd_subscribe(tail, SYSLOG_DEBUG, name, "");
+    syslog_write(client, SYSLOG_WARNING, "wrap", "start"); // sent right away
+
+    u64 cursor = 0;
+    size_t size;
+    free(syslog_tail(tail, &cursor, &size)); // the cursor is now past "start"
+
+    for (int i = 0; i < SYSLOG_CLIENT_RING_SIZE + WRAP_EXTRA; i++)
+        syslog_printf(client, SYSLOG_DEBUG, "wrap", "%d", i);
+    syslog_flush(client);
+
+    bool ok = true;
+    syslog_tail_header_t *header = syslog_tail(tail, &cursor, &size);
+    if (!header || size < sizeof(*header) + sizeof(syslog_tail_record_t))
+    {
+        fprintf(stderr, "wraparound: tail returned nothing\n");
+        ok = false;
+    }
+    else
+    {
+        const syslog_tail_record_t *record = (const syslog_tail_record_t *) (header + 1);
+        const char *message = (const char *) (record + 1) + record->client_len + record->category_len;
+        char expected[16];
+        snprintf(expected, sizeof(expected), "%d", WRAP_EXTRA);
+
+        if (header->dropped != WRAP_EXTRA)
+        {
+            fprintf(stderr, "wraparound: %llu records dropped, expected %d\n", (unsigned long long) header->dropped, WRAP_EXTRA);
+            ok = false;
+        }
+
+        if (record->message_len != strlen(expected) || memcmp(message, expected, record->message_len) != 0)
+        {
+            fprintf(stderr, "wraparound: the oldest record is '%.*s', expected '%s'\n", (int) record->message_len, message, expected);
+            ok = false;
+        }
+    }
+
+    free(header);
+    syslog_client_destroy(client);
+    rpc_client_destroy(tail);
+    return ok;
+}
 
 int main()
 {
@@ -16,4 +79,24 @@ int main()
 
     syslogd_log(logger, "Hello from syslog-test!");
     syslogd_logc(logger, "ERROR", "Hello from syslog-test!");
+    rpc_client_destroy(logger);
+
+    syslog_client_t *client = syslog_client_create("syslog-test");
+    if (!client)
+    {
+        fprintf(stderr, "failed to create syslog client\n");
+        return 1;
+    }
+
+    for (int i = 0; i < 100; i++)
+        syslog_printf(client, SYSLOG_DEBUG, "batch", "message %d of a batch", i);
+    syslog_write(client, SYSLOG_WARNING, "batch", "a warning is sent right away, with the messages before it");
+    syslog_write(client, SYSLOG_INFO, NULL, "sent by syslog_client_destroy");
+    syslog_client_destroy(client);
+
+    if (!test_tail_wraparound())
+        return 1;
+
+    puts("syslog-test: ok");
+    return 0;
 }
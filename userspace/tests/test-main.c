@@ -17,6 +17,7 @@ struct
     { "libc", "/initrd/tests/libc-test" },     //
     { "c++", "/initrd/tests/libstdc++-test" }, //
     { "rust", "/initrd/tests/rust-test" },     //
+    { "malloc", "/initrd/tests/malloc-test" }, //
     { 0 },
 };
 